@@ -1,5 +1,6 @@
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
+#include <OBMolGraph>
 #include "obgasteiger.h"
 
 using namespace std;
@@ -7,50 +8,192 @@ using namespace std;
 namespace OpenBabel {
   namespace OBFFs {
 
+    namespace {
+
+      const int GasteigerIterations = 6;
+      const double GasteigerDamping = 0.5;
+      const double GasteigerDenomHydrogen = 20.02;
+
+      /**
+       * Look up the a, b and c coefficients for chi = a + b q + c q^2.
+       * @return False if there are no parameters for the element.
+       */
+      bool GasteigerParameters(unsigned int element, int hyb, unsigned int freeOxygens,
+			       double &a, double &b, double &c)
+      {
+	switch (element) {
+	case 1: // H
+	  a = 7.17; b = 6.24; c = -0.56;
+	  return true;
+	case 6: // C
+	  if (hyb == 1) {
+	    a = 10.39; b = 9.45; c = 0.73;
+	  } else if (hyb == 2) {
+	    a = 8.79; b = 9.32; c = 1.51;
+	  } else {
+	    a = 7.98; b = 9.18; c = 1.88;
+	  }
+	  return true;
+	case 7: // N
+	  if (hyb == 1) {
+	    a = 17.68; b = 12.70; c = -0.27;
+	  } else if (hyb == 2) {
+	    a = 12.87; b = 11.15; c = 0.85;
+	  } else {
+	    a = 11.54; b = 10.82; c = 1.36;
+	  }
+	  return true;
+	case 8: // O
+	  if (hyb == 3) {
+	    a = 14.18; b = 12.92; c = 1.39;
+	  } else {
+	    a = 17.07; b = 13.79; c = 0.47;
+	  }
+	  return true;
+	case 9: // F
+	  a = 14.66; b = 13.85; c = 2.31;
+	  return true;
+	case 13: // Al
+	  a = 1.06; b = 5.47; c = 1.59;
+	  return true;
+	case 15: // P
+	  a = 8.90; b = 8.24; c = 0.96;
+	  return true;
+	case 16: // S
+	  if (freeOxygens < 2) {
+	    a = 10.14; b = 9.13; c = 1.38;
+	  } else {
+	    a = 10.88; b = 9.49; c = 1.33;
+	  }
+	  return true;
+	case 17: // Cl
+	  a = 11.00; b = 9.69; c = 1.35;
+	  return true;
+	case 35: // Br
+	  a = 10.08; b = 8.47; c = 1.16;
+	  return true;
+	case 53: // I
+	  a = 9.90; b = 7.96; c = 0.96;
+	  return true;
+	default:
+	  return false;
+	}
+      }
+
+    }
+
     bool OBGasteiger::ComputeCharges(OBMol & mol)
     {
-      if (mol.AutomaticFormalCharge() && mol.AutomaticPartialCharge() && mol.HasPartialChargesPerceived()) //Gasteiger charges are already stored in mol 
-	this->CopyFromMol(mol);
-      else {
-	OBAtom *atom;
-	vector<OBAtom*>::iterator itr;
-	vector<double>::iterator itr2;
-	vector<short>::iterator itr3;
-	vector<double> partialCharges;
-	vector<short> formalCharges;
-
-	// backup the charges stored in the molecule
-	bool isSetPerceived=mol.HasPartialChargesPerceived();
-	bool isAutomaticFormal(mol.AutomaticFormalCharge());
-	bool isAutomaticPartial(mol.AutomaticPartialCharge());
-	for (atom = mol.BeginAtom(itr); atom; atom = mol.NextAtom(itr))
-	  {
-	    partialCharges.push_back((double)atom->GetPartialCharge());
-	    formalCharges.push_back(atom->GetFormalCharge());
-	  }
+      return ComputeCharges(const_cast<const OBMol&>(mol), m_partialCharges, m_formalCharges);
+    }
+
+    bool OBGasteiger::ComputeCharges(const OBMol & mol, vector<double> & partialCharges,
+				     vector<double> & formalCharges)
+    {
+      const unsigned int numAtoms = mol.NumAtoms();
+      partialCharges.clear();
+      formalCharges.clear();
+      if (!numAtoms)
+	return false;
+
+      OBMolGraph graph;
+      graph.Build(mol);
+      const vector<unsigned int> &offsets = graph.GetOffsets();
+      const vector<unsigned int> &neighbors = graph.GetNeighbors();
 
-	// new Gasteiger charges are computed and copied
-	mol.SetAutomaticFormalCharge(true);
-	mol.SetAutomaticPartialCharge(true);
-	mol.UnsetPartialChargesPerceived();
-	m_partialCharges.clear();
-	m_partialCharges.reserve(mol.NumAtoms());
-	m_formalCharges.clear();
-	m_formalCharges.reserve(mol.NumAtoms());
-	for (atom = mol.BeginAtom(itr);atom;atom = mol.NextAtom(itr)) {
-	  m_partialCharges.push_back(atom->GetPartialCharge());
-	  m_formalCharges.push_back((double)atom->GetFormalCharge());
+      // count the double, triple and aromatic (order 5) bonds of each atom
+      vector<unsigned int> doubles(numAtoms, 0), triples(numAtoms, 0), aromatics(numAtoms, 0);
+      for (unsigned int i = 0; i < mol.NumBonds(); ++i) {
+	OBBond *bond = mol.GetBond(i);
+	const unsigned int order = bond->GetBondOrder();
+	const unsigned int ia = bond->GetBeginAtomIdx() - 1;
+	const unsigned int ib = bond->GetEndAtomIdx() - 1;
+	if (order == 2) {
+	  doubles[ia]++;
+	  doubles[ib]++;
+	} else if (order == 5) {
+	  aromatics[ia]++;
+	  aromatics[ib]++;
+	} else if (order == 3) {
+	  triples[ia]++;
+	  triples[ib]++;
 	}
-	// restore charges of molecule
-	for (atom = mol.BeginAtom(itr), itr2=partialCharges.begin(), itr3= formalCharges.begin() ;atom;atom = mol.NextAtom(itr), ++itr2, ++itr3) {
-	  atom->SetPartialCharge(*itr2);
-	  atom->SetFormalCharge(*itr3);
+      }
+
+      // flat parameter arrays
+      vector<unsigned int> element(numAtoms);
+      formalCharges.resize(numAtoms);
+      for (unsigned int i = 0; i < numAtoms; ++i) {
+	OBAtom *atom = mol.GetAtom(i + 1);
+	element[i] = atom->GetAtomicNum();
+	formalCharges[i] = (double) atom->GetFormalCharge();
+      }
+
+      vector<double> a(numAtoms), b(numAtoms), c(numAtoms), denom(numAtoms);
+      vector<bool> valid(numAtoms);
+      for (unsigned int i = 0; i < numAtoms; ++i) {
+	int hyb = 3;
+	if (triples[i] || doubles[i] > 1)
+	  hyb = 1;
+	else if (doubles[i] || aromatics[i])
+	  hyb = 2;
+	unsigned int freeOxygens = 0;
+	for (unsigned int n = offsets[i]; n < offsets[i + 1]; ++n) {
+	  const unsigned int j = neighbors[n];
+	  if (hyb == 3 && element[i] == 7 && (doubles[j] || triples[j] || aromatics[j]))
+	    hyb = 2;
+	  if (element[j] == 8 && graph.GetDegree(j) == 1)
+	    freeOxygens++;
+	}
+
+	valid[i] = GasteigerParameters(element[i], hyb, freeOxygens, a[i], b[i], c[i]);
+	if (!valid[i])
+	  a[i] = b[i] = c[i] = 0.0;
+	denom[i] = (element[i] == 1) ? GasteigerDenomHydrogen : a[i] + b[i] + c[i];
+      }
+
+      // iterative partial equalization of the electronegativity, starting
+      // from the formal charges
+      vector<double> &q = partialCharges;
+      q = formalCharges;
+      vector<double> chi(numAtoms);
+      const vector<unsigned int> &bonds = graph.GetBonds();
+      double alpha = 1.0;
+      for (int iter = 0; iter < GasteigerIterations; ++iter) {
+	alpha *= GasteigerDamping;
+	for (unsigned int i = 0; i < numAtoms; ++i)
+	  chi[i] = (c[i] * q[i] + b[i]) * q[i] + a[i];
+	for (unsigned int k = 0; k < bonds.size(); k += 2) {
+	  const unsigned int i = bonds[k], j = bonds[k + 1];
+	  if (!valid[i] || !valid[j])
+	    continue;
+	  // the less electronegative atom limits the transfer
+	  const double d = (chi[i] >= chi[j]) ? denom[j] : denom[i];
+	  const double dq = alpha * (chi[i] - chi[j]) / d;
+	  q[i] -= dq;
+	  q[j] += dq;
 	}
-	mol.SetAutomaticFormalCharge(isAutomaticFormal);
-	mol.SetAutomaticPartialCharge(isAutomaticPartial);
-	(isSetPerceived)? mol.SetPartialChargesPerceived() : mol.UnsetPartialChargesPerceived();
       }
+
       return true;
     }
+
+    bool OBGasteiger::ComputeCharges(const vector<const OBMol*> & mols,
+				     vector<vector<double> > & partialCharges)
+    {
+      const int numMols = mols.size();
+      partialCharges.resize(numMols);
+
+      int failed = 0;
+      #pragma omp parallel for reduction(+:failed) schedule(dynamic) if (numMols > 1)
+      for (int m = 0; m < numMols; ++m) {
+	vector<double> formalCharges;
+	if (!ComputeCharges(*mols[m], partialCharges[m], formalCharges))
+	  failed++;
+      }
+
+      return !failed;
+    }
+
   }
 } // end namespace OpenBabel
@@ -25,10 +25,45 @@ namespace OpenBabel {
 
   namespace OBFFs {
   
+    /**
+     * Gasteiger-Marsili partial charges.
+     *
+     * The charges are computed directly from flat per-atom parameter arrays
+     * and the bonds of an OBMolGraph. The molecule is only read: no charges
+     * or perception flags are changed, so the static functions can be called
+     * concurrently for different molecules.
+     *
+     * The hybridization of C, N and O is derived from the bond orders: sp for
+     * a triple bond or two double bonds, sp2 for a double bond, for aromatic
+     * (order 5) bonds and for N bonded to an unsaturated atom (amides,
+     * anilines), sp3 otherwise. Atoms
+     * without parameters keep their formal charge and do not exchange charge.
+     *
+     * Based on:
+     * Gasteiger, J.; Marsili, M. (1980). "Iterative partial equalization of
+     * orbital electronegativity - a rapid access to atomic charges".
+     * Tetrahedron 36: 3219.
+     */
     class OBGasteiger : public OBChargeMethod
     {
     public:
+      /**
+       * Compute the charges for @p mol and store them in this object.
+       */
       bool ComputeCharges(OBMol & mol);
+      /**
+       * Compute the charges for @p mol without storing them in an object.
+       * @return False if the molecule has no atoms.
+       */
+      static bool ComputeCharges(const OBMol & mol, std::vector<double> & partialCharges,
+          std::vector<double> & formalCharges);
+      /**
+       * Compute the charges for many molecules, in parallel when OpenMP is
+       * available.
+       * @return False if any of the molecules failed.
+       */
+      static bool ComputeCharges(const std::vector<const OBMol*> & mols,
+          std::vector<std::vector<double> > & partialCharges);
     }; 
   }
 }// namespace OpenBabel
@@ -19,6 +19,9 @@ GNU General Public License for more details.
 
 #include <OBForceField>
 #include <OBLogFile>
+#include <OBDecomposition>
+#include <OBProfiler>
+#include <OBAutoTune>
 #include <GAFF>
 
 #include <openbabel/mol.h>
@@ -38,6 +41,8 @@ namespace OpenBabel {
       }
       
       bool Setup(/*const*/ OBMol &mol);
+      //! Reuses the types, charges and auto-tuned terms of @p source.
+      bool SetupCopy(const OBFunction *source, OBMol &mol);
       void Compute(Computation computation = Value);
       double GetValue() const;
       
@@ -48,9 +53,38 @@ namespace OpenBabel {
         return true; 
       }
     protected:
+      enum BondedTerm {
+	BondedBond    = (1<<0),
+	BondedAngle   = (1<<1),
+	BondedTorsion = (1<<2),
+	BondedOOP     = (1<<3),
+      };
+      enum VdWTerm {
+	VdWNone,
+	VdWAllPair,
+	VdWClusterPair,
+	VdWAuto
+      };
+      enum ElectroTerm {
+	ElectroNone,
+	ElectroAllPair,
+	ElectroClusterPair,
+	ElectroGB,
+	ElectroAuto
+      };
+
       void ProcessOptions(std::vector<Option> &options);
       std::string GetDefaultOptions() const;
+      //! Remove all terms and add the terms for the options (@p vdwterm & @p electroterm are not auto).
+      void addTerms(int vdwterm, int electroterm);
+      //! Choose the terms and number of threads for the auto options.
+      void autoTune(OBMol &mol);
       
+      int m_bondedterm, m_vdwterm, m_electroterm;
+      int m_tunedVdW, m_tunedElectro; //!< the terms chosen by the last autoTune()
+      double m_rvdw, m_rele, m_rgb;
+      GeneralizedBorn::Model m_gbmodel;
+      int m_threads; //!< -1: auto, 0: OpenMP default
       GAFFParameterDB *p_database;
       GAFFTypeRules *p_gaffTypeRules;
       GAFFType *p_gaffType;
@@ -59,15 +93,13 @@ namespace OpenBabel {
     };
 
     GAFFFunction::GAFFFunction() 
-      : m_HaveCreatedDB(false), m_HaveCreatedType(false), m_HaveCreatedCharge(false)
+      : m_HaveCreatedDB(false), m_HaveCreatedType(false), m_HaveCreatedCharge(false),
+	m_bondedterm(BondedBond | BondedAngle | BondedTorsion | BondedOOP), m_vdwterm(VdWAllPair),
+	m_electroterm(ElectroAllPair), m_tunedVdW(VdWAllPair), m_tunedElectro(ElectroAllPair),
+	m_rvdw(10.0), m_rele(12.0), m_rgb(16.0),
+	m_gbmodel(GeneralizedBorn::OBC), m_threads(0)
     {
-      AddTerm(new BondHarmonic(this));
-      AddTerm(new AngleHarmonic(this));
-      AddTerm(new TorsionHarmonic(this));
-      AddTerm(new TorsionHarmonic(this,"Torsion Harmonic OOP"));
-      AddTerm(new LJ6_12(this, 0.5, LJ6_12::geometric));
-      AddTerm(new Coulomb(this, 0.8333));
-      //     AddTerm(new Coulomn(this, m_common));
+      addTerms(m_vdwterm, m_electroterm);
     }
 
     GAFFFunction::~GAFFFunction(){
@@ -138,18 +170,119 @@ namespace OpenBabel {
       p_gaffType->ValidateTypes(p_database);
       p_charge->ComputeCharges(mol);
 
-      OBFunction::Setup(mol);
+      autoTune(mol);
+
+      return OBFunction::Setup(mol);
+    }
+
+    bool GAFFFunction::SetupCopy(const OBFunction *source, OBMol &mol)
+    {
+      // only when the typing and charges of source are in the objects shared
+      // with this function
+      const GAFFFunction *gaff = dynamic_cast<const GAFFFunction*>(source);
+      if (!gaff || !gaff->p_gaffType || !gaff->p_charge || !gaff->p_database ||
+	  gaff->p_gaffType != GetOBFFType() || gaff->p_charge != GetOBChargeMethod() ||
+	  gaff->p_database != GetParameterDB() || gaff->NumParticles() != mol.NumAtoms())
+	return Setup(mol);
+
+      p_gaffType = gaff->p_gaffType;
+      p_database = gaff->p_database;
+      p_charge = gaff->p_charge;
+
+      if (m_vdwterm == VdWAuto || m_electroterm == ElectroAuto) {
+	m_tunedVdW = gaff->m_tunedVdW;
+	m_tunedElectro = gaff->m_tunedElectro;
+	addTerms((m_vdwterm == VdWAuto) ? m_tunedVdW : m_vdwterm,
+		 (m_electroterm == ElectroAuto) ? m_tunedElectro : m_electroterm);
+      }
+      if (m_threads < 0)
+	SetNumThreads(gaff->m_numThreads);
+
+      return OBFunction::Setup(mol);
+    }
+
+    void GAFFFunction::autoTune(OBMol &mol)
+    {
+      if (m_vdwterm != VdWAuto && m_electroterm != ElectroAuto && m_threads >= 0)
+	return;
+
+      OBLogFile *logFile = GetLogFile();
+      OBAutoTune tune;
+      int vdwterm = m_vdwterm, electroterm = m_electroterm;
+      if (m_vdwterm == VdWAuto) {
+	const OBAutoTune::Decision decision = tune.Tune(this, mol, m_rvdw,
+	    "bonded = none\nvdwterm = allpair\nelectroterm = none\nthreads = 1\n",
+	    "bonded = none\nvdwterm = clusterpair\nelectroterm = none\nthreads = 1\n");
+	if (decision.strategy == OBAutoTune::ClusterPair) {
+	  vdwterm = VdWClusterPair;
+	  logFile->Log(OBLogFile::Medium, "autotune_vdw",
+	      "  Auto-tune: cluster-pair Van der Waals term (all pairs %.3f ms, cluster pairs %.3f ms, benchmark %.0f)\n",
+	      "allpair_ms", 1000.0 * decision.allPairTime, "clusterpair_ms", 1000.0 * decision.clusterPairTime,
+	      "benchmarked", decision.benchmarked, "clusterpair", 1.0);
+	} else {
+	  vdwterm = VdWAllPair;
+	  logFile->Log(OBLogFile::Medium, "autotune_vdw",
+	      "  Auto-tune: all-pairs Van der Waals term (all pairs %.3f ms, cluster pairs %.3f ms, benchmark %.0f)\n",
+	      "allpair_ms", 1000.0 * decision.allPairTime, "clusterpair_ms", 1000.0 * decision.clusterPairTime,
+	      "benchmarked", decision.benchmarked, "clusterpair", 0.0);
+	}
+      }
+      if (m_electroterm == ElectroAuto) {
+	const OBAutoTune::Decision decision = tune.Tune(this, mol, m_rele,
+	    "bonded = none\nvdwterm = none\nelectroterm = allpair\nthreads = 1\n",
+	    "bonded = none\nvdwterm = none\nelectroterm = clusterpair\nthreads = 1\n");
+	if (decision.strategy == OBAutoTune::ClusterPair) {
+	  electroterm = ElectroClusterPair;
+	  logFile->Log(OBLogFile::Medium, "autotune_electro",
+	      "  Auto-tune: cluster-pair electrostatic term (all pairs %.3f ms, cluster pairs %.3f ms, benchmark %.0f)\n",
+	      "allpair_ms", 1000.0 * decision.allPairTime, "clusterpair_ms", 1000.0 * decision.clusterPairTime,
+	      "benchmarked", decision.benchmarked, "clusterpair", 1.0);
+	} else {
+	  electroterm = ElectroAllPair;
+	  logFile->Log(OBLogFile::Medium, "autotune_electro",
+	      "  Auto-tune: all-pairs electrostatic term (all pairs %.3f ms, cluster pairs %.3f ms, benchmark %.0f)\n",
+	      "allpair_ms", 1000.0 * decision.allPairTime, "clusterpair_ms", 1000.0 * decision.clusterPairTime,
+	      "benchmarked", decision.benchmarked, "clusterpair", 0.0);
+	}
+      }
+      if (m_vdwterm == VdWAuto || m_electroterm == ElectroAuto) {
+	m_tunedVdW = vdwterm;
+	m_tunedElectro = electroterm;
+	addTerms(vdwterm, electroterm);
+      }
+
+      // only the bonded terms are computed in parallel
+      if (m_threads < 0) {
+	const int numThreads = OBAutoTune::NumThreads(OBAutoTune::BondedTime(mol.NumAtoms()));
+	SetNumThreads(numThreads);
+	logFile->Log(OBLogFile::Medium, "autotune_threads", "  Auto-tune: %.0f threads for the bonded terms\n",
+	    "threads", numThreads);
+      }
     }
 
     void GAFFFunction::Compute(Computation computation)
     {
+      GatherPositions();
       if (computation == OBFunction::Gradients)
 	for (unsigned int idx = 0; idx < m_gradients.size(); ++idx)
 	  m_gradients[idx] = Eigen::Vector3d::Zero();
+      if (m_decomposition)
+	m_decomposition->Reset(this);
 
       std::vector<OBFunctionTerm*>::iterator term;
-      for (term = m_terms.begin(); term != m_terms.end(); ++term)
-	(*term)->Compute(computation);
+      if (m_profiler) {
+	for (term = m_terms.begin(); term != m_terms.end(); ++term) {
+	  const unsigned int section = m_profiler->Section((*term)->GetName());
+	  m_profiler->Begin();
+	  (*term)->Compute(computation);
+	  m_profiler->End(section);
+	}
+      } else
+	for (term = m_terms.begin(); term != m_terms.end(); ++term)
+	  (*term)->Compute(computation);
+
+      if (computation == OBFunction::Gradients)
+	ScatterGradients();
     }
   
     double GAFFFunction::GetValue() const
@@ -169,6 +302,15 @@ namespace OpenBabel {
       std::stringstream ss;
       ss << "# parameters = gaff" << std::endl;
       ss << std::endl;
+      ss << "# Threads for the bonded terms, 0 uses the OpenMP default (OMP_NUM_THREADS)." << std::endl;
+      ss << "# auto chooses the number of threads from the system size." << std::endl;
+      ss << "# threads = auto | N" << std::endl;
+      ss << "threads = 0" << std::endl;
+      ss << std::endl;
+      ss << "# Sort the atoms along a space-filling curve for better memory locality." << std::endl;
+      ss << "# ordering = input | morton" << std::endl;
+      ss << "ordering = input" << std::endl;
+      ss << std::endl;
       ss << "################" << std::endl;
       ss << "# Bonded Terms #" << std::endl;
       ss << "################" << std::endl;
@@ -181,37 +323,47 @@ namespace OpenBabel {
       ss << "# Van der Waals Term #" << std::endl;
       ss << "######################" << std::endl;
       ss << std::endl;
-      ss << "# vdwterm = allpair | none" << std::endl;
+      ss << "# auto: all pairs or cluster pairs, whichever is faster for the molecule" << std::endl;
+      ss << "# vdwterm = allpair | clusterpair | auto | none" << std::endl;
       ss << "vdwterm = allpair" << std::endl;
       ss << std::endl;
+      ss << "# Cut-off distance for vdwterm = clusterpair | auto" << std::endl;
+      ss << "rvdw = 10.0" << std::endl;
+      ss << std::endl;
+      ss << "######################" << std::endl;
+      ss << "# Electrostatic Term #" << std::endl;
+      ss << "######################" << std::endl;
+      ss << std::endl;
+      ss << "# gb: all-pairs electrostatic term and generalized Born implicit solvent" << std::endl;
+      ss << "# auto: all pairs or cluster pairs, whichever is faster for the molecule" << std::endl;
+      ss << "# electroterm = allpair | clusterpair | gb | auto | none" << std::endl;
+      ss << "electroterm = allpair" << std::endl;
+      ss << std::endl;
+      ss << "# Cut-off distance for electroterm = clusterpair | auto" << std::endl;
+      ss << "rele = 12.0" << std::endl;
+      ss << std::endl;
+      ss << "# Born radii model and cut-off distance for electroterm = gb" << std::endl;
+      ss << "# gbmodel = obc | hct" << std::endl;
+      ss << "gbmodel = obc" << std::endl;
+      ss << "rgb = 16.0" << std::endl;
+      ss << std::endl;
       return ss.str();
     }
      
     void GAFFFunction::ProcessOptions(std::vector<Option> &options)
     {
-      enum BondedTerm {
-	BondedBond    = (1<<0),
-	BondedAngle   = (1<<1),
-	BondedTorsion = (1<<2),
-	BondedOOP     = (1<<3),
-      };
       int bondedterm = 0;
       bool isBondFound = false;
-
-      enum VdWTerm {
-	VdWNone,
-	VdWAllPair
-      };
       int vdwterm = VdWAllPair;
-
-      enum ElectroTerm {
-	ElectroNone,
-	ElectroAllPair
-      };
+      double rvdw = 10.0;
       int electroterm = ElectroAllPair;
+      double rele = 12.0;
+      GeneralizedBorn::Model gbmodel = GeneralizedBorn::OBC;
+      double rgb = 16.0;
+      int threads = 0;
 
       OBLogFile *logFile = GetLogFile();
-      logFile->Write("Processing GAFF options...\n");
+      logFile->Write(OBLogFile::Medium, "Processing GAFF options...\n");
  
       std::vector<Option>::iterator option;
       for (option = options.begin(); option != options.end(); ++option) {
@@ -219,7 +371,7 @@ namespace OpenBabel {
 	if ((*option).name == "bonded") {
 	  isBondFound=true;
 	  if ((*option).value.find("non") != std::string::npos) {
-	    logFile->Write("  Disabling all bonded interactions ...\n");
+	    logFile->Write(OBLogFile::Medium, "  Disabling all bonded interactions ...\n");
 	    bondedterm = 0;        
 	  }
 	  if ((*option).value.find("all") != std::string::npos) {
@@ -242,6 +394,10 @@ namespace OpenBabel {
 	if ((*option).name == "vdwterm") {
 	  if ((*option).value == "allpair") {
 	    vdwterm = VdWAllPair;
+	  } else if ((*option).value == "clusterpair") {
+	    vdwterm = VdWClusterPair;
+	  } else if ((*option).value == "auto") {
+	    vdwterm = VdWAuto;
 	  } else if ((*option).value == "none") {
 	    vdwterm = VdWNone;
 	  } else {
@@ -252,9 +408,15 @@ namespace OpenBabel {
 	}
 
 	if ((*option).name == "electroterm") {
-	  if ((*option).value == "allpair")
+	  if ((*option).value == "allpair") {
 	    electroterm = ElectroAllPair;
-	  if ((*option).value == "none") {
+	  } else if ((*option).value == "clusterpair") {
+	    electroterm = ElectroClusterPair;
+	  } else if ((*option).value == "gb") {
+	    electroterm = ElectroGB;
+	  } else if ((*option).value == "auto") {
+	    electroterm = ElectroAuto;
+	  } else if ((*option).value == "none") {
 	    electroterm = ElectroNone;
 	  } else {
 	    std::stringstream ss;
@@ -262,50 +424,138 @@ namespace OpenBabel {
 	    logFile->Write(ss.str());
 	  }
 	}
+
+	if ((*option).name == "ordering") {
+	  if ((*option).value == "input") {
+	    SetAtomReordering(false);
+	  } else if ((*option).value == "morton") {
+	    logFile->Write(OBLogFile::Medium, "  Sorting atoms along a Morton curve...\n");
+	    SetAtomReordering(true);
+	  } else {
+	    std::stringstream ss;
+	    ss << "Invalid value for option: " << (*option).name << " = " << (*option).value << std::endl;
+	    logFile->Write(ss.str());
+	  }
+	}
+
+	if ((*option).name == "rvdw") {
+	  std::stringstream ss((*option).value);
+	  ss >> rvdw;
+	}
+
+	if ((*option).name == "rele") {
+	  std::stringstream ss((*option).value);
+	  ss >> rele;
+	}
+
+	if ((*option).name == "gbmodel") {
+	  if ((*option).value == "obc") {
+	    gbmodel = GeneralizedBorn::OBC;
+	  } else if ((*option).value == "hct") {
+	    gbmodel = GeneralizedBorn::HCT;
+	  } else {
+	    std::stringstream ss;
+	    ss << "Invalid value for option: " << (*option).name << " = " << (*option).value << std::endl;
+	    logFile->Write(ss.str());
+	  }
+	}
+
+	if ((*option).name == "rgb") {
+	  std::stringstream ss((*option).value);
+	  ss >> rgb;
+	}
+
+	if ((*option).name == "threads") {
+	  if ((*option).value == "auto") {
+	    threads = -1;
+	  } else {
+	    std::stringstream ss((*option).value);
+	    if (!(ss >> threads) || threads < 0) {
+	      threads = 0;
+	      std::stringstream msg;
+	      msg << "Invalid value for option: " << (*option).name << " = " << (*option).value << std::endl;
+	      logFile->Write(msg.str());
+	    }
+	  }
+	}
       }
       // use default if option for bonded interaction is not supplied
       isBondFound ? : bondedterm = BondedBond | BondedAngle | BondedTorsion | BondedOOP;
 
+      m_bondedterm = bondedterm;
+      m_vdwterm = vdwterm;
+      m_rvdw = rvdw;
+      m_electroterm = electroterm;
+      m_rele = rele;
+      m_gbmodel = gbmodel;
+      m_rgb = rgb;
+      m_threads = threads;
+      SetNumThreads(threads > 0 ? threads : 0);
+
+      // the auto options are resolved in Setup(), all pairs until then
+      addTerms((vdwterm == VdWAuto) ? int(VdWAllPair) : vdwterm,
+	       (electroterm == ElectroAuto) ? int(ElectroAllPair) : electroterm);
+    }
+
+    void GAFFFunction::addTerms(int vdwterm, int electroterm)
+    {
+      OBLogFile *logFile = GetLogFile();
+      const int bondedterm = m_bondedterm;
+      const double rvdw = m_rvdw, rele = m_rele, rgb = m_rgb;
+      const GeneralizedBorn::Model gbmodel = m_gbmodel;
 
       // remove previous terms
       RemoveAllTerms();
       // add new bonded terms
       if (bondedterm & BondedBond){
 	AddTerm(new BondHarmonic(this));
-	logFile->Write("  Enabling bond stretching term...\n");
+	logFile->Write(OBLogFile::Medium, "  Enabling bond stretching term...\n");
       }
       if (bondedterm & BondedAngle){
 	AddTerm(new AngleHarmonic(this));
-	logFile->Write("  Enabling angle bending term...\n");
+	logFile->Write(OBLogFile::Medium, "  Enabling angle bending term...\n");
       }
       if (bondedterm & BondedTorsion) {
 	AddTerm(new TorsionHarmonic(this));
-	logFile->Write("  Enabling torsion term...\n");
+	logFile->Write(OBLogFile::Medium, "  Enabling torsion term...\n");
       }
       if (bondedterm & BondedOOP) {
 	AddTerm(new TorsionHarmonic(this,"Torsion Harmonic OOP"));
-	logFile->Write("  Enabling out of plane term...\n");
+	logFile->Write(OBLogFile::Medium, "  Enabling out of plane term...\n");
       }
       // van der waals term
       switch (vdwterm) {
       case VdWNone:
-	logFile->Write("  Disabling Van der Waals term\n");
+	logFile->Write(OBLogFile::Medium, "  Disabling Van der Waals term\n");
 	break;
       case VdWAllPair:
       default:
 	AddTerm(new LJ6_12(this, 0.5, LJ6_12::geometric));
-	logFile->Write("  Using all-pairs Van der Waals term\n");
+	logFile->Write(OBLogFile::Medium, "  Using all-pairs Van der Waals term\n");
+	break;
+      case VdWClusterPair:
+	AddTerm(new LJ6_12ClusterPair(this, rvdw, 0.5, LJ6_12::geometric));
+	logFile->Write(OBLogFile::Medium, "  Using cluster-pair Van der Waals term\n");
 	break;
       }
       // electrostatic term
       switch (electroterm) {
       case ElectroNone:
-	logFile->Write("  Disabling Van der electrostatic term\n");
+	logFile->Write(OBLogFile::Medium, "  Disabling Van der electrostatic term\n");
 	break;
       case ElectroAllPair:
       default:
-	logFile->Write("  Using all-pairs electrostatic term\n");
+	logFile->Write(OBLogFile::Medium, "  Using all-pairs electrostatic term\n");
+	AddTerm(new Coulomb(this, 0.8333));
+	break;
+      case ElectroClusterPair:
+	logFile->Write(OBLogFile::Medium, "  Using cluster-pair electrostatic term\n");
+	AddTerm(new CoulombClusterPair(this, rele, 0.8333));
+	break;
+      case ElectroGB:
+	logFile->Write(OBLogFile::Medium, "  Using all-pairs electrostatic term with generalized Born solvent\n");
 	AddTerm(new Coulomb(this, 0.8333));
+	AddTerm(new GeneralizedBorn(this, gbmodel, rgb));
 	break;
       }
     }
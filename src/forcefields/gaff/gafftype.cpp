@@ -18,7 +18,14 @@ namespace OpenBabel {
       m_initialized = ParseParamFile();
     }
 
-    bool GAFFTypeRules::IsInitialized()
+    GAFFTypeRules::~GAFFTypeRules()
+    {
+      vector<pair<OBSmartsPattern*,string> >::iterator itr;
+      for (itr = m_vexttyp.begin();itr != m_vexttyp.end();++itr)
+	delete itr->first;
+    }
+
+    bool GAFFTypeRules::IsInitialized() const
     {
       return m_initialized;
     }
@@ -37,6 +44,7 @@ namespace OpenBabel {
       ifstream ifs;
       if (OpenDatafile(ifs, m_filename).length() == 0) {
 	obErrorLog.ThrowError(__FUNCTION__, "Cannot open type definitions file", obError);
+	obLocale.RestoreLocale();
 	return false;
       }
 
@@ -51,6 +59,7 @@ namespace OpenBabel {
 	    delete sp;
 	    sp = NULL;
 	    obErrorLog.ThrowError(__FUNCTION__, " Could not parse atom type table from gaff.prm", obError);
+	    obLocale.RestoreLocale();
 	    return false;
 	  }
 	}
@@ -73,6 +82,7 @@ namespace OpenBabel {
     {
       if (!IsInitialized()){
 	obErrorLog.ThrowError(__FUNCTION__, "Force field types are not initialized", obError);
+	return false;
       }
 
       m_numAtoms = mol.NumAtoms();
@@ -83,9 +93,14 @@ namespace OpenBabel {
 
       m_atoms.clear();
       m_atoms.resize(m_numAtoms);
-      for (itr1 = p_typerules -> m_vexttyp.begin();itr1 != p_typerules -> m_vexttyp.end();++itr1) {
-	if (itr1->first->Match(const_cast<OBMol&>(mol))) {
-	  mlist = itr1->first->GetMapList();
+      // The shared patterns are only used through the const Match() which
+      // stores the matches in mlist instead of the pattern. Match() may still
+      // perceive properties of mol, so mol should not be typed from two
+      // threads at the same time.
+      const GAFFTypeRules *typerules = p_typerules;
+      for (itr1 = typerules -> m_vexttyp.begin();itr1 != typerules -> m_vexttyp.end();++itr1) {
+	const OBSmartsPattern *pattern = itr1->first;
+	if (pattern->Match(const_cast<OBMol&>(mol), mlist)) {
 	  for (itr2 = mlist.begin();itr2 != mlist.end();++itr2) {
 	    m_atoms[ (*itr2)[0]-1 ]=(itr1->second).c_str();
 	  }
@@ -216,94 +231,50 @@ namespace OpenBabel {
 	}
       }
 
+      // the interactions are enumerated from the molecular graph, this avoids
+      // the OBMol angle and torsion perception
+      m_graph.Build(mol);
+
+      const std::vector<unsigned int> &bonds = m_graph.GetBonds();
       m_bonds.clear();
-      m_bonds.reserve(mol.NumBonds());
+      m_bonds.reserve(m_graph.NumBonds());
       OBFFType::BondIdentifier bondID;
-      FOR_BONDS_OF_MOL(bond,const_cast<OBMol&>(mol)){
-	bondID.iA = bond->GetBeginAtom()->GetIdx()-1;
-	bondID.iB = bond->GetEndAtom()->GetIdx()-1;
+      for (i = 0; i < bonds.size(); i += 2) {
+	bondID.iA = bonds[i];
+	bondID.iB = bonds[i+1];
 	bondID.name=MakeBondName(m_atoms[bondID.iA],m_atoms[bondID.iB]);
 	m_bonds.push_back(bondID);
       }
 
-      size_t ic, id;
+      const std::vector<unsigned int> &angles = m_graph.GetAngles();
       m_angles.clear();
+      m_angles.reserve(m_graph.NumAngles());
       OBFFType::AngleIdentifier angleID;
-      FOR_ANGLES_OF_MOL(angle,const_cast<OBMol&>(mol)){
-	angleID.iB = (*angle)[0];
-	angleID.iA = (*angle)[1];
-	angleID.iC = (*angle)[2];
+      for (i = 0; i < angles.size(); i += 3) {
+	angleID.iA = angles[i];
+	angleID.iB = angles[i+1];
+	angleID.iC = angles[i+2];
 	angleID.name=MakeAngleName(m_atoms[angleID.iA], m_atoms[angleID.iB], m_atoms[angleID.iC]);
 	m_angles.push_back(angleID);
       }
 
+      const std::vector<unsigned int> &torsions = m_graph.GetTorsions();
       m_torsions.clear();
+      m_torsions.reserve(m_graph.NumTorsions());
       OBFFType::TorsionIdentifier torsionID;
-      FOR_TORSIONS_OF_MOL(t,const_cast<OBMol&>(mol)) {
-	torsionID.iA = (*t)[0];
-	torsionID.iB = (*t)[1];
-	torsionID.iC = (*t)[2];
-	torsionID.iD = (*t)[3];
+      for (i = 0; i < torsions.size(); i += 4) {
+	torsionID.iA = torsions[i];
+	torsionID.iB = torsions[i+1];
+	torsionID.iC = torsions[i+2];
+	torsionID.iD = torsions[i+3];
 	torsionID.name=MakeTorsionName(m_atoms[torsionID.iA], m_atoms[torsionID.iB], m_atoms[torsionID.iC], m_atoms[torsionID.iD]);
 	m_torsions.push_back(torsionID);
       }
 
+      // the out-of-plane (improper) terms are intentionally left empty, as
+      // before: the impropers are available from m_graph.GetImpropers() once
+      // an OOP term is implemented
       m_oops.clear();
-      OBFFType::OOPIdentifier oopID;
-      FOR_ATOMS_OF_MOL(atom, const_cast<OBMol&>(mol)) {
-	b = (OBAtom*) &*atom;
-	oopID.iB = b->GetIdx()-1;
-	for( OBAtomAtomIter nbr1(b); nbr1; ++nbr1 ) {
-	  oopID.iA = nbr1 -> GetIdx()-1;
-	  OBAtomAtomIter nbr2=nbr1;
-	  ++nbr2;
-	  for( ; nbr2; ++nbr2 ) {
-	    oopID.iC = nbr2 -> GetIdx()-1;
-	    OBAtomAtomIter nbr3=nbr2;
-	    ++nbr3;
-	    for( ; nbr3; ++nbr3 ) {
-	      oopID.iD = nbr3 -> GetIdx()-1;
-	      oopID.name=MakeOOPName(m_atoms[oopID.iA], m_atoms[oopID.iB], m_atoms[oopID.iC], m_atoms[oopID.iD]);
-	      m_oops.push_back(oopID);
-	    }
-	  }
-	}
-      }
-      m_oops.clear();
-      
-      OBAtom *c, *d;
-      OBBond *bond1, *bond2, *bond3;
-      OBBondIterator itr3, itr4, itr5;
-      FOR_ATOMS_OF_MOL(atom, const_cast<OBMol&>(mol)) {
-	a = (OBAtom*) &*atom;
-	ia = a->GetIdx()-1;
-	for (bond1 = a->BeginBond(itr3);bond1;bond1 = a->NextBond(itr3)){
-	  if (bond1->GetBeginAtom() == a)
-	    b = bond1->GetEndAtom();
-	  else
-	    b = bond1->GetBeginAtom();
-	  ib = b->GetIdx()-1;
-	  m_Connected.insert(ia+ib*m_numAtoms);
-	  for (bond2 = b->BeginBond(itr4);bond2;bond2 = b->NextBond(itr4)){
-	    if (bond2->GetBeginAtom() == b)
-	      c = bond2->GetEndAtom();
-	    else
-	      c = bond2->GetBeginAtom();
-	    if (c==a) continue;
-	    ic = c->GetIdx()-1;
-	    m_OneThree.insert(ia+ic*m_numAtoms);
-	    for (bond3 = c->BeginBond(itr5);bond3;bond3 = c->NextBond(itr5)){
-	      if (bond3->GetBeginAtom() == c)
-		d = bond3->GetEndAtom();
-	      else
-		d = bond3->GetBeginAtom();
-	      if (d==b||d==a) continue;
-	      id = d->GetIdx()-1;
-	      m_OneFour.insert(ia+id*m_numAtoms);
-	    }
-	  }
-	}
-      }
 
       return true;
     }
@@ -560,17 +531,17 @@ namespace OpenBabel {
 
     bool GAFFType::IsConnected(const size_t &iA, const size_t &iB) const
     {
-      return (m_Connected.find(iA + m_numAtoms*iB)!=m_Connected.end());
+      return m_graph.GetSeparation(iA, iB) == 1;
     }
 
     bool GAFFType::IsOneThree(const size_t &iA, const size_t &iB) const
     {
-      return (m_OneThree.find(iA+m_numAtoms*iB)!=m_OneThree.end());
+      return m_graph.GetSeparation(iA, iB) == 2;
     }
 
     bool GAFFType::IsOneFour(const size_t &iA, const size_t &iB) const
     {
-      return (m_OneFour.find(iA+m_numAtoms*iB)!=m_OneFour.end());
+      return m_graph.GetSeparation(iA, iB) == 3;
     }
 
 
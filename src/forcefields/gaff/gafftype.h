@@ -23,6 +23,7 @@ GNU General Public License for more details.
 #include <set>
 #include <map>
 #include <OBFFType>
+#include <OBMolGraph>
 
 namespace OpenBabel {
   class OBMol;
@@ -71,18 +72,27 @@ namespace OpenBabel {
       */
       std::vector<double> m_masses;
       std::vector<double> m_charges;
-      std::set<unsigned long int> m_Connected;
-      std::set<unsigned long int> m_OneThree;
-      std::set<unsigned long int> m_OneFour;
+      OBMolGraph m_graph; //!< bonds and 1-2, 1-3, 1-4 exclusions
       friend class GAFFParameterDB;
     };
 
+    /**
+     * The compiled SMARTS atom type rules. These are read-only after
+     * construction: GAFFType::SetTypes() matches with per-call state, so a
+     * single GAFFTypeRules can be shared by GAFFType objects in different
+     * threads (each thread needs its own GAFFType and OBMol).
+     */
     class GAFFTypeRules
     {
     public:
       GAFFTypeRules(const std::string & filename);
-      bool IsInitialized();
+      ~GAFFTypeRules();
+      bool IsInitialized() const;
     private:
+      // not copyable, the patterns are owned
+      GAFFTypeRules(const GAFFTypeRules &);
+      GAFFTypeRules& operator=(const GAFFTypeRules &);
+
       std::string m_filename;
       bool ParseParamFile();
       std::vector<std::pair<OBSmartsPattern*,std::string> > m_vexttyp; // external atom type rules
@@ -0,0 +1,449 @@
+/*********************************************************************
+Cluster pair terms - Lennard-Jones and Coulomb from an OBClusterPairList
+
+Copyright (C) 2009 by Frank Peters
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include "ClusterPair.h"
+#include <OBFFType>
+#include <OBParameterDB>
+#include <OBChargeMethod>
+#include <OBFunction>
+#include <OBFunctionTerm>
+
+#include <openbabel/mol.h>
+
+#include <OBLogFile>
+#include <OBDecomposition>
+
+#include <map>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    // The kernels below loop over the ClusterSize x ClusterSize atom pairs of a
+    // cluster pair with a fixed trip count and without branches, the inner (j)
+    // loop can be vectorized by the compiler. Masked out pairs get 1/r^2 = 0.
+    // The decomposition is only added to for the enabled pairs, without a
+    // decomposition (OBNoDecomposition) this test is removed by the compiler.
+
+    const std::string LJ6_12ClusterPair::m_name = "Lennard-Jones 6-12 Cluster Pair";
+
+    LJ6_12ClusterPair::LJ6_12ClusterPair(OBFunction *function, const double rcut, const double factorOneFour,
+					 const LJ6_12::MixingRule rule, const std::string tableName)
+      : OBFunctionTerm(function), m_tableName(tableName), m_rcut(rcut), m_factorOneFour(factorOneFour), m_rule(rule),
+	m_list(NULL), m_numTypes(0), m_value(999999.99)
+    {
+      switch (rule)
+	{
+	case LJ6_12::geometric: m_Mix = & LJ6_12::Mix<LJ6_12::geometric>; break;
+	case LJ6_12::arithmetic: m_Mix = & LJ6_12::Mix<LJ6_12::arithmetic>; break;
+	case LJ6_12::sixthpower: m_Mix = & LJ6_12::Mix<LJ6_12::sixthpower>; break;
+	}
+    }
+
+    LJ6_12ClusterPair::~LJ6_12ClusterPair()
+    {
+      delete m_list;
+    }
+
+    // E = c12/r^12 - c6/r^6
+    // c6 = 4*epsilon*sigma^6, c12 = 4*epsilon*sigma^12
+
+    template <bool gradients, class Decomposition>
+    double LJ6_12ClusterPair::ComputeClusterPairs(Decomposition &decomposition)
+    {
+      const unsigned int CS = OBClusterPairList::ClusterSize;
+      const double *x = m_list->GetX();
+      const double *y = m_list->GetY();
+      const double *z = m_list->GetZ();
+      const double rcut2 = m_rcut * m_rcut;
+      const bool geometric = (m_rule == LJ6_12::geometric);
+      const std::vector<OBClusterPairList::ClusterPair> &pairs = m_list->GetClusterPairs();
+      const std::vector<unsigned int> &atoms = m_list->GetAtoms();
+      double energy = 0.0;
+
+      for (unsigned int p = 0; p < pairs.size(); ++p) {
+	const unsigned int i0 = pairs[p].i * CS;
+	const unsigned int j0 = pairs[p].j * CS;
+	const unsigned int mask = pairs[p].mask;
+	double fjx[CS], fjy[CS], fjz[CS];
+	for (unsigned int b = 0; b < CS; ++b)
+	  fjx[b] = fjy[b] = fjz[b] = 0.0;
+
+	for (unsigned int a = 0; a < CS; ++a) {
+	  const double xi = x[i0 + a], yi = y[i0 + a], zi = z[i0 + a];
+	  double c6[CS], c12[CS];
+	  if (geometric)
+	    for (unsigned int b = 0; b < CS; ++b) {
+	      c6[b] = m_slotC6[i0 + a] * m_slotC6[j0 + b];
+	      c12[b] = m_slotC12[i0 + a] * m_slotC12[j0 + b];
+	    }
+	  else {
+	    const unsigned int row = m_slotTypes[i0 + a] * m_numTypes;
+	    for (unsigned int b = 0; b < CS; ++b) {
+	      c6[b] = m_c6[row + m_slotTypes[j0 + b]];
+	      c12[b] = m_c12[row + m_slotTypes[j0 + b]];
+	    }
+	  }
+
+	  double fix = 0.0, fiy = 0.0, fiz = 0.0;
+	  for (unsigned int b = 0; b < CS; ++b) {
+	    const double dx = xi - x[j0 + b];
+	    const double dy = yi - y[j0 + b];
+	    const double dz = zi - z[j0 + b];
+	    const double r2 = dx * dx + dy * dy + dz * dz;
+	    const bool on = ((mask >> (a * CS + b)) & 1u) && (r2 < rcut2);
+	    const double rinv2 = on ? 1.0 / r2 : 0.0;
+	    const double rinv6 = rinv2 * rinv2 * rinv2;
+	    const double e6 = c6[b] * rinv6;
+	    const double e12 = c12[b] * rinv6 * rinv6;
+	    energy += e12 - e6;
+	    if (Decomposition::Enabled && on)
+	      decomposition.Add(atoms[i0 + a], atoms[j0 + b], e12 - e6);
+	    if (gradients) {
+	      const double fscal = (12.0 * e12 - 6.0 * e6) * rinv2;
+	      fix += fscal * dx;
+	      fiy += fscal * dy;
+	      fiz += fscal * dz;
+	      fjx[b] -= fscal * dx;
+	      fjy[b] -= fscal * dy;
+	      fjz[b] -= fscal * dz;
+	    }
+	  }
+	  if (gradients) {
+	    m_fx[i0 + a] += fix;
+	    m_fy[i0 + a] += fiy;
+	    m_fz[i0 + a] += fiz;
+	  }
+	}
+
+	if (gradients)
+	  for (unsigned int b = 0; b < CS; ++b) {
+	    m_fx[j0 + b] += fjx[b];
+	    m_fy[j0 + b] += fjy[b];
+	    m_fz[j0 + b] += fjz[b];
+	  }
+      }
+
+      return energy;
+    }
+
+    template <class Decomposition>
+    void LJ6_12ClusterPair::compute(OBFunction::Computation computation, Decomposition &decomposition)
+    {
+      if (m_list->Update())
+	UpdateSlots();
+
+      if (computation == OBFunction::Gradients) {
+	std::fill(m_fx.begin(), m_fx.end(), 0.0);
+	std::fill(m_fy.begin(), m_fy.end(), 0.0);
+	std::fill(m_fz.begin(), m_fz.end(), 0.0);
+	m_value = ComputeClusterPairs<true>(decomposition);
+
+	const std::vector<unsigned int> &atoms = m_list->GetAtoms();
+	for (unsigned int s = 0; s < atoms.size(); ++s)
+	  if (atoms[s] != OBClusterPairList::NoAtom)
+	    m_function->GetInternalGradients()[atoms[s]] += Eigen::Vector3d(m_fx[s], m_fy[s], m_fz[s]);
+      }
+      else
+	m_value = ComputeClusterPairs<false>(decomposition);
+
+      // scaled 1-4 interactions
+      for (unsigned int i = 0; i < m_oneFour.size(); ++i) {
+	const Eigen::Vector3d ab = m_function->GetInternalPositions()[m_oneFour[i].iA] - m_function->GetInternalPositions()[m_oneFour[i].iB];
+	const double rinv2 = 1.0 / ab.squaredNorm();
+	const double rinv6 = rinv2 * rinv2 * rinv2;
+	const double e6 = m_oneFour[i].c6 * rinv6;
+	const double e12 = m_oneFour[i].c12 * rinv6 * rinv6;
+	decomposition.Add(m_oneFour[i].iA, m_oneFour[i].iB, e12 - e6);
+	m_value += e12 - e6;
+	if (computation == OBFunction::Gradients) {
+	  const Eigen::Vector3d F = ab * ((12.0 * e12 - 6.0 * e6) * rinv2);
+	  m_function->GetInternalGradients()[m_oneFour[i].iA] += F;
+	  m_function->GetInternalGradients()[m_oneFour[i].iB] -= F;
+	}
+      }
+    }
+
+    void LJ6_12ClusterPair::Compute(OBFunction::Computation computation)
+    {
+      if (OBDecomposition *decomposition = m_function->GetDecomposition())
+	compute(computation, *decomposition);
+      else {
+	OBNoDecomposition none;
+	compute(computation, none);
+      }
+    }
+
+    void LJ6_12ClusterPair::UpdateSlots()
+    {
+      const std::vector<unsigned int> &atoms = m_list->GetAtoms();
+      const unsigned int numSlots = atoms.size();
+
+      m_fx.resize(numSlots);
+      m_fy.resize(numSlots);
+      m_fz.resize(numSlots);
+      m_slotC6.resize(numSlots);
+      m_slotC12.resize(numSlots);
+      m_slotTypes.resize(numSlots);
+      for (unsigned int s = 0; s < numSlots; ++s) {
+	if (atoms[s] == OBClusterPairList::NoAtom) {
+	  m_slotC6[s] = m_slotC12[s] = 0.0;
+	  m_slotTypes[s] = 0;
+	  continue;
+	}
+	const unsigned int type = m_atomTypes[atoms[s]];
+	const double sigma3 = m_sigma[type] * m_sigma[type] * m_sigma[type];
+	m_slotC6[s] = 2.0 * sqrt(m_epsilon[type]) * sigma3;
+	m_slotC12[s] = m_slotC6[s] * sigma3;
+	m_slotTypes[s] = type;
+      }
+
+      const std::vector<std::pair<unsigned int, unsigned int> > &oneFourPairs = m_list->GetOneFourPairs();
+      OneFourParameter parameter;
+      m_oneFour.clear();
+      m_oneFour.reserve(oneFourPairs.size());
+      for (unsigned int i = 0; i < oneFourPairs.size(); ++i) {
+	parameter.iA = oneFourPairs[i].first;
+	parameter.iB = oneFourPairs[i].second;
+	const unsigned int index = m_atomTypes[parameter.iA] * m_numTypes + m_atomTypes[parameter.iB];
+	parameter.c6 = m_factorOneFour * m_c6[index];
+	parameter.c12 = m_factorOneFour * m_c12[index];
+	m_oneFour.push_back(parameter);
+      }
+    }
+
+    bool LJ6_12ClusterPair::Setup()
+    {
+      // combine the typing stored in obfftype with the parameters from the parameter database
+      OBParameterDBTable * pTable = ((m_function->GetParameterDB())->GetTable(m_tableName));
+      OBFFType * pOBFFType(m_function->GetOBFFType());
+      vector<OBParameterDBTable::Query> query;
+      vector<OBVariant> row;
+      map<string,unsigned int> types;
+      map<string,unsigned int>::iterator itr;
+
+      if ( (pTable==NULL) || (pOBFFType==NULL) )
+	return false;
+
+      const vector<OBFFType::AtomIdentifier> &atoms(pOBFFType->GetAtoms());
+      m_atomTypes.resize(atoms.size());
+      m_sigma.clear();
+      m_epsilon.clear();
+      for(unsigned int j=0; j != atoms.size(); ++j){
+	itr=types.find(atoms[j]);
+	if (itr==types.end()){
+	  query.clear();
+	  query.push_back( OBParameterDBTable::Query(0, OBVariant(atoms[j])));
+	  row = pTable->FindRow(query);
+	  m_sigma.push_back(row.at(1).AsDouble());
+	  m_epsilon.push_back(row.at(2).AsDouble());
+	  itr = types.insert(pair<string,unsigned int>(atoms[j], m_sigma.size()-1)).first;
+	}
+	m_atomTypes[m_function->InternalIndex(j)] = itr->second;
+      }
+
+      double sigma, epsilon, sigma6;
+      m_numTypes = m_sigma.size();
+      m_c6.resize(m_numTypes * m_numTypes);
+      m_c12.resize(m_numTypes * m_numTypes);
+      for (unsigned int j = 0; j < m_numTypes; ++j)
+	for (unsigned int k = 0; k < m_numTypes; ++k) {
+	  (*m_Mix)(sigma, epsilon, m_sigma[j], m_epsilon[j], m_sigma[k], m_epsilon[k]);
+	  sigma6 = pow(sigma, 6.0);
+	  m_c6[j * m_numTypes + k] = 4.0 * epsilon * sigma6;
+	  m_c12[j * m_numTypes + k] = 4.0 * epsilon * sigma6 * sigma6;
+	}
+
+      delete m_list;
+      m_list = new OBClusterPairList(m_function, m_rcut);
+      UpdateSlots();
+      return true;
+    }
+
+    const std::string CoulombClusterPair::m_name = "Coulomb Cluster Pair";
+
+    CoulombClusterPair::CoulombClusterPair(OBFunction *function, const double rcut, const double factorOneFour,
+					   const double relativePermittivity)
+      : OBFunctionTerm(function), m_rcut(rcut), m_factorOneFour(factorOneFour), m_relativePermittivity(relativePermittivity),
+	m_list(NULL), m_value(999999.99) {}
+
+    CoulombClusterPair::~CoulombClusterPair()
+    {
+      delete m_list;
+    }
+
+    // E = qq/r
+
+    template <bool gradients, class Decomposition>
+    double CoulombClusterPair::ComputeClusterPairs(Decomposition &decomposition)
+    {
+      const unsigned int CS = OBClusterPairList::ClusterSize;
+      const double *x = m_list->GetX();
+      const double *y = m_list->GetY();
+      const double *z = m_list->GetZ();
+      const double rcut2 = m_rcut * m_rcut;
+      const std::vector<OBClusterPairList::ClusterPair> &pairs = m_list->GetClusterPairs();
+      const std::vector<unsigned int> &atoms = m_list->GetAtoms();
+      double energy = 0.0;
+
+      for (unsigned int p = 0; p < pairs.size(); ++p) {
+	const unsigned int i0 = pairs[p].i * CS;
+	const unsigned int j0 = pairs[p].j * CS;
+	const unsigned int mask = pairs[p].mask;
+	double fjx[CS], fjy[CS], fjz[CS];
+	for (unsigned int b = 0; b < CS; ++b)
+	  fjx[b] = fjy[b] = fjz[b] = 0.0;
+
+	for (unsigned int a = 0; a < CS; ++a) {
+	  const double xi = x[i0 + a], yi = y[i0 + a], zi = z[i0 + a];
+	  const double qi = m_slotCharges[i0 + a];
+	  double fix = 0.0, fiy = 0.0, fiz = 0.0;
+	  for (unsigned int b = 0; b < CS; ++b) {
+	    const double dx = xi - x[j0 + b];
+	    const double dy = yi - y[j0 + b];
+	    const double dz = zi - z[j0 + b];
+	    const double r2 = dx * dx + dy * dy + dz * dz;
+	    const bool on = ((mask >> (a * CS + b)) & 1u) && (r2 < rcut2);
+	    const double rinv = on ? 1.0 / sqrt(r2) : 0.0;
+	    const double e = qi * m_slotCharges[j0 + b] * rinv;
+	    energy += e;
+	    if (Decomposition::Enabled && on)
+	      decomposition.Add(atoms[i0 + a], atoms[j0 + b], e);
+	    if (gradients) {
+	      const double fscal = e * rinv * rinv;
+	      fix += fscal * dx;
+	      fiy += fscal * dy;
+	      fiz += fscal * dz;
+	      fjx[b] -= fscal * dx;
+	      fjy[b] -= fscal * dy;
+	      fjz[b] -= fscal * dz;
+	    }
+	  }
+	  if (gradients) {
+	    m_fx[i0 + a] += fix;
+	    m_fy[i0 + a] += fiy;
+	    m_fz[i0 + a] += fiz;
+	  }
+	}
+
+	if (gradients)
+	  for (unsigned int b = 0; b < CS; ++b) {
+	    m_fx[j0 + b] += fjx[b];
+	    m_fy[j0 + b] += fjy[b];
+	    m_fz[j0 + b] += fjz[b];
+	  }
+      }
+
+      return energy;
+    }
+
+    template <class Decomposition>
+    void CoulombClusterPair::compute(OBFunction::Computation computation, Decomposition &decomposition)
+    {
+      if (m_list->Update())
+	UpdateSlots();
+
+      if (computation == OBFunction::Gradients) {
+	std::fill(m_fx.begin(), m_fx.end(), 0.0);
+	std::fill(m_fy.begin(), m_fy.end(), 0.0);
+	std::fill(m_fz.begin(), m_fz.end(), 0.0);
+	m_value = ComputeClusterPairs<true>(decomposition);
+
+	const std::vector<unsigned int> &atoms = m_list->GetAtoms();
+	for (unsigned int s = 0; s < atoms.size(); ++s)
+	  if (atoms[s] != OBClusterPairList::NoAtom)
+	    m_function->GetInternalGradients()[atoms[s]] += Eigen::Vector3d(m_fx[s], m_fy[s], m_fz[s]);
+      }
+      else
+	m_value = ComputeClusterPairs<false>(decomposition);
+
+      // scaled 1-4 interactions
+      for (unsigned int i = 0; i < m_oneFour.size(); ++i) {
+	const Eigen::Vector3d ab = m_function->GetInternalPositions()[m_oneFour[i].iA] - m_function->GetInternalPositions()[m_oneFour[i].iB];
+	const double rinv2 = 1.0 / ab.squaredNorm();
+	const double e = m_oneFour[i].qq * sqrt(rinv2);
+	decomposition.Add(m_oneFour[i].iA, m_oneFour[i].iB, e);
+	m_value += e;
+	if (computation == OBFunction::Gradients) {
+	  const Eigen::Vector3d F = ab * (e * rinv2);
+	  m_function->GetInternalGradients()[m_oneFour[i].iA] += F;
+	  m_function->GetInternalGradients()[m_oneFour[i].iB] -= F;
+	}
+      }
+    }
+
+    void CoulombClusterPair::Compute(OBFunction::Computation computation)
+    {
+      if (OBDecomposition *decomposition = m_function->GetDecomposition())
+	compute(computation, *decomposition);
+      else {
+	OBNoDecomposition none;
+	compute(computation, none);
+      }
+    }
+
+    void CoulombClusterPair::UpdateSlots()
+    {
+      const std::vector<unsigned int> &atoms = m_list->GetAtoms();
+      const unsigned int numSlots = atoms.size();
+
+      m_fx.resize(numSlots);
+      m_fy.resize(numSlots);
+      m_fz.resize(numSlots);
+      m_slotCharges.resize(numSlots);
+      for (unsigned int s = 0; s < numSlots; ++s)
+	m_slotCharges[s] = (atoms[s] == OBClusterPairList::NoAtom) ? 0.0 : m_charges[atoms[s]];
+
+      const std::vector<std::pair<unsigned int, unsigned int> > &oneFourPairs = m_list->GetOneFourPairs();
+      OneFourParameter parameter;
+      m_oneFour.clear();
+      m_oneFour.reserve(oneFourPairs.size());
+      for (unsigned int i = 0; i < oneFourPairs.size(); ++i) {
+	parameter.iA = oneFourPairs[i].first;
+	parameter.iB = oneFourPairs[i].second;
+	parameter.qq = m_factorOneFour * m_charges[parameter.iA] * m_charges[parameter.iB];
+	m_oneFour.push_back(parameter);
+      }
+    }
+
+    bool CoulombClusterPair::Setup()
+    {
+      OBChargeMethod * pOBChargeMethod(m_function->GetOBChargeMethod());
+      const double factor = 332.0716 / m_relativePermittivity; // energy scale: kcal/mol
+
+      if (pOBChargeMethod==NULL)
+	return false;
+
+      // q_i * q_j * factor = (q_i * sqrt(factor)) * (q_j * sqrt(factor))
+      const vector<double> & partialCharge = (pOBChargeMethod->GetPartialCharges());
+      const double sqrtFactor = sqrt(factor);
+      m_charges.resize(partialCharge.size());
+      for (unsigned int j = 0; j < partialCharge.size(); ++j)
+	m_charges[m_function->InternalIndex(j)] = sqrtFactor * partialCharge[j];
+
+      delete m_list;
+      m_list = new OBClusterPairList(m_function, m_rcut);
+      UpdateSlots();
+      return true;
+    }
+
+  }
+} // end namespace OpenBabel
@@ -0,0 +1,106 @@
+#ifndef OBFFS_CLUSTERPAIR_H
+#define OBFFS_CLUSTERPAIR_H
+
+#include <OBFunction>
+#include <OBFunctionTerm>
+#include <OBClusterPairList>
+
+#include "LJ6_12.h"
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /**
+     * Lennard-Jones 6-12 interaction with a cut-off, computed from an
+     * OBClusterPairList. The pairs further apart than @p rcut are ignored
+     * (the potential is truncated, not shifted), the energy only matches
+     * LJ6_12 when all pairs are within the cut-off. The 1-4 interactions are
+     * scaled by @p factorOneFour, they are found by the pair search and
+     * should also be within the cut-off.
+     */
+    class LJ6_12ClusterPair : public OBFunctionTerm
+    {
+    public:
+      struct OneFourParameter
+      {
+	unsigned int iA, iB;
+	double c6, c12;
+      };
+      LJ6_12ClusterPair(OBFunction *function, const double rcut = 10.0, const double factorOneFour = 0.5,
+			const LJ6_12::MixingRule rule = LJ6_12::geometric, const std::string tableName="LJ6_12");
+      ~LJ6_12ClusterPair();
+      std::string GetName() const { return m_name; }
+      bool Setup();
+      void Compute(OBFunction::Computation computation = OBFunction::Value);
+      double GetValue() const { return m_value; }
+      void ResetNeighborLists() { if (m_list) m_list->Invalidate(); }
+    private:
+      template <class Decomposition>
+      void compute(OBFunction::Computation computation, Decomposition &decomposition);
+      template <bool gradients, class Decomposition>
+      double ComputeClusterPairs(Decomposition &decomposition);
+      void UpdateSlots();
+
+      static const std::string m_name;
+      const std::string m_tableName;
+      const double m_rcut;
+      const double m_factorOneFour;
+      const LJ6_12::MixingRule m_rule;
+      void (*m_Mix)(double &, double &, const double &,  const double &,  const double &,  const double &);
+      OBClusterPairList *m_list;
+      unsigned int m_numTypes;
+      std::vector<unsigned int> m_atomTypes; //!< type index for each atom (internal order)
+      std::vector<double> m_sigma, m_epsilon; //!< parameters for each type
+      std::vector<double> m_c6, m_c12; //!< pair parameters (numTypes x numTypes)
+      std::vector<double> m_slotC6, m_slotC12; //!< geometric mixing: sqrt(c6), sqrt(c12) for each slot
+      std::vector<unsigned int> m_slotTypes; //!< other mixing rules: type index for each slot
+      std::vector<double> m_fx, m_fy, m_fz;
+      std::vector<OneFourParameter> m_oneFour;
+      double m_value;
+    };
+
+    /**
+     * Coulomb interaction with a cut-off, computed from an OBClusterPairList.
+     * The pairs further apart than @p rcut are ignored, the energy only
+     * matches Coulomb when all pairs are within the cut-off. The 1-4
+     * interactions are scaled by @p factorOneFour.
+     */
+    class CoulombClusterPair : public OBFunctionTerm
+    {
+    public:
+      struct OneFourParameter
+      {
+	unsigned int iA, iB;
+	double qq;
+      };
+      CoulombClusterPair(OBFunction *function, const double rcut = 12.0, const double factorOneFour = 0.8333,
+			 const double relativePermittivity = 1.0);
+      ~CoulombClusterPair();
+      std::string GetName() const { return m_name; }
+      bool Setup();
+      void Compute(OBFunction::Computation computation = OBFunction::Value);
+      double GetValue() const { return m_value; }
+      void ResetNeighborLists() { if (m_list) m_list->Invalidate(); }
+    private:
+      template <class Decomposition>
+      void compute(OBFunction::Computation computation, Decomposition &decomposition);
+      template <bool gradients, class Decomposition>
+      double ComputeClusterPairs(Decomposition &decomposition);
+      void UpdateSlots();
+
+      static const std::string m_name;
+      const double m_rcut;
+      const double m_factorOneFour;
+      const double m_relativePermittivity;
+      OBClusterPairList *m_list;
+      std::vector<double> m_charges; //!< scaled charge for each atom (internal order)
+      std::vector<double> m_slotCharges;
+      std::vector<double> m_fx, m_fy, m_fz;
+      std::vector<OneFourParameter> m_oneFour;
+      double m_value;
+    };
+
+  } // OBFFs
+} // OpenBabel
+
+#endif
@@ -26,22 +26,26 @@ GNU General Public License for more details.
 #include <openbabel/mol.h>
 
 #include <OBLogFile>
+#include <OBDecomposition>
 #include <OBVectorMath>
 
+#include <cmath>
+#include <algorithm>
+
 using namespace std;
 
 namespace OpenBabel {
   namespace OBFFs {
  
     const std::string Coulomb::m_name = "Coulomb";
+    const double Coulomb::MinAttractiveDistance = 1.0;
 
     Coulomb::Coulomb(OBFunction *function, const double factorOneFour, const double relativePermittivity)
-      : OBFunctionTerm(function), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numPairs(0), m_factorOneFour(factorOneFour), m_relativePermittivity(relativePermittivity) {}
+      : OBFunctionTerm(function), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numPairs(0), m_factorOneFour(factorOneFour), m_relativePermittivity(relativePermittivity),
+      m_lowerBound(0.0), m_numDense(0), m_mask(NULL), m_oneFourMask(NULL), m_charges(NULL) {}
 
     Coulomb::~Coulomb() 
     {
-      delete [] m_i;
-      delete [] m_calcs;
     }
 
     // Conventions taken from Lammps potentials
@@ -49,8 +53,77 @@ namespace OpenBabel {
     // epsilon (energy)
     // sigma (distance)
 
-    void Coulomb::Compute(OBFunction::Computation computation)
+    // Dense path, see LJ6_12::computeDense(). E = q_i q_j / r
+
+    template <bool gradients, class Decomposition>
+    double Coulomb::computeDense(Decomposition &decomposition)
     {
+      const unsigned int n = m_numDense;
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      double x[MaxDenseAtoms], y[MaxDenseAtoms], z[MaxDenseAtoms];
+      double fx[MaxDenseAtoms], fy[MaxDenseAtoms], fz[MaxDenseAtoms];
+      for (unsigned int i = 0; i < n; ++i) {
+	x[i] = positions[i].x();
+	y[i] = positions[i].y();
+	z[i] = positions[i].z();
+	fx[i] = fy[i] = fz[i] = 0.0;
+      }
+
+      double energy = 0.0;
+      for (unsigned int i = 0; i < n; ++i) {
+	const unsigned long long mask = m_mask[i];
+	if (!mask)
+	  continue;
+	const unsigned long long oneFour = m_oneFourMask[i];
+	const double xi = x[i], yi = y[i], zi = z[i];
+	const double qi = m_charges[i];
+	double fix = 0.0, fiy = 0.0, fiz = 0.0;
+	for (unsigned int j = i + 1; j < n; ++j) {
+	  const double dx = xi - x[j];
+	  const double dy = yi - y[j];
+	  const double dz = zi - z[j];
+	  const double r2 = dx * dx + dy * dy + dz * dz;
+	  const bool on = (mask >> j) & 1;
+	  const double scale = ((oneFour >> j) & 1) ? m_factorOneFour : 1.0;
+	  const double rinv2 = on ? 1.0 / r2 : 0.0;
+	  const double e = scale * qi * m_charges[j] * sqrt(rinv2);
+	  energy += e;
+	  if (Decomposition::Enabled && on)
+	    decomposition.Add(i, j, e);
+	  if (gradients) {
+	    const double fscal = e * rinv2;
+	    fix += fscal * dx;
+	    fiy += fscal * dy;
+	    fiz += fscal * dz;
+	    fx[j] -= fscal * dx;
+	    fy[j] -= fscal * dy;
+	    fz[j] -= fscal * dz;
+	  }
+	}
+	fx[i] += fix;
+	fy[i] += fiy;
+	fz[i] += fiz;
+      }
+
+      if (gradients) {
+	std::vector<Eigen::Vector3d> &forces = m_function->GetInternalGradients();
+	for (unsigned int i = 0; i < n; ++i)
+	  forces[i] += Eigen::Vector3d(fx[i], fy[i], fz[i]);
+      }
+      return energy;
+    }
+
+    template <class Decomposition>
+    void Coulomb::compute(OBFunction::Computation computation, Decomposition &decomposition)
+    {
+      if (m_numDense) {
+	if (computation == OBFunction::Gradients)
+	  m_value = computeDense<true>(decomposition);
+	else
+	  m_value = computeDense<false>(decomposition);
+	return;
+      }
+
       m_value = 0.0;
       unsigned int ia, ib;
       double rab, term, e;
@@ -61,14 +134,15 @@ namespace OpenBabel {
 	for (unsigned int i = 0; i < m_numPairs; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  rab = VectorBondDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], Fa, Fb);
+	  rab = VectorBondDerivative(m_function->GetInternalPositions()[ia], m_function->GetInternalPositions()[ib], Fa, Fb);
 	  term = 1.0 / rab;
 	  e = m_calcs[i].qq * term;
 	  dE = - e * term;
 	  Fa *= dE;
 	  Fb *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
+	  m_function->GetInternalGradients()[ia] += Fa;
+	  m_function->GetInternalGradients()[ib] += Fb;
+	  decomposition.Add(ia, ib, e);
 	  m_value += e;
 	}
       }      
@@ -76,56 +150,101 @@ namespace OpenBabel {
 	for (unsigned int i = 0; i < m_numPairs; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  const Eigen::Vector3d ab = m_function->GetPositions()[ia] - m_function->GetPositions()[ib];
+	  const Eigen::Vector3d ab = m_function->GetInternalPositions()[ia] - m_function->GetInternalPositions()[ib];
 	  rab = ab.norm();
 	  e =  m_calcs[i].qq / rab;
+	  decomposition.Add(ia, ib, e);
 	  m_value +=  e;
 	}
       }
     }
+
+    void Coulomb::Compute(OBFunction::Computation computation)
+    {
+      if (OBDecomposition *decomposition = m_function->GetDecomposition())
+	compute(computation, *decomposition);
+      else {
+	OBNoDecomposition none;
+	compute(computation, none);
+      }
+    }
   
     bool Coulomb::Setup()
     {
       OBChargeMethod * pOBChargeMethod(m_function->GetOBChargeMethod());
       OBFFType * pOBFFType(m_function->GetOBFFType());
-      Parameter parameter;
-      Index i;
-      vector <Index> v_i;
-      vector <Parameter> v_calcs;
       const double factor = 332.0716 / m_relativePermittivity; // energy scale: kcal/mol
 
+      m_numPairs = 0;
+      m_numDense = 0;
       if ( (pOBFFType==NULL) || (pOBChargeMethod==NULL))
 	return false;
 
       const vector<double> & partialCharge = (pOBChargeMethod->GetPartialCharges());
 
+      // count the pairs first, the arrays are allocated from the arena
+      for(unsigned int j=0; j != partialCharge.size();++j)
+	for(unsigned int k= j+1 ;k != partialCharge.size();++k)
+	  if (IsNonBondedPair(j, k))
+	    ++m_numPairs;
+      m_i = m_function->GetArena().Allocate<Index>(m_numPairs);
+      m_calcs = m_function->GetArena().Allocate<Parameter>(m_numPairs);
+      // not a strict bound, see MinAttractiveDistance
+      m_lowerBound = 0.0;
+
+      unsigned int n = 0;
       for(unsigned int j=0; j != partialCharge.size();++j){
 	for(unsigned int k= j+1 ;k != partialCharge.size();++k){
-	  i.iA = j;
-	  i.iB = k;
-	  if (pOBFFType->IsConnected(i.iA, i.iB))
-	    continue;
-	  if (pOBFFType->IsOneThree(i.iA, i.iB))
+	  if (!IsNonBondedPair(j, k))
 	    continue;
-	  parameter.qq = factor * partialCharge[j] * partialCharge[k];
-	  if (pOBFFType->IsOneFour(i.iA, i.iB))
-	    parameter.qq *= m_factorOneFour;
-	  v_i.push_back(i);
-	  v_calcs.push_back(parameter);
+	  m_i[n].iA = m_function->InternalIndex(j);
+	  m_i[n].iB = m_function->InternalIndex(k);
+	  m_calcs[n].qq = factor * partialCharge[j] * partialCharge[k];
+	  if (pOBFFType->IsOneFour(j, k))
+	    m_calcs[n].qq *= m_factorOneFour;
+	  if (m_calcs[n].qq < 0.0)
+	    m_lowerBound += m_calcs[n].qq / MinAttractiveDistance;
+	  ++n;
 	}
       }
 
-      m_numPairs = v_i.size();
-      delete [] m_i;
-      delete [] m_calcs;
-      m_i = new Index [m_numPairs];
-      m_calcs = new Parameter [m_numPairs];
-      for (size_t i=0; i< m_numPairs; ++i){
-	m_i[i] = v_i[i];
-	m_calcs[i] = v_calcs[i];
-      }
+      setupDense(partialCharge, factor);
       return true;
     }
+
+    void Coulomb::setupDense(const std::vector<double> &partialCharges, double factor)
+    {
+      OBFFType * pOBFFType(m_function->GetOBFFType());
+      const unsigned int numAtoms = partialCharges.size();
+      m_numDense = 0;
+      if (!numAtoms || numAtoms > MaxDenseAtoms)
+	return;
+
+      OBArena &arena = m_function->GetArena();
+      m_mask = arena.Allocate<unsigned long long>(numAtoms);
+      m_oneFourMask = arena.Allocate<unsigned long long>(numAtoms);
+      m_charges = arena.Allocate<double>(numAtoms);
+      // q_i * q_j * factor = (q_i * sqrt(factor)) * (q_j * sqrt(factor))
+      const double sqrtFactor = sqrt(factor);
+      for (unsigned int j = 0; j < numAtoms; ++j) {
+	const unsigned int i = m_function->InternalIndex(j);
+	m_mask[i] = m_oneFourMask[i] = 0;
+	m_charges[i] = sqrtFactor * partialCharges[j];
+      }
+      for (unsigned int j = 0; j < numAtoms; ++j)
+	for (unsigned int k = j + 1; k < numAtoms; ++k) {
+	  if (!IsNonBondedPair(j, k))
+	    continue;
+	  unsigned int a = m_function->InternalIndex(j), b = m_function->InternalIndex(k);
+	  if (a > b)
+	    std::swap(a, b);
+	  m_mask[a] |= (unsigned long long) 1 << b;
+	  if (pOBFFType->IsOneFour(j, k))
+	    m_oneFourMask[a] |= (unsigned long long) 1 << b;
+	}
+
+      m_numDense = numAtoms;
+    }
   }
 } // end namespace OpenBabel
 
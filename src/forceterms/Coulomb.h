@@ -4,9 +4,25 @@
 namespace OpenBabel {
   namespace OBFFs {
 
+    /**
+     * Coulomb interaction between all non-bonded pairs. The 1-4 interactions
+     * are scaled by @p factorOneFour.
+     *
+     * Molecules with at most MaxDenseAtoms atoms are computed from dense rows
+     * with a bit mask of enabled (and 1-4) partners for each atom (see LJ6_12).
+     *
+     * The Coulomb energy has no lower bound. GetLowerBound() assumes that
+     * attractive pairs are at least MinAttractiveDistance apart, this is not
+     * enforced: the early exit in OBFunction::ComputeBounded() is a heuristic
+     * for poses with closer opposite charges (these usually clash anyway).
+     */
     class Coulomb : public OBFunctionTerm
     {
     public:
+      //! Largest molecule for the dense path (bits in a row mask).
+      static const unsigned int MaxDenseAtoms = 64;
+      //! Distance (A) of the attractive pairs assumed by GetLowerBound().
+      static const double MinAttractiveDistance;
       struct Index
       {
 	unsigned int iA, iB;
@@ -21,7 +37,14 @@ namespace OpenBabel {
       bool Setup();
       void Compute(OBFunction::Computation computation = OBFunction::Value);
       double GetValue() const { return m_value; }
+      double GetLowerBound() const { return m_lowerBound; }
     private:
+      template <class Decomposition>
+      void compute(OBFunction::Computation computation, Decomposition &decomposition);
+      template <bool gradients, class Decomposition>
+      double computeDense(Decomposition &decomposition);
+      void setupDense(const std::vector<double> &partialCharges, double factor);
+
       static const std::string m_name;
       unsigned int m_numPairs;
       Parameter *  m_calcs;
@@ -29,6 +52,12 @@ namespace OpenBabel {
       double m_value;
       const double m_relativePermittivity;
       const double m_factorOneFour;
+      double m_lowerBound;
+      // dense path
+      unsigned int m_numDense; //!< number of atoms, 0 if the pair arrays are used
+      unsigned long long *m_mask; //!< for each atom: bit j set if the pair with atom j > i is computed
+      unsigned long long *m_oneFourMask; //!< for each atom: bit j set if the pair is a scaled 1-4 pair
+      double *m_charges; //!< scaled charge for each atom
     };
 
   } // OBFFs
@@ -0,0 +1,378 @@
+/*********************************************************************
+Generalized Born Term - OBC/HCT implicit solvent
+
+Copyright (C) 2009 by Frank Peters
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include "GeneralizedBorn.h"
+#include <OBFFType>
+#include <OBChargeMethod>
+#include <OBFunction>
+#include <OBFunctionTerm>
+
+#include <OBLogFile>
+#include <OBDecomposition>
+#include <OBAutoTune>
+
+#include <cmath>
+#include <cctype>
+#include <sstream>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    const std::string GeneralizedBorn::m_name = "Generalized Born";
+
+    namespace {
+      // Onufriev, Bashford & Case, Proteins 55, 383 (2004), model II
+      const double Alpha = 1.0;
+      const double Beta = 0.8;
+      const double Gamma = 4.85;
+      //! Dielectric offset (A)
+      const double Offset = 0.09;
+      //! Upper limit for HCT Born radii (A)
+      const double MaxBornRadius = 30.0;
+
+      /**
+       * mbondi2 radius and HCT scale factor for the element of a force field
+       * atom type (e.g. GAFF "c3", "hn", "cl").
+       * @return False if the element is not known.
+       */
+      bool intrinsicRadius(const std::string &type, bool bondedToNitrogen, double &radius, double &scale)
+      {
+	const char first = type.empty() ? ' ' : tolower(type[0]);
+	const char second = (type.size() > 1) ? tolower(type[1]) : ' ';
+	switch (first) {
+	case 'h':
+	  radius = bondedToNitrogen ? 1.3 : 1.2;
+	  scale = 0.85;
+	  return true;
+	case 'c':
+	  if (second == 'l') {
+	    radius = 1.7;
+	    scale = 0.8;
+	  } else {
+	    radius = 1.7;
+	    scale = 0.72;
+	  }
+	  return true;
+	case 'n':
+	  radius = 1.55;
+	  scale = 0.79;
+	  return true;
+	case 'o':
+	  radius = 1.5;
+	  scale = 0.85;
+	  return true;
+	case 'f':
+	  radius = 1.5;
+	  scale = 0.88;
+	  return true;
+	case 'p':
+	  radius = 1.85;
+	  scale = 0.86;
+	  return true;
+	case 's':
+	  radius = 1.8;
+	  scale = 0.96;
+	  return true;
+	case 'b':
+	  if (second == 'r') {
+	    radius = 1.85;
+	    scale = 0.8;
+	    return true;
+	  }
+	  break;
+	case 'i':
+	  radius = 1.98;
+	  scale = 0.8;
+	  return true;
+	}
+	radius = 1.5;
+	scale = 0.8;
+	return false;
+      }
+    }
+
+    GeneralizedBorn::GeneralizedBorn(OBFunction *function, const Model model, const double rcut,
+				     const double solventPermittivity, const double solutePermittivity,
+				     const int boxSize)
+      : OBFunctionTerm(function), m_model(model), m_rcut(rcut), m_solventPermittivity(solventPermittivity),
+      m_solutePermittivity(solutePermittivity), m_boxSize(boxSize), m_list(NULL), m_value(999999.99) {}
+
+    GeneralizedBorn::~GeneralizedBorn()
+    {
+      delete m_list;
+    }
+
+    // Descreening of atom i by atom j (Hawkins, Cramer & Truhlar 1996), the
+    // Born radius integral I_i is half the sum of these terms.
+    double GeneralizedBorn::descreen(double r, double rho, double sr, double *dhdr)
+    {
+      if (rho >= r + sr) {
+	if (dhdr)
+	  *dhdr = 0.0;
+	return 0.0;
+      }
+
+      const double diff = r - sr;
+      double l, dl;
+      if (rho > fabs(diff)) {
+	l = 1.0 / rho;
+	dl = 0.0;
+      } else {
+	l = 1.0 / fabs(diff);
+	dl = (diff > 0.0) ? -l * l : l * l;
+      }
+      const double u = 1.0 / (r + sr);
+      const double du = - u * u;
+      const double l2 = l * l;
+      const double u2 = u * u;
+      const double rinv = 1.0 / r;
+      const double sr2 = sr * sr;
+      const double ratio = log(u / l);
+
+      double h = l - u + 0.25 * r * (u2 - l2) + 0.5 * ratio * rinv + 0.25 * sr2 * rinv * (l2 - u2);
+      if (dhdr)
+	*dhdr = dl - du + 0.25 * (u2 - l2) + 0.5 * r * (u * du - l * dl)
+	  + 0.5 * ((du / u - dl / l) * rinv - ratio * rinv * rinv)
+	  - 0.25 * sr2 * rinv * rinv * (l2 - u2) + 0.5 * sr2 * rinv * (l * dl - u * du);
+
+      // atom i is inside the descreening sphere of atom j
+      if (rho < sr - r) {
+	h += 2.0 * (1.0 / rho - l);
+	if (dhdr)
+	  *dhdr -= 2.0 * dl;
+      }
+      return h;
+    }
+
+    void GeneralizedBorn::computeBornRadii()
+    {
+      const unsigned int numAtoms = m_radii.size();
+      for (unsigned int i = 0; i < numAtoms; ++i) {
+	const double rho = m_radii[i];
+	const double integral = 0.5 * m_sums[i];
+	if (m_model == HCT) {
+	  const double inverse = 1.0 / rho - integral;
+	  if (inverse < 1.0 / MaxBornRadius) {
+	    m_bornRadii[i] = MaxBornRadius;
+	    m_chain[i] = 0.0;
+	  } else {
+	    m_bornRadii[i] = 1.0 / inverse;
+	    m_chain[i] = 0.5 * m_bornRadii[i] * m_bornRadii[i];
+	  }
+	} else {
+	  // psi = I * rho, R = 1 / (1/rho - tanh(a psi - b psi^2 + g psi^3) / radius)
+	  const double psi = integral * rho;
+	  const double t = tanh(psi * (Alpha - psi * (Beta - psi * Gamma)));
+	  const double radius = m_intrinsicRadii[i];
+	  m_bornRadii[i] = 1.0 / (1.0 / rho - t / radius);
+	  m_chain[i] = 0.5 * m_bornRadii[i] * m_bornRadii[i] * (1.0 - t * t)
+	    * (Alpha - psi * (2.0 * Beta - 3.0 * Gamma * psi)) * rho / radius;
+	}
+      }
+    }
+
+    template <class Decomposition>
+    void GeneralizedBorn::compute(OBFunction::Computation computation, Decomposition &decomposition)
+    {
+      const unsigned int numAtoms = m_charges.size();
+      const bool gradients = (computation == OBFunction::Gradients);
+      const bool hasGroups = m_function->HasGroups();
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      std::vector<Eigen::Vector3d> &forces = m_function->GetInternalGradients();
+      m_value = 0.0;
+
+      // descreening sums over the pairs within the cut-off
+      m_list->Update();
+      m_pairs.clear();
+      m_sums.assign(numAtoms, 0.0);
+      Pair pair;
+      for (unsigned int i = 0; i < numAtoms; ++i) {
+	const std::vector<unsigned int> &nbrs = m_list->GetNbrs(i);
+	for (unsigned int k = 0; k < nbrs.size(); ++k) {
+	  const unsigned int j = nbrs[k];
+	  pair.iA = i;
+	  pair.iB = j;
+	  pair.r = sqrt(m_list->GetDist2(k));
+	  if (pair.r < 1.0e-6)
+	    continue;
+	  m_sums[i] += descreen(pair.r, m_radii[i], m_scaledRadii[j], NULL);
+	  m_sums[j] += descreen(pair.r, m_radii[j], m_scaledRadii[i], NULL);
+	  m_pairs.push_back(pair);
+	}
+      }
+      computeBornRadii();
+      if (gradients)
+	m_dEdR.assign(numAtoms, 0.0);
+
+      // self energies
+      for (unsigned int i = 0; i < numAtoms; ++i) {
+	if (!m_self[i])
+	  continue;
+	const double q2 = m_charges[i] * m_charges[i];
+	const double e = - 0.5 * q2 / m_bornRadii[i];
+	if (gradients)
+	  m_dEdR[i] -= e / m_bornRadii[i];
+	decomposition.Add(i, e);
+	m_value += e;
+      }
+
+      // pair energies, the explicit distance dependence of f_ij
+      for (unsigned int p = 0; p < m_pairs.size(); ++p) {
+	const unsigned int ia = m_pairs[p].iA;
+	const unsigned int ib = m_pairs[p].iB;
+	const double qq = m_charges[ia] * m_charges[ib];
+	if (qq == 0.0)
+	  continue;
+	if (hasGroups && !m_function->IsInterGroup(m_function->InputIndex(ia), m_function->InputIndex(ib)))
+	  continue;
+	const double r = m_pairs[p].r;
+	const double r2 = r * r;
+	const double D = m_bornRadii[ia] * m_bornRadii[ib];
+	const double expTerm = exp(-0.25 * r2 / D);
+	const double f2 = r2 + D * expTerm;
+	const double f = sqrt(f2);
+	const double e = - qq / f;
+	if (gradients) {
+	  const double f3 = f2 * f;
+	  const double dEdr = qq * r * (1.0 - 0.25 * expTerm) / f3;
+	  const double dEdD = 0.5 * qq * expTerm * (1.0 + 0.25 * r2 / D) / f3;
+	  m_dEdR[ia] += dEdD * m_bornRadii[ib];
+	  m_dEdR[ib] += dEdD * m_bornRadii[ia];
+	  const Eigen::Vector3d F = (positions[ia] - positions[ib]) * (- dEdr / r);
+	  forces[ia] += F;
+	  forces[ib] -= F;
+	}
+	decomposition.Add(ia, ib, e);
+	m_value += e;
+      }
+
+      if (!gradients)
+	return;
+
+      // chain rule through the Born radii: dE/dr_ij = dE/dR_i dR_i/dr_ij + dE/dR_j dR_j/dr_ij
+      for (unsigned int i = 0; i < numAtoms; ++i)
+	m_dEdR[i] *= m_chain[i];
+      double dh;
+      for (unsigned int p = 0; p < m_pairs.size(); ++p) {
+	const unsigned int ia = m_pairs[p].iA;
+	const unsigned int ib = m_pairs[p].iB;
+	const double r = m_pairs[p].r;
+	double dEdr = 0.0;
+	if (m_dEdR[ia] != 0.0) {
+	  descreen(r, m_radii[ia], m_scaledRadii[ib], &dh);
+	  dEdr += m_dEdR[ia] * dh;
+	}
+	if (m_dEdR[ib] != 0.0) {
+	  descreen(r, m_radii[ib], m_scaledRadii[ia], &dh);
+	  dEdr += m_dEdR[ib] * dh;
+	}
+	if (dEdr == 0.0)
+	  continue;
+	const Eigen::Vector3d F = (positions[ia] - positions[ib]) * (- dEdr / r);
+	forces[ia] += F;
+	forces[ib] -= F;
+      }
+    }
+
+    void GeneralizedBorn::Compute(OBFunction::Computation computation)
+    {
+      if (OBDecomposition *decomposition = m_function->GetDecomposition())
+	compute(computation, *decomposition);
+      else {
+	OBNoDecomposition none;
+	compute(computation, none);
+      }
+    }
+
+    double GeneralizedBorn::GetBornRadius(unsigned int index) const
+    {
+      const unsigned int i = m_function->InternalIndex(index);
+      return (i < m_bornRadii.size()) ? m_bornRadii[i] : 0.0;
+    }
+
+    bool GeneralizedBorn::Setup()
+    {
+      OBChargeMethod * pOBChargeMethod(m_function->GetOBChargeMethod());
+      OBFFType * pOBFFType(m_function->GetOBFFType());
+      // energy scale: kcal/mol
+      const double factor = 332.0716 * (1.0 / m_solutePermittivity - 1.0 / m_solventPermittivity);
+
+      if ( (pOBFFType==NULL) || (pOBChargeMethod==NULL))
+	return false;
+
+      const vector<double> & partialCharge = (pOBChargeMethod->GetPartialCharges());
+      const vector<OBFFType::AtomIdentifier> & atoms(pOBFFType->GetAtoms());
+      const unsigned int numAtoms = partialCharge.size();
+      if (atoms.size() != numAtoms || m_function->NumParticles() != numAtoms)
+	return false;
+
+      // mbondi2: hydrogens bonded to nitrogen have a larger radius
+      vector<bool> bondedToNitrogen(numAtoms, false);
+      const vector<OBFFType::BondIdentifier> & bonds(pOBFFType->GetBonds());
+      for (unsigned int i = 0; i < bonds.size(); ++i) {
+	const std::string &typeA = atoms[bonds[i].iA];
+	const std::string &typeB = atoms[bonds[i].iB];
+	if (!typeA.empty() && tolower(typeA[0]) == 'n')
+	  bondedToNitrogen[bonds[i].iB] = true;
+	if (!typeB.empty() && tolower(typeB[0]) == 'n')
+	  bondedToNitrogen[bonds[i].iA] = true;
+      }
+
+      const double sqrtFactor = sqrt(factor);
+      m_charges.resize(numAtoms);
+      m_radii.resize(numAtoms);
+      m_scaledRadii.resize(numAtoms);
+      m_intrinsicRadii.resize(numAtoms);
+      m_self.resize(numAtoms);
+      m_bornRadii.assign(numAtoms, 0.0);
+      m_chain.assign(numAtoms, 0.0);
+      for (unsigned int j = 0; j < numAtoms; ++j) {
+	const unsigned int i = m_function->InternalIndex(j);
+	double radius, scale;
+	if (!intrinsicRadius(atoms[j], bondedToNitrogen[j], radius, scale)) {
+	  std::stringstream ss;
+	  ss << "    " << m_name << ": no radius for atom type " << atoms[j] << ", using " << radius << " A" << std::endl;
+	  m_function->GetLogFile()->Write(OBLogFile::Medium, ss.str());
+	}
+	m_charges[i] = sqrtFactor * partialCharge[j];
+	m_intrinsicRadii[i] = radius;
+	m_radii[i] = radius - Offset;
+	m_scaledRadii[i] = scale * (radius - Offset);
+	m_self[i] = m_function->IsInterGroup(j, j);
+      }
+
+      // finer cells pay off for dense systems with many atoms within the cut-off
+      int boxSize = m_boxSize;
+      if (boxSize <= 0) {
+	const double neighbors = OBAutoTune::CountNeighbors(m_function->GetInternalPositions(), m_rcut);
+	boxSize = OBAutoTune::NbrListBoxSize(neighbors);
+	std::stringstream ss;
+	ss << "    " << m_name << ": " << neighbors << " atoms within the cut-off, " << boxSize
+	   << " neighbor list cells per cut-off" << std::endl;
+	m_function->GetLogFile()->Write(OBLogFile::Medium, ss.str());
+      }
+
+      delete m_list;
+      m_list = new OBNbrList(m_function, m_rcut, false, boxSize);
+      return true;
+    }
+
+  }
+} // end namespace OpenBabel
@@ -0,0 +1,84 @@
+#ifndef OBFFS_GENERALIZEDBORN_H
+#define OBFFS_GENERALIZEDBORN_H
+
+#include <OBFunction>
+#include <OBFunctionTerm>
+#include <OBNbrList>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /**
+     * Generalized Born implicit solvent (polar solvation energy only):
+     *
+     *   E = - k (1/e_in - 1/e_out) [ sum_i<j q_i q_j / f_ij + 1/2 sum_i q_i^2 / R_i ]
+     *   f_ij = sqrt(r_ij^2 + R_i R_j exp(-r_ij^2 / (4 R_i R_j)))
+     *
+     * The Born radii R_i are computed with the pairwise descreening integral
+     * of Hawkins, Cramer & Truhlar (HCT) and optionally rescaled as in Onufriev,
+     * Bashford & Case (OBC, alpha/beta/gamma = 1.0/0.8/4.85). Intrinsic radii
+     * are the mbondi2 radii of the elements (derived from the atom types), the
+     * descreening integrals and the pair terms use an OBNbrList with cut-off
+     * @p rcut. All pairs within the cut-off contribute, including the bonded
+     * ones. The vacuum Coulomb interaction is a separate term.
+     *
+     * @p boxSize is the number of OBNbrList cells per cut-off (plus skin) distance, 0
+     * (the default) chooses it from the atom density (OBAutoTune).
+     */
+    class GeneralizedBorn : public OBFunctionTerm
+    {
+    public:
+      enum Model {
+	HCT,
+	OBC
+      };
+      struct Pair
+      {
+	unsigned int iA, iB;
+	double r;
+      };
+      GeneralizedBorn(OBFunction *function, const Model model = OBC, const double rcut = 16.0,
+		      const double solventPermittivity = 78.5, const double solutePermittivity = 1.0,
+		      const int boxSize = 0);
+      ~GeneralizedBorn();
+      std::string GetName() const { return m_name; }
+      bool Setup();
+      void Compute(OBFunction::Computation computation = OBFunction::Value);
+      double GetValue() const { return m_value; }
+      void ResetNeighborLists() { if (m_list) m_list->Invalidate(); }
+      /**
+       * @return The Born radius of atom @p index (input order) from the last Compute().
+       */
+      double GetBornRadius(unsigned int index) const;
+    private:
+      template <class Decomposition>
+      void compute(OBFunction::Computation computation, Decomposition &decomposition);
+      //! Descreening integral of atom i (radius rho) by atom j (scaled radius sr) and its derivative.
+      static double descreen(double r, double rho, double sr, double *dhdr);
+      //! Born radii and dR/dI from the descreening sums.
+      void computeBornRadii();
+
+      static const std::string m_name;
+      const Model m_model;
+      const double m_rcut;
+      const double m_solventPermittivity;
+      const double m_solutePermittivity;
+      const int m_boxSize;
+      OBNbrList *m_list;
+      std::vector<double> m_charges; //!< scaled charge for each atom (internal order)
+      std::vector<double> m_radii; //!< intrinsic radius - offset (internal order)
+      std::vector<double> m_scaledRadii; //!< scale factor * (intrinsic radius - offset)
+      std::vector<double> m_intrinsicRadii;
+      std::vector<bool> m_self; //!< self energy enabled (interaction groups)
+      std::vector<double> m_sums; //!< descreening sums
+      std::vector<double> m_bornRadii;
+      std::vector<double> m_chain; //!< dR_i / dsum_i
+      std::vector<double> m_dEdR;
+      std::vector<Pair> m_pairs; //!< pairs within the cut-off (i < j)
+      double m_value;
+    };
+
+  } // OBFFs
+} // OpenBabel
+
+#endif
@@ -25,9 +25,12 @@ GNU General Public License for more details.
 #include <openbabel/mol.h>
 
 #include <OBLogFile>
+#include <OBDecomposition>
 #include <OBVectorMath>
 
 #include <map>
+#include <cmath>
+#include <algorithm>
 
 using namespace std;
 
@@ -55,7 +58,9 @@ namespace OpenBabel {
     }
 
     LJ6_12::LJ6_12(OBFunction *function, const double factorOneFour, const LJ6_12::MixingRule rule, const std::string tableName)
-      : OBFunctionTerm(function), m_tableName(tableName), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numPairs(0), m_factorOneFour(factorOneFour) 
+      : OBFunctionTerm(function), m_tableName(tableName), m_rule(rule), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numPairs(0), m_factorOneFour(factorOneFour),
+      m_lowerBound(0.0), m_numDense(0), m_mask(NULL), m_oneFourMask(NULL), m_c6(NULL), m_c12(NULL), m_types(NULL),
+      m_typeC6(NULL), m_typeC12(NULL), m_numTypes(0)
     {
       switch (rule)
 	{
@@ -67,8 +72,6 @@ namespace OpenBabel {
 
     LJ6_12::~LJ6_12() 
     {
-      delete [] m_i;
-      delete [] m_calcs;
     }
 
     // Conventions taken from Lammps potentials
@@ -76,8 +79,86 @@ namespace OpenBabel {
     // epsilon (energy)
     // sigma (distance)
 
-    void LJ6_12::Compute(OBFunction::Computation computation)
+    // Dense path: row i covers the atoms j > i, pairs that are not in the
+    // mask get 1/r^2 = 0 (as in the cluster pair kernels). Positions and
+    // forces for at most 64 atoms fit in 3 kB on the stack.
+    // E = c12/r^12 - c6/r^6, c6 = 4*epsilon*sigma^6, c12 = 4*epsilon*sigma^12
+
+    template <bool gradients, class Decomposition>
+    double LJ6_12::computeDense(Decomposition &decomposition)
+    {
+      const unsigned int n = m_numDense;
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      const bool geometricRule = (m_rule == LJ6_12::geometric);
+      double x[MaxDenseAtoms], y[MaxDenseAtoms], z[MaxDenseAtoms];
+      double fx[MaxDenseAtoms], fy[MaxDenseAtoms], fz[MaxDenseAtoms];
+      for (unsigned int i = 0; i < n; ++i) {
+	x[i] = positions[i].x();
+	y[i] = positions[i].y();
+	z[i] = positions[i].z();
+	fx[i] = fy[i] = fz[i] = 0.0;
+      }
+
+      double energy = 0.0;
+      for (unsigned int i = 0; i < n; ++i) {
+	const unsigned long long mask = m_mask[i];
+	if (!mask)
+	  continue;
+	const unsigned long long oneFour = m_oneFourMask[i];
+	const double xi = x[i], yi = y[i], zi = z[i];
+	const double c6i = m_c6[i], c12i = m_c12[i];
+	const unsigned int row = geometricRule ? 0 : m_types[i] * m_numTypes;
+	double fix = 0.0, fiy = 0.0, fiz = 0.0;
+	for (unsigned int j = i + 1; j < n; ++j) {
+	  const double dx = xi - x[j];
+	  const double dy = yi - y[j];
+	  const double dz = zi - z[j];
+	  const double r2 = dx * dx + dy * dy + dz * dz;
+	  const bool on = (mask >> j) & 1;
+	  const double scale = ((oneFour >> j) & 1) ? m_factorOneFour : 1.0;
+	  const double c6 = scale * (geometricRule ? c6i * m_c6[j] : m_typeC6[row + m_types[j]]);
+	  const double c12 = scale * (geometricRule ? c12i * m_c12[j] : m_typeC12[row + m_types[j]]);
+	  const double rinv2 = on ? 1.0 / r2 : 0.0;
+	  const double rinv6 = rinv2 * rinv2 * rinv2;
+	  const double e6 = c6 * rinv6;
+	  const double e12 = c12 * rinv6 * rinv6;
+	  energy += e12 - e6;
+	  if (Decomposition::Enabled && on)
+	    decomposition.Add(i, j, e12 - e6);
+	  if (gradients) {
+	    const double fscal = (12.0 * e12 - 6.0 * e6) * rinv2;
+	    fix += fscal * dx;
+	    fiy += fscal * dy;
+	    fiz += fscal * dz;
+	    fx[j] -= fscal * dx;
+	    fy[j] -= fscal * dy;
+	    fz[j] -= fscal * dz;
+	  }
+	}
+	fx[i] += fix;
+	fy[i] += fiy;
+	fz[i] += fiz;
+      }
+
+      if (gradients) {
+	std::vector<Eigen::Vector3d> &forces = m_function->GetInternalGradients();
+	for (unsigned int i = 0; i < n; ++i)
+	  forces[i] += Eigen::Vector3d(fx[i], fy[i], fz[i]);
+      }
+      return energy;
+    }
+
+    template <class Decomposition>
+    void LJ6_12::compute(OBFunction::Computation computation, Decomposition &decomposition)
     {
+      if (m_numDense) {
+	if (computation == OBFunction::Gradients)
+	  m_value = computeDense<true>(decomposition);
+	else
+	  m_value = computeDense<false>(decomposition);
+	return;
+      }
+
       m_value = 0.0;
       double rab, term, term3, term6, term12, e;
       Eigen::Vector3d Fa, Fb;
@@ -88,7 +169,7 @@ namespace OpenBabel {
 	for (unsigned int i = 0; i < m_numPairs; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  rab = VectorBondDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], Fa, Fb);
+	  rab = VectorBondDerivative(m_function->GetInternalPositions()[ia], m_function->GetInternalPositions()[ib], Fa, Fb);
 	  term = m_calcs[i].sigma / rab;
 	  term3 = term * term * term;
 	  term6 = term3 * term3;
@@ -96,25 +177,63 @@ namespace OpenBabel {
 	  dE = 24.* m_calcs[i].epsilon * (-2.0*term12 + term6)/rab;
 	  Fa *= dE;
 	  Fb *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
+	  m_function->GetInternalGradients()[ia] += Fa;
+	  m_function->GetInternalGradients()[ib] += Fb;
 	  e = 4.0 * m_calcs[i].epsilon * (term12-term6);
+	  decomposition.Add(ia, ib, e);
 	  m_value += e;
 	}
       }      
       else {
 	for (unsigned int i = 0; i < m_numPairs; ++i) {
-	  const Eigen::Vector3d ab = m_function->GetPositions()[m_i[i].iA] - m_function->GetPositions()[m_i[i].iB];
+	  const Eigen::Vector3d ab = m_function->GetInternalPositions()[m_i[i].iA] - m_function->GetInternalPositions()[m_i[i].iB];
 	  rab = ab.norm();
 	  term = m_calcs[i].sigma / rab;
 	  term3 = term*term*term;
 	  term6 = term3*term3;
 	  term12 = term6*term6;
 	  e = 4.0 * m_calcs[i].epsilon * (term12-term6);
+	  decomposition.Add(m_i[i].iA, m_i[i].iB, e);
 	  m_value += e;      
 	}
       }
     }
+
+    void LJ6_12::Compute(OBFunction::Computation computation)
+    {
+      if (OBDecomposition *decomposition = m_function->GetDecomposition())
+	compute(computation, *decomposition);
+      else {
+	OBNoDecomposition none;
+	compute(computation, none);
+      }
+    }
+
+    // Every pair contributes at least -epsilon. Stop when a repulsive pair makes
+    // the value larger than maxValue, even if all remaining pairs are at their
+    // minimum.
+    bool LJ6_12::ComputeBounded(double offset, double maxValue)
+    {
+      double rab, term, term3, term6, term12, e;
+      double remaining = m_lowerBound;
+
+      m_value = 0.0;
+      for (unsigned int i = 0; i < m_numPairs; ++i) {
+	const Eigen::Vector3d ab = m_function->GetInternalPositions()[m_i[i].iA] - m_function->GetInternalPositions()[m_i[i].iB];
+	rab = ab.norm();
+	term = m_calcs[i].sigma / rab;
+	term3 = term*term*term;
+	term6 = term3*term3;
+	term12 = term6*term6;
+	e = 4.0 * m_calcs[i].epsilon * (term12-term6);
+	m_value += e;
+	remaining += m_calcs[i].epsilon;
+	if ((e > 0.0) && (offset + m_value + remaining > maxValue))
+	  return false;
+      }
+
+      return offset + m_value <= maxValue;
+    }
   
     bool LJ6_12::Setup()
     {
@@ -128,17 +247,27 @@ namespace OpenBabel {
       string name;
       map<string,Parameter> parameters;
       map<string,Parameter>::iterator itr;
-      Index i;
-      vector <Index> v_i;
-      vector <Parameter> v_calcs;
-      OBAtom *a, *b;
 
+      m_numPairs = 0;
+      m_numDense = 0;
       if ( (pTable==NULL) || (pOBFFType==NULL) )
 	return false;
 
+      // count the pairs first, the arrays are allocated from the arena
+      for(unsigned int j=0; j != atoms.size(); ++j)
+	for(unsigned int k= j+1; k != atoms.size(); ++k)
+	  if (IsNonBondedPair(j, k))
+	    ++m_numPairs;
+      m_i = m_function->GetArena().Allocate<Index>(m_numPairs);
+      m_calcs = m_function->GetArena().Allocate<Parameter>(m_numPairs);
+      m_lowerBound = 0.0;
+
       double sigma_j, sigma_k, epsilon_j, epsilon_k;
+      unsigned int n = 0;
       for(unsigned int j=0; j != atoms.size(); ++j){
 	for(unsigned int k= j+1; k != atoms.size(); ++k){
+	  if (!IsNonBondedPair(j, k))
+	    continue;
 	  if (atoms[j]<atoms[k])
 	    name = atoms[j] + "-" + atoms[k];
 	  else
@@ -160,30 +289,97 @@ namespace OpenBabel {
 	  }
 	  else
 	    parameter=itr->second;
-	  i.iA = j;
-	  i.iB = k;
-	  if (pOBFFType->IsConnected(i.iA, i.iB))
-	    continue;
-	  if (pOBFFType->IsOneThree(i.iA, i.iB))
-	    continue;
-	  if (pOBFFType->IsOneFour(i.iA, i.iB))
+	  if (pOBFFType->IsOneFour(j, k))
 	    parameter.epsilon *= m_factorOneFour;
-	  v_i.push_back(i);
-	  v_calcs.push_back(parameter);
+	  m_i[n].iA = m_function->InternalIndex(j);
+	  m_i[n].iB = m_function->InternalIndex(k);
+	  m_calcs[n] = parameter;
+	  m_lowerBound -= parameter.epsilon;
+	  ++n;
 	}
       }
 
-      m_numPairs = v_i.size();
-      delete [] m_i;
-      delete [] m_calcs;
-      m_i = new Index [m_numPairs];
-      m_calcs = new Parameter [m_numPairs];
-      for (size_t i=0; i< m_numPairs; ++i){
-	m_i[i] = v_i[i];
-	m_calcs[i] = v_calcs[i];
-      }
+      setupDense(pTable, pOBFFType);
       return true;
     }
+
+    void LJ6_12::setupDense(OBParameterDBTable *pTable, OBFFType *pOBFFType)
+    {
+      const vector<OBFFType::AtomIdentifier> &atoms(pOBFFType->GetAtoms());
+      const unsigned int numAtoms = atoms.size();
+      m_numDense = 0;
+      if (!numAtoms || numAtoms > MaxDenseAtoms)
+	return;
+
+      OBArena &arena = m_function->GetArena();
+      m_mask = arena.Allocate<unsigned long long>(numAtoms);
+      m_oneFourMask = arena.Allocate<unsigned long long>(numAtoms);
+      for (unsigned int i = 0; i < numAtoms; ++i)
+	m_mask[i] = m_oneFourMask[i] = 0;
+      vector<bool> used(numAtoms, false);
+      for (unsigned int j = 0; j < numAtoms; ++j)
+	for (unsigned int k = j + 1; k < numAtoms; ++k) {
+	  if (!IsNonBondedPair(j, k))
+	    continue;
+	  used[j] = used[k] = true;
+	  unsigned int a = m_function->InternalIndex(j), b = m_function->InternalIndex(k);
+	  if (a > b)
+	    std::swap(a, b);
+	  m_mask[a] |= (unsigned long long) 1 << b;
+	  if (pOBFFType->IsOneFour(j, k))
+	    m_oneFourMask[a] |= (unsigned long long) 1 << b;
+	}
+
+      // parameters for each type, only for the atoms in a pair (atoms excluded
+      // by the groups need no parameters)
+      vector<OBParameterDBTable::Query> query;
+      vector<OBVariant> row;
+      vector<double> sigma, epsilon;
+      map<string,unsigned int> types;
+      map<string,unsigned int>::iterator itr;
+      m_types = arena.Allocate<unsigned int>(numAtoms);
+      m_c6 = arena.Allocate<double>(numAtoms);
+      m_c12 = arena.Allocate<double>(numAtoms);
+      for (unsigned int j = 0; j < numAtoms; ++j) {
+	const unsigned int i = m_function->InternalIndex(j);
+	m_types[i] = 0;
+	m_c6[i] = m_c12[i] = 0.0;
+	if (!used[j])
+	  continue;
+	itr = types.find(atoms[j]);
+	if (itr == types.end()) {
+	  query.clear();
+	  query.push_back( OBParameterDBTable::Query(0, OBVariant(atoms[j])));
+	  row = pTable->FindRow(query);
+	  sigma.push_back(row.at(1).AsDouble());
+	  epsilon.push_back(row.at(2).AsDouble());
+	  itr = types.insert(pair<string,unsigned int>(atoms[j], sigma.size() - 1)).first;
+	}
+	const unsigned int type = itr->second;
+	m_types[i] = type;
+	// geometric: c6 = 4 sqrt(eps_i eps_j) (sigma_i sigma_j)^3 = (2 sqrt(eps_i) sigma_i^3) (2 sqrt(eps_j) sigma_j^3)
+	const double sigma3 = sigma[type] * sigma[type] * sigma[type];
+	m_c6[i] = 2.0 * sqrt(epsilon[type]) * sigma3;
+	m_c12[i] = m_c6[i] * sigma3;
+      }
+
+      m_numTypes = sigma.size();
+      m_typeC6 = m_typeC12 = NULL;
+      if (m_rule != geometric) {
+	double mixedSigma, mixedEpsilon, sigma6;
+	m_typeC6 = arena.Allocate<double>(m_numTypes * m_numTypes);
+	m_typeC12 = arena.Allocate<double>(m_numTypes * m_numTypes);
+	for (unsigned int j = 0; j < m_numTypes; ++j)
+	  for (unsigned int k = 0; k < m_numTypes; ++k) {
+	    (*m_Mix)(mixedSigma, mixedEpsilon, sigma[j], epsilon[j], sigma[k], epsilon[k]);
+	    sigma6 = pow(mixedSigma, 6.0);
+	    m_typeC6[j * m_numTypes + k] = 4.0 * mixedEpsilon * sigma6;
+	    m_typeC12[j * m_numTypes + k] = 4.0 * mixedEpsilon * sigma6 * sigma6;
+	  }
+      }
+
+      m_numDense = numAtoms;
+    }
   }
 } // end namespace OpenBabel
 
@@ -1,13 +1,30 @@
+#ifndef OBFFS_LJ6_12_H
+#define OBFFS_LJ6_12_H
+
 #include <OBFunction>
 #include <OBFunctionTerm>
 
 namespace OpenBabel {
   namespace OBFFs {
 
+    class OBParameterDBTable;
+    class OBFFType;
+
+    /**
+     * Lennard-Jones 6-12 interaction between all non-bonded pairs. The 1-4
+     * interactions are scaled by @p factorOneFour.
+     *
+     * Molecules with at most MaxDenseAtoms atoms are computed from dense
+     * rows instead of the pair arrays: the coordinates are copied to the
+     * stack and each atom has a bit mask of enabled (and 1-4) partners, so
+     * the inner loop has no indirection and can be vectorized.
+     */
     class LJ6_12 : public OBFunctionTerm
     {
     public:
       enum MixingRule {geometric, arithmetic, sixthpower};
+      //! Largest molecule for the dense path (bits in a row mask).
+      static const unsigned int MaxDenseAtoms = 64;
 
       struct Index
       {
@@ -23,19 +40,44 @@ namespace OpenBabel {
       bool Setup();
       void Compute(OBFunction::Computation computation = OBFunction::Value);
       double GetValue() const { return m_value; }
-    protected:
+      double GetLowerBound() const { return m_lowerBound; }
+      bool IsClashSensitive() const { return true; }
+      bool ComputeBounded(double offset, double maxValue);
+
       template <MixingRule rule>
       static void Mix(double & sigma, double & epsilon, const double & sigma_1,  const double & epsilon_1,  const double & sigma_2,  const double & epsilon_2);
     private:
+      template <class Decomposition>
+      void compute(OBFunction::Computation computation, Decomposition &decomposition);
+      template <bool gradients, class Decomposition>
+      double computeDense(Decomposition &decomposition);
+      void setupDense(OBParameterDBTable *pTable, OBFFType *pOBFFType);
+
       static const std::string m_name;
       const std::string m_tableName;
+      const MixingRule m_rule;
       unsigned int m_numPairs;
       Parameter *  m_calcs;
       Index * m_i;
       double m_value;
       void (*m_Mix)(double &, double &, const double &,  const double &,  const double &,  const double &);
       const double m_factorOneFour;
+      double m_lowerBound;
+      // dense path
+      unsigned int m_numDense; //!< number of atoms, 0 if the pair arrays are used
+      unsigned long long *m_mask; //!< for each atom: bit j set if the pair with atom j > i is computed
+      unsigned long long *m_oneFourMask; //!< for each atom: bit j set if the pair is a scaled 1-4 pair
+      double *m_c6, *m_c12; //!< geometric mixing: sqrt(c6), sqrt(c12) for each atom
+      unsigned int *m_types; //!< other mixing rules: type index for each atom
+      double *m_typeC6, *m_typeC12; //!< other mixing rules: c6, c12 (numTypes x numTypes)
+      unsigned int m_numTypes;
     };
 
+    template<> void LJ6_12::Mix<LJ6_12::geometric>(double & sigma, double & epsilon, const double & sigma_1,  const double & epsilon_1,  const double & sigma_2,  const double & epsilon_2);
+    template<> void LJ6_12::Mix<LJ6_12::arithmetic>(double & sigma, double & epsilon, const double & sigma_1,  const double & epsilon_1,  const double & sigma_2,  const double & epsilon_2);
+    template<> void LJ6_12::Mix<LJ6_12::sixthpower>(double & sigma, double & epsilon, const double & sigma_1,  const double & epsilon_1,  const double & sigma_2,  const double & epsilon_2);
+
   } // OBFFs
 } // OpenBabel
+
+#endif
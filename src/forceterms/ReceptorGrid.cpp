@@ -0,0 +1,287 @@
+/*********************************************************************
+Receptor grid term - rigid receptor interactions from precomputed maps
+
+Copyright (C) 2009 by Frank Peters
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include "ReceptorGrid.h"
+#include <OBFFType>
+#include <OBParameterDB>
+#include <OBChargeMethod>
+#include <OBFunction>
+#include <OBFunctionTerm>
+
+#include <openbabel/mol.h>
+
+#include <OBLogFile>
+#include <OBDecomposition>
+#include <OBVectorMath>
+
+#include <map>
+#include <algorithm>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    const std::string ReceptorGrid::m_name = "Receptor Grid";
+
+    // map values are capped to keep the interpolation well behaved inside the receptor
+    static const double maxMapValue = 1000.0;
+
+    ReceptorGrid::ReceptorGrid(OBFunction *function, const OBBitVec &receptor, const double spacing, const double padding,
+			       const double cutoff, const LJ6_12::MixingRule rule, const double relativePermittivity, const std::string tableName)
+      : OBFunctionTerm(function), m_tableName(tableName), m_receptor(receptor), m_spacing(spacing), m_padding(padding),
+	m_cutoff(cutoff), m_relativePermittivity(relativePermittivity), m_numAtoms(0), m_calcs(NULL), m_i(NULL), m_value(999999.99),
+	m_lowerBound(0.0)
+    {
+      switch (rule)
+	{
+	case LJ6_12::geometric: m_Mix = & LJ6_12::Mix<LJ6_12::geometric>; break;
+	case LJ6_12::arithmetic: m_Mix = & LJ6_12::Mix<LJ6_12::arithmetic>; break;
+	case LJ6_12::sixthpower: m_Mix = & LJ6_12::Mix<LJ6_12::sixthpower>; break;
+	}
+    }
+
+    ReceptorGrid::~ReceptorGrid()
+    {
+    }
+
+    // Trilinear interpolation of a map at pos. dpos is set to the derivative of the
+    // interpolated value with respect to pos. Outside the grid the value is 0.
+    double ReceptorGrid::Interpolate(const std::vector<double> &map, const Eigen::Vector3d &pos, Eigen::Vector3d &dpos) const
+    {
+      const Eigen::Vector3d g = (pos - m_origin) / m_spacing;
+      const int i = int(floor(g.x()));
+      const int j = int(floor(g.y()));
+      const int k = int(floor(g.z()));
+      if ( (i < 0) || (j < 0) || (k < 0) ||
+	   (i >= m_dim.x() - 1) || (j >= m_dim.y() - 1) || (k >= m_dim.z() - 1) ) {
+	dpos = Eigen::Vector3d::Zero();
+	return 0.0;
+      }
+      const double fx = g.x() - i;
+      const double fy = g.y() - j;
+      const double fz = g.z() - k;
+
+      const double c000 = map[GridIndex(i, j, k)];
+      const double c100 = map[GridIndex(i+1, j, k)];
+      const double c010 = map[GridIndex(i, j+1, k)];
+      const double c110 = map[GridIndex(i+1, j+1, k)];
+      const double c001 = map[GridIndex(i, j, k+1)];
+      const double c101 = map[GridIndex(i+1, j, k+1)];
+      const double c011 = map[GridIndex(i, j+1, k+1)];
+      const double c111 = map[GridIndex(i+1, j+1, k+1)];
+
+      const double c00 = c000 + fx * (c100 - c000);
+      const double c10 = c010 + fx * (c110 - c010);
+      const double c01 = c001 + fx * (c101 - c001);
+      const double c11 = c011 + fx * (c111 - c011);
+      const double c0 = c00 + fy * (c10 - c00);
+      const double c1 = c01 + fy * (c11 - c01);
+
+      const double dx0 = (c100 - c000) + fy * ((c110 - c010) - (c100 - c000));
+      const double dx1 = (c101 - c001) + fy * ((c111 - c011) - (c101 - c001));
+      dpos.x() = (dx0 + fz * (dx1 - dx0)) / m_spacing;
+      dpos.y() = ((c10 - c00) + fz * ((c11 - c01) - (c10 - c00))) / m_spacing;
+      dpos.z() = (c1 - c0) / m_spacing;
+
+      return c0 + fz * (c1 - c0);
+    }
+
+    template <class Decomposition>
+    void ReceptorGrid::compute(OBFunction::Computation computation, Decomposition &decomposition)
+    {
+      m_value = 0.0;
+      unsigned int ia;
+      double e;
+      Eigen::Vector3d dlj, delec;
+
+      for (unsigned int i = 0; i < m_numAtoms; ++i) {
+	ia = m_i[i].iA;
+	const Eigen::Vector3d &pos = m_function->GetInternalPositions()[ia];
+	e = Interpolate(m_ljMaps[m_calcs[i].map], pos, dlj);
+	e += m_calcs[i].q * Interpolate(m_elecMap, pos, delec);
+	if (computation == OBFunction::Gradients)
+	  m_function->GetInternalGradients()[ia] -= dlj + m_calcs[i].q * delec;
+	decomposition.Add(ia, e);
+	m_value += e;
+      }
+    }
+
+    void ReceptorGrid::Compute(OBFunction::Computation computation)
+    {
+      if (OBDecomposition *decomposition = m_function->GetDecomposition())
+	compute(computation, *decomposition);
+      else {
+	OBNoDecomposition none;
+	compute(computation, none);
+      }
+    }
+
+    bool ReceptorGrid::Setup()
+    {
+      OBParameterDBTable * pTable = ((m_function->GetParameterDB())->GetTable(m_tableName));
+      OBFFType * pOBFFType(m_function->GetOBFFType());
+      OBChargeMethod * pOBChargeMethod(m_function->GetOBChargeMethod());
+
+      m_numAtoms = 0;
+      if ( (pTable==NULL) || (pOBFFType==NULL) || (pOBChargeMethod==NULL) )
+	return false;
+
+      const vector<OBFFType::AtomIdentifier> & atoms(pOBFFType->GetAtoms());
+      const vector<double> & partialCharge(pOBChargeMethod->GetPartialCharges());
+      const vector<Eigen::Vector3d> & positions(m_function->GetInternalPositions());
+      const double factor = 332.0716 / m_relativePermittivity; // energy scale: kcal/mol
+      vector<OBParameterDBTable::Query> query;
+      vector<OBVariant> row;
+      map<string,unsigned int> ligandTypes;
+      map<string,unsigned int>::iterator itr;
+      vector<double> typeSigma, typeEpsilon;
+      vector<unsigned int> receptorAtoms;
+      vector<double> receptorSigma, receptorEpsilon, receptorCharge;
+      Parameter parameter;
+      Eigen::Vector3d lmin, lmax;
+
+      // the ligand atoms, the arrays are allocated from the arena
+      for (unsigned int j = 0; j != atoms.size(); ++j)
+	if (!m_receptor.BitIsOn(j))
+	  ++m_numAtoms;
+      m_i = m_function->GetArena().Allocate<Index>(m_numAtoms);
+      m_calcs = m_function->GetArena().Allocate<Parameter>(m_numAtoms);
+
+      unsigned int n = 0;
+      for (unsigned int j = 0; j != atoms.size(); ++j) {
+	query.clear();
+	query.push_back( OBParameterDBTable::Query(0, OBVariant(atoms[j])));
+	if (m_receptor.BitIsOn(j)) {
+	  row = pTable->FindRow(query);
+	  receptorAtoms.push_back(m_function->InternalIndex(j));
+	  receptorCharge.push_back(partialCharge[j]);
+	  receptorSigma.push_back(row.at(1).AsDouble());
+	  receptorEpsilon.push_back(row.at(2).AsDouble());
+	  continue;
+	}
+
+	itr = ligandTypes.find(atoms[j]);
+	if (itr == ligandTypes.end()) {
+	  row = pTable->FindRow(query);
+	  parameter.map = typeSigma.size();
+	  typeSigma.push_back(row.at(1).AsDouble());
+	  typeEpsilon.push_back(row.at(2).AsDouble());
+	  ligandTypes.insert(pair<string,unsigned int>(atoms[j], parameter.map));
+	} else
+	  parameter.map = itr->second;
+	parameter.q = partialCharge[j];
+	const unsigned int ia = m_function->InternalIndex(j);
+
+	if (!n)
+	  lmin = lmax = positions[ia];
+	for (int c = 0; c < 3; ++c) {
+	  if (positions[ia][c] < lmin[c])
+	    lmin[c] = positions[ia][c];
+	  if (positions[ia][c] > lmax[c])
+	    lmax[c] = positions[ia][c];
+	}
+	m_i[n].iA = ia;
+	m_calcs[n] = parameter;
+	++n;
+      }
+      m_ljMaps.clear();
+      m_elecMap.clear();
+      m_lowerBound = 0.0;
+      if (!m_numAtoms)
+	return true;
+
+      // grid dimensions
+      m_origin = lmin - Eigen::Vector3d(m_padding, m_padding, m_padding);
+      for (int c = 0; c < 3; ++c)
+	m_dim[c] = int(ceil( (lmax[c] - lmin[c] + 2.0 * m_padding) / m_spacing )) + 1;
+      const unsigned int numPoints = m_dim.x() * m_dim.y() * m_dim.z();
+
+      // bin the receptor atoms in cells with edge length m_cutoff, atoms outside
+      // the grid extended by m_cutoff can not contribute
+      const Eigen::Vector3d cellOrigin = m_origin - Eigen::Vector3d(m_cutoff, m_cutoff, m_cutoff);
+      Eigen::Vector3i cellDim;
+      for (int c = 0; c < 3; ++c)
+	cellDim[c] = int(ceil( ((m_dim[c] - 1) * m_spacing + 2.0 * m_cutoff) / m_cutoff ));
+      vector< vector<unsigned int> > cells(cellDim.x() * cellDim.y() * cellDim.z());
+      for (unsigned int r = 0; r < receptorAtoms.size(); ++r) {
+	const Eigen::Vector3d g = (positions[receptorAtoms[r]] - cellOrigin) / m_cutoff;
+	const int ci = int(floor(g.x())), cj = int(floor(g.y())), ck = int(floor(g.z()));
+	if ( (ci < 0) || (cj < 0) || (ck < 0) || (ci >= cellDim.x()) || (cj >= cellDim.y()) || (ck >= cellDim.z()) )
+	  continue;
+	cells[ci + cellDim.x() * (cj + cellDim.y() * ck)].push_back(r);
+      }
+
+      // mixed parameters for each ligand type with each receptor atom
+      const unsigned int numTypes = typeSigma.size();
+      const unsigned int numReceptor = receptorAtoms.size();
+      vector<double> mixedSigma(numTypes * numReceptor), mixedEpsilon(numTypes * numReceptor);
+      for (unsigned int t = 0; t < numTypes; ++t)
+	for (unsigned int r = 0; r < numReceptor; ++r)
+	  (*m_Mix)(mixedSigma[t * numReceptor + r], mixedEpsilon[t * numReceptor + r],
+		   typeSigma[t], typeEpsilon[t], receptorSigma[r], receptorEpsilon[r]);
+
+      m_ljMaps.resize(numTypes, vector<double>(numPoints, 0.0));
+      m_elecMap.resize(numPoints, 0.0);
+      const double cutoff2 = m_cutoff * m_cutoff;
+      double r2, term, term6;
+      for (int gk = 0; gk < m_dim.z(); ++gk)
+	for (int gj = 0; gj < m_dim.y(); ++gj)
+	  for (int gi = 0; gi < m_dim.x(); ++gi) {
+	    const unsigned int point = GridIndex(gi, gj, gk);
+	    const Eigen::Vector3d pos = m_origin + m_spacing * Eigen::Vector3d(double(gi), double(gj), double(gk));
+	    const Eigen::Vector3d g = (pos - cellOrigin) / m_cutoff;
+	    const int ci = int(floor(g.x())), cj = int(floor(g.y())), ck = int(floor(g.z()));
+	    for (int k = max(ck - 1, 0); k <= min(ck + 1, cellDim.z() - 1); ++k)
+	      for (int j = max(cj - 1, 0); j <= min(cj + 1, cellDim.y() - 1); ++j)
+		for (int l = max(ci - 1, 0); l <= min(ci + 1, cellDim.x() - 1); ++l) {
+		  const vector<unsigned int> &cell = cells[l + cellDim.x() * (j + cellDim.y() * k)];
+		  for (vector<unsigned int>::const_iterator r = cell.begin(); r != cell.end(); ++r) {
+		    r2 = (positions[receptorAtoms[*r]] - pos).squaredNorm();
+		    if (r2 > cutoff2)
+		      continue;
+		    if (r2 < 0.25) // grid point (almost) on top of a receptor atom
+		      r2 = 0.25;
+		    m_elecMap[point] += factor * receptorCharge[*r] / sqrt(r2);
+		    for (unsigned int t = 0; t < numTypes; ++t) {
+		      term = mixedSigma[t * numReceptor + *r] * mixedSigma[t * numReceptor + *r] / r2;
+		      term6 = term * term * term;
+		      m_ljMaps[t][point] += 4.0 * mixedEpsilon[t * numReceptor + *r] * (term6 * term6 - term6);
+		    }
+		  }
+		}
+	    for (unsigned int t = 0; t < numTypes; ++t)
+	      if (m_ljMaps[t][point] > maxMapValue)
+		m_ljMaps[t][point] = maxMapValue;
+	  }
+
+      // interpolated values are within the range of the map values, outside the
+      // grid the value is 0
+      vector<double> ljMin(numTypes, 0.0);
+      for (unsigned int t = 0; t < numTypes; ++t)
+	ljMin[t] = min(0.0, *min_element(m_ljMaps[t].begin(), m_ljMaps[t].end()));
+      const double elecMin = min(0.0, *min_element(m_elecMap.begin(), m_elecMap.end()));
+      const double elecMax = max(0.0, *max_element(m_elecMap.begin(), m_elecMap.end()));
+      for (unsigned int j = 0; j < m_numAtoms; ++j)
+	m_lowerBound += ljMin[m_calcs[j].map] + min(m_calcs[j].q * elecMin, m_calcs[j].q * elecMax);
+
+      return true;
+    }
+  }
+} // end namespace OpenBabel
+
@@ -0,0 +1,91 @@
+#ifndef OBFFS_RECEPTORGRID_H
+#define OBFFS_RECEPTORGRID_H
+
+#include <OBFunction>
+#include <OBFunctionTerm>
+
+#include <openbabel/bitvec.h>
+
+#include "LJ6_12.h"
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /**
+     * Lennard-Jones and electrostatic interaction between a rigid receptor and the
+     * remaining (ligand) atoms, evaluated from precomputed 3D potential maps.
+     *
+     * Setup() computes one LJ map per distinct ligand atom type and one electrostatic
+     * potential map from the receptor atom types and charges. Compute() then only
+     * interpolates (trilinear) the maps at the ligand atom positions, which makes the
+     * cost per step independent of the receptor size. The receptor atoms should not
+     * move after Setup() and receive no gradients.
+     *
+     * The grid covers the bounding box of the ligand atoms at Setup() plus @p padding.
+     * Ligand atoms outside the grid do not interact with the receptor.
+     *
+     * The other terms should not compute the receptor-receptor and receptor-ligand
+     * interactions again, use the interaction groups for this:
+     * @code
+     * function->AddIntraGroup(ligand);
+     * function->AddInterGroup(ligand);
+     * @endcode
+     */
+    class ReceptorGrid : public OBFunctionTerm
+    {
+    public:
+      struct Index
+      {
+	unsigned int iA;
+      };
+      struct Parameter
+      {
+	double q;
+	unsigned int map;
+      };
+      /**
+       * @param receptor Bit i is set when atom i (0...N-1) belongs to the rigid receptor.
+       * @param spacing The distance between grid points.
+       * @param padding The distance the grid extends beyond the ligand atoms.
+       * @param cutoff Receptor atoms further than @p cutoff from a grid point are ignored.
+       */
+      ReceptorGrid(OBFunction *function, const OBBitVec &receptor, const double spacing = 0.375,
+		   const double padding = 6.0, const double cutoff = 12.0, const LJ6_12::MixingRule rule = LJ6_12::geometric,
+		   const double relativePermittivity = 1.0, const std::string tableName="LJ6_12");
+      ~ReceptorGrid();
+      std::string GetName() const { return m_name; }
+      bool Setup();
+      void Compute(OBFunction::Computation computation = OBFunction::Value);
+      double GetValue() const { return m_value; }
+      double GetLowerBound() const { return m_lowerBound; }
+      bool IsClashSensitive() const { return true; }
+    private:
+      template <class Decomposition>
+      void compute(OBFunction::Computation computation, Decomposition &decomposition);
+      double Interpolate(const std::vector<double> &map, const Eigen::Vector3d &pos, Eigen::Vector3d &dpos) const;
+      inline unsigned int GridIndex(int i, int j, int k) const
+      {
+	return i + m_dim.x() * (j + m_dim.y() * k);
+      }
+
+      static const std::string m_name;
+      const std::string m_tableName;
+      OBBitVec m_receptor;
+      const double m_spacing, m_padding, m_cutoff;
+      const double m_relativePermittivity;
+      void (*m_Mix)(double &, double &, const double &,  const double &,  const double &,  const double &);
+      unsigned int m_numAtoms;
+      Parameter *  m_calcs;
+      Index * m_i;
+      double m_value;
+      Eigen::Vector3d m_origin;
+      Eigen::Vector3i m_dim;
+      std::vector< std::vector<double> > m_ljMaps;
+      std::vector<double> m_elecMap;
+      double m_lowerBound;
+    };
+
+  } // OBFFs
+} // OpenBabel
+
+#endif
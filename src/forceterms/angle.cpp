@@ -25,8 +25,11 @@ GNU General Public License for more details.
 #include <openbabel/mol.h>
 
 #include <OBLogFile>
+#include <OBDecomposition>
 #include <OBVectorMath>
 
+#include <limits>
+
 using namespace std;
 
 namespace OpenBabel {
@@ -36,17 +39,13 @@ namespace OpenBabel {
 
     AngleHarmonic::AngleHarmonic(OBFunction *function, std::string tableName)
       : OBFunctionTerm(function), m_tableName(tableName), m_i(0), m_calcs(0),
-      m_value(999999.99) 
+      m_value(999999.99), m_lowerBound(0.0)
     {
     }
 
 
     AngleHarmonic::~AngleHarmonic()
     {
-      if (m_i)
-        delete [] m_i;
-      if (m_calcs)
-        delete [] m_calcs;
     }
 
     // Conventions taken from Lammps potentials
@@ -55,48 +54,63 @@ namespace OpenBabel {
     // K (energy/angle^2)
     // theta0 (angle)
 
-    void AngleHarmonic::Compute(OBFunction::Computation computation)
+    template <class Decomposition>
+    void AngleHarmonic::compute(OBFunction::Computation computation, Decomposition &decomposition)
     {
-      m_value = 0.0;
-      double theta, delta, delta2, e;
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      const int numAngles = m_numAngles;
+      double energy = 0.0;
 	
       if (computation == OBFunction::Gradients) {
-	size_t ia, ib, ic;
-	Eigen::Vector3d Fa, Fb, Fc;
-	double dE;
-	for (unsigned int i = 0; i < m_numAngles; ++i) {
-	  ia = m_i[i].iA;
-	  ib = m_i[i].iB;
-	  ic = m_i[i].iC;
-	  theta = VectorAngleDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], m_function->GetPositions()[ic], Fa, Fb, Fc); 
-	  delta = DEG_TO_RAD * (theta - m_calcs[i].theta0);
-	  if (!isfinite(theta))
-	    theta = 0.0;
-	  dE = 2.0 * m_calcs[i].K * delta;
-	  Fa *= dE;
-	  Fb *= dE;
-	  Fc *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
-	  m_function->GetGradients()[ic] += Fc;
-	  delta2 = delta * delta;
-	  e = m_calcs[i].K * delta2;
-	  m_value += e;
+	std::vector<Eigen::Vector3d> &gradients = m_function->GetInternalGradients();
+	// angles with the same color share no atoms and can be computed in parallel
+	for (unsigned int c = 0; c + 1 < m_colorOffsets.size(); ++c) {
+	  const int begin = m_colorOffsets[c], end = m_colorOffsets[c + 1];
+#pragma omp parallel for reduction(+:energy) if (!Decomposition::Enabled && end - begin > ParallelThreshold) num_threads(m_function->GetNumThreads())
+	  for (int i = begin; i < end; ++i) {
+	    const unsigned int ia = m_i[i].iA;
+	    const unsigned int ib = m_i[i].iB;
+	    const unsigned int ic = m_i[i].iC;
+	    Eigen::Vector3d Fa, Fb, Fc;
+	    double theta = VectorAngleDerivative(positions[ia], positions[ib], positions[ic], Fa, Fb, Fc); 
+	    const double delta = DEG_TO_RAD * (theta - m_calcs[i].theta0);
+	    if (!isfinite(theta))
+	      theta = 0.0;
+	    const double dE = 2.0 * m_calcs[i].K * delta;
+	    gradients[ia] += Fa * dE;
+	    gradients[ib] += Fb * dE;
+	    gradients[ic] += Fc * dE;
+	    const double e = m_calcs[i].K * delta * delta;
+	    decomposition.Add(ia, ib, ic, e);
+	    energy += e;
+	  }
 	}
       } else {
-	Eigen::Vector3d ab, bc;
-	for (unsigned int i = 0; i < m_numAngles; ++i) {
-	  ab = m_function->GetPositions()[m_i[i].iA] - m_function->GetPositions()[m_i[i].iB];
-	  bc = m_function->GetPositions()[m_i[i].iC] - m_function->GetPositions()[m_i[i].iB];
-	  theta = VectorAngle(ab, bc);
+#pragma omp parallel for reduction(+:energy) if (!Decomposition::Enabled && numAngles > ParallelThreshold) num_threads(m_function->GetNumThreads())
+	for (int i = 0; i < numAngles; ++i) {
+	  const Eigen::Vector3d ab = positions[m_i[i].iA] - positions[m_i[i].iB];
+	  const Eigen::Vector3d bc = positions[m_i[i].iC] - positions[m_i[i].iB];
+	  double theta = VectorAngle(ab, bc);
 	  if (!isfinite(theta))
 	    theta = 0.0;
-	  delta = DEG_TO_RAD * (theta - m_calcs[i].theta0);
-	  delta2 = delta * delta;
-	  e = m_calcs[i].K * delta2;
-	  m_value += e;
+	  const double delta = DEG_TO_RAD * (theta - m_calcs[i].theta0);
+	  const double e = m_calcs[i].K * delta * delta;
+	  decomposition.Add(m_i[i].iA, m_i[i].iB, m_i[i].iC, e);
+	  energy += e;
 	}
       }
+
+      m_value = energy;
+    }
+
+    void AngleHarmonic::Compute(OBFunction::Computation computation)
+    {
+      if (OBDecomposition *decomposition = m_function->GetDecomposition())
+	compute(computation, *decomposition);
+      else {
+	OBNoDecomposition none;
+	compute(computation, none);
+      }
     }
   
     bool AngleHarmonic::Setup()
@@ -111,15 +125,23 @@ namespace OpenBabel {
       map<string,Parameter> parameters;
       map<string,Parameter>::iterator itr;
 
+      m_numAngles = 0;
       if ( (pTable==NULL) || (pOBFFType==NULL) )
 	return false;
+
+      // only keep the interactions enabled by the interaction groups, rigid
+      // angles (e.g. in SETTLE waters) are not evaluated
+      if (m_function->HasGroups() || m_function->GetConstraints()) {
+	vector<OBFFType::AngleIdentifier> selected;
+	for(unsigned int i=0;i != angles.size();++i)
+	  if (m_function->IsIntraGroup(angles[i].iA, angles[i].iB, angles[i].iC) &&
+	      !m_function->IsConstrained(angles[i].iA, angles[i].iB, angles[i].iC))
+	    selected.push_back(angles[i]);
+	angles.swap(selected);
+      }
       m_numAngles=angles.size();
-      if (m_i)
-        delete [] m_i;
-      if (m_calcs)
-        delete [] m_calcs;
-      m_i = new Index [m_numAngles];
-      m_calcs = new Parameter [m_numAngles];
+      m_i = m_function->GetArena().Allocate<Index>(m_numAngles);
+      m_calcs = m_function->GetArena().Allocate<Parameter>(m_numAngles);
       for(unsigned int i=0;i != m_numAngles;++i){
 	itr=parameters.find(angles[i].name);
 	if (itr==parameters.end()){
@@ -133,11 +155,29 @@ namespace OpenBabel {
 	else {
 	  parameter=itr->second;
 	}
-	m_i[i].iA = angles[i].iA;
-	m_i[i].iB  = angles[i].iB;
-	m_i[i].iC  = angles[i].iC;
+	m_i[i].iA = m_function->InternalIndex(angles[i].iA);
+	m_i[i].iB  = m_function->InternalIndex(angles[i].iB);
+	m_i[i].iC  = m_function->InternalIndex(angles[i].iC);
 	m_calcs[i] = parameter;
       }
+
+      // E >= 0 if all K >= 0
+      m_lowerBound = 0.0;
+      for (unsigned int i = 0; i < m_numAngles; ++i)
+	if (m_calcs[i].K < 0.0)
+	  m_lowerBound = -numeric_limits<double>::infinity();
+
+      // sort the angles by color for the parallel gradient computation
+      vector<unsigned int> atoms, order;
+      atoms.reserve(3 * m_numAngles);
+      for (unsigned int i = 0; i < m_numAngles; ++i) {
+	atoms.push_back(m_i[i].iA);
+	atoms.push_back(m_i[i].iB);
+	atoms.push_back(m_i[i].iC);
+      }
+      ColorInteractions(atoms, 3, order, m_colorOffsets);
+      Permute(m_i, order);
+      Permute(m_calcs, order);
       return true;
     }
   }
@@ -25,9 +25,11 @@ GNU General Public License for more details.
 #include <openbabel/mol.h>
 
 #include <OBLogFile>
+#include <OBDecomposition>
 #include <OBVectorMath>
 
 #include <map>
+#include <limits>
 
 using namespace std;
 
@@ -37,12 +39,11 @@ namespace OpenBabel {
     const std::string BondHarmonic::m_name = "Bond Harmonic";
 
     BondHarmonic::BondHarmonic(OBFunction *function, std::string tableName)
-      : OBFunctionTerm(function), m_tableName(tableName), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numBonds(0) {}
+      : OBFunctionTerm(function), m_tableName(tableName), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numBonds(0),
+      m_lowerBound(0.0) {}
 
     BondHarmonic::~BondHarmonic() 
     {
-      delete [] m_i;
-      delete [] m_calcs;
     }
 
 
@@ -52,42 +53,56 @@ namespace OpenBabel {
     // K (energy/distance^2)
     // r0 (distance)
 
-    void BondHarmonic::Compute(OBFunction::Computation computation)
+    template <class Decomposition>
+    void BondHarmonic::compute(OBFunction::Computation computation, Decomposition &decomposition)
     {
-      m_value = 0.0;
-      unsigned int ia, ib;
-      double rab, delta, delta2, e;
-      Eigen::Vector3d Fa, Fb;
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      const int numBonds = m_numBonds;
+      double energy = 0.0;
 
       if (computation == OBFunction::Gradients) {
-	double dE;
-	for (unsigned int i = 0; i < m_numBonds; ++i) {
-	  ia = m_i[i].iA;
-	  ib = m_i[i].iB;
-	  rab = VectorBondDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], Fa, Fb);
-	  delta = rab - m_calcs[i].r0;
-	  delta2 = delta * delta;
-	  dE = 2.0 * m_calcs[i].K * delta;
-	  Fa *= dE;
-	  Fb *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
-	  e = m_calcs[i].K * delta2;
-	  m_value += e;
+	std::vector<Eigen::Vector3d> &gradients = m_function->GetInternalGradients();
+	// bonds with the same color share no atoms and can be computed in parallel
+	for (unsigned int c = 0; c + 1 < m_colorOffsets.size(); ++c) {
+	  const int begin = m_colorOffsets[c], end = m_colorOffsets[c + 1];
+#pragma omp parallel for reduction(+:energy) if (!Decomposition::Enabled && end - begin > ParallelThreshold) num_threads(m_function->GetNumThreads())
+	  for (int i = begin; i < end; ++i) {
+	    const unsigned int ia = m_i[i].iA;
+	    const unsigned int ib = m_i[i].iB;
+	    Eigen::Vector3d Fa, Fb;
+	    const double rab = VectorBondDerivative(positions[ia], positions[ib], Fa, Fb);
+	    const double delta = rab - m_calcs[i].r0;
+	    const double dE = 2.0 * m_calcs[i].K * delta;
+	    gradients[ia] += Fa * dE;
+	    gradients[ib] += Fb * dE;
+	    const double e = m_calcs[i].K * delta * delta;
+	    decomposition.Add(ia, ib, e);
+	    energy += e;
+	  }
 	}
       }      
       else {
-	for (unsigned int i = 0; i < m_numBonds; ++i) {
-	  ia = m_i[i].iA;
-	  ib = m_i[i].iB;
-	  const Eigen::Vector3d ab = m_function->GetPositions()[ia] - m_function->GetPositions()[ib];
-	  rab = ab.norm();
-	  delta = rab - m_calcs[i].r0;
-	  delta2 = delta * delta;
-	  e = m_calcs[i].K * delta2;
-	  m_value += e;      
+#pragma omp parallel for reduction(+:energy) if (!Decomposition::Enabled && numBonds > ParallelThreshold) num_threads(m_function->GetNumThreads())
+	for (int i = 0; i < numBonds; ++i) {
+	  const double rab = (positions[m_i[i].iA] - positions[m_i[i].iB]).norm();
+	  const double delta = rab - m_calcs[i].r0;
+	  const double e = m_calcs[i].K * delta * delta;
+	  decomposition.Add(m_i[i].iA, m_i[i].iB, e);
+	  energy += e;
 	}
       }
+
+      m_value = energy;
+    }
+
+    void BondHarmonic::Compute(OBFunction::Computation computation)
+    {
+      if (OBDecomposition *decomposition = m_function->GetDecomposition())
+	compute(computation, *decomposition);
+      else {
+	OBNoDecomposition none;
+	compute(computation, none);
+      }
     }
   
     bool BondHarmonic::Setup()
@@ -102,13 +117,22 @@ namespace OpenBabel {
       map<string,Parameter> parameters;
       map<string,Parameter>::iterator itr;
 
+      m_numBonds = 0;
       if ( (pTable==NULL) || (pOBFFType==NULL) )
 	return false;
+
+      // only keep the interactions enabled by the interaction groups, constrained
+      // bonds are not evaluated
+      if (m_function->HasGroups() || m_function->GetConstraints()) {
+	vector<OBFFType::BondIdentifier> selected;
+	for(unsigned int i=0;i != bonds.size();++i)
+	  if (m_function->IsIntraGroup(bonds[i].iA, bonds[i].iB) && !m_function->IsConstrained(bonds[i].iA, bonds[i].iB))
+	    selected.push_back(bonds[i]);
+	bonds.swap(selected);
+      }
       m_numBonds=bonds.size();
-      delete [] m_i;
-      delete [] m_calcs;
-      m_i = new Index [m_numBonds];
-      m_calcs = new Parameter [m_numBonds];
+      m_i = m_function->GetArena().Allocate<Index>(m_numBonds);
+      m_calcs = m_function->GetArena().Allocate<Parameter>(m_numBonds);
       for(unsigned int i=0;i != m_numBonds;++i){
 	itr=parameters.find(bonds[i].name);
 	if (itr==parameters.end()){
@@ -122,10 +146,27 @@ namespace OpenBabel {
 	else {
 	  parameter=itr->second;
 	}
-	m_i[i].iA = bonds[i].iA;
-	m_i[i].iB  = bonds[i].iB;
+	m_i[i].iA = m_function->InternalIndex(bonds[i].iA);
+	m_i[i].iB  = m_function->InternalIndex(bonds[i].iB);
 	m_calcs[i] = parameter;
       }
+
+      // E >= 0 if all K >= 0
+      m_lowerBound = 0.0;
+      for (unsigned int i = 0; i < m_numBonds; ++i)
+	if (m_calcs[i].K < 0.0)
+	  m_lowerBound = -numeric_limits<double>::infinity();
+
+      // sort the bonds by color for the parallel gradient computation
+      vector<unsigned int> atoms, order;
+      atoms.reserve(2 * m_numBonds);
+      for (unsigned int i = 0; i < m_numBonds; ++i) {
+	atoms.push_back(m_i[i].iA);
+	atoms.push_back(m_i[i].iB);
+      }
+      ColorInteractions(atoms, 2, order, m_colorOffsets);
+      Permute(m_i, order);
+      Permute(m_calcs, order);
       return true;
     }
 
@@ -137,8 +178,6 @@ namespace OpenBabel {
 
     BondClass2::~BondClass2() 
     {
-      delete [] m_i;
-      delete [] m_calcs;
     }
 
     // Conventions taken from Lammps potentials
@@ -147,40 +186,57 @@ namespace OpenBabel {
     // K (energy/distance^2)
     // r0 (distance)
 
-    void BondClass2::Compute(OBFunction::Computation computation)
+    template <class Decomposition>
+    void BondClass2::compute(OBFunction::Computation computation, Decomposition &decomposition)
     {
-      m_value = 0.0;
-      unsigned int ia, ib;
-      double rab, delta, delta2, e, dE;
-      Eigen::Vector3d Fa, Fb;
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      const int numBonds = m_numBonds;
+      double energy = 0.0;
 
       if (computation == OBFunction::Gradients) {
-	for (unsigned int i = 0; i < m_numBonds; ++i) {
-	  ia = m_i[i].iA;
-	  ib = m_i[i].iB;
-	  rab = VectorBondDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], Fa, Fb);
-	  delta = rab - m_calcs[i].r0;
-	  delta2 = delta * delta;
-	  dE = delta * (2.0 * m_calcs[i].K2 + 3.0 * m_calcs[i].K3 * delta + 4.0 * m_calcs[i].K4 * delta2);
-	  Fa *= dE;
-	  Fb *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
-	  e = delta2 * (m_calcs[i].K2 + m_calcs[i].K3 * delta + m_calcs[i].K4 * delta2);
-	  m_value += e;
-	}      
+	std::vector<Eigen::Vector3d> &gradients = m_function->GetInternalGradients();
+	// bonds with the same color share no atoms and can be computed in parallel
+	for (unsigned int c = 0; c + 1 < m_colorOffsets.size(); ++c) {
+	  const int begin = m_colorOffsets[c], end = m_colorOffsets[c + 1];
+#pragma omp parallel for reduction(+:energy) if (!Decomposition::Enabled && end - begin > ParallelThreshold) num_threads(m_function->GetNumThreads())
+	  for (int i = begin; i < end; ++i) {
+	    const unsigned int ia = m_i[i].iA;
+	    const unsigned int ib = m_i[i].iB;
+	    Eigen::Vector3d Fa, Fb;
+	    const double rab = VectorBondDerivative(positions[ia], positions[ib], Fa, Fb);
+	    const double delta = rab - m_calcs[i].r0;
+	    const double delta2 = delta * delta;
+	    const double dE = delta * (2.0 * m_calcs[i].K2 + 3.0 * m_calcs[i].K3 * delta + 4.0 * m_calcs[i].K4 * delta2);
+	    gradients[ia] += Fa * dE;
+	    gradients[ib] += Fb * dE;
+	    const double e = delta2 * (m_calcs[i].K2 + m_calcs[i].K3 * delta + m_calcs[i].K4 * delta2);
+	    decomposition.Add(ia, ib, e);
+	    energy += e;
+	  }
+	}
       } else {
-	for (unsigned int i = 0; i < m_numBonds; ++i) {
-	  ia = m_i[i].iA;
-	  ib = m_i[i].iB;
-	  const Eigen::Vector3d ab = m_function->GetPositions()[ia] - m_function->GetPositions()[ib];
-	  rab = ab.norm();
-	  delta = rab - m_calcs[i].r0;
-	  delta2 = delta * delta;
-	  e = delta2 * (m_calcs[i].K2 + m_calcs[i].K3 * delta + m_calcs[i].K4 * delta2);
-	  m_value += e;      
+#pragma omp parallel for reduction(+:energy) if (!Decomposition::Enabled && numBonds > ParallelThreshold) num_threads(m_function->GetNumThreads())
+	for (int i = 0; i < numBonds; ++i) {
+	  const double rab = (positions[m_i[i].iA] - positions[m_i[i].iB]).norm();
+	  const double delta = rab - m_calcs[i].r0;
+	  const double delta2 = delta * delta;
+	  const double e = delta2 * (m_calcs[i].K2 + m_calcs[i].K3 * delta + m_calcs[i].K4 * delta2);
+	  decomposition.Add(m_i[i].iA, m_i[i].iB, e);
+	  energy += e;
 	}
       }
+
+      m_value = energy;
+    }
+
+    void BondClass2::Compute(OBFunction::Computation computation)
+    {
+      if (OBDecomposition *decomposition = m_function->GetDecomposition())
+	compute(computation, *decomposition);
+      else {
+	OBNoDecomposition none;
+	compute(computation, none);
+      }
     }
   
     bool BondClass2::Setup()
@@ -195,13 +251,22 @@ namespace OpenBabel {
       map<string,Parameter> parameters;
       map<string,Parameter>::iterator itr;
 
+      m_numBonds = 0;
       if ( (pTable==NULL) || (pOBFFType==NULL) )
 	return false;
+
+      // only keep the interactions enabled by the interaction groups, constrained
+      // bonds are not evaluated
+      if (m_function->HasGroups() || m_function->GetConstraints()) {
+	vector<OBFFType::BondIdentifier> selected;
+	for(unsigned int i=0;i != bonds.size();++i)
+	  if (m_function->IsIntraGroup(bonds[i].iA, bonds[i].iB) && !m_function->IsConstrained(bonds[i].iA, bonds[i].iB))
+	    selected.push_back(bonds[i]);
+	bonds.swap(selected);
+      }
       m_numBonds=bonds.size();
-      delete [] m_i;
-      delete [] m_calcs;
-      m_i = new Index [m_numBonds];
-      m_calcs = new Parameter [m_numBonds];
+      m_i = m_function->GetArena().Allocate<Index>(m_numBonds);
+      m_calcs = m_function->GetArena().Allocate<Parameter>(m_numBonds);
       for(unsigned int i=0;i != m_numBonds;++i){
 	itr=parameters.find(bonds[i].name);
 	if (itr==parameters.end()){
@@ -217,10 +282,21 @@ namespace OpenBabel {
 	else {
 	  parameter=itr->second;
 	}
-	m_i[i].iA = bonds[i].iA;
-	m_i[i].iB  = bonds[i].iB;
+	m_i[i].iA = m_function->InternalIndex(bonds[i].iA);
+	m_i[i].iB  = m_function->InternalIndex(bonds[i].iB);
 	m_calcs[i] = parameter;
       }
+
+      // sort the bonds by color for the parallel gradient computation
+      vector<unsigned int> atoms, order;
+      atoms.reserve(2 * m_numBonds);
+      for (unsigned int i = 0; i < m_numBonds; ++i) {
+	atoms.push_back(m_i[i].iA);
+	atoms.push_back(m_i[i].iB);
+      }
+      ColorInteractions(atoms, 2, order, m_colorOffsets);
+      Permute(m_i, order);
+      Permute(m_calcs, order);
       return true;
     }
  
@@ -25,8 +25,11 @@ GNU General Public License for more details.
 #include <openbabel/mol.h>
 
 #include <OBLogFile>
+#include <OBDecomposition>
 #include <OBVectorMath>
 
+#include <iterator>
+
 using namespace std;
 
 namespace OpenBabel {
@@ -35,13 +38,12 @@ namespace OpenBabel {
     const std::string TorsionHarmonic::m_name = "Torsion Harmonic";
 
     TorsionHarmonic::TorsionHarmonic(OBFunction *function, std::string tableName)
-      : OBFunctionTerm(function), m_tableName(tableName), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numTorsions(0) {}
+      : OBFunctionTerm(function), m_tableName(tableName), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numTorsions(0),
+      m_lowerBound(0.0) {}
 
 
     TorsionHarmonic::~TorsionHarmonic()
     {
-      delete [] m_i;
-      delete [] m_calcs;
     }
 
     // Conventions taken from Lammps potentials
@@ -50,50 +52,66 @@ namespace OpenBabel {
     // K (energy/torsion^2)
     // phi0 (torsion)
 
-    void TorsionHarmonic::Compute(OBFunction::Computation computation)
+    template <class Decomposition>
+    void TorsionHarmonic::compute(OBFunction::Computation computation, Decomposition &decomposition)
     {
-      m_value = 0.0;
-      double phi, delta, delta2, e, cosine;
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      const int numTorsions = m_numTorsions;
+      double energy = 0.0;
 	
       if (computation == OBFunction::Gradients) {
-	size_t ia, ib, ic, id;
-	Eigen::Vector3d Fa, Fb, Fc, Fd;
-	double dE, sine;
-	for (unsigned int i = 0; i < m_numTorsions; ++i) {
-	  ia = m_i[i].iA;
-	  ib = m_i[i].iB;
-	  ic = m_i[i].iC;
-	  id = m_i[i].iD;
-	  phi = VectorTorsionDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], m_function->GetPositions()[ic], m_function->GetPositions()[id], Fa, Fb, Fc, Fd); 
-	  if (!isfinite(phi))
-	    phi = 0.0;
-	  sine = sin(DEG_TO_RAD* m_calcs[i].n * phi);	  
-	  dE = m_calcs[i].K * m_calcs[i].d * m_calcs[i].n * sine;
-	  Fa *= dE;
-	  Fb *= dE;
-	  Fc *= dE;
-	  Fd *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
-	  m_function->GetGradients()[ic] += Fc;
-	  m_function->GetGradients()[id] += Fd;
-
-	  cosine = cos(DEG_TO_RAD * m_calcs[i].n * phi);
-	  e = m_calcs[i].K * (1.0 + m_calcs[i].d * cosine);
-	  m_value += e;
+	std::vector<Eigen::Vector3d> &gradients = m_function->GetInternalGradients();
+	// torsions with the same color share no atoms and can be computed in parallel
+	for (unsigned int c = 0; c + 1 < m_colorOffsets.size(); ++c) {
+	  const int begin = m_colorOffsets[c], end = m_colorOffsets[c + 1];
+#pragma omp parallel for reduction(+:energy) if (!Decomposition::Enabled && end - begin > ParallelThreshold) num_threads(m_function->GetNumThreads())
+	  for (int i = begin; i < end; ++i) {
+	    const unsigned int ia = m_i[i].iA;
+	    const unsigned int ib = m_i[i].iB;
+	    const unsigned int ic = m_i[i].iC;
+	    const unsigned int id = m_i[i].iD;
+	    Eigen::Vector3d Fa, Fb, Fc, Fd;
+	    double phi = VectorTorsionDerivative(positions[ia], positions[ib], positions[ic], positions[id], Fa, Fb, Fc, Fd); 
+	    if (!isfinite(phi))
+	      phi = 0.0;
+	    const double sine = sin(DEG_TO_RAD* m_calcs[i].n * phi);	  
+	    const double dE = m_calcs[i].K * m_calcs[i].d * m_calcs[i].n * sine;
+	    gradients[ia] += Fa * dE;
+	    gradients[ib] += Fb * dE;
+	    gradients[ic] += Fc * dE;
+	    gradients[id] += Fd * dE;
+
+	    const double cosine = cos(DEG_TO_RAD * m_calcs[i].n * phi);
+	    const double e = m_calcs[i].K * (1.0 + m_calcs[i].d * cosine);
+	    decomposition.Add(ia, ib, ic, id, e);
+	    energy += e;
+	  }
 	}
       } else {
-	for (unsigned int i = 0; i < m_numTorsions; ++i) {
-	  phi = VectorTorsion(m_function->GetPositions()[m_i[i].iA], m_function->GetPositions()[m_i[i].iB],
-			    m_function->GetPositions()[m_i[i].iC], m_function->GetPositions()[m_i[i].iD]);
+#pragma omp parallel for reduction(+:energy) if (!Decomposition::Enabled && numTorsions > ParallelThreshold) num_threads(m_function->GetNumThreads())
+	for (int i = 0; i < numTorsions; ++i) {
+	  double phi = VectorTorsion(positions[m_i[i].iA], positions[m_i[i].iB], positions[m_i[i].iC], positions[m_i[i].iD]);
 	  if (!isfinite(phi))
 	    phi = 0.0;
 
-	  cosine = cos(DEG_TO_RAD * m_calcs[i].n * phi);
-	  e = m_calcs[i].K * (1.0 + m_calcs[i].d * cosine);
-	  m_value += e;
+	  const double cosine = cos(DEG_TO_RAD * m_calcs[i].n * phi);
+	  const double e = m_calcs[i].K * (1.0 + m_calcs[i].d * cosine);
+	  decomposition.Add(m_i[i].iA, m_i[i].iB, m_i[i].iC, m_i[i].iD, e);
+	  energy += e;
 	}
       }
+
+      m_value = energy;
+    }
+
+    void TorsionHarmonic::Compute(OBFunction::Computation computation)
+    {
+      if (OBDecomposition *decomposition = m_function->GetDecomposition())
+	compute(computation, *decomposition);
+      else {
+	OBNoDecomposition none;
+	compute(computation, none);
+      }
     }
   
     bool TorsionHarmonic::Setup()
@@ -106,28 +124,29 @@ namespace OpenBabel {
       std::vector< std::vector<OBVariant> > rows;
       std::vector< std::vector<OBVariant> >::const_iterator itr2;
       Index i;
-      std::vector< Index > v_i;
-      std::vector< Parameter > v_calcs;
       Parameter parameter;
       multimap<string,Parameter> parameters;
       multimap<string,Parameter>::const_iterator itr;
       pair< multimap<string,Parameter>::const_iterator , multimap<string,Parameter>::const_iterator > ret;
 
+      m_numTorsions = 0;
       if ( (pTable==NULL) || (pOBFFType==NULL) )
 	return false;
 
+      // only keep the interactions enabled by the interaction groups
+      if (m_function->HasGroups()) {
+	vector<OBFFType::TorsionIdentifier> selected;
+	for(unsigned int i=0;i != torsions.size();++i)
+	  if (m_function->IsIntraGroup(torsions[i].iA, torsions[i].iB, torsions[i].iC, torsions[i].iD))
+	    selected.push_back(torsions[i]);
+	torsions.swap(selected);
+      }
+
       //The torsion potential can be a sum of terms, i.e., more than one entry per dihedral
       //Every term in such a sum will be a separate entry into m_i and m_calcs
-      //Therefore we use multimap, FindRows, and do not know m_numTorsions a priori
-
-      v_i.reserve(torsions.size());
-      v_calcs.reserve(torsions.size());
+      //Therefore we use multimap, FindRows, and count the entries before filling the arrays
       for(unsigned int j=0;j != torsions.size();++j){
 	ret=parameters.equal_range(torsions[j].name);
-	i.iA = torsions[j].iA;
-	i.iB = torsions[j].iB;
-	i.iC = torsions[j].iC;
-	i.iD = torsions[j].iD;
 	if (ret.first==ret.second){
 	  query.clear();
 	  query.push_back( OBParameterDBTable::Query(0, OBVariant(torsions[j].name)));
@@ -137,27 +156,44 @@ namespace OpenBabel {
 	    parameter.d = itr2->at(6).AsDouble();
 	    parameter.n = itr2->at(7).AsDouble();
 	    parameters.insert(pair<string,Parameter>(torsions[j].name,parameter));
-	    v_i.push_back(i);
-	    v_calcs.push_back(parameter);
 	  }
+	  ret=parameters.equal_range(torsions[j].name);
 	}
-	else {
-	  for(itr = ret.first; itr != ret.second; ++itr){
-	    parameter=itr->second;
-	    v_i.push_back(i);
-	    v_calcs.push_back(parameter);
-	  }
+	m_numTorsions += distance(ret.first, ret.second);
+      }
+      m_i = m_function->GetArena().Allocate<Index>(m_numTorsions);
+      m_calcs = m_function->GetArena().Allocate<Parameter>(m_numTorsions);
+      unsigned int n = 0;
+      for(unsigned int j=0;j != torsions.size();++j){
+	ret=parameters.equal_range(torsions[j].name);
+	i.iA = m_function->InternalIndex(torsions[j].iA);
+	i.iB = m_function->InternalIndex(torsions[j].iB);
+	i.iC = m_function->InternalIndex(torsions[j].iC);
+	i.iD = m_function->InternalIndex(torsions[j].iD);
+	for(itr = ret.first; itr != ret.second; ++itr){
+	  m_i[n]=i;
+	  m_calcs[n]=itr->second;
+	  ++n;
 	}
       }
-      m_numTorsions = v_i.size();
-      delete [] m_i;
-      delete [] m_calcs;
-      m_i = new Index [m_numTorsions];
-      m_calcs = new Parameter [m_numTorsions];
-      for (unsigned int i=0; i< m_numTorsions; ++i){
-	m_i[i]=v_i[i];
-	m_calcs[i]=v_calcs[i];
+
+      // E = K (1 + d cos(n phi)) >= K - |K d|
+      m_lowerBound = 0.0;
+      for (unsigned int i = 0; i < m_numTorsions; ++i)
+	m_lowerBound += m_calcs[i].K - fabs(m_calcs[i].K * m_calcs[i].d);
+
+      // sort the torsions by color for the parallel gradient computation
+      vector<unsigned int> atoms, order;
+      atoms.reserve(4 * m_numTorsions);
+      for (unsigned int i = 0; i < m_numTorsions; ++i) {
+	atoms.push_back(m_i[i].iA);
+	atoms.push_back(m_i[i].iB);
+	atoms.push_back(m_i[i].iC);
+	atoms.push_back(m_i[i].iD);
       }
+      ColorInteractions(atoms, 4, order, m_colorOffsets);
+      Permute(m_i, order);
+      Permute(m_calcs, order);
       return true;
     }  
   }
@@ -20,13 +20,19 @@ namespace OpenBabel {
       bool Setup();
       void Compute(OBFunction::Computation computation = OBFunction::Value);
       double GetValue() const { return m_value;}
+      double GetLowerBound() const { return m_lowerBound; }
     private:
+      template <class Decomposition>
+      void compute(OBFunction::Computation computation, Decomposition &decomposition);
+
       static const std::string m_name;
       const std::string m_tableName;
       unsigned int m_numTorsions;
       Parameter *  m_calcs;
       Index * m_i;
       double m_value;
+      std::vector<unsigned int> m_colorOffsets;
+      double m_lowerBound;
     };
     
   } // OBFFs
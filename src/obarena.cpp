@@ -0,0 +1,97 @@
+/*********************************************************************
+  OBArena - Contiguous storage for the function terms
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBArena>
+
+#include <algorithm>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    namespace {
+      //! Size of the first block.
+      const size_t MinBlockSize = 64 * 1024;
+
+      size_t align(size_t bytes)
+      {
+        return (bytes + OBArena::Alignment - 1) & ~(OBArena::Alignment - 1);
+      }
+    }
+
+    const size_t OBArena::Alignment;
+
+    OBArena::OBArena() : m_used(0), m_size(0)
+    {
+    }
+
+    OBArena::~OBArena()
+    {
+      freeBlocks();
+    }
+
+    void OBArena::freeBlocks()
+    {
+      for (unsigned int i = 0; i < m_blocks.size(); ++i)
+        delete [] m_blocks[i].memory;
+      m_blocks.clear();
+    }
+
+    void OBArena::addBlock(size_t size)
+    {
+      Block block;
+      block.size = align(size);
+      block.memory = new char[block.size + Alignment];
+      block.data = block.memory + (Alignment - reinterpret_cast<size_t>(block.memory) % Alignment) % Alignment;
+      m_blocks.push_back(block);
+      m_used = 0;
+    }
+
+    void OBArena::Reset()
+    {
+      // the last Setup() did not fit: use one block large enough for all arrays
+      if (m_blocks.size() > 1) {
+        const size_t size = m_size + m_size / 4;
+        freeBlocks();
+        addBlock(size);
+      }
+      m_used = 0;
+      m_size = 0;
+    }
+
+    void* OBArena::allocate(size_t bytes)
+    {
+      bytes = align(bytes);
+      if (m_blocks.empty() || m_used + bytes > m_blocks.back().size)
+        addBlock(std::max(bytes, std::max(MinBlockSize, m_blocks.empty() ? 0 : 2 * m_blocks.back().size)));
+
+      void *data = m_blocks.back().data + m_used;
+      m_used += bytes;
+      m_size += bytes;
+      return data;
+    }
+
+    size_t OBArena::GetCapacity() const
+    {
+      size_t capacity = 0;
+      for (unsigned int i = 0; i < m_blocks.size(); ++i)
+        capacity += m_blocks[i].size;
+      return capacity;
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
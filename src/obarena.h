@@ -0,0 +1,113 @@
+/*********************************************************************
+  OBArena - Contiguous storage for the function terms
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBARENA_H
+#define OBARENA_H
+
+#include <vector>
+#include <cstddef>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /**
+     * @class OBArena obarena.h <OBArena>
+     * @brief Bump allocator for the interaction arrays of the terms.
+     *
+     * Every OBFunction owns an arena. OBFunction::Setup() calls Reset() before
+     * setting up the terms, the terms then carve their index and parameter
+     * arrays from it with Allocate(). The arrays are contiguous and in the
+     * order in which the terms are computed.
+     *
+     * Reset() keeps the memory: setting up the next molecule of a batch reuses
+     * the same block without calling malloc/free. When a Setup() needs more
+     * than the block, the remaining arrays go to extra blocks and the next
+     * Reset() replaces all blocks by a single block for the total size.
+     *
+     * Only POD types can be allocated, the memory is not initialized and no
+     * destructors are called. Pointers returned by Allocate() are valid until
+     * the next Reset() (i.e. the next OBFunction::Setup()).
+     */
+    class OBArena
+    {
+      public:
+        //! Alignment of every array (cache line).
+        static const size_t Alignment = 64;
+
+        OBArena();
+        ~OBArena();
+        /**
+         * Invalidate all arrays, the memory is kept for the next allocations.
+         */
+        void Reset();
+        /**
+         * @return Uninitialized storage for @p count elements of type @p T or 0
+         * if @p count is 0.
+         */
+        template <typename T>
+        T* Allocate(size_t count)
+        {
+          return count ? static_cast<T*>(allocate(count * sizeof(T))) : 0;
+        }
+        /**
+         * @return The number of bytes allocated since the last Reset() (including
+         * alignment).
+         */
+        size_t GetSize() const
+        {
+          return m_size;
+        }
+        /**
+         * @return The number of bytes in all blocks.
+         */
+        size_t GetCapacity() const;
+        /**
+         * @return The number of blocks, 1 if the arrays of the last Setup() are
+         * in a single block.
+         */
+        unsigned int NumBlocks() const
+        {
+          return m_blocks.size();
+        }
+
+      private:
+        OBArena(const OBArena&);
+        OBArena& operator=(const OBArena&);
+
+        struct Block
+        {
+          char *memory; //!< allocated memory
+          char *data; //!< memory aligned to Alignment
+          size_t size; //!< usable bytes from data
+        };
+
+        void* allocate(size_t bytes);
+        void addBlock(size_t size);
+        void freeBlocks();
+
+        std::vector<Block> m_blocks; //!< allocations go to the last block
+        size_t m_used; //!< bytes used in the last block
+        size_t m_size;
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBArena class
+
+#endif
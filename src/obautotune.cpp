@@ -0,0 +1,231 @@
+/*********************************************************************
+  OBAutoTune - Select the non-bonded evaluation strategy at setup
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBAutoTune>
+#include <OBFunction>
+#include <OBLogFile>
+#include <OBNbrList>
+#include <OBProfiler>
+
+#include <openbabel/mol.h>
+
+#include <QThread>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    namespace {
+      // Cost model, seconds on a ~2 GHz core. The ratios matter more than the
+      // absolute values, close calls are benchmarked.
+      const double AllPairPairTime = 5.0e-9; //!< one all-pairs interaction
+      const double ClusterPairPairTime = 1.0e-9; //!< one atom pair in a cluster pair
+      const double ClusterOverhead = 2.5; //!< atom pairs computed per pair within the cut-off
+      const double ClusterAtomTime = 2.0e-8; //!< per atom: coordinates, forces, list rebuilds
+      const double ClusterFixedTime = 5.0e-6;
+      const double BondedTermTime = 2.0e-8; //!< one bond, angle or torsion
+      const double BondedTermsPerAtom = 6.0;
+      const double CellVisitTime = 1.0e-8; //!< OBNbrList: one cell
+      const double DistanceTime = 3.0e-9; //!< OBNbrList: one distance test
+      //! Work per evaluation below which a single thread is used.
+      const double ParallelTime = 5.0e-5;
+      //! Minimum work per thread.
+      const double ThreadTime = 2.5e-5;
+      //! OBClusterPairList skin
+      const double Skin = 1.0;
+      //! Atoms sampled by CountNeighbors()
+      const unsigned int MaxSamples = 1000;
+      //! No benchmark for larger systems, the all-pairs setup alone is too slow.
+      const unsigned int MaxBenchmarkAtoms = 20000;
+
+      typedef long long CellKey;
+
+      CellKey cellKey(int x, int y, int z, const Eigen::Vector3i &dim)
+      {
+        return x + dim.x() * (CellKey(y) + CellKey(dim.y()) * z);
+      }
+    }
+
+    const double OBAutoTune::Margin = 2.0;
+
+    OBAutoTune::OBAutoTune() : m_benchmark(true)
+    {
+    }
+
+    double OBAutoTune::CountNeighbors(const std::vector<Eigen::Vector3d> &positions, double rcut)
+    {
+      const unsigned int numAtoms = positions.size();
+      if (numAtoms < 2 || rcut <= 0.0)
+        return 0.0;
+
+      // atoms sorted by cell (edge rcut)
+      Eigen::Vector3d min = positions[0], max = positions[0];
+      for (unsigned int i = 1; i < numAtoms; ++i)
+        for (int k = 0; k < 3; ++k) {
+          min[k] = std::min(min[k], positions[i][k]);
+          max[k] = std::max(max[k], positions[i][k]);
+        }
+      Eigen::Vector3i dim;
+      for (int k = 0; k < 3; ++k)
+        dim[k] = int(floor((max[k] - min[k]) / rcut)) + 1;
+
+      std::vector<Eigen::Vector3i> cells(numAtoms);
+      std::vector<std::pair<CellKey, unsigned int> > sorted(numAtoms);
+      for (unsigned int i = 0; i < numAtoms; ++i) {
+        for (int k = 0; k < 3; ++k)
+          cells[i][k] = int(floor((positions[i][k] - min[k]) / rcut));
+        sorted[i] = std::make_pair(cellKey(cells[i].x(), cells[i].y(), cells[i].z(), dim), i);
+      }
+      std::sort(sorted.begin(), sorted.end());
+
+      // count the neighbors of every stride-th atom in the 27 surrounding cells
+      const double rcut2 = rcut * rcut;
+      const unsigned int stride = std::max(1u, numAtoms / MaxSamples);
+      unsigned int numSamples = 0;
+      double count = 0.0;
+      std::vector<std::pair<CellKey, unsigned int> >::const_iterator begin, end;
+      for (unsigned int i = 0; i < numAtoms; i += stride) {
+        numSamples++;
+        for (int x = cells[i].x() - 1; x <= cells[i].x() + 1; ++x)
+          for (int y = cells[i].y() - 1; y <= cells[i].y() + 1; ++y)
+            for (int z = cells[i].z() - 1; z <= cells[i].z() + 1; ++z) {
+              if (x < 0 || y < 0 || z < 0 || x >= dim.x() || y >= dim.y() || z >= dim.z())
+                continue;
+              const CellKey key = cellKey(x, y, z, dim);
+              begin = std::lower_bound(sorted.begin(), sorted.end(), std::make_pair(key, 0u));
+              for (end = begin; end != sorted.end() && end->first == key; ++end)
+                if (end->second != i && (positions[end->second] - positions[i]).squaredNorm() <= rcut2)
+                  count += 1.0;
+            }
+      }
+      return count / numSamples;
+    }
+
+    double OBAutoTune::AllPairTime(unsigned int numAtoms)
+    {
+      return AllPairPairTime * 0.5 * numAtoms * (numAtoms - (numAtoms ? 1.0 : 0.0));
+    }
+
+    double OBAutoTune::ClusterPairTime(unsigned int numAtoms, double neighbors)
+    {
+      return ClusterFixedTime + ClusterAtomTime * numAtoms
+        + ClusterPairPairTime * ClusterOverhead * 0.5 * numAtoms * neighbors;
+    }
+
+    double OBAutoTune::BondedTime(unsigned int numAtoms)
+    {
+      return BondedTermTime * BondedTermsPerAtom * numAtoms;
+    }
+
+    int OBAutoTune::NbrListBoxSize(double neighbors)
+    {
+      // atoms tested = neighbors * searched volume / sphere volume
+      const double sphere = 4.0 / 3.0 * M_PI;
+      int best = 1;
+      double bestTime = 0.0;
+      for (int boxSize = 1; boxSize <= 4; ++boxSize) {
+        const double cells = OBNbrList::NumSearchCells(boxSize);
+        const double tested = neighbors * cells / (boxSize * boxSize * boxSize) / sphere;
+        const double time = CellVisitTime * cells + DistanceTime * tested;
+        if (boxSize == 1 || time < bestTime) {
+          best = boxSize;
+          bestTime = time;
+        }
+      }
+      return best;
+    }
+
+    int OBAutoTune::NumThreads(double seconds)
+    {
+      int numThreads = QThread::idealThreadCount();
+      if (numThreads < 1 || seconds < ParallelTime)
+        return 1;
+      return std::max(1, std::min(numThreads, int(seconds / ThreadTime)));
+    }
+
+    double OBAutoTune::Benchmark(OBFunction *function, int repeats)
+    {
+      // wall time only, the benchmark does not need the hardware counters
+      OBProfiler profiler(false);
+      const unsigned int section = profiler.Section("OBAutoTune::Benchmark");
+      // the first evaluation builds the lists
+      function->Compute(OBFunction::Gradients);
+      double best = 0.0;
+      for (int i = 0; i < repeats; ++i) {
+        profiler.ResetStatistics();
+        profiler.Begin();
+        function->Compute(OBFunction::Gradients);
+        profiler.End(section);
+        const double seconds = profiler.GetStatistics("OBAutoTune::Benchmark").seconds;
+        if (!i || seconds < best)
+          best = seconds;
+      }
+      return best;
+    }
+
+    OBAutoTune::Decision OBAutoTune::Tune(const OBFunction *function, OBMol &mol, double rcut,
+        const std::string &allPairOptions, const std::string &clusterPairOptions) const
+    {
+      std::vector<Eigen::Vector3d> positions;
+      positions.reserve(mol.NumAtoms());
+      FOR_ATOMS_OF_MOL (atom, mol)
+        positions.push_back(Eigen::Vector3d(atom->GetVector().AsArray()));
+      const unsigned int numAtoms = positions.size();
+
+      Decision decision;
+      decision.neighbors = CountNeighbors(positions, rcut + Skin);
+      decision.allPairTime = AllPairTime(numAtoms);
+      decision.clusterPairTime = ClusterPairTime(numAtoms, decision.neighbors);
+      decision.benchmarked = false;
+
+      const double fast = std::min(decision.allPairTime, decision.clusterPairTime);
+      const double slow = std::max(decision.allPairTime, decision.clusterPairTime);
+      if (m_benchmark && numAtoms > 1 && numAtoms <= MaxBenchmarkAtoms && slow < Margin * fast) {
+        const std::string *options[2] = { &allPairOptions, &clusterPairOptions };
+        double times[2];
+        unsigned int measured = 0;
+        for (; measured < 2; ++measured) {
+          OBFunction *trial = function->NewInstance();
+          if (!trial)
+            break;
+          trial->GetLogFile()->SetLogLevel(OBLogFile::None);
+          trial->SetOptions(function->GetOptions() + "\n" + *options[measured]);
+          const bool ok = trial->Setup(mol);
+          if (ok)
+            times[measured] = Benchmark(trial);
+          delete trial;
+          if (!ok)
+            break;
+        }
+        if (measured == 2) {
+          decision.allPairTime = times[0];
+          decision.clusterPairTime = times[1];
+          decision.benchmarked = true;
+        }
+      }
+
+      decision.strategy = (decision.clusterPairTime < decision.allPairTime) ? ClusterPair : AllPair;
+      return decision;
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
@@ -0,0 +1,142 @@
+/*********************************************************************
+  OBAutoTune - Select the non-bonded evaluation strategy at setup
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBAUTOTUNE_H
+#define OBAUTOTUNE_H
+
+#include <vector>
+#include <string>
+
+#include <Eigen/Core>
+
+namespace OpenBabel {
+
+  class OBMol;
+
+  namespace OBFFs {
+
+    class OBFunction;
+
+    /**
+     * @class OBAutoTune obautotune.h <OBAutoTune>
+     * @brief Cost model for choosing how the non-bonded terms are evaluated.
+     *
+     * The fastest strategy depends on the size and shape of the system: all
+     * pairs for small molecules, cluster-pair lists (with a cut-off) for large
+     * ones. The cost model estimates the time per evaluation from the number
+     * of atoms and the number of neighbors within the cut-off, which is
+     * counted on a cell grid for a sample of the atoms (so flat or elongated
+     * molecules are handled).
+     *
+     * When the predicted times are within a factor Margin of each other,
+     * Tune() refines the decision with a micro-benchmark: two copies of the
+     * function (OBFunction::NewInstance()) are set up with the options for
+     * each strategy and the gradients are computed a few times.
+     *
+     * The same model gives the OBNbrList cells per cut-off distance and the
+     * number of OpenMP threads for a given time per evaluation.
+     *
+     * @code
+     * OBAutoTune tune;
+     * OBAutoTune::Decision vdw = tune.Tune(function, mol, 10.0,
+     *     "vdwterm = allpair\nelectroterm = none\n", "vdwterm = clusterpair\nelectroterm = none\n");
+     * @endcode
+     */
+    class OBAutoTune
+    {
+      public:
+        enum Strategy {
+          AllPair,
+          ClusterPair
+        };
+        struct Decision
+        {
+          Strategy strategy;
+          double allPairTime; //!< seconds per evaluation (model or benchmark)
+          double clusterPairTime;
+          double neighbors; //!< average number of atoms within the cut-off
+          bool benchmarked; //!< true if the times were measured
+        };
+        //! Benchmark when the predicted times are within this factor.
+        static const double Margin;
+
+        OBAutoTune();
+        /**
+         * Enable or disable the micro-benchmark (enabled by default).
+         */
+        void SetBenchmark(bool benchmark)
+        {
+          m_benchmark = benchmark;
+        }
+        bool GetBenchmark() const
+        {
+          return m_benchmark;
+        }
+        /**
+         * Choose all pairs or cluster pairs for a term with cut-off @p rcut.
+         * @p allPairOptions and @p clusterPairOptions are appended to the
+         * options of @p function for the benchmark copies, they should select
+         * the strategy and disable the other terms.
+         */
+        Decision Tune(const OBFunction *function, OBMol &mol, double rcut,
+            const std::string &allPairOptions, const std::string &clusterPairOptions) const;
+
+        /**
+         * @return The average number of atoms within @p rcut of an atom.
+         */
+        static double CountNeighbors(const std::vector<Eigen::Vector3d> &positions, double rcut);
+        /**
+         * @return The predicted seconds per evaluation for all pairs.
+         */
+        static double AllPairTime(unsigned int numAtoms);
+        /**
+         * @return The predicted seconds per evaluation for cluster pairs with
+         * @p neighbors atoms within the cut-off (+ skin).
+         */
+        static double ClusterPairTime(unsigned int numAtoms, double neighbors);
+        /**
+         * @return The predicted seconds per evaluation for the bonded terms
+         * (about 6 bonds, angles and torsions per atom).
+         */
+        static double BondedTime(unsigned int numAtoms);
+        /**
+         * @return The OBNbrList cells per cut-off distance (1-4) with the
+         * lowest predicted cost for @p neighbors atoms within the cut-off.
+         */
+        static int NbrListBoxSize(double neighbors);
+        /**
+         * @return The number of threads for @p seconds of work per evaluation:
+         * 1 for small systems where the thread overhead dominates.
+         */
+        static int NumThreads(double seconds);
+        /**
+         * @return The seconds per function->Compute(OBFunction::Gradients), the
+         * minimum of @p repeats runs.
+         */
+        static double Benchmark(OBFunction *function, int repeats = 3);
+
+      private:
+        bool m_benchmark;
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBAutoTune class
+
+#endif
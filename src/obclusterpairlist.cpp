@@ -0,0 +1,292 @@
+/*********************************************************************
+  OBClusterPairList - OBClusterPairList class
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBClusterPairList>
+#include <OBFunction>
+#include <OBProfiler>
+#include <OBFFType>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    const unsigned int OBClusterPairList::ClusterSize;
+    const unsigned int OBClusterPairList::NoAtom;
+
+    OBClusterPairList::OBClusterPairList(OBFunction *function, double rcut, double skin, int updateInterval)
+      : m_function(function), m_rcut(rcut), m_skin(skin), m_updateInterval(updateInterval),
+      m_updateCounter(0), m_numClusters(0)
+    {
+      Build();
+    }
+
+    void OBClusterPairList::Build()
+    {
+      OBProfiler *profiler = m_function->GetProfiler();
+      if (profiler)
+        profiler->Begin();
+      sortAtoms();
+      updateCoordinates();
+      computeBoundingBoxes();
+      searchPairs();
+      m_buildPositions = m_function->GetInternalPositions();
+      m_updateCounter = 0;
+      if (profiler)
+        profiler->End(profiler->Section("OBClusterPairList::Build"));
+    }
+
+    bool OBClusterPairList::Update()
+    {
+      m_updateCounter++;
+
+      if (m_updateCounter > m_updateInterval || moved()) {
+        Build();
+        return true;
+      }
+
+      updateCoordinates();
+      return false;
+    }
+
+    bool OBClusterPairList::moved() const
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      if (positions.size() != m_buildPositions.size())
+        return true;
+      const double limit2 = 0.25 * m_skin * m_skin;
+      for (unsigned int i = 0; i < positions.size(); ++i)
+        if ((positions[i] - m_buildPositions[i]).squaredNorm() > limit2)
+          return true;
+      return false;
+    }
+
+    void OBClusterPairList::sortAtoms()
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      const unsigned int numAtoms = positions.size();
+
+      m_atoms.clear();
+      m_numClusters = 0;
+      if (!numAtoms)
+        return;
+
+      Eigen::Vector3d min = positions[0], max = positions[0];
+      for (unsigned int i = 1; i < numAtoms; ++i)
+        for (int k = 0; k < 3; ++k) {
+          if (positions[i][k] < min[k])
+            min[k] = positions[i][k];
+          if (positions[i][k] > max[k])
+            max[k] = positions[i][k];
+        }
+
+      // Choose the column edge to make the clusters roughly cubic: a cube with
+      // this edge contains ClusterSize atoms on average.
+      Eigen::Vector3d extent = max - min;
+      for (int k = 0; k < 3; ++k)
+        if (extent[k] < 1.0)
+          extent[k] = 1.0;
+      const double density = numAtoms / (extent.x() * extent.y() * extent.z());
+      const double edge = pow(ClusterSize / density, 1.0 / 3.0);
+      const int nx = std::max(1, int(ceil(extent.x() / edge)));
+      const int ny = std::max(1, int(ceil(extent.y() / edge)));
+
+      // put the atoms in columns along z
+      std::vector<std::vector<std::pair<double, unsigned int> > > columns(nx * ny);
+      for (unsigned int i = 0; i < numAtoms; ++i) {
+        int cx = std::min(nx - 1, int((positions[i].x() - min.x()) / edge));
+        int cy = std::min(ny - 1, int((positions[i].y() - min.y()) / edge));
+        columns[cx + cy * nx].push_back(std::make_pair(positions[i].z(), i));
+      }
+
+      // sort the columns on z and cut them into clusters, the last cluster in
+      // each column is padded
+      m_atoms.reserve(numAtoms + columns.size() * ClusterSize);
+      for (unsigned int c = 0; c < columns.size(); ++c) {
+        if (columns[c].empty())
+          continue;
+        std::sort(columns[c].begin(), columns[c].end());
+        for (unsigned int i = 0; i < columns[c].size(); ++i)
+          m_atoms.push_back(columns[c][i].second);
+        while (m_atoms.size() % ClusterSize)
+          m_atoms.push_back(NoAtom);
+      }
+
+      m_numClusters = m_atoms.size() / ClusterSize;
+    }
+
+    void OBClusterPairList::updateCoordinates()
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      const unsigned int numSlots = m_atoms.size();
+
+      m_x.resize(numSlots);
+      m_y.resize(numSlots);
+      m_z.resize(numSlots);
+      for (unsigned int s = 0; s < numSlots; ++s) {
+        const unsigned int atom = m_atoms[s];
+        if (atom == NoAtom) {
+          // far away from everything, the interaction masks exclude these anyway
+          m_x[s] = m_y[s] = m_z[s] = 1.0e6 + s;
+          continue;
+        }
+        m_x[s] = positions[atom].x();
+        m_y[s] = positions[atom].y();
+        m_z[s] = positions[atom].z();
+      }
+    }
+
+    void OBClusterPairList::computeBoundingBoxes()
+    {
+      m_bbMin.resize(m_numClusters);
+      m_bbMax.resize(m_numClusters);
+      for (unsigned int c = 0; c < m_numClusters; ++c) {
+        // the first atom in a cluster is never padding
+        const unsigned int first = c * ClusterSize;
+        m_bbMin[c] = m_bbMax[c] = Eigen::Vector3d(m_x[first], m_y[first], m_z[first]);
+        for (unsigned int a = 1; a < ClusterSize; ++a) {
+          const unsigned int s = first + a;
+          if (m_atoms[s] == NoAtom)
+            break;
+          const Eigen::Vector3d pos(m_x[s], m_y[s], m_z[s]);
+          for (int k = 0; k < 3; ++k) {
+            if (pos[k] < m_bbMin[c][k])
+              m_bbMin[c][k] = pos[k];
+            if (pos[k] > m_bbMax[c][k])
+              m_bbMax[c][k] = pos[k];
+          }
+        }
+      }
+    }
+
+    void OBClusterPairList::searchPairs()
+    {
+      m_pairs.clear();
+      m_oneFourPairs.clear();
+      if (!m_numClusters)
+        return;
+
+      const double rlist = m_rcut + m_skin;
+      const double rlist2 = rlist * rlist;
+
+      // Two clusters with bounding boxes closer than rlist have centers closer
+      // than rlist + the largest bounding box diagonal. Using this as cell edge,
+      // only the neighboring cells need to be searched.
+      double maxDiagonal = 0.0;
+      Eigen::Vector3d min, max;
+      std::vector<Eigen::Vector3d> centers(m_numClusters);
+      for (unsigned int c = 0; c < m_numClusters; ++c) {
+        maxDiagonal = std::max(maxDiagonal, (m_bbMax[c] - m_bbMin[c]).norm());
+        centers[c] = 0.5 * (m_bbMin[c] + m_bbMax[c]);
+        if (!c)
+          min = max = centers[c];
+        for (int k = 0; k < 3; ++k) {
+          if (centers[c][k] < min[k])
+            min[k] = centers[c][k];
+          if (centers[c][k] > max[k])
+            max[k] = centers[c][k];
+        }
+      }
+      const double edge = rlist + maxDiagonal;
+      Eigen::Vector3i dim;
+      for (int k = 0; k < 3; ++k)
+        dim[k] = int(floor((max[k] - min[k]) / edge)) + 1;
+
+      std::vector<Eigen::Vector3i> cellOf(m_numClusters);
+      std::vector<std::vector<unsigned int> > cells(dim.x() * dim.y() * dim.z());
+      for (unsigned int c = 0; c < m_numClusters; ++c) {
+        for (int k = 0; k < 3; ++k)
+          cellOf[c][k] = std::min(dim[k] - 1, int(floor((centers[c][k] - min[k]) / edge)));
+        cells[cellOf[c].x() + dim.x() * (cellOf[c].y() + dim.y() * cellOf[c].z())].push_back(c);
+      }
+
+      ClusterPair pair;
+      for (unsigned int ci = 0; ci < m_numClusters; ++ci) {
+        const Eigen::Vector3i &idx = cellOf[ci];
+        for (int i = std::max(0, idx.x() - 1); i <= std::min(dim.x() - 1, idx.x() + 1); ++i)
+          for (int j = std::max(0, idx.y() - 1); j <= std::min(dim.y() - 1, idx.y() + 1); ++j)
+            for (int k = std::max(0, idx.z() - 1); k <= std::min(dim.z() - 1, idx.z() + 1); ++k) {
+              const std::vector<unsigned int> &cell = cells[i + dim.x() * (j + dim.y() * k)];
+              for (unsigned int n = 0; n < cell.size(); ++n) {
+                const unsigned int cj = cell[n];
+                if (cj < ci)
+                  continue;
+
+                // squared distance between the bounding boxes
+                double d2 = 0.0;
+                for (int l = 0; l < 3; ++l) {
+                  double d = std::max(m_bbMin[cj][l] - m_bbMax[ci][l], m_bbMin[ci][l] - m_bbMax[cj][l]);
+                  if (d > 0.0)
+                    d2 += d * d;
+                }
+                if (d2 > rlist2)
+                  continue;
+
+                pair.i = ci;
+                pair.j = cj;
+                pair.mask = clusterMask(ci, cj);
+                if (pair.mask)
+                  m_pairs.push_back(pair);
+              }
+            }
+      }
+    }
+
+    unsigned int OBClusterPairList::clusterMask(unsigned int ci, unsigned int cj)
+    {
+      OBFFType *pOBFFType = m_function->GetOBFFType();
+      unsigned int mask = 0;
+
+      for (unsigned int a = 0; a < ClusterSize; ++a) {
+        const size_t ia = m_atoms[ci * ClusterSize + a];
+        if (ia == NoAtom)
+          continue;
+        for (unsigned int b = 0; b < ClusterSize; ++b) {
+          // the diagonal cluster pairs contain every pair twice
+          if (ci == cj && b <= a)
+            continue;
+          const size_t ib = m_atoms[cj * ClusterSize + b];
+          if (ib == NoAtom)
+            continue;
+          // groups and types use the input order
+          const size_t inputA = m_function->InputIndex(ia);
+          const size_t inputB = m_function->InputIndex(ib);
+          if (!m_function->IsInterGroup(inputA, inputB))
+            continue;
+          if (pOBFFType) {
+            if (pOBFFType->IsConnected(inputA, inputB))
+              continue;
+            if (pOBFFType->IsOneThree(inputA, inputB))
+              continue;
+            if (pOBFFType->IsOneFour(inputA, inputB)) {
+              m_oneFourPairs.push_back(std::make_pair(ia, ib));
+              continue;
+            }
+          }
+          mask |= 1u << (a * ClusterSize + b);
+        }
+      }
+
+      return mask;
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
@@ -0,0 +1,168 @@
+/*********************************************************************
+  OBClusterPairList - OBClusterPairList class
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBCLUSTERPAIRLIST_H
+#define OBCLUSTERPAIRLIST_H
+
+#include <vector>
+#include <utility>
+#include <Eigen/Core>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    class OBFunction;
+
+    /**
+     * @class OBClusterPairList obclusterpairlist.h <OBClusterPairList>
+     * @brief A pair list of small spatial atom clusters for non-bonded kernels
+     *
+     * The atoms are sorted spatially and divided into clusters of ClusterSize
+     * atoms. Instead of atom pairs, the list contains the pairs of clusters with
+     * bounding boxes closer than the cut-off plus a buffer (skin). A kernel can
+     * then compute all ClusterSize x ClusterSize atom pairs of a cluster pair
+     * from contiguous coordinate arrays without any gathering.
+     *
+     * Each cluster pair has an interaction mask, bit (a * ClusterSize + b) is set
+     * when the interaction between atom a in cluster i and atom b in cluster j
+     * should be computed. Padding atoms, pairs counted twice in the diagonal
+     * cluster pairs, 1-2 and 1-3 pairs, 1-4 pairs and pairs disabled by the
+     * interaction groups are masked out. The 1-4 pairs are available from
+     * GetOneFourPairs() since they usually need scaling.
+     *
+     * Based on:
+     * Pall, S.; Hess, B. (2013). "A flexible algorithm for calculating pair
+     * interactions on SIMD architectures". Computer Physics Communications
+     * 184: 2641.
+     */
+    class OBClusterPairList
+    {
+      public:
+        //! Number of atoms per cluster, 4 doubles fill a 256 bit SIMD register.
+        static const unsigned int ClusterSize = 4;
+        //! Atom index used for the padding atoms in GetAtoms().
+        static const unsigned int NoAtom = 0xFFFFFFFF;
+
+        struct ClusterPair
+        {
+          unsigned int i, j; //!< the cluster indexes (i <= j)
+          unsigned int mask; //!< the interaction mask
+        };
+
+        /**
+         * Constructor.
+         * @param function The function containing the positions.
+         * @param rcut The cut-off distance.
+         * @param skin The buffer added to the cut-off when searching cluster pairs.
+         * @param updateInterval The maximum number of Update() calls between rebuilding
+         * the list. The list is rebuilt earlier when an atom moved more than skin/2.
+         */
+        OBClusterPairList(OBFunction *function, double rcut, double skin = 1.0, int updateInterval = 10);
+        /**
+         * Sort the atoms into clusters and search the cluster pairs.
+         */
+        void Build();
+        /**
+         * Copy the current positions into the cluster coordinate arrays. The list
+         * is rebuilt when an atom moved more than skin/2 since the last Build()
+         * (two such atoms could otherwise have moved within the cut-off) and
+         * at least every updateInterval calls.
+         * @return True if the list was rebuilt, the atoms are in a different order.
+         */
+        bool Update();
+        /**
+         * Rebuild the list in the next Update().
+         */
+        void Invalidate()
+        {
+          m_buildPositions.clear();
+        }
+
+        unsigned int NumClusters() const
+        {
+          return m_numClusters;
+        }
+        /**
+         * @return The atom index (0...N-1, internal order, see OBFunction::InternalIndex())
+         * for each slot (cluster * ClusterSize + lane) or NoAtom for padding.
+         */
+        const std::vector<unsigned int>& GetAtoms() const
+        {
+          return m_atoms;
+        }
+        //! @return The x coordinates for each slot.
+        const double* GetX() const
+        {
+          return &m_x[0];
+        }
+        //! @return The y coordinates for each slot.
+        const double* GetY() const
+        {
+          return &m_y[0];
+        }
+        //! @return The z coordinates for each slot.
+        const double* GetZ() const
+        {
+          return &m_z[0];
+        }
+        const std::vector<ClusterPair>& GetClusterPairs() const
+        {
+          return m_pairs;
+        }
+        /**
+         * @return The 1-4 atom pairs (internal indexes 0...N-1). These are collected while
+         * searching the cluster pairs, the cut-off should be larger than the
+         * largest 1-4 distance (~4 A).
+         */
+        const std::vector<std::pair<unsigned int, unsigned int> >& GetOneFourPairs() const
+        {
+          return m_oneFourPairs;
+        }
+        double GetCutOff() const
+        {
+          return m_rcut;
+        }
+
+      private:
+        //! @return True if an atom moved more than skin/2 since the last Build().
+        bool moved() const;
+        void sortAtoms();
+        void updateCoordinates();
+        void computeBoundingBoxes();
+        void searchPairs();
+        unsigned int clusterMask(unsigned int ci, unsigned int cj);
+
+        OBFunction                         *m_function;
+        double                              m_rcut, m_skin;
+        int                                 m_updateInterval;
+        int                                 m_updateCounter;
+        unsigned int                        m_numClusters;
+        std::vector<unsigned int>           m_atoms;
+        std::vector<Eigen::Vector3d>        m_buildPositions; //!< the positions at the last Build()
+        std::vector<double>                 m_x, m_y, m_z;
+        std::vector<Eigen::Vector3d>        m_bbMin, m_bbMax;
+        std::vector<ClusterPair>            m_pairs;
+        std::vector<std::pair<unsigned int, unsigned int> > m_oneFourPairs;
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBClusterPairList class
+
+#endif
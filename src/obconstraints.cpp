@@ -0,0 +1,328 @@
+/*********************************************************************
+  OBConstraints - SHAKE/RATTLE and SETTLE holonomic constraints
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBConstraints>
+#include <OBFunction>
+#include <OBFFType>
+#include <OBParameterDB>
+
+#include <openbabel/mol.h>
+#include <openbabel/oberror.h>
+
+#include <Eigen/Geometry>
+
+#include <cmath>
+#include <map>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    OBConstraints::OBConstraints() : m_tolerance(1e-8), m_maxIterations(1000), m_numShake(0)
+    {
+    }
+
+    void OBConstraints::addPair(unsigned int iA, unsigned int iB)
+    {
+      m_pairs.insert(iA < iB ? std::make_pair(iA, iB) : std::make_pair(iB, iA));
+    }
+
+    void OBConstraints::AddDistance(unsigned int iA, unsigned int iB, double distance)
+    {
+      Distance constraint;
+      constraint.iA = iA;
+      constraint.iB = iB;
+      constraint.distance = distance;
+      m_distances.push_back(constraint);
+      addPair(iA, iB);
+    }
+
+    void OBConstraints::AddWater(unsigned int iO, unsigned int iH1, unsigned int iH2,
+        double distanceOH, double distanceHH)
+    {
+      Water water;
+      water.iO = iO;
+      water.iH1 = iH1;
+      water.iH2 = iH2;
+      water.distanceOH = distanceOH;
+      water.distanceHH = distanceHH;
+      m_waters.push_back(water);
+      addPair(iO, iH1);
+      addPair(iO, iH2);
+      addPair(iH1, iH2);
+    }
+
+    unsigned int OBConstraints::AddWaters(OBMol &mol, double distanceOH, double distanceHH)
+    {
+      unsigned int count = 0;
+      FOR_ATOMS_OF_MOL (atom, mol) {
+        if (!atom->IsOxygen() || atom->GetValence() != 2)
+          continue;
+        std::vector<unsigned int> hydrogens;
+        FOR_NBORS_OF_ATOM (nbr, &*atom)
+          if (nbr->IsHydrogen())
+            hydrogens.push_back(nbr->GetIdx() - 1);
+        if (hydrogens.size() != 2 || IsConstrained(atom->GetIdx() - 1, hydrogens[0]))
+          continue;
+        AddWater(atom->GetIdx() - 1, hydrogens[0], hydrogens[1], distanceOH, distanceHH);
+        count++;
+      }
+      return count;
+    }
+
+    unsigned int OBConstraints::AddHydrogenBonds(OBMol &mol, OBFunction *function,
+        const std::string &tableName)
+    {
+      // the equilibrium lengths by bond name (column 0) from the bond table
+      // (r0 in column 4, see BondHarmonic)
+      OBFFType *type = function ? function->GetOBFFType() : 0;
+      OBParameterDBTable *table = (function && function->GetParameterDB()) ?
+        function->GetParameterDB()->GetTable(tableName) : 0;
+      std::map<std::pair<unsigned int, unsigned int>, double> lengths;
+      if (type && table && type->SetTypes(mol)) {
+        const std::vector<OBFFType::BondIdentifier> &bonds = type->GetBonds();
+        std::vector<OBParameterDBTable::Query> query;
+        for (unsigned int i = 0; i < bonds.size(); ++i) {
+          query.clear();
+          query.push_back(OBParameterDBTable::Query(0, OBVariant(bonds[i].name)));
+          const std::vector<OBVariant> &row = table->FindRow(query);
+          if (row.size() > 4)
+            lengths[std::make_pair(bonds[i].iA, bonds[i].iB)] = row[4].AsDouble();
+        }
+      }
+
+      unsigned int count = 0;
+      FOR_BONDS_OF_MOL (bond, mol) {
+        OBAtom *a = bond->GetBeginAtom();
+        OBAtom *b = bond->GetEndAtom();
+        if (!a->IsHydrogen() && !b->IsHydrogen())
+          continue;
+        const unsigned int iA = a->GetIdx() - 1, iB = b->GetIdx() - 1;
+        if (IsConstrained(iA, iB))
+          continue;
+        std::map<std::pair<unsigned int, unsigned int>, double>::const_iterator length;
+        length = lengths.find(std::make_pair(iA, iB));
+        if (length == lengths.end())
+          length = lengths.find(std::make_pair(iB, iA));
+        AddDistance(iA, iB, (length != lengths.end()) ? length->second : bond->GetLength());
+        count++;
+      }
+      return count;
+    }
+
+    void OBConstraints::Clear()
+    {
+      m_distances.clear();
+      m_waters.clear();
+      m_pairs.clear();
+      m_internalDistances.clear();
+      m_internalWaters.clear();
+      m_numShake = 0;
+    }
+
+    bool OBConstraints::Setup(const OBFunction *function, const std::vector<double> &inverseMasses)
+    {
+      const unsigned int numAtoms = function->NumParticles();
+      m_internalDistances.clear();
+      m_internalWaters.clear();
+
+      for (unsigned int i = 0; i < m_distances.size(); ++i) {
+        const Distance &constraint = m_distances[i];
+        if (constraint.iA >= numAtoms || constraint.iB >= numAtoms)
+          return false;
+        InternalDistance internal;
+        internal.iA = constraint.iA;
+        internal.iB = constraint.iB;
+        internal.distance2 = constraint.distance * constraint.distance;
+        internal.invMassA = inverseMasses[internal.iA];
+        internal.invMassB = inverseMasses[internal.iB];
+        m_internalDistances.push_back(internal);
+      }
+      m_numShake = m_internalDistances.size();
+
+      for (unsigned int i = 0; i < m_waters.size(); ++i) {
+        const Water &water = m_waters[i];
+        if (water.iO >= numAtoms || water.iH1 >= numAtoms || water.iH2 >= numAtoms)
+          return false;
+        InternalWater internal;
+        internal.iO = water.iO;
+        internal.iH1 = water.iH1;
+        internal.iH2 = water.iH2;
+        internal.distanceOH = water.distanceOH;
+        internal.distanceHH = water.distanceHH;
+        if (inverseMasses[internal.iO] <= 0.0 || inverseMasses[internal.iH1] <= 0.0)
+          return false;
+        internal.massO = 1.0 / inverseMasses[internal.iO];
+        internal.massH = 1.0 / inverseMasses[internal.iH1];
+        m_internalWaters.push_back(internal);
+
+        // the velocities of the waters are corrected by RATTLE
+        const unsigned int atoms[3] = { internal.iO, internal.iH1, internal.iH2 };
+        const double distances[3] = { water.distanceOH, water.distanceOH, water.distanceHH };
+        for (unsigned int j = 0; j < 3; ++j) {
+          InternalDistance pair;
+          pair.iA = atoms[j < 2 ? 0 : 1];
+          pair.iB = atoms[j < 2 ? j + 1 : 2];
+          pair.distance2 = distances[j] * distances[j];
+          pair.invMassA = inverseMasses[pair.iA];
+          pair.invMassB = inverseMasses[pair.iB];
+          m_internalDistances.push_back(pair);
+        }
+      }
+
+      return true;
+    }
+
+    bool OBConstraints::ConstrainPositions(const std::vector<Eigen::Vector3d> &reference,
+        std::vector<Eigen::Vector3d> &positions) const
+    {
+      bool ok = true;
+      for (unsigned int i = 0; i < m_internalWaters.size(); ++i)
+        if (!settle(m_internalWaters[i], reference, positions))
+          ok = false;
+
+      // SHAKE: correct each distance along its reference vector until all agree
+      for (int iteration = 0; iteration < m_maxIterations; ++iteration) {
+        bool converged = true;
+        for (unsigned int i = 0; i < m_numShake; ++i) {
+          const InternalDistance &c = m_internalDistances[i];
+          const Eigen::Vector3d rab = positions[c.iA] - positions[c.iB];
+          const double diff = c.distance2 - rab.squaredNorm();
+          if (fabs(diff) <= 2.0 * m_tolerance * c.distance2)
+            continue;
+          converged = false;
+          const Eigen::Vector3d rab0 = reference[c.iA] - reference[c.iB];
+          const double dot = rab0.dot(rab);
+          if (dot < 1e-6 * c.distance2)
+            return false;
+          const double g = diff / (2.0 * dot * (c.invMassA + c.invMassB));
+          positions[c.iA] += g * c.invMassA * rab0;
+          positions[c.iB] -= g * c.invMassB * rab0;
+        }
+        if (converged)
+          return ok;
+      }
+
+      return false;
+    }
+
+    bool OBConstraints::ConstrainVelocities(const std::vector<Eigen::Vector3d> &positions,
+        std::vector<Eigen::Vector3d> &velocities) const
+    {
+      // RATTLE: remove the relative velocity along each constraint
+      for (int iteration = 0; iteration < m_maxIterations; ++iteration) {
+        bool converged = true;
+        for (unsigned int i = 0; i < m_internalDistances.size(); ++i) {
+          const InternalDistance &c = m_internalDistances[i];
+          const Eigen::Vector3d rab = positions[c.iA] - positions[c.iB];
+          const double dot = rab.dot(velocities[c.iA] - velocities[c.iB]);
+          if (fabs(dot) <= m_tolerance * c.distance2)
+            continue;
+          converged = false;
+          const double k = -dot / (c.distance2 * (c.invMassA + c.invMassB));
+          velocities[c.iA] += k * c.invMassA * rab;
+          velocities[c.iB] -= k * c.invMassB * rab;
+        }
+        if (converged)
+          return true;
+      }
+
+      return false;
+    }
+
+    /*
+     * SETTLE, following the notation of Miyamoto & Kollman: the new positions
+     * are expressed in a frame with the z axis perpendicular to the old water
+     * plane, the analytical solution is rotated back.
+     */
+    bool OBConstraints::settle(const InternalWater &water, const std::vector<Eigen::Vector3d> &reference,
+        std::vector<Eigen::Vector3d> &positions) const
+    {
+      const double mO = water.massO, mH = water.massH;
+      const double invTotalMass = 1.0 / (mO + 2.0 * mH);
+
+      // relative to the old oxygen for precision
+      const Eigen::Vector3d center = reference[water.iO];
+      const Eigen::Vector3d b0 = reference[water.iH1] - center;
+      const Eigen::Vector3d c0 = reference[water.iH2] - center;
+      const Eigen::Vector3d a1 = positions[water.iO] - center;
+      const Eigen::Vector3d b1 = positions[water.iH1] - center;
+      const Eigen::Vector3d c1 = positions[water.iH2] - center;
+      const Eigen::Vector3d com = (mO * a1 + mH * (b1 + c1)) * invTotalMass;
+      const Eigen::Vector3d xa1 = a1 - com, xb1 = b1 - com, xc1 = c1 - com;
+
+      // local frame
+      const Eigen::Vector3d ez = b0.cross(c0).normalized();
+      const Eigen::Vector3d ex = xa1.cross(ez).normalized();
+      const Eigen::Vector3d ey = ez.cross(ex);
+
+      const double xb0d = ex.dot(b0), yb0d = ey.dot(b0);
+      const double xc0d = ex.dot(c0), yc0d = ey.dot(c0);
+      const double za1d = ez.dot(xa1);
+      const double xb1d = ex.dot(xb1), yb1d = ey.dot(xb1), zb1d = ez.dot(xb1);
+      const double xc1d = ex.dot(xc1), yc1d = ey.dot(xc1), zc1d = ez.dot(xc1);
+
+      // canonical water: oxygen at distance ra from the center of mass
+      const double rc = 0.5 * water.distanceHH;
+      double rb = sqrt(water.distanceOH * water.distanceOH - rc * rc);
+      const double ra = rb * 2.0 * mH * invTotalMass;
+      rb -= ra;
+
+      const double sinphi = za1d / ra;
+      const double cosphi2 = 1.0 - sinphi * sinphi;
+      if (cosphi2 <= 0.0)
+        return false;
+      const double cosphi = sqrt(cosphi2);
+      const double sinpsi = (zb1d - zc1d) / (2.0 * rc * cosphi);
+      const double cospsi2 = 1.0 - sinpsi * sinpsi;
+      if (cospsi2 <= 0.0)
+        return false;
+      const double cospsi = sqrt(cospsi2);
+
+      const double ya2d = ra * cosphi;
+      const double xb2d = -rc * cospsi;
+      const double t1 = -rb * cosphi;
+      const double t2 = rc * sinpsi * sinphi;
+      const double yb2d = t1 - t2;
+      const double yc2d = t1 + t2;
+
+      // rotation around z
+      const double alpha = xb2d * (xb0d - xc0d) + yb0d * yb2d + yc0d * yc2d;
+      const double beta = xb2d * (yc0d - yb0d) + xb0d * yb2d + xc0d * yc2d;
+      const double gamma = xb0d * yb1d - xb1d * yb0d + xc0d * yc1d - xc1d * yc0d;
+      const double alpha2beta2 = alpha * alpha + beta * beta;
+      const double root = alpha2beta2 - gamma * gamma;
+      if (root < 0.0)
+        return false;
+      const double sintheta = (alpha * gamma - beta * sqrt(root)) / alpha2beta2;
+      const double costheta = sqrt(1.0 - sintheta * sintheta);
+
+      const Eigen::Vector3d a3(-ya2d * sintheta, ya2d * costheta, za1d);
+      const Eigen::Vector3d b3(xb2d * costheta - yb2d * sintheta, xb2d * sintheta + yb2d * costheta, zb1d);
+      const Eigen::Vector3d c3(-xb2d * costheta - yc2d * sintheta, -xb2d * sintheta + yc2d * costheta, zc1d);
+
+      const Eigen::Vector3d origin = center + com;
+      positions[water.iO] = origin + a3.x() * ex + a3.y() * ey + a3.z() * ez;
+      positions[water.iH1] = origin + b3.x() * ex + b3.y() * ey + b3.z() * ez;
+      positions[water.iH2] = origin + c3.x() * ex + c3.y() * ey + c3.z() * ez;
+      return true;
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
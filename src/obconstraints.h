@@ -0,0 +1,201 @@
+/*********************************************************************
+  OBConstraints - SHAKE/RATTLE and SETTLE holonomic constraints
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBCONSTRAINTS_H
+#define OBCONSTRAINTS_H
+
+#include <vector>
+#include <set>
+#include <string>
+#include <utility>
+
+#include <Eigen/Core>
+
+namespace OpenBabel {
+
+  class OBMol;
+
+  namespace OBFFs {
+
+    class OBFunction;
+
+    /**
+     * @class OBConstraints obconstraints.h <OBConstraints>
+     * @brief Fixed distances for dynamics with larger time steps.
+     *
+     * Distance constraints (e.g. all bonds to hydrogen) are solved with
+     * SHAKE for the positions and RATTLE for the velocities. Rigid waters
+     * (O-H, O-H and H-H distances) are solved analytically with SETTLE
+     * (Miyamoto & Kollman, J. Comput. Chem. 13, 952 (1992)).
+     *
+     * Set the constraints with OBFunction::SetConstraints() before
+     * OBFunction::Setup(): the bond terms skip the constrained bonds and the
+     * angle terms skip angles with all three distances constrained (the
+     * H-O-H angle of a rigid water). OBDynamics applies the constraints.
+     *
+     * @code
+     * function->SetParameterDB(&database);
+     * function->SetOBFFType(&type);
+     * OBConstraints constraints;
+     * constraints.AddWaters(mol);
+     * constraints.AddHydrogenBonds(mol, function);
+     * function->SetConstraints(&constraints);
+     * function->Setup(mol);
+     * OBDynamics dynamics(function);
+     * dynamics.SetTimeStep(2.0);
+     * dynamics.Setup(mol);
+     * @endcode
+     *
+     * All atom indexes are in the input order (0...N-1).
+     */
+    class OBConstraints
+    {
+      public:
+        struct Distance
+        {
+          unsigned int iA, iB;
+          double distance;
+        };
+        struct Water
+        {
+          unsigned int iO, iH1, iH2;
+          double distanceOH, distanceHH;
+        };
+
+        OBConstraints();
+
+        /**
+         * Fix the distance between atoms @p iA and @p iB.
+         */
+        void AddDistance(unsigned int iA, unsigned int iB, double distance);
+        /**
+         * Make the water with oxygen @p iO and hydrogens @p iH1, @p iH2 rigid.
+         * The default distances are the TIP3P geometry.
+         */
+        void AddWater(unsigned int iO, unsigned int iH1, unsigned int iH2,
+            double distanceOH = 0.9572, double distanceHH = 1.5139);
+        /**
+         * Make all waters (oxygen with two hydrogens and no other neighbors)
+         * in @p mol rigid.
+         * @return The number of waters added.
+         */
+        unsigned int AddWaters(OBMol &mol, double distanceOH = 0.9572, double distanceHH = 1.5139);
+        /**
+         * Fix the length of all bonds to hydrogen in @p mol that are not
+         * constrained yet (call AddWaters() first) to their equilibrium length
+         * r0 from the bond parameters of @p function: the OBFFType and
+         * parameter database set on @p function, table @p tableName. Bonds
+         * without parameters (or without @p function) keep their current
+         * length. The atom types of @p mol are set on the OBFFType.
+         * @return The number of distances added.
+         */
+        unsigned int AddHydrogenBonds(OBMol &mol, OBFunction *function = 0,
+            const std::string &tableName = "Bond Harmonic");
+        void Clear();
+
+        const std::vector<Distance>& GetDistances() const
+        {
+          return m_distances;
+        }
+        const std::vector<Water>& GetWaters() const
+        {
+          return m_waters;
+        }
+        /**
+         * @return The number of removed degrees of freedom.
+         */
+        unsigned int NumConstraints() const
+        {
+          return m_distances.size() + 3 * m_waters.size();
+        }
+        /**
+         * @return True if the distance between @p iA and @p iB is constrained.
+         */
+        bool IsConstrained(unsigned int iA, unsigned int iB) const
+        {
+          return m_pairs.find(iA < iB ? std::make_pair(iA, iB) : std::make_pair(iB, iA)) != m_pairs.end();
+        }
+
+        /**
+         * Set the relative tolerance for SHAKE and RATTLE (default 1e-8).
+         */
+        void SetTolerance(double tolerance)
+        {
+          m_tolerance = tolerance;
+        }
+        void SetMaxIterations(int maxIterations)
+        {
+          m_maxIterations = maxIterations;
+        }
+
+        //! \name Used by OBDynamics (input atom order, see OBFunction::GetPositions())
+        //@{
+        /**
+         * Check the constraints against @p function and precompute the SHAKE,
+         * SETTLE and RATTLE parameters.
+         * @param inverseMasses The inverse mass of each atom.
+         */
+        bool Setup(const OBFunction *function, const std::vector<double> &inverseMasses);
+        /**
+         * Move @p positions to satisfy the constraints, the corrections are
+         * along the constrained vectors of @p reference (the positions before
+         * the step).
+         * @return False if SHAKE did not converge or SETTLE failed.
+         */
+        bool ConstrainPositions(const std::vector<Eigen::Vector3d> &reference,
+            std::vector<Eigen::Vector3d> &positions) const;
+        /**
+         * Remove the velocity components along the constraints.
+         * @return False if RATTLE did not converge.
+         */
+        bool ConstrainVelocities(const std::vector<Eigen::Vector3d> &positions,
+            std::vector<Eigen::Vector3d> &velocities) const;
+        //@}
+
+      private:
+        struct InternalDistance
+        {
+          unsigned int iA, iB;
+          double distance2, invMassA, invMassB;
+        };
+        struct InternalWater
+        {
+          unsigned int iO, iH1, iH2;
+          double distanceOH, distanceHH, massO, massH;
+        };
+
+        bool settle(const InternalWater &water, const std::vector<Eigen::Vector3d> &reference,
+            std::vector<Eigen::Vector3d> &positions) const;
+        void addPair(unsigned int iA, unsigned int iB);
+
+        std::vector<Distance> m_distances;
+        std::vector<Water> m_waters;
+        std::set<std::pair<unsigned int, unsigned int> > m_pairs; //!< constrained pairs (smaller index first)
+        double m_tolerance;
+        int m_maxIterations;
+        std::vector<InternalDistance> m_internalDistances; //!< SHAKE distances followed by the water distances (RATTLE only)
+        std::vector<InternalWater> m_internalWaters;
+        unsigned int m_numShake; //!< distances solved by SHAKE
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBConstraints class
+
+#endif
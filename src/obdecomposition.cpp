@@ -0,0 +1,95 @@
+/*********************************************************************
+  OBDecomposition - Per-atom and per-group energy decomposition
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBDecomposition>
+#include <OBFunction>
+
+#include <algorithm>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    const bool OBDecomposition::Enabled;
+    const bool OBNoDecomposition::Enabled;
+
+    OBDecomposition::OBDecomposition() : m_function(0), m_numGroups(0)
+    {
+    }
+
+    void OBDecomposition::SetGroup(unsigned int index, int group)
+    {
+      if (index >= m_inputGroups.size())
+        m_inputGroups.resize(index + 1, -1);
+      m_inputGroups[index] = group;
+      if (group >= m_numGroups)
+        m_numGroups = group + 1;
+    }
+
+    void OBDecomposition::SetGroup(const OBBitVec &atoms, int group)
+    {
+      for (int i = atoms.NextBit(-1); i != atoms.EndBit(); i = atoms.NextBit(i))
+        SetGroup(i, group);
+    }
+
+    void OBDecomposition::ClearGroups()
+    {
+      m_inputGroups.clear();
+      m_numGroups = 0;
+    }
+
+    void OBDecomposition::Reset(const OBFunction *function)
+    {
+      const unsigned int numAtoms = function->NumParticles();
+      m_function = function;
+      m_atoms.assign(numAtoms, 0.0);
+      m_groups.assign(numAtoms, -1);
+      for (unsigned int i = 0; i < numAtoms && i < m_inputGroups.size(); ++i)
+        m_groups[function->InternalIndex(i)] = m_inputGroups[i];
+      m_pairs.assign(m_numGroups * m_numGroups, 0.0);
+      m_external.assign(m_numGroups, 0.0);
+    }
+
+    double OBDecomposition::GetAtomValue(unsigned int index) const
+    {
+      if (!m_function || index >= m_atoms.size())
+        return 0.0;
+      return m_atoms[m_function->InternalIndex(index)];
+    }
+
+    double OBDecomposition::GetGroupValue(int group) const
+    {
+      double value = 0.0;
+      for (unsigned int i = 0; i < m_groups.size(); ++i)
+        if (m_groups[i] == group)
+          value += m_atoms[i];
+      return value;
+    }
+
+    double OBDecomposition::GetGroupPairValue(int group1, int group2) const
+    {
+      if (group1 > group2)
+        std::swap(group1, group2);
+      if (group1 < 0 || group2 >= m_numGroups || m_pairs.empty())
+        return 0.0;
+      return m_pairs[group1 * m_numGroups + group2];
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
@@ -0,0 +1,185 @@
+/*********************************************************************
+  OBDecomposition - Per-atom and per-group energy decomposition
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBDECOMPOSITION_H
+#define OBDECOMPOSITION_H
+
+#include <vector>
+
+#include <openbabel/bitvec.h>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    class OBFunction;
+
+    /**
+     * @class OBDecomposition obdecomposition.h <OBDecomposition>
+     * @brief Accumulates the value of a function per atom and per group pair.
+     *
+     * When set with OBFunction::SetDecomposition(), the terms add the value of
+     * every interaction in the same loop that computes the total:
+     *
+     * - the atoms of an interaction get equal shares of its value,
+     * - pair interactions are binned in the bucket of the two atom groups
+     *   (e.g. ligand-receptor), interactions with 3 or 4 atoms put the share of
+     *   each atom in the bucket of its own group,
+     * - interactions of one atom with an environment (e.g. a receptor grid) are
+     *   binned per group in GetExternalValue().
+     *
+     * Atoms can be put in groups (e.g. residues) with SetGroup(), atoms without
+     * a group only contribute to the atom values. The values are for the last
+     * Compute() of the function, OBFunction::ComputeBounded() does not update
+     * them.
+     *
+     * @code
+     * OBDecomposition decomposition;
+     * decomposition.SetGroup(ligand, 0);
+     * decomposition.SetGroup(receptor, 1);
+     * function->SetDecomposition(&decomposition);
+     * function->Compute();
+     * double interaction = decomposition.GetGroupPairValue(0, 1);
+     * @endcode
+     *
+     * The terms are templates over the decomposition type, OBNoDecomposition is
+     * used when no decomposition is set and compiles to nothing.
+     */
+    class OBDecomposition
+    {
+      public:
+        static const bool Enabled = true;
+
+        OBDecomposition();
+        /**
+         * Put atom @p index (input order, 0...N-1) in @p group (0...), -1 for no group.
+         */
+        void SetGroup(unsigned int index, int group);
+        /**
+         * Put all atoms in @p atoms (bit i is atom i) in @p group.
+         */
+        void SetGroup(const OBBitVec &atoms, int group);
+        void ClearGroups();
+        unsigned int NumGroups() const
+        {
+          return m_numGroups;
+        }
+        /**
+         * Clear the values for @p function. Called by OBFunction::Compute()
+         * implementations before computing the terms.
+         */
+        void Reset(const OBFunction *function);
+
+        /**
+         * @return The value of atom @p index (input order).
+         */
+        double GetAtomValue(unsigned int index) const;
+        /**
+         * @return The sum of the atom values for the atoms in @p group.
+         */
+        double GetGroupValue(int group) const;
+        /**
+         * @return The value of the interactions between @p group1 and @p group2
+         * or within @p group1 if both are the same.
+         */
+        double GetGroupPairValue(int group1, int group2) const;
+        /**
+         * @return The value of the interactions of the atoms in @p group with
+         * the environment (e.g. a receptor grid).
+         */
+        double GetExternalValue(int group) const
+        {
+          return (group >= 0 && group < (int) m_external.size()) ? m_external[group] : 0.0;
+        }
+
+        //! \name Used by the terms (internal atom indexes)
+        //@{
+        void Add(unsigned int a, double value)
+        {
+          m_atoms[a] += value;
+          if (m_groups[a] >= 0)
+            m_external[m_groups[a]] += value;
+        }
+        void Add(unsigned int a, unsigned int b, double value)
+        {
+          const double share = 0.5 * value;
+          m_atoms[a] += share;
+          m_atoms[b] += share;
+          addPair(m_groups[a], m_groups[b], value);
+        }
+        void Add(unsigned int a, unsigned int b, unsigned int c, double value)
+        {
+          const double share = value / 3.0;
+          addShare(a, share);
+          addShare(b, share);
+          addShare(c, share);
+        }
+        void Add(unsigned int a, unsigned int b, unsigned int c, unsigned int d, double value)
+        {
+          const double share = 0.25 * value;
+          addShare(a, share);
+          addShare(b, share);
+          addShare(c, share);
+          addShare(d, share);
+        }
+        //@}
+
+      private:
+        void addPair(int groupA, int groupB, double value)
+        {
+          if (groupA < 0 || groupB < 0)
+            return;
+          if (groupA > groupB)
+            m_pairs[groupB * m_numGroups + groupA] += value;
+          else
+            m_pairs[groupA * m_numGroups + groupB] += value;
+        }
+        void addShare(unsigned int a, double share)
+        {
+          m_atoms[a] += share;
+          if (m_groups[a] >= 0)
+            m_pairs[m_groups[a] * (m_numGroups + 1)] += share;
+        }
+
+        const OBFunction *m_function;
+        std::vector<int> m_inputGroups; //!< group for each atom (input order)
+        std::vector<int> m_groups; //!< group for each atom (internal order)
+        std::vector<double> m_atoms; //!< value for each atom (internal order)
+        std::vector<double> m_pairs; //!< upper triangle of numGroups x numGroups
+        std::vector<double> m_external;
+        int m_numGroups;
+    };
+
+    /**
+     * @brief Decomposition type used when no OBDecomposition is set.
+     */
+    struct OBNoDecomposition
+    {
+      static const bool Enabled = false;
+
+      void Add(unsigned int, double) {}
+      void Add(unsigned int, unsigned int, double) {}
+      void Add(unsigned int, unsigned int, unsigned int, double) {}
+      void Add(unsigned int, unsigned int, unsigned int, unsigned int, double) {}
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBDecomposition class
+
+#endif
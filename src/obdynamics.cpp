@@ -0,0 +1,248 @@
+/*********************************************************************
+  OBDynamics - Velocity Verlet molecular dynamics with constraints
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBDynamics>
+#include <OBFunction>
+#include <OBConstraints>
+#include <OBTrajectory>
+#include <OBLogFile>
+
+#include <openbabel/mol.h>
+#include <openbabel/oberror.h>
+
+#include <cmath>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    namespace {
+      //! (kcal/mol/Angstrom) / amu in Angstrom/fs^2
+      const double AccelerationUnit = 4.184e-4;
+    }
+
+    const double OBDynamics::Boltzmann = 0.0019872041;
+
+    OBDynamics::OBDynamics(OBFunction *function) : m_function(function), m_timeStep(1.0), m_step(0),
+        m_trajectory(0), m_trajectoryInterval(1), m_thermostatTemperature(0.0), m_collisionFrequency(0.0)
+    {
+    }
+
+    bool OBDynamics::Setup(OBMol &mol)
+    {
+      std::vector<double> masses(mol.NumAtoms());
+      FOR_ATOMS_OF_MOL (atom, mol)
+        masses[atom->GetIdx() - 1] = atom->GetAtomicMass();
+      return Setup(masses);
+    }
+
+    bool OBDynamics::Setup(const std::vector<double> &masses)
+    {
+      const unsigned int numAtoms = m_function->NumParticles();
+      if (masses.size() != numAtoms) {
+        obErrorLog.ThrowError(__FUNCTION__, "The number of masses does not match the function", obError);
+        return false;
+      }
+
+      // atoms without mass are fixed
+      m_inverseMasses.resize(numAtoms);
+      for (unsigned int i = 0; i < numAtoms; ++i)
+        m_inverseMasses[i] = (masses[i] > 0.0) ? 1.0 / masses[i] : 0.0;
+
+      if (OBConstraints *constraints = m_function->GetConstraints()) {
+        if (!constraints->Setup(m_function, m_inverseMasses)) {
+          obErrorLog.ThrowError(__FUNCTION__, "Invalid constraints", obError);
+          return false;
+        }
+        m_reference = m_function->GetPositions();
+        if (!constraints->ConstrainPositions(m_reference, m_function->GetPositions()))
+          obErrorLog.ThrowError(__FUNCTION__, "Could not satisfy the constraints", obWarning);
+      }
+
+      m_step = 0;
+      m_velocities.assign(numAtoms, Eigen::Vector3d::Zero());
+      computeAccelerations();
+      if (m_trajectory)
+        m_trajectory->AddFrame(m_function);
+      return true;
+    }
+
+    void OBDynamics::SetTrajectory(OBTrajectoryWriter *trajectory, int interval)
+    {
+      m_trajectory = trajectory;
+      m_trajectoryInterval = (interval > 0) ? interval : 1;
+    }
+
+    void OBDynamics::computeAccelerations()
+    {
+      // the gradients are the forces
+      m_function->Compute(OBFunction::Gradients);
+      const std::vector<Eigen::Vector3d> &forces = m_function->GetGradients();
+      m_accelerations.resize(forces.size());
+      for (unsigned int i = 0; i < forces.size(); ++i)
+        m_accelerations[i] = (AccelerationUnit * m_inverseMasses[i]) * forces[i];
+    }
+
+    void OBDynamics::removeCenterOfMassMotion()
+    {
+      Eigen::Vector3d momentum = Eigen::Vector3d::Zero();
+      double totalMass = 0.0;
+      for (unsigned int i = 0; i < m_velocities.size(); ++i)
+        if (m_inverseMasses[i] > 0.0) {
+          momentum += m_velocities[i] / m_inverseMasses[i];
+          totalMass += 1.0 / m_inverseMasses[i];
+        }
+      if (totalMass <= 0.0)
+        return;
+      const Eigen::Vector3d velocity = momentum / totalMass;
+      for (unsigned int i = 0; i < m_velocities.size(); ++i)
+        if (m_inverseMasses[i] > 0.0)
+          m_velocities[i] -= velocity;
+    }
+
+    Eigen::Vector3d OBDynamics::randomVelocity(unsigned int index, double temperature)
+    {
+      if (m_inverseMasses[index] <= 0.0)
+        return Eigen::Vector3d::Zero();
+
+      // Maxwell-Boltzmann: each component is normal with variance kT/m
+      const double sigma = sqrt(Boltzmann * temperature * m_inverseMasses[index] * AccelerationUnit);
+      double gaussian[4];
+      for (unsigned int j = 0; j < 4; j += 2) {
+        // Box-Muller
+        const double u1 = 1.0 - m_random.NextFloat();
+        const double u2 = m_random.NextFloat();
+        const double r = sqrt(-2.0 * log(u1));
+        gaussian[j] = r * cos(2.0 * M_PI * u2);
+        gaussian[j + 1] = r * sin(2.0 * M_PI * u2);
+      }
+      return sigma * Eigen::Vector3d(gaussian[0], gaussian[1], gaussian[2]);
+    }
+
+    void OBDynamics::InitializeVelocities(double temperature, int seed)
+    {
+      if (seed)
+        m_random.Seed(seed);
+      else
+        m_random.TimeSeed();
+
+      for (unsigned int i = 0; i < m_velocities.size(); ++i)
+        m_velocities[i] = randomVelocity(i, temperature);
+
+      removeCenterOfMassMotion();
+      if (const OBConstraints *constraints = m_function->GetConstraints())
+        constraints->ConstrainVelocities(m_function->GetPositions(), m_velocities);
+
+      // scale to the exact temperature
+      const double current = GetTemperature();
+      if (current > 0.0) {
+        const double scale = sqrt(temperature / current);
+        for (unsigned int i = 0; i < m_velocities.size(); ++i)
+          m_velocities[i] *= scale;
+      }
+    }
+
+    bool OBDynamics::TakeNSteps(int n)
+    {
+      std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      const OBConstraints *constraints = m_function->GetConstraints();
+      OBLogFile *logfile = m_function->GetLogFile();
+      const double dt = m_timeStep;
+      const double halfStep = 0.5 * dt;
+
+      for (int i = 0; i < n; ++i) {
+        m_step++;
+
+        // v(t + dt/2) and x(t + dt)
+        if (constraints)
+          m_reference = positions;
+        for (unsigned int j = 0; j < positions.size(); ++j) {
+          m_velocities[j] += halfStep * m_accelerations[j];
+          positions[j] += dt * m_velocities[j];
+        }
+        if (constraints) {
+          if (!constraints->ConstrainPositions(m_reference, positions)) {
+            obErrorLog.ThrowError(__FUNCTION__, "SHAKE/SETTLE failed, the time step is too large", obError);
+            return false;
+          }
+          // the velocities consistent with the constrained positions
+          for (unsigned int j = 0; j < positions.size(); ++j)
+            m_velocities[j] = (positions[j] - m_reference[j]) / dt;
+        }
+
+        // v(t + dt)
+        computeAccelerations();
+        for (unsigned int j = 0; j < positions.size(); ++j)
+          m_velocities[j] += halfStep * m_accelerations[j];
+        if (m_collisionFrequency > 0.0) {
+          const double probability = m_collisionFrequency * dt;
+          for (unsigned int j = 0; j < positions.size(); ++j)
+            if (m_random.NextFloat() < probability)
+              m_velocities[j] = randomVelocity(j, m_thermostatTemperature);
+        }
+        if (constraints && !constraints->ConstrainVelocities(positions, m_velocities)) {
+          obErrorLog.ThrowError(__FUNCTION__, "RATTLE did not converge", obError);
+          return false;
+        }
+
+        if (m_trajectory && m_step % m_trajectoryInterval == 0)
+          m_trajectory->AddFrame(m_function);
+        if (logfile->IsLow() && m_step % 10 == 0)
+          logfile->Log(OBLogFile::Low, "md_step", " %6.0f    %12.4f    %12.4f    %8.2f\n",
+              "step", m_step, "potential", GetPotentialEnergy(), "kinetic", GetKineticEnergy(),
+              "temperature", GetTemperature());
+      }
+
+      return true;
+    }
+
+    double OBDynamics::GetPotentialEnergy() const
+    {
+      return m_function->GetValue();
+    }
+
+    double OBDynamics::GetKineticEnergy() const
+    {
+      double energy = 0.0;
+      for (unsigned int i = 0; i < m_velocities.size(); ++i)
+        if (m_inverseMasses[i] > 0.0)
+          energy += m_velocities[i].squaredNorm() / m_inverseMasses[i];
+      return 0.5 * energy / AccelerationUnit;
+    }
+
+    unsigned int OBDynamics::NumDegreesOfFreedom() const
+    {
+      unsigned int numFree = 0;
+      for (unsigned int i = 0; i < m_inverseMasses.size(); ++i)
+        if (m_inverseMasses[i] > 0.0)
+          numFree++;
+      int dof = 3 * numFree - 3;
+      if (const OBConstraints *constraints = m_function->GetConstraints())
+        dof -= constraints->NumConstraints();
+      return dof > 0 ? dof : 0;
+    }
+
+    double OBDynamics::GetTemperature() const
+    {
+      const unsigned int dof = NumDegreesOfFreedom();
+      return dof ? 2.0 * GetKineticEnergy() / (dof * Boltzmann) : 0.0;
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
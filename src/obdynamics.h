@@ -0,0 +1,162 @@
+/*********************************************************************
+  OBDynamics - Velocity Verlet molecular dynamics with constraints
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBDYNAMICS_H
+#define OBDYNAMICS_H
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include <openbabel/rand.h>
+
+namespace OpenBabel {
+
+  class OBMol;
+
+  namespace OBFFs {
+
+    class OBFunction;
+    class OBTrajectoryWriter;
+
+    /**
+     * @class OBDynamics obdynamics.h <OBDynamics>
+     * @brief Velocity Verlet dynamics at constant energy (NVE) or temperature (NVT).
+     *
+     * Units: positions in Angstrom, time in fs, masses in amu and energies in
+     * kcal/mol. Without constraints the time step is limited to about 0.5-1 fs
+     * by the X-H bond vibrations. With the OBConstraints set on the function
+     * (OBFunction::SetConstraints()) the positions are corrected with SHAKE and
+     * SETTLE and the velocities with RATTLE after every step, which allows
+     * steps of 2 fs (bonds to hydrogen) or more. SetThermostat() couples the
+     * system to a heat bath (Andersen thermostat).
+     *
+     * @code
+     * OBDynamics dynamics(function);
+     * dynamics.SetTimeStep(2.0);
+     * dynamics.Setup(mol);
+     * dynamics.InitializeVelocities(300.0);
+     * dynamics.TakeNSteps(10000);
+     * @endcode
+     */
+    class OBDynamics
+    {
+      public:
+        /**
+         * Boltzmann constant in kcal/(mol K).
+         */
+        static const double Boltzmann;
+
+        explicit OBDynamics(OBFunction *function);
+
+        /**
+         * Set the time step in fs (default 1.0).
+         */
+        void SetTimeStep(double timeStep)
+        {
+          m_timeStep = timeStep;
+        }
+        double GetTimeStep() const
+        {
+          return m_timeStep;
+        }
+        /**
+         * Set the masses from the atoms in @p mol, set up the constraints of
+         * the function and compute the initial forces. The velocities are
+         * zero. The function must be set up.
+         * @return False if the constraints could not be set up.
+         */
+        bool Setup(OBMol &mol);
+        /**
+         * Same as above with the @p masses in the input atom order.
+         */
+        bool Setup(const std::vector<double> &masses);
+        /**
+         * Assign random velocities from the Maxwell-Boltzmann distribution
+         * at @p temperature (K) without center of mass motion.
+         */
+        void InitializeVelocities(double temperature, int seed = 0);
+        /**
+         * Couple the system to a heat bath at @p temperature (K) with the
+         * Andersen thermostat: in each step every atom gets a new random
+         * velocity with the probability @p collisionFrequency (1/fs) times
+         * the time step. A frequency of 0 (default) gives NVE dynamics.
+         */
+        void SetThermostat(double temperature, double collisionFrequency = 0.01)
+        {
+          m_thermostatTemperature = temperature;
+          m_collisionFrequency = collisionFrequency;
+        }
+        double GetThermostatTemperature() const
+        {
+          return m_thermostatTemperature;
+        }
+        /**
+         * Take @p n steps.
+         * @return False if the constraints could not be satisfied.
+         */
+        bool TakeNSteps(int n);
+        /**
+         * Record the positions in @p trajectory every @p interval steps, 0
+         * to stop recording.
+         */
+        void SetTrajectory(OBTrajectoryWriter *trajectory, int interval = 1);
+
+        //! @return The velocities in Angstrom/fs (input atom order).
+        std::vector<Eigen::Vector3d>& GetVelocities()
+        {
+          return m_velocities;
+        }
+        int GetStep() const
+        {
+          return m_step;
+        }
+        double GetPotentialEnergy() const;
+        double GetKineticEnergy() const;
+        /**
+         * @return The instantaneous temperature (K) for the degrees of freedom
+         * left by the constraints and without the center of mass motion.
+         */
+        double GetTemperature() const;
+        unsigned int NumDegreesOfFreedom() const;
+
+      private:
+        void computeAccelerations();
+        void removeCenterOfMassMotion();
+        //! @return A velocity from the Maxwell-Boltzmann distribution for atom @p index.
+        Eigen::Vector3d randomVelocity(unsigned int index, double temperature);
+
+        OBFunction *m_function;
+        double m_timeStep;
+        int m_step;
+        std::vector<double> m_inverseMasses; //!< input order, 1/amu
+        std::vector<Eigen::Vector3d> m_velocities;
+        std::vector<Eigen::Vector3d> m_accelerations;
+        std::vector<Eigen::Vector3d> m_reference; //!< positions before the step for SHAKE
+        OBTrajectoryWriter *m_trajectory;
+        int m_trajectoryInterval;
+        double m_thermostatTemperature, m_collisionFrequency;
+        OBRandom m_random;
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBDynamics class
+
+#endif
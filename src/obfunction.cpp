@@ -21,17 +21,25 @@ GNU General Public License for more details.
 #include <OBFunction>
 #include <OBFunctionTerm>
 #include <OBLogFile>
+#include <OBConstraints>
 
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
 #include <iostream>
 #include <iterator>
+#include <algorithm>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 using namespace std;
 
 namespace OpenBabel {
 namespace OBFFs {
 
-  OBFunction::OBFunction() : m_logfile(new OBLogFile), m_parameterDB(0)
+  OBFunction::OBFunction() : m_logfile(new OBLogFile), m_parameterDB(0), m_obffType(0), m_obChargeMethod(0),
+      m_decomposition(0), m_profiler(0), m_constraints(0), m_numThreads(0),
+      m_reorder(false)
   {
   }
 
@@ -39,21 +47,85 @@ namespace OBFFs {
   {
     std::vector<OBFunctionTerm*>::iterator term;
     for (term = m_terms.begin(); term != m_terms.end(); ++term)
-      delete &*term;
+      delete *term;
     delete m_logfile;
   }
 
+  // Interleave the lower 10 bits of x, y and z.
+  static unsigned int MortonCode(unsigned int x, unsigned int y, unsigned int z)
+  {
+    unsigned int code = 0;
+    for (unsigned int bit = 0; bit < 10; ++bit) {
+      code |= ((x >> bit) & 1u) << (3 * bit);
+      code |= ((y >> bit) & 1u) << (3 * bit + 1);
+      code |= ((z >> bit) & 1u) << (3 * bit + 2);
+    }
+    return code;
+  }
+
   bool OBFunction::Setup(/*const*/ OBMol &mol)
   {
-    m_positions.resize(mol.NumAtoms());
+    const unsigned int numAtoms = mol.NumAtoms();
+    std::vector<Eigen::Vector3d> positions(numAtoms);
     FOR_ATOMS_OF_MOL (atom, mol)
-      m_positions[atom->GetIdx()-1] = Eigen::Vector3d(atom->GetVector().AsArray());
+      positions[atom->GetIdx()-1] = Eigen::Vector3d(atom->GetVector().AsArray());
+
+    m_order.clear();
+    m_internal.clear();
+    if (m_reorder && numAtoms) {
+      Eigen::Vector3d min = positions[0], max = positions[0];
+      for (unsigned int i = 1; i < numAtoms; ++i)
+        for (int k = 0; k < 3; ++k) {
+          if (positions[i][k] < min[k])
+            min[k] = positions[i][k];
+          if (positions[i][k] > max[k])
+            max[k] = positions[i][k];
+        }
+      // 1024 cells along the largest dimension
+      double extent = std::max(max.x() - min.x(), std::max(max.y() - min.y(), max.z() - min.z()));
+      const double scale = (extent > 0.0) ? 1023.0 / extent : 0.0;
+
+      std::vector<std::pair<unsigned int, unsigned int> > codes(numAtoms);
+      for (unsigned int i = 0; i < numAtoms; ++i) {
+        const Eigen::Vector3d cell = (positions[i] - min) * scale;
+        codes[i] = std::make_pair(MortonCode((unsigned int)cell.x(), (unsigned int)cell.y(), (unsigned int)cell.z()), i);
+      }
+      std::sort(codes.begin(), codes.end());
+
+      m_order.resize(numAtoms);
+      m_internal.resize(numAtoms);
+      for (unsigned int i = 0; i < numAtoms; ++i) {
+        m_order[i] = codes[i].second;
+        m_internal[codes[i].second] = i;
+      }
+    }
+
+    m_positions.resize(numAtoms);
+    for (unsigned int i = 0; i < numAtoms; ++i)
+      m_positions[InternalIndex(i)] = positions[i];
 
-    m_gradients.resize(mol.NumAtoms(), Eigen::Vector3d::Zero());
+    m_gradients.resize(numAtoms, Eigen::Vector3d::Zero());
 
+    // the public positions and gradients stay in the input order
+    if (m_order.empty()) {
+      m_inputPositions.clear();
+      m_inputGradients.clear();
+    } else {
+      m_inputPositions = positions;
+      m_inputGradients.assign(numAtoms, Eigen::Vector3d::Zero());
+    }
+
+    // the terms allocate their arrays from the arena in the order they are computed
+    m_arena.Reset();
+    bool success = true;
     std::vector<OBFunctionTerm*>::iterator term;
     for (term = m_terms.begin(); term != m_terms.end(); ++term)
-      (*term)->Setup();
+      if (!(*term)->Setup()) {
+        m_logfile->Write(OBLogFile::Low, "Could not set up " + (*term)->GetName() + "\n");
+        success = false;
+      }
+
+    return success;
   }
 
   bool OBFunction::CopyPositionsToMol(OBMol& mol) const
@@ -61,10 +133,65 @@ namespace OBFFs {
     if (mol.NumAtoms() != m_positions.size())
       return false;
     std::vector<OBAtom*>::iterator itr;
-    std::vector<Eigen::Vector3d>::const_iterator itr2;
     OBAtom *atom;
-    for (atom = mol.BeginAtom(itr), itr2=m_positions.begin(); atom; atom = mol.NextAtom(itr), ++itr2)
-      atom->SetVector(const_cast<double *>(itr2->data()));
+    unsigned int index = 0;
+    for (atom = mol.BeginAtom(itr); atom; atom = mol.NextAtom(itr), ++index)
+      atom->SetVector(const_cast<double *>(GetPositions()[index].data()));
+    return true;
+  }
+
+  void OBFunction::GatherPositions()
+  {
+    for (unsigned int i = 0; i < m_order.size(); ++i)
+      m_positions[i] = m_inputPositions[m_order[i]];
+  }
+
+  void OBFunction::ScatterGradients()
+  {
+    for (unsigned int i = 0; i < m_order.size(); ++i)
+      m_inputGradients[m_order[i]] = m_gradients[i];
+  }
+
+  void OBFunction::ResetNeighborLists()
+  {
+    std::vector<OBFunctionTerm*>::iterator term;
+    for (term = m_terms.begin(); term != m_terms.end(); ++term)
+      (*term)->ResetNeighborLists();
+  }
+
+  bool OBFunction::ComputeBounded(double maxValue)
+  {
+    GatherPositions();
+    // order: unbounded terms, clash sensitive terms, other terms
+    std::vector<OBFunctionTerm*> terms;
+    std::vector<OBFunctionTerm*>::iterator term;
+    double remaining = 0.0;
+    for (term = m_terms.begin(); term != m_terms.end(); ++term)
+      if (!isfinite((*term)->GetLowerBound()))
+        terms.push_back(*term);
+    for (term = m_terms.begin(); term != m_terms.end(); ++term)
+      if (isfinite((*term)->GetLowerBound()) && (*term)->IsClashSensitive()) {
+        terms.push_back(*term);
+        remaining += (*term)->GetLowerBound();
+      }
+    for (term = m_terms.begin(); term != m_terms.end(); ++term)
+      if (isfinite((*term)->GetLowerBound()) && !(*term)->IsClashSensitive()) {
+        terms.push_back(*term);
+        remaining += (*term)->GetLowerBound();
+      }
+
+    double value = 0.0;
+    for (term = terms.begin(); term != terms.end(); ++term) {
+      if (isfinite((*term)->GetLowerBound()))
+        remaining -= (*term)->GetLowerBound();
+      // offset: the value so far + lower bound for the terms after this one
+      if (!(*term)->ComputeBounded(value + remaining, maxValue))
+        return false;
+      value += (*term)->GetValue();
+      if (value + remaining > maxValue)
+        return false;
+    }
+
     return true;
   }
 
@@ -102,6 +229,117 @@ namespace OBFFs {
     return m_terms;
   }
 
+  void OBFunction::AddIntraGroup(const OBBitVec &group)
+  {
+    m_intraGroups.push_back(group);
+  }
+
+  void OBFunction::AddInterGroup(const OBBitVec &group)
+  {
+    m_interGroups.push_back(group);
+  }
+
+  void OBFunction::AddInterGroups(const OBBitVec &group1, const OBBitVec &group2)
+  {
+    m_interGroupPairs.push_back(std::pair<OBBitVec, OBBitVec>(group1, group2));
+  }
+
+  OBFunction* OBFunction::NewInstance() const
+  {
+    OBFunctionFactory *factory = OBFunctionFactory::GetFactory(GetName());
+    if (!factory)
+      return 0;
+
+    OBFunction *function = factory->NewInstance();
+    function->SetParameterDB(m_parameterDB);
+    function->SetOBFFType(m_obffType);
+    function->SetOBChargeMethod(m_obChargeMethod);
+    if (!m_options.empty())
+      function->SetOptions(m_options);
+    function->m_intraGroups = m_intraGroups;
+    function->m_interGroups = m_interGroups;
+    function->m_interGroupPairs = m_interGroupPairs;
+    function->m_reorder = m_reorder;
+    function->m_constraints = m_constraints;
+    function->m_numThreads = m_numThreads;
+    return function;
+  }
+
+  int OBFunction::GetNumThreads() const
+  {
+#ifdef _OPENMP
+    return m_numThreads ? m_numThreads : omp_get_max_threads();
+#else
+    return 1;
+#endif
+  }
+
+  void OBFunction::ClearGroups()
+  {
+    m_intraGroups.clear();
+    m_interGroups.clear();
+    m_interGroupPairs.clear();
+  }
+
+  bool OBFunction::IsIntraGroup(unsigned int iA, unsigned int iB) const
+  {
+    if (!HasGroups())
+      return true;
+    for (unsigned int i = 0; i < m_intraGroups.size(); ++i)
+      if (m_intraGroups[i].BitIsOn(iA) && m_intraGroups[i].BitIsOn(iB))
+        return true;
+    return false;
+  }
+
+  bool OBFunction::IsIntraGroup(unsigned int iA, unsigned int iB, unsigned int iC) const
+  {
+    if (!HasGroups())
+      return true;
+    for (unsigned int i = 0; i < m_intraGroups.size(); ++i)
+      if (m_intraGroups[i].BitIsOn(iA) && m_intraGroups[i].BitIsOn(iB) && 
+          m_intraGroups[i].BitIsOn(iC))
+        return true;
+    return false;
+  }
+
+  bool OBFunction::IsIntraGroup(unsigned int iA, unsigned int iB, unsigned int iC, unsigned int iD) const
+  {
+    if (!HasGroups())
+      return true;
+    for (unsigned int i = 0; i < m_intraGroups.size(); ++i)
+      if (m_intraGroups[i].BitIsOn(iA) && m_intraGroups[i].BitIsOn(iB) && 
+          m_intraGroups[i].BitIsOn(iC) && m_intraGroups[i].BitIsOn(iD))
+        return true;
+    return false;
+  }
+
+  bool OBFunction::IsInterGroup(unsigned int iA, unsigned int iB) const
+  {
+    if (!HasGroups())
+      return true;
+    for (unsigned int i = 0; i < m_interGroups.size(); ++i)
+      if (m_interGroups[i].BitIsOn(iA) && m_interGroups[i].BitIsOn(iB)) 
+        return true;
+    for (unsigned int i = 0; i < m_interGroupPairs.size(); ++i) {
+      if (m_interGroupPairs[i].first.BitIsOn(iA) && m_interGroupPairs[i].second.BitIsOn(iB)) 
+        return true;
+      if (m_interGroupPairs[i].first.BitIsOn(iB) && m_interGroupPairs[i].second.BitIsOn(iA)) 
+        return true;
+    }
+    return false;
+  }
+
+  bool OBFunction::IsConstrained(unsigned int iA, unsigned int iB) const
+  {
+    return m_constraints && m_constraints->IsConstrained(iA, iB);
+  }
+
+  bool OBFunction::IsConstrained(unsigned int iA, unsigned int iB, unsigned int iC) const
+  {
+    return m_constraints && m_constraints->IsConstrained(iA, iB) && m_constraints->IsConstrained(iB, iC)
+      && m_constraints->IsConstrained(iA, iC);
+  }
+
   //  
   //         f(1) - f(0)
   // f'(0) = -----------      f(1) = f(0+h)
@@ -112,32 +350,33 @@ namespace OBFFs {
     double e_orig, e_plus_delta, delta, dx, dy, dz;
     delta = 1.0e-5;
 
-    const Eigen::Vector3d va = m_positions.at(index);
+    std::vector<Eigen::Vector3d> &positions = GetPositions();
+    const Eigen::Vector3d va = positions.at(index);
     Compute(OBFunction::Value);
     e_orig = GetValue();
     
     // X direction
-    m_positions[index].x() += delta;
+    positions[index].x() += delta;
     Compute(OBFunction::Value);
     e_plus_delta = GetValue();
     dx = (e_plus_delta - e_orig) / delta;
     
     // Y direction
-    m_positions[index].x() = va.x();
-    m_positions[index].y() += delta;
+    positions[index].x() = va.x();
+    positions[index].y() += delta;
     Compute(OBFunction::Value);
     e_plus_delta = GetValue();
     dy = (e_plus_delta - e_orig) / delta;
     
     // Z direction
-    m_positions[index].y() = va.y();
-    m_positions[index].z() += delta;
+    positions[index].y() = va.y();
+    positions[index].z() += delta;
     Compute(OBFunction::Value);
     e_plus_delta = GetValue();
     dz = (e_plus_delta - e_orig) / delta;
 
     // reset coordinates to original
-    m_positions[index].z() = va.z();
+    positions[index].z() = va.z();
 
     return Eigen::Vector3d(-dx, -dy, -dz);
   }
@@ -152,7 +391,8 @@ namespace OBFFs {
     double e_0, e_1, e_2, delta, dx, dy, dz;
     delta = 1.0e-5;
 
-    const Eigen::Vector3d va = m_positions.at(index);
+    std::vector<Eigen::Vector3d> &positions = GetPositions();
+    const Eigen::Vector3d va = positions.at(index);
 
     // calculate f(0)
     Compute(OBFunction::Value);
@@ -163,51 +403,51 @@ namespace OBFFs {
     //
     
     // calculate f(1)
-    m_positions[index].x() += delta;
+    positions[index].x() += delta;
     Compute(OBFunction::Value);
     e_1 = GetValue();
 
     // calculate f(2)
-    m_positions[index].x() += delta;
+    positions[index].x() += delta;
     Compute(OBFunction::Value);
     e_2 = GetValue();
     
     dx = (e_2 - 2 * e_1 + e_0) / (delta * delta);
-    m_positions[index].x() = va.x();
+    positions[index].x() = va.x();
     
     // 
     // Y direction
     //
     
     // calculate f(1)
-    m_positions[index].y() += delta;
+    positions[index].y() += delta;
     Compute(OBFunction::Value);
     e_1 = GetValue();
 
     // calculate f(2)
-    m_positions[index].y() += delta;
+    positions[index].y() += delta;
     Compute(OBFunction::Value);
     e_2 = GetValue();
 
     dy = (e_2 - 2 * e_1 + e_0) / (delta * delta);
-    m_positions[index].y() = va.y();
+    positions[index].y() = va.y();
 
     // 
     // Z direction
     //
     
     // calculate f(1)
-    m_positions[index].z() += delta;
+    positions[index].z() += delta;
     Compute(OBFunction::Value);
     e_1 = GetValue();
 
     // calculate f(2)
-    m_positions[index].z() += delta;
+    positions[index].z() += delta;
     Compute(OBFunction::Value);
     e_2 = GetValue();
 
     dz = (e_2 - 2 * e_1 + e_0) / (delta * delta);
-    m_positions[index].z() = va.z();
+    positions[index].z() = va.z();
 
 
     return Eigen::Vector3d(-dx, -dy, -dz);
@@ -24,6 +24,10 @@ GNU General Public License for more details.
 #include <vector>
 #include <Eigen/Core>
 
+#include <openbabel/bitvec.h>
+
+#include <OBArena>
+
 namespace OpenBabel {
 
   class OBMol;
@@ -35,6 +39,10 @@ namespace OBFFs {
   class OBParameterDB;
   class OBFFType;
   class OBChargeMethod;
+  class OBDecomposition;
+  class OBProfiler;
+  class OBConstraints;
+  class OBScheduler;
 
   /** @class OBFunction
    *  @brief Base class for functions (e.g. force fields, ...) of 3D variables (e.g. atom coordinates, ...).
@@ -65,12 +73,46 @@ namespace OBFFs {
        * Atom positions and gradients will be handled by the OBFunction class. Subclasses can overload
        * this method to do their own setup but should always call OBFunction::Setup() to make sure the
        * positions are copied and gradients are set to zero.
+       *
+       * @return False if any of the terms could not be set up (e.g. missing parameters).
        */
       virtual bool Setup(/*const*/ OBMol &mol);
+      /**
+       * Set up a copy (see NewInstance()) of @p source, which was set up for the
+       * same @p mol. Subclasses reuse what @p source computed in the shared
+       * OBFFType and OBChargeMethod (types, charges) and its automatic choices
+       * instead of computing them again, the terms are set up for this function.
+       * The default calls Setup().
+       */
+      virtual bool SetupCopy(const OBFunction *source, OBMol &mol)
+      {
+        return Setup(mol);
+      }
+      /**
+       * Make the terms rebuild their neighbor lists in the next Compute(), for
+       * positions that do not follow from the previous ones (e.g. the next
+       * trajectory frame). See OBFunctionTerm::ResetNeighborLists().
+       */
+      void ResetNeighborLists();
       /**
        * Perform the specified OBFunction::Computation. 
        */
       virtual void Compute(Computation computation = Value) = 0;
+      /**
+       * Compute the value, but stop as soon as the value is known to be larger than
+       * @p maxValue. This is useful to reject clashing conformers or poses without
+       * computing all terms and pairs.
+       *
+       * Terms without a lower bound (see OBFunctionTerm::GetLowerBound()) are computed
+       * first, followed by the clash sensitive terms (e.g. van der Waals) and the
+       * remaining terms. The computation stops when the computed value plus the lower
+       * bounds for the terms not computed yet exceeds @p maxValue. The result is only
+       * exact when the lower bounds hold, see Coulomb for a term with a heuristic bound.
+       *
+       * @return True if the value is not larger than @p maxValue, GetValue() returns
+       * the value. False if the computation was stopped, GetValue() is meaningless.
+       */
+      bool ComputeBounded(double maxValue);
       /**
        * Implemented by subclasses to return the current value (i.e. OBFunctionImpl).
        * Call Compute() before GetValue().
@@ -84,20 +126,71 @@ namespace OBFFs {
        * Get the number of particles
        */
       unsigned int NumParticles() const { return m_positions.size(); }
+      //! \name Atom ordering
+      //@{
+      /**
+       * Enable or disable sorting the atoms along a Morton (Z-order) curve in Setup().
+       * Atoms close in space are then close in memory, this improves the cache usage
+       * for large systems. Disabled by default.
+       *
+       * GetPositions() and GetGradients() always use the input (OBMol) order, as do
+       * OBFFType, OBChargeMethod and the interaction groups. The terms work on
+       * GetInternalPositions() and GetInternalGradients() with the indexes from
+       * InternalIndex(). Use InputIndex() to convert back.
+       */
+      void SetAtomReordering(bool enable) { m_reorder = enable; }
+      bool GetAtomReordering() const { return m_reorder; }
+      /**
+       * @return The internal index for the atom with input index @p index (0...N-1).
+       */
+      unsigned int InternalIndex(unsigned int index) const
+      {
+        return m_internal.empty() ? index : m_internal[index];
+      }
+      /**
+       * @return The input index (0...N-1) for the atom with internal index @p index.
+       */
+      unsigned int InputIndex(unsigned int index) const
+      {
+        return m_order.empty() ? index : m_order[index];
+      }
+      /**
+       * Get the position for the atom with input index @p index (0...N-1).
+       */
+      Eigen::Vector3d& GetPosition(unsigned int index) { return GetPositions()[index]; }
+      const Eigen::Vector3d& GetPosition(unsigned int index) const { return GetPositions()[index]; }
+      /**
+       * Get the gradient for the atom with input index @p index (0...N-1).
+       */
+      Eigen::Vector3d& GetGradient(unsigned int index) { return GetGradients()[index]; }
+      const Eigen::Vector3d& GetGradient(unsigned int index) const { return GetGradients()[index]; }
+      /**
+       * Get the atom positions in the internal order, for the terms. Compute() copies
+       * the positions from GetPositions() first when the atoms are reordered.
+       */
+      std::vector<Eigen::Vector3d>& GetInternalPositions() { return m_positions; }
+      const std::vector<Eigen::Vector3d>& GetInternalPositions() const { return m_positions; }
+      /**
+       * Get the atom gradients in the internal order, for the terms. Compute() copies
+       * them to GetGradients() when the atoms are reordered.
+       */
+      std::vector<Eigen::Vector3d>& GetInternalGradients() { return m_gradients; }
+      const std::vector<Eigen::Vector3d>& GetInternalGradients() const { return m_gradients; }
+      //@}
       /** 
-       * Get the atom positions.
+       * Get the atom positions (input order).
        */
-      std::vector<Eigen::Vector3d>&  GetPositions() { return m_positions; }
-      const std::vector<Eigen::Vector3d>&  GetPositions() const { return m_positions; }
+      std::vector<Eigen::Vector3d>&  GetPositions() { return m_order.empty() ? m_positions : m_inputPositions; }
+      const std::vector<Eigen::Vector3d>&  GetPositions() const { return m_order.empty() ? m_positions : m_inputPositions; }
       /** 
        * Copy atom positions to molecule
        */
       bool CopyPositionsToMol(OBMol& mol) const;
       /** 
-       * Get the atom gradients.
+       * Get the atom gradients (input order).
        */
-      std::vector<Eigen::Vector3d>&  GetGradients() { return m_gradients; } 
-      const std::vector<Eigen::Vector3d>&  GetGradients() const { return m_gradients; } 
+      std::vector<Eigen::Vector3d>&  GetGradients() { return m_order.empty() ? m_gradients : m_inputGradients; }
+      const std::vector<Eigen::Vector3d>&  GetGradients() const { return m_order.empty() ? m_gradients : m_inputGradients; }
       /**
        * @return True if this function has analytical gradients. 
        */
@@ -145,6 +238,104 @@ namespace OBFFs {
 
       std::string GetOptions() const;
       void SetOptions(const std::string &options);
+      /**
+       * Create a new function of the same type (using the OBFunctionFactory for GetName())
+       * with the same options, interaction groups and atom ordering. The parameter database,
+       * OBFFType, OBChargeMethod and OBConstraints are shared. The new function still needs to be set up,
+       * this can be used to evaluate the same system in several threads.
+       *
+       * @return The new function or 0 if there is no factory for GetName().
+       */
+      OBFunction* NewInstance() const;
+      /**
+       * Set the OBDecomposition to accumulate the per-atom and per-group values in,
+       * 0 (the default) disables the decomposition. The decomposition is not owned.
+       */
+      void SetDecomposition(OBDecomposition *decomposition) { m_decomposition = decomposition; }
+      OBDecomposition* GetDecomposition() const { return m_decomposition; }
+      /**
+       * Set the OBProfiler to measure the terms and neighbor list updates with,
+       * 0 (the default) disables profiling. The profiler is not owned.
+       */
+      void SetProfiler(OBProfiler *profiler) { m_profiler = profiler; }
+      OBProfiler* GetProfiler() const { return m_profiler; }
+      /**
+       * Set the OBConstraints for dynamics, 0 (the default) for none. The bond terms
+       * skip the constrained bonds, the constraints must be set before calling Setup().
+       * The constraints are not owned.
+       */
+      void SetConstraints(OBConstraints *constraints) { m_constraints = constraints; }
+      OBConstraints* GetConstraints() const { return m_constraints; }
+      /**
+       * Get the OBArena for the interaction arrays of the terms. It is reset by
+       * Setup() before the terms are set up, the memory is kept for the next
+       * molecule.
+       */
+      OBArena& GetArena() { return m_arena; }
+      const OBArena& GetArena() const { return m_arena; }
+      /**
+       * Set the number of OpenMP threads for the terms, 0 (the default) uses the
+       * OpenMP default (i.e. OMP_NUM_THREADS).
+       */
+      void SetNumThreads(int numThreads) { m_numThreads = (numThreads > 0) ? numThreads : 0; }
+      /**
+       * @return The number of threads used by the terms (1 without OpenMP).
+       */
+      int GetNumThreads() const;
+      /**
+       * @return True if the distance between atoms @p iA & @p iB is constrained.
+       */
+      bool IsConstrained(unsigned int iA, unsigned int iB) const;
+      /**
+       * @return True if all three distances between atoms @p iA, @p iB & @p iC are
+       * constrained (i.e. the angle is rigid).
+       */
+      bool IsConstrained(unsigned int iA, unsigned int iB, unsigned int iC) const;
+
+      //! \name Interaction groups
+      //@{
+      /**
+       * Enable the bonded interactions (bonds, angles, torsions, ...) within @p group.
+       * Bit i in @p group refers to atom index i (0...N-1). When any group is set,
+       * terms only set up the interactions selected by the groups. Groups should be
+       * set before calling Setup().
+       */
+      void AddIntraGroup(const OBBitVec &group);
+      /**
+       * Enable the non-bonded interactions (van der Waals, electrostatic) between
+       * all atoms in @p group.
+       */
+      void AddInterGroup(const OBBitVec &group);
+      /**
+       * Enable the non-bonded interactions (van der Waals, electrostatic) between the
+       * atoms in @p group1 and the atoms in @p group2.
+       */
+      void AddInterGroups(const OBBitVec &group1, const OBBitVec &group2);
+      /**
+       * Remove all groups, all interactions will be set up again.
+       */
+      void ClearGroups();
+      /**
+       * @return True if any interaction group is set.
+       */
+      bool HasGroups() const
+      {
+        return !m_intraGroups.empty() || !m_interGroups.empty() || !m_interGroupPairs.empty();
+      }
+      /**
+       * @return True if the bonded interaction between atoms @p iA & @p iB is enabled
+       * (i.e. there are no groups or both atoms are in a single intra group).
+       */
+      bool IsIntraGroup(unsigned int iA, unsigned int iB) const;
+      bool IsIntraGroup(unsigned int iA, unsigned int iB, unsigned int iC) const;
+      bool IsIntraGroup(unsigned int iA, unsigned int iB, unsigned int iC, unsigned int iD) const;
+      /**
+       * @return True if the non-bonded interaction between atoms @p iA & @p iB is enabled
+       * (i.e. there are no groups, both atoms are in a single inter group or the atoms
+       * are in the two groups of a pair added with AddInterGroups()).
+       */
+      bool IsInterGroup(unsigned int iA, unsigned int iB) const;
+      //@}
     
       /*! Calculate the potential energy function derivative numerically with 
        *  repect to the coordinates of atom with index a (this vector is the gradient)
@@ -159,6 +350,9 @@ namespace OBFFs {
       Eigen::Vector3d NumericalSecondDerivative(unsigned int index);
  
     protected:
+      //! OBScheduler::ComputeValue() runs the terms itself and gathers the positions
+      friend class OBScheduler;
+
       struct Option {
         Option(int _line, const std::string &_name, const std::string &_value) 
             : line(_line), name(_name), value(_value)
@@ -171,15 +365,38 @@ namespace OBFFs {
       };
       virtual void ProcessOptions(std::vector<Option> &options) = 0;
       virtual std::string GetDefaultOptions() const = 0;
+      /**
+       * Copy GetPositions() to the internal order. Subclasses that compute terms call
+       * this at the start of Compute(), it does nothing when the atoms are not reordered.
+       */
+      void GatherPositions();
+      /**
+       * Copy the internal gradients to GetGradients(). Subclasses that compute terms
+       * call this at the end of Compute(Gradients).
+       */
+      void ScatterGradients();
 
       OBLogFile *m_logfile;
       OBParameterDB *m_parameterDB;
       OBFFType *m_obffType;
       OBChargeMethod *m_obChargeMethod;
+      OBDecomposition *m_decomposition;
+      OBProfiler *m_profiler;
+      OBConstraints *m_constraints;
+      OBArena m_arena;
+      int m_numThreads; //!< 0: OpenMP default
       std::string m_options;
       std::vector<OBFunctionTerm*> m_terms;
-      std::vector<Eigen::Vector3d> m_positions;
-      std::vector<Eigen::Vector3d> m_gradients;
+      std::vector<Eigen::Vector3d> m_positions; //!< internal order
+      std::vector<Eigen::Vector3d> m_gradients; //!< internal order
+      std::vector<Eigen::Vector3d> m_inputPositions; //!< input order (empty: no reordering)
+      std::vector<Eigen::Vector3d> m_inputGradients; //!< input order (empty: no reordering)
+      std::vector<OBBitVec> m_intraGroups;
+      std::vector<OBBitVec> m_interGroups;
+      std::vector<std::pair<OBBitVec, OBBitVec> > m_interGroupPairs;
+      bool m_reorder;
+      std::vector<unsigned int> m_order; //!< input index for each internal index (empty: no reordering)
+      std::vector<unsigned int> m_internal; //!< internal index for each input index (empty: no reordering)
   };
 
   class OBFunctionFactory
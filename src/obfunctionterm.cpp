@@ -19,6 +19,7 @@ GNU General Public License for more details.
 
 #include <OBFunctionTerm>
 #include <OBFunction>
+#include <OBFFType>
 
 namespace OpenBabel {
 namespace OBFFs {
@@ -30,6 +31,65 @@ namespace OBFFs {
   OBFunctionTerm::~OBFunctionTerm()
   {}
 
+  const int OBFunctionTerm::ParallelThreshold;
+
+  bool OBFunctionTerm::IsNonBondedPair(unsigned int iA, unsigned int iB) const
+  {
+    OBFFType *type = m_function->GetOBFFType();
+    if (!m_function->IsInterGroup(iA, iB))
+      return false;
+    return !type->IsConnected(iA, iB) && !type->IsOneThree(iA, iB);
+  }
+
+  void OBFunctionTerm::ColorInteractions(const std::vector<unsigned int> &atoms, unsigned int atomsPerInteraction,
+      std::vector<unsigned int> &order, std::vector<unsigned int> &colorOffsets) const
+  {
+    const unsigned int numInteractions = atomsPerInteraction ? atoms.size() / atomsPerInteraction : 0;
+    // the colors already used by the interactions of each atom
+    std::vector<std::vector<bool> > used(m_function->NumParticles());
+    std::vector<unsigned int> colors(numInteractions);
+    unsigned int numColors = 0;
+
+    for (unsigned int i = 0; i < numInteractions; ++i) {
+      const unsigned int *interaction = &atoms[i * atomsPerInteraction];
+      // find the lowest color not used by any of the atoms
+      unsigned int color = 0;
+      bool free = false;
+      while (!free) {
+        free = true;
+        for (unsigned int a = 0; a < atomsPerInteraction; ++a) {
+          const std::vector<bool> &atomColors = used[interaction[a]];
+          if (color < atomColors.size() && atomColors[color]) {
+            free = false;
+            ++color;
+            break;
+          }
+        }
+      }
+
+      for (unsigned int a = 0; a < atomsPerInteraction; ++a) {
+        std::vector<bool> &atomColors = used[interaction[a]];
+        if (atomColors.size() <= color)
+          atomColors.resize(color + 1, false);
+        atomColors[color] = true;
+      }
+      colors[i] = color;
+      if (color >= numColors)
+        numColors = color + 1;
+    }
+
+    // counting sort on color
+    colorOffsets.assign(numColors + 1, 0);
+    for (unsigned int i = 0; i < numInteractions; ++i)
+      colorOffsets[colors[i] + 1]++;
+    for (unsigned int c = 0; c < numColors; ++c)
+      colorOffsets[c + 1] += colorOffsets[c];
+    std::vector<unsigned int> next(colorOffsets.begin(), colorOffsets.end() - 1);
+    order.resize(numInteractions);
+    for (unsigned int i = 0; i < numInteractions; ++i)
+      order[next[colors[i]]++] = i;
+  }
+
 }
 } // end namespace OpenBabel
 
@@ -2,6 +2,7 @@
 #define OBFFS_FUNCTIONTERM_H
 
 #include <vector>
+#include <limits>
 
 #include <OBVariant>
 #include <OBFunction>
@@ -42,6 +43,43 @@ namespace OBFFs {
        * Call Compute() before GetValue().
        */
       virtual double GetValue() const = 0;
+      /**
+       * Get a lower bound for the value of this term, independent of the positions.
+       * Used by OBFunction::ComputeBounded(). The default is -infinity (no bound).
+       */
+      virtual double GetLowerBound() const
+      {
+        return -std::numeric_limits<double>::infinity();
+      }
+      /**
+       * @return True if this term becomes large for clashing atoms (e.g. van der Waals
+       * repulsion). These terms are computed first by OBFunction::ComputeBounded().
+       */
+      virtual bool IsClashSensitive() const
+      {
+        return false;
+      }
+      /**
+       * Compute the value, terms can stop early when @p offset + the value computed
+       * so far + a lower bound for the remaining interactions exceeds @p maxValue.
+       * The default implementation computes the full value.
+       *
+       * @param offset The value of the terms computed before this one plus the lower
+       * bounds for the terms computed after this one.
+       * @return False if @p offset + value is known to be larger than @p maxValue.
+       */
+      virtual bool ComputeBounded(double offset, double maxValue)
+      {
+        Compute(OBFunction::Value);
+        return offset + GetValue() <= maxValue;
+      }
+      /**
+       * Rebuild the neighbor lists in the next Compute(). The default does
+       * nothing (no neighbor lists).
+       */
+      virtual void ResetNeighborLists()
+      {
+      }
  
       /**
        * Get the the parameter data base for this term.
@@ -49,6 +87,41 @@ namespace OBFFs {
       //virtual OBParameterDB* GetParameterDB() const = 0;
 
     protected:
+      /**
+       * Minimum number of interactions in a color before Compute() uses multiple
+       * threads (OpenMP) for it.
+       */
+      static const int ParallelThreshold = 512;
+      /**
+       * Color the interactions (bonds, angles, ...) such that no two interactions
+       * with the same color share an atom (greedy coloring). The interactions within
+       * a color can then be computed in parallel and add their gradients without
+       * write conflicts.
+       *
+       * @param atoms The atom indexes, @p atomsPerInteraction for each interaction.
+       * @param atomsPerInteraction The number of atoms in an interaction.
+       * @param order Set to the interaction indexes sorted by color.
+       * @param colorOffsets Set to the offsets for each color in @p order. Color c
+       * contains the interactions order[colorOffsets[c]] to order[colorOffsets[c+1]-1].
+       */
+      void ColorInteractions(const std::vector<unsigned int> &atoms, unsigned int atomsPerInteraction,
+          std::vector<unsigned int> &order, std::vector<unsigned int> &colorOffsets) const;
+      /**
+       * @return True if atoms @p iA & @p iB (input order) have a non-bonded interaction:
+       * the interaction groups enable it and the atoms are not in a 1-2 or 1-3 relation.
+       */
+      bool IsNonBondedPair(unsigned int iA, unsigned int iB) const;
+      /**
+       * Reorder the first order.size() elements of @p array: array[i] = old array[order[i]].
+       */
+      template <typename T>
+      static void Permute(T *array, const std::vector<unsigned int> &order)
+      {
+        std::vector<T> copy(array, array + order.size());
+        for (unsigned int i = 0; i < order.size(); ++i)
+          array[i] = copy[order[i]];
+      }
+
       OBFunction *m_function;
   };
 
@@ -17,22 +17,104 @@ GNU General Public License for more details.
 ***********************************************************************/
 
 #include <OBLogFile>
+#include <QThread>
+#include <QWaitCondition>
 #include <iostream>
+#include <cmath>
+#include <cstdio>
 
 namespace OpenBabel {
 namespace OBFFs {
   
+  namespace {
+    //! Time between writes by the flusher thread (ms).
+    const unsigned long FlushInterval = 50;
 
-  OBLogFile::OBLogFile() : m_loglvl(High), m_logos(&std::cout)
+    const char *levelNames[] = { "none", "low", "medium", "high" };
+
+    void writeJsonString(std::ostream &os, const char *str)
+    {
+      os << '"';
+      for (; *str; ++str) {
+        const unsigned char c = *str;
+        if (c == '"' || c == '\\')
+          os << '\\' << c;
+        else if (c == '\n')
+          os << "\\n";
+        else if (c == '\t')
+          os << "\\t";
+        else if (c < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          os << buf;
+        } else
+          os << c;
+      }
+      os << '"';
+    }
+
+    void writeJsonNumber(std::ostream &os, double value)
+    {
+      // JSON has no inf/nan
+      if (value != value || std::fabs(value) > 1e308) {
+        os << "null";
+        return;
+      }
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%.10g", value);
+      os << buf;
+    }
+  }
+
+  class OBLogFileFlusher : public QThread
+  {
+    public:
+      OBLogFileFlusher(OBLogFile *logfile) : m_logfile(logfile), m_quit(false) {}
+      void quit()
+      {
+        QMutexLocker locker(&m_mutex);
+        m_quit = true;
+        m_condition.wakeAll();
+      }
+    protected:
+      void run()
+      {
+        QMutexLocker locker(&m_mutex);
+        while (!m_quit) {
+          m_condition.wait(&m_mutex, FlushInterval);
+          locker.unlock();
+          m_logfile->m_writeMutex.lock();
+          m_logfile->drain();
+          m_logfile->m_logos->flush();
+          m_logfile->m_writeMutex.unlock();
+          locker.relock();
+        }
+      }
+    private:
+      OBLogFile *m_logfile;
+      QMutex m_mutex;
+      QWaitCondition m_condition;
+      bool m_quit;
+  };
+
+  OBLogFile::OBLogFile() : m_loglvl(High), m_logos(&std::cout), m_format(Text), m_slots(0),
+      m_head(0), m_tail(0), m_numDropped(0), m_numReported(0), m_thread(0)
   {
+    m_clock.start();
   }
   
   OBLogFile::~OBLogFile()
   {
+    SetAsynchronous(false);
+    delete [] m_slots;
   }
 
   bool OBLogFile::SetOutputStream(std::ostream* pos)
   {
+    QMutexLocker locker(&m_writeMutex);
+    if (m_slots)
+      drain();
+
     if(pos)
       m_logos = pos;
     else
@@ -40,23 +122,201 @@ namespace OBFFs {
     
     return true;
   }
+
+  void OBLogFile::SetFormat(Format format)
+  {
+    QMutexLocker locker(&m_writeMutex);
+    if (m_slots)
+      drain();
+    m_format = format;
+  }
+
+  void OBLogFile::SetAsynchronous(bool async)
+  {
+    if (async == (m_thread != 0))
+      return;
+
+    if (async) {
+      if (!m_slots) {
+        m_slots = new Slot[BufferSize];
+        for (int i = 0; i < BufferSize; ++i)
+          m_slots[i].sequence = i;
+        m_head = 0;
+        m_tail = 0;
+      }
+      m_thread = new OBLogFileFlusher(this);
+      m_thread->start();
+    } else {
+      m_thread->quit();
+      m_thread->wait();
+      delete m_thread;
+      m_thread = 0;
+      Flush();
+    }
+  }
+
+  void OBLogFile::Flush()
+  {
+    QMutexLocker locker(&m_writeMutex);
+    if (m_slots)
+      drain();
+    if (m_logos)
+      m_logos->flush();
+  }
     
   void OBLogFile::Write(const std::string &msg)
   {
-    if (!m_logos)
-      return;
-     
-    *m_logos << msg;
+    message(Low, msg);
   }
 
   void OBLogFile::Write(LogLevel lvl, const std::string &msg)
   {
-    if (!m_logos || (m_loglvl < lvl))
+    if (m_loglvl >= lvl)
+      message(lvl, msg);
+  }
+
+  void OBLogFile::message(int level, const std::string &msg)
+  {
+    if (!m_logos)
+      return;
+
+    if (m_format == Text && !m_thread) {
+      *m_logos << msg;
       return;
-     
-    *m_logos << msg;
+    }
+
+    Record record;
+    record.level = level;
+    record.numFields = 0;
+    record.time = m_clock.elapsed();
+    record.event = "message";
+    record.format = 0;
+    record.text = new std::string(msg);
+    if (m_thread)
+      enqueue(record);
+    else {
+      writeRecord(record);
+      delete record.text;
+    }
   }
 
+  void OBLogFile::push(int level, const char *event, const char *format, int numFields,
+      const char * const *keys, const double *values)
+  {
+    Record record;
+    record.level = level;
+    record.numFields = numFields;
+    record.time = m_clock.elapsed();
+    record.event = event;
+    record.format = format;
+    record.text = 0;
+    for (int i = 0; i < numFields; ++i) {
+      record.keys[i] = keys[i];
+      record.values[i] = values[i];
+    }
+
+    if (m_thread)
+      enqueue(record);
+    else if (m_logos)
+      writeRecord(record);
+  }
+
+  /*
+   * Bounded multi-producer queue: slot i is free for position p when its
+   * sequence is p, a producer claims p by incrementing m_head and publishes
+   * the record by setting the sequence to p + 1. The writer releases the slot
+   * for position p + BufferSize after copying the record.
+   */
+  void OBLogFile::enqueue(const Record &record)
+  {
+    int pos = m_head;
+    while (true) {
+      Slot &slot = m_slots[static_cast<unsigned int>(pos) % BufferSize];
+      const int diff = slot.sequence.fetchAndAddAcquire(0) - pos;
+      if (diff == 0) {
+        if (m_head.testAndSetOrdered(pos, pos + 1)) {
+          slot.record = record;
+          slot.sequence.fetchAndStoreRelease(pos + 1);
+          return;
+        }
+      } else if (diff < 0) {
+        // full, never block the caller
+        m_numDropped.fetchAndAddRelaxed(1);
+        delete record.text;
+        return;
+      }
+      pos = m_head;
+    }
+  }
+
+  void OBLogFile::drain()
+  {
+    while (true) {
+      Slot &slot = m_slots[static_cast<unsigned int>(m_tail) % BufferSize];
+      if (slot.sequence.fetchAndAddAcquire(0) != m_tail + 1)
+        break;
+      const Record record = slot.record;
+      slot.sequence.fetchAndStoreRelease(m_tail + BufferSize);
+      ++m_tail;
+      writeRecord(record);
+      delete record.text;
+    }
+
+    const int numDropped = m_numDropped;
+    if (numDropped != m_numReported) {
+      Record record;
+      record.level = Low;
+      record.numFields = 1;
+      record.time = m_clock.elapsed();
+      record.event = "log_dropped";
+      record.format = "  (%.0f log records dropped)\n";
+      record.text = 0;
+      record.keys[0] = "count";
+      record.values[0] = numDropped - m_numReported;
+      m_numReported = numDropped;
+      writeRecord(record);
+    }
+  }
+
+  void OBLogFile::writeRecord(const Record &record)
+  {
+    std::ostream &os = *m_logos;
+
+    if (m_format == JsonLines) {
+      char time[32];
+      snprintf(time, sizeof(time), "%.3f", 0.001 * record.time);
+      os << "{\"time\":" << time << ",\"level\":\"" << levelNames[record.level] << "\",\"event\":";
+      writeJsonString(os, record.event);
+      if (record.text) {
+        os << ",\"text\":";
+        writeJsonString(os, record.text->c_str());
+      }
+      for (int i = 0; i < record.numFields; ++i) {
+        os << ',';
+        writeJsonString(os, record.keys[i]);
+        os << ':';
+        writeJsonNumber(os, record.values[i]);
+      }
+      os << "}\n";
+      return;
+    }
+
+    if (record.text) {
+      os << *record.text;
+    } else if (record.format) {
+      double values[MaxFields] = { 0.0, 0.0, 0.0, 0.0 };
+      for (int i = 0; i < record.numFields; ++i)
+        values[i] = record.values[i];
+      char buf[1024];
+      snprintf(buf, sizeof(buf), record.format, values[0], values[1], values[2], values[3]);
+      os << buf;
+    } else {
+      os << record.event;
+      for (int i = 0; i < record.numFields; ++i)
+        os << ' ' << record.keys[i] << '=' << record.values[i];
+      os << '\n';
+    }
+  }
 
 }
 } // end namespace OpenBabel
@@ -22,6 +22,10 @@ GNU General Public License for more details.
 #include <openbabel/babelconfig.h>
 #include <string>
 
+#include <QAtomicInt>
+#include <QMutex>
+#include <QTime>
+
 #undef OBAPI
 #define OBAPI
 
@@ -45,6 +49,35 @@ namespace OBFFs {
   };
 
  
+  class OBLogFileFlusher;
+
+  /**
+   * @class OBLogFile oblogfile.h <OBLogFile>
+   * @brief Level-filtered log with optional structured records.
+   *
+   * Besides the plain Write() methods, code that logs often (e.g. every
+   * minimization step) can use Log() to add a structured record: an event
+   * name and up to four named numbers. The names and the text format must be
+   * string literals (they are stored as pointers), the numbers are only
+   * formatted when the record is written:
+   *
+   * @code
+   * logfile->Log(OBLogFile::Low, "cg_step", " %4.0f    %8.3f\n", "step", step, "energy", e);
+   * @endcode
+   *
+   * The records are written as text (using the format, numbers are passed as
+   * double) or as JSON lines (one object per record, see SetFormat()):
+   *
+   * @code
+   * {"time":0.125,"level":"low","event":"cg_step","step":10,"energy":-12.5}
+   * @endcode
+   *
+   * By default records are written immediately. SetAsynchronous() starts a
+   * background thread that writes the records, Log() then only copies the
+   * record into a lock-free ring buffer and never blocks. Records that do
+   * not fit in a full buffer are dropped and counted ("log_dropped" record).
+   * Log() may be called by several threads in the asynchronous mode.
+   */
   class OBAPI OBLogFile
   {     
     public:
@@ -55,6 +88,11 @@ namespace OBFFs {
         Medium,    //!< individual energy terms
         High       //!< individual calculations and parameters
       };
+      enum Format
+      {
+        Text,      //!< formatted messages as before
+        JsonLines  //!< one JSON object per record
+      };
  
       OBLogFile();
       /** 
@@ -97,7 +135,7 @@ namespace OBFFs {
        * }
        * @endcode
        */
-      bool SetLogLevel(LogLevel level) { m_loglvl = level; }
+      bool SetLogLevel(LogLevel level) { m_loglvl = level; return true; }
       /** 
        * @return The log level.
        */ 
@@ -117,6 +155,75 @@ namespace OBFFs {
       void Write(LogLevel lvl, const std::string &msg);
       std::ostream& operator()() { return *m_logos; }
       //@}
+
+      //! \name Structured logging
+      //@{
+      /**
+       * Set the output format for Write() messages and Log() records.
+       */
+      void SetFormat(Format format);
+      Format GetFormat() const { return m_format; }
+      /**
+       * Write the records from a background thread (@p async true) or
+       * immediately (@p async false, default). Disabling writes the pending
+       * records.
+       */
+      void SetAsynchronous(bool async);
+      bool IsAsynchronous() const { return m_thread != 0; }
+      /**
+       * Write all pending records to the output stream.
+       */
+      void Flush();
+      /**
+       * Add a record with event name @p event if the log level is at least
+       * @p lvl. @p format is the text format (0 to write "event key=value ...")
+       * and takes the values as double.
+       */
+      void Log(LogLevel lvl, const char *event, const char *format = 0)
+      {
+        if (m_loglvl >= lvl)
+          push(lvl, event, format, 0, 0, 0);
+      }
+      void Log(LogLevel lvl, const char *event, const char *format, const char *key1, double value1)
+      {
+        if (m_loglvl >= lvl) {
+          const char *keys[1] = { key1 };
+          const double values[1] = { value1 };
+          push(lvl, event, format, 1, keys, values);
+        }
+      }
+      void Log(LogLevel lvl, const char *event, const char *format, const char *key1, double value1,
+          const char *key2, double value2)
+      {
+        if (m_loglvl >= lvl) {
+          const char *keys[2] = { key1, key2 };
+          const double values[2] = { value1, value2 };
+          push(lvl, event, format, 2, keys, values);
+        }
+      }
+      void Log(LogLevel lvl, const char *event, const char *format, const char *key1, double value1,
+          const char *key2, double value2, const char *key3, double value3)
+      {
+        if (m_loglvl >= lvl) {
+          const char *keys[3] = { key1, key2, key3 };
+          const double values[3] = { value1, value2, value3 };
+          push(lvl, event, format, 3, keys, values);
+        }
+      }
+      void Log(LogLevel lvl, const char *event, const char *format, const char *key1, double value1,
+          const char *key2, double value2, const char *key3, double value3, const char *key4, double value4)
+      {
+        if (m_loglvl >= lvl) {
+          const char *keys[4] = { key1, key2, key3, key4 };
+          const double values[4] = { value1, value2, value3, value4 };
+          push(lvl, event, format, 4, keys, values);
+        }
+      }
+      /**
+       * @return The number of records dropped because the buffer was full.
+       */
+      int NumDropped() const { return m_numDropped; }
+      //@}
       
       bool IsNone() const { return (m_loglvl >= None) ? true : false; }
       bool IsLow() const { return (m_loglvl >= Low) ? true : false; }
@@ -127,7 +234,45 @@ namespace OBFFs {
       // some data in class for fast inline Get/Set functions
       LogLevel      m_loglvl; //!< Log level for output
       std::ostream* m_logos; //!< Output for logfile 
-  }; // class OBForceField
+
+    private:
+      friend class OBLogFileFlusher;
+      OBLogFile(const OBLogFile&);
+      OBLogFile& operator=(const OBLogFile&);
+
+      enum { MaxFields = 4, BufferSize = 4096 };
+      struct Record
+      {
+        int level, numFields, time; //!< time in ms since construction
+        const char *event, *format;
+        std::string *text; //!< Write() message (owned), 0 for Log() records
+        const char *keys[MaxFields];
+        double values[MaxFields];
+      };
+      struct Slot
+      {
+        QAtomicInt sequence; //!< position the slot is ready for (see push())
+        Record record;
+      };
+
+      void message(int level, const std::string &msg);
+      void push(int level, const char *event, const char *format, int numFields,
+          const char * const *keys, const double *values);
+      void enqueue(const Record &record);
+      //! Write the pending records (called with m_writeMutex locked).
+      void drain();
+      void writeRecord(const Record &record);
+
+      Format m_format;
+      QTime m_clock;
+      Slot *m_slots; //!< ring buffer, only allocated in the asynchronous mode
+      QAtomicInt m_head; //!< next position to fill (producers)
+      int m_tail; //!< next position to write (m_writeMutex)
+      QAtomicInt m_numDropped;
+      int m_numReported; //!< dropped records reported by drain()
+      QMutex m_writeMutex; //!< serializes writing to m_logos in the asynchronous mode
+      OBLogFileFlusher *m_thread;
+  }; // class OBLogFile
 
 }// namespace OpenBabel
 }
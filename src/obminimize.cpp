@@ -19,12 +19,10 @@ GNU General Public License for more details.
 ***********************************************************************/
 
 #include <OBMinimize>
+#include <OBTrajectory>
+#include <OBScheduler>
 #include <openbabel/obutil.h>
 
-#ifdef __MINGW32__
-#include <cstdio> // FIXME replace snprinf with std::stringstream
-#endif
-
 using namespace std;
 using namespace OpenBabel::OBFFs;
 
@@ -42,13 +40,17 @@ namespace OBFFs {
     std::vector<Eigen::Vector3d> grad1; //!< Used for conjugate gradients and steepest descent(Initialize and TakeNSteps)
     unsigned int nAtoms; //!< Number of atoms
     int         linesearch; //!< LineSearch type
-
-    char        logbuf[BUFF_SIZE];
+    OBTrajectoryWriter *trajectory; //!< Records the positions, may be 0
+    int         trajectoryInterval; //!< Steps between trajectory frames
+    OBScheduler *scheduler; //!< Computes the values, may be 0
   };
 
   OBMinimize::OBMinimize(OBFunction *function) : d(new OBMinimizePrivate)
   {
     m_function = function;
+    d->trajectory = 0;
+    d->trajectoryInterval = 1;
+    d->scheduler = 0;
   }
   
   OBMinimize::~OBMinimize()
@@ -118,7 +120,7 @@ namespace OBFFs {
     while (true) {
       // Take step X(n) + step
       LineSearchTakeStep(origCoords, direction, step);
-      m_function->Compute(OBFunction::Value);
+      ComputeValue();
       e_n1 = m_function->GetValue();
 
       if (e_n1 < opt_e) {
@@ -132,12 +134,12 @@ namespace OBFFs {
       
       // Take step X(n) + step + delta
       LineSearchTakeStep(origCoords, direction, step+delta);
-      m_function->Compute(OBFunction::Value);
+      ComputeValue();
       e_n2 = m_function->GetValue();
  
       // Take step X(n) + step + delta * 2.0
       LineSearchTakeStep(origCoords, direction, step+delta*2.0);
-      m_function->Compute(OBFunction::Value);
+      ComputeValue();
       e_n3 = m_function->GetValue();
       
       double denom = e_n3 - 2.0 * e_n2 + e_n1; // f'(x)
@@ -157,7 +159,7 @@ namespace OBFFs {
       
       // Take step X(n) + step
       LineSearchTakeStep(origCoords, direction, step);
-      m_function->Compute(OBFunction::Value);
+      ComputeValue();
       e_n1 = m_function->GetValue();
 
       if (e_n1 < opt_e) {
@@ -194,7 +196,7 @@ namespace OBFFs {
     double trustRadius = 0.3; // don't move further than 0.3 Angstroms
     double trustRadius2 = 0.9; // use norm2() instead of norm() to avoid sqrt() calls
     
-    m_function->Compute(OBFunction::Value);
+    ComputeValue();
     e_n1 = m_function->GetValue();
     
     unsigned int i;
@@ -218,7 +220,7 @@ namespace OBFFs {
         }
       }
     
-      m_function->Compute(OBFunction::Value);
+      ComputeValue();
       e_n2 = m_function->GetValue();
       
       // convergence criteria: A higher precision here 
@@ -246,6 +248,25 @@ namespace OBFFs {
     return alpha;
   }
   
+  void OBMinimize::SetTrajectory(OBTrajectoryWriter *trajectory, int interval)
+  {
+    d->trajectory = trajectory;
+    d->trajectoryInterval = (interval > 0) ? interval : 1;
+  }
+
+  void OBMinimize::SetScheduler(OBScheduler *scheduler)
+  {
+    d->scheduler = scheduler;
+  }
+
+  void OBMinimize::ComputeValue()
+  {
+    if (d->scheduler)
+      d->scheduler->ComputeValue(m_function);
+    else
+      m_function->Compute(OBFunction::Value);
+  }
+
   void OBMinimize::SteepestDescentInitialize(int steps, double econv) 
   {
     d->nsteps = steps;
@@ -254,17 +275,15 @@ namespace OBFFs {
 
     m_function->Compute(OBFunction::Gradients);
     d->e_n1 = m_function->GetValue();
+    if (d->trajectory)
+      d->trajectory->AddFrame(m_function);
     
     OBLogFile *logfile = m_function->GetLogFile();
-    if (logfile->IsLow()) {
-      logfile->Write("\nS T E E P E S T   D E S C E N T\n\n");
-      snprintf(d->logbuf, BUFF_SIZE, "STEPS = %d\n\n",  steps);
-      logfile->Write(d->logbuf);
-      logfile->Write("STEP n       E(n)         E(n-1)    \n");
-      logfile->Write("------------------------------------\n");
-      snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f      ----\n", d->cstep, d->e_n1);
-      logfile->Write(d->logbuf);
-    }
+    logfile->Log(OBLogFile::Low, "sd_start", "\nS T E E P E S T   D E S C E N T\n\n"
+        "STEPS = %.0f\n\n"
+        "STEP n       E(n)         E(n-1)    \n"
+        "------------------------------------\n", "steps", steps);
+    logfile->Log(OBLogFile::Low, "sd_step", " %4.0f    %8.3f      ----\n", "step", d->cstep, "energy", d->e_n1);
  
   }
  
@@ -294,17 +313,16 @@ namespace OBFFs {
       }
       m_function->Compute(OBFunction::Gradients);
       e_n2 = m_function->GetValue();
+      if (d->trajectory && d->cstep % d->trajectoryInterval == 0)
+        d->trajectory->AddFrame(m_function);
      
-      if (logfile->IsLow()) {
-        if (d->cstep % 10 == 0) {
-          snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.5f    %8.5f\n", d->cstep, e_n2, d->e_n1);
-          logfile->Write(d->logbuf);
-        }
-      }
+      if (d->cstep % 10 == 0)
+        logfile->Log(OBLogFile::Low, "sd_step", " %4.0f    %8.5f    %8.5f\n",
+            "step", d->cstep, "energy", e_n2, "previous", d->e_n1);
 
       if (IsNear(e_n2, d->e_n1, d->econv)) {
-        if (logfile->IsLow())
-          logfile->Write("    STEEPEST DESCENT HAS CONVERGED\n");
+        logfile->Log(OBLogFile::Low, "sd_converged", "    STEEPEST DESCENT HAS CONVERGED\n",
+            "step", d->cstep, "energy", e_n2);
         return false;
       }
       
@@ -334,15 +352,14 @@ namespace OBFFs {
 
     m_function->Compute(OBFunction::Gradients);
     d->e_n1 = m_function->GetValue();
+    if (d->trajectory)
+      d->trajectory->AddFrame(m_function);
     
     OBLogFile *logfile = m_function->GetLogFile();
-    if (logfile->IsLow()) {
-      logfile->Write("\nC O N J U G A T E   G R A D I E N T S\n\n");
-      snprintf(d->logbuf, BUFF_SIZE, "STEPS = %d\n\n",  steps);
-      logfile->Write(d->logbuf);
-      logfile->Write("STEP n     E(n)       E(n-1)    \n");
-      logfile->Write("--------------------------------\n");
-    }
+    logfile->Log(OBLogFile::Low, "cg_start", "\nC O N J U G A T E   G R A D I E N T S\n\n"
+        "STEPS = %.0f\n\n"
+        "STEP n     E(n)       E(n-1)    \n"
+        "--------------------------------\n", "steps", steps);
 
     d->grad1.clear();
     d->grad1.resize(m_function->GetPositions().size());
@@ -371,10 +388,8 @@ namespace OBFFs {
     m_function->Compute(OBFunction::Gradients);
     e_n2 = m_function->GetValue();
       
-    if (logfile->IsLow()) {
-      snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f\n", 1, e_n2, d->e_n1);
-      logfile->Write(d->logbuf);
-    }
+    logfile->Log(OBLogFile::Low, "cg_step", " %4.0f    %8.3f    %8.3f\n",
+        "step", 1, "energy", e_n2, "previous", d->e_n1);
  
     // save the direction and energy
     d->grad1 = m_function->GetGradients();
@@ -432,22 +447,18 @@ namespace OBFFs {
  
       m_function->Compute(OBFunction::Gradients);
       e_n2 = m_function->GetValue();
+      if (d->trajectory && d->cstep % d->trajectoryInterval == 0)
+        d->trajectory->AddFrame(m_function);
 	
       if (IsNear(e_n2, d->e_n1, d->econv)) {
-        if (logfile->IsLow()) {
-          snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f\n", d->cstep, e_n2, d->e_n1);
-          logfile->Write(d->logbuf);
-          logfile->Write("    CONJUGATE GRADIENTS HAS CONVERGED\n");
-        }
+        logfile->Log(OBLogFile::Low, "cg_converged", " %4.0f    %8.3f    %8.3f\n"
+            "    CONJUGATE GRADIENTS HAS CONVERGED\n", "step", d->cstep, "energy", e_n2, "previous", d->e_n1);
         return false;
       }
 
-      if (logfile->IsLow()) {
-        if (d->cstep % 10 == 0) {
-          snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f\n", d->cstep, e_n2, d->e_n1);
-          logfile->Write(d->logbuf);
-        }
-      }
+      if (d->cstep % 10 == 0)
+        logfile->Log(OBLogFile::Low, "cg_step", " %4.0f    %8.3f    %8.3f\n",
+            "step", d->cstep, "energy", e_n2, "previous", d->e_n1);
  
       if (d->nsteps == d->cstep)
         return false;
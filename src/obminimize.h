@@ -45,6 +45,8 @@ namespace OBFFs {
   };
   
   class OBMinimizePrivate;
+  class OBTrajectoryWriter;
+  class OBScheduler;
   class OBAPI OBMinimize
   {
   protected:
@@ -62,6 +64,27 @@ namespace OBFFs {
     // Energy Minimization                                                 //
     /////////////////////////////////////////////////////////////////////////
       
+    /** 
+     * @brief Record the positions in @p trajectory every @p interval steps (and
+     * the starting positions). Pass 0 to stop recording.
+     * 
+     * @param trajectory An open OBTrajectoryWriter for NumParticles() atoms.
+     * @param interval The number of steps between frames.
+     */
+    void SetTrajectory(OBTrajectoryWriter *trajectory, int interval = 1);
+    /** 
+     * @brief Compute the values with OBScheduler::ComputeValue() (one task per
+     * term) instead of in the calling thread. Pass 0 to compute them in the
+     * calling thread again.
+     *
+     * Most evaluations of the line searches only need the value. The gradients
+     * are still computed in the calling thread, the terms add them to the same
+     * array.
+     * 
+     * @param scheduler The scheduler, the calling thread may be one of its workers.
+     */
+    void SetScheduler(OBScheduler *scheduler);
+
     //! \name Methods for energy minimization
     //@{
     /** 
@@ -116,6 +139,10 @@ namespace OBFFs {
      */
     void   LineSearchTakeStep(std::vector<Eigen::Vector3d> &origCoords, 
         std::vector<Eigen::Vector3d> &direction, double step);
+    /** 
+     * @brief Compute the value of the function, with the scheduler when one is set.
+     */
+    void ComputeValue();
     /** 
      * @brief Perform steepest descent optimalization for steps steps or until convergence criteria is reached.
      * 
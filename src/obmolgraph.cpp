@@ -0,0 +1,171 @@
+/*********************************************************************
+  OBMolGraph - OBMolGraph class
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBMolGraph>
+
+#include <openbabel/mol.h>
+
+#include <algorithm>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    const unsigned int OBMolGraph::NotExcluded;
+
+    OBMolGraph::OBMolGraph() : m_numAtoms(0)
+    {
+      m_offsets.push_back(0);
+      m_exclusionOffsets.push_back(0);
+    }
+
+    void OBMolGraph::Build(const OBMol &mol)
+    {
+      std::vector<std::pair<unsigned int, unsigned int> > bonds;
+      bonds.reserve(mol.NumBonds());
+      for (unsigned int i = 0; i < mol.NumBonds(); ++i) {
+        OBBond *bond = mol.GetBond(i);
+        bonds.push_back(std::make_pair(bond->GetBeginAtomIdx() - 1, bond->GetEndAtomIdx() - 1));
+      }
+
+      Build(mol.NumAtoms(), bonds);
+    }
+
+    void OBMolGraph::Build(unsigned int numAtoms, const std::vector<std::pair<unsigned int, unsigned int> > &bonds)
+    {
+      m_numAtoms = numAtoms;
+
+      // count the neighbors and convert the counts to offsets
+      m_offsets.assign(numAtoms + 1, 0);
+      m_bonds.clear();
+      m_bonds.reserve(2 * bonds.size());
+      for (unsigned int i = 0; i < bonds.size(); ++i) {
+        m_offsets[bonds[i].first + 1]++;
+        m_offsets[bonds[i].second + 1]++;
+        m_bonds.push_back(bonds[i].first);
+        m_bonds.push_back(bonds[i].second);
+      }
+      for (unsigned int i = 0; i < numAtoms; ++i)
+        m_offsets[i + 1] += m_offsets[i];
+
+      // fill the neighbors, each atom keeps the bond order
+      std::vector<unsigned int> next(m_offsets.begin(), m_offsets.end() - 1);
+      m_neighbors.resize(m_offsets[numAtoms]);
+      for (unsigned int i = 0; i < bonds.size(); ++i) {
+        m_neighbors[next[bonds[i].first]++] = bonds[i].second;
+        m_neighbors[next[bonds[i].second]++] = bonds[i].first;
+      }
+
+      enumerate();
+    }
+
+    void OBMolGraph::enumerate()
+    {
+      m_angles.clear();
+      m_torsions.clear();
+      m_impropers.clear();
+      m_exclusions.clear();
+      m_exclusionOffsets.assign(1, 0);
+      m_exclusionOffsets.reserve(m_numAtoms + 1);
+
+      const unsigned int *nbr = m_neighbors.empty() ? 0 : &m_neighbors[0];
+      std::vector<unsigned int> excluded;
+      for (unsigned int b = 0; b < m_numAtoms; ++b) {
+        const unsigned int begin = m_offsets[b], end = m_offsets[b + 1];
+
+        // angles and impropers with b as vertex/center
+        for (unsigned int p = begin; p < end; ++p)
+          for (unsigned int q = p + 1; q < end; ++q) {
+            m_angles.push_back(nbr[p]);
+            m_angles.push_back(b);
+            m_angles.push_back(nbr[q]);
+            for (unsigned int r = q + 1; r < end; ++r) {
+              m_impropers.push_back(nbr[p]);
+              m_impropers.push_back(b);
+              m_impropers.push_back(nbr[q]);
+              m_impropers.push_back(nbr[r]);
+            }
+          }
+
+        // torsions around the b-c bonds (each bond once)
+        for (unsigned int p = begin; p < end; ++p) {
+          const unsigned int c = nbr[p];
+          if (c < b)
+            continue;
+          for (unsigned int q = begin; q < end; ++q) {
+            const unsigned int a = nbr[q];
+            if (a == c)
+              continue;
+            for (unsigned int r = m_offsets[c]; r < m_offsets[c + 1]; ++r) {
+              const unsigned int d = nbr[r];
+              if (d == b || d == a)
+                continue;
+              m_torsions.push_back(a);
+              m_torsions.push_back(b);
+              m_torsions.push_back(c);
+              m_torsions.push_back(d);
+            }
+          }
+        }
+
+        // exclusions of b: walk 3 bonds and keep the shortest separation
+        excluded.clear();
+        for (unsigned int p = begin; p < end; ++p) {
+          const unsigned int i = nbr[p];
+          excluded.push_back(i << 2 | 1);
+          for (unsigned int q = m_offsets[i]; q < m_offsets[i + 1]; ++q) {
+            const unsigned int j = nbr[q];
+            if (j == b)
+              continue;
+            excluded.push_back(j << 2 | 2);
+            for (unsigned int r = m_offsets[j]; r < m_offsets[j + 1]; ++r) {
+              const unsigned int k = nbr[r];
+              if (k == b || k == i)
+                continue;
+              excluded.push_back(k << 2 | 3);
+            }
+          }
+        }
+        // sorting puts the shortest separation for an atom first
+        std::sort(excluded.begin(), excluded.end());
+        for (unsigned int e = 0; e < excluded.size(); ++e) {
+          if (e && (excluded[e] >> 2) == (excluded[e - 1] >> 2))
+            continue;
+          m_exclusions.push_back(excluded[e]);
+        }
+        m_exclusionOffsets.push_back(m_exclusions.size());
+      }
+    }
+
+    unsigned int OBMolGraph::GetSeparation(unsigned int i, unsigned int j) const
+    {
+      if (i >= m_numAtoms || i == j)
+        return NotExcluded;
+
+      std::vector<unsigned int>::const_iterator begin = m_exclusions.begin() + m_exclusionOffsets[i];
+      std::vector<unsigned int>::const_iterator end = m_exclusions.begin() + m_exclusionOffsets[i + 1];
+      std::vector<unsigned int>::const_iterator e = std::lower_bound(begin, end, j << 2);
+      if (e == end || (*e >> 2) != j)
+        return NotExcluded;
+
+      return *e & 3;
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
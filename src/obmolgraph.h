@@ -0,0 +1,151 @@
+/*********************************************************************
+  OBMolGraph - OBMolGraph class
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBMOLGRAPH_H
+#define OBMOLGRAPH_H
+
+#include <vector>
+#include <utility>
+
+namespace OpenBabel {
+
+  class OBMol;
+
+  namespace OBFFs {
+
+    /**
+     * @class OBMolGraph obmolgraph.h <OBMolGraph>
+     * @brief Compact molecular graph with bonded interaction enumeration
+     *
+     * The bonds are stored once in compressed sparse row (CSR) form: the
+     * neighbors of atom i are GetNeighbors()[GetOffsets()[i]] ...
+     * GetNeighbors()[GetOffsets()[i+1] - 1]. All indexes are 0...N-1 (atom
+     * index - 1).
+     *
+     * Build() enumerates the bonds, angles, torsions, impropers and the 1-2,
+     * 1-3 and 1-4 exclusions from this graph in a single pass over the atoms.
+     * Unlike FOR_ANGLES_OF_MOL and FOR_TORSIONS_OF_MOL, this does not trigger
+     * the OBMol angle and torsion perception or attach any data to the
+     * molecule.
+     *
+     * The interactions are stored in flat arrays:
+     * - bonds: 2 atoms per bond (a, b) in the OBMol bond order.
+     * - angles: 3 atoms per angle (a, vertex, c).
+     * - torsions: 4 atoms per torsion (a, b, c, d) around the b-c bond.
+     * - impropers: 4 atoms per improper (a, center, c, d).
+     */
+    class OBMolGraph
+    {
+      public:
+        //! Separation returned for atoms more than 3 bonds apart.
+        static const unsigned int NotExcluded = 0;
+
+        OBMolGraph();
+        /**
+         * Build the graph from the bonds in @p mol.
+         */
+        void Build(const OBMol &mol);
+        /**
+         * Build the graph from a bond list (0...N-1 indexes).
+         */
+        void Build(unsigned int numAtoms, const std::vector<std::pair<unsigned int, unsigned int> > &bonds);
+
+        unsigned int NumAtoms() const
+        {
+          return m_numAtoms;
+        }
+        unsigned int GetDegree(unsigned int i) const
+        {
+          return m_offsets[i + 1] - m_offsets[i];
+        }
+        const std::vector<unsigned int>& GetOffsets() const
+        {
+          return m_offsets;
+        }
+        const std::vector<unsigned int>& GetNeighbors() const
+        {
+          return m_neighbors;
+        }
+
+        const std::vector<unsigned int>& GetBonds() const
+        {
+          return m_bonds;
+        }
+        const std::vector<unsigned int>& GetAngles() const
+        {
+          return m_angles;
+        }
+        const std::vector<unsigned int>& GetTorsions() const
+        {
+          return m_torsions;
+        }
+        const std::vector<unsigned int>& GetImpropers() const
+        {
+          return m_impropers;
+        }
+        unsigned int NumBonds() const
+        {
+          return m_bonds.size() / 2;
+        }
+        unsigned int NumAngles() const
+        {
+          return m_angles.size() / 3;
+        }
+        unsigned int NumTorsions() const
+        {
+          return m_torsions.size() / 4;
+        }
+        unsigned int NumImpropers() const
+        {
+          return m_impropers.size() / 4;
+        }
+
+        /**
+         * The exclusions of atom i are in GetExclusions()[GetExclusionOffsets()[i]]
+         * ... GetExclusions()[GetExclusionOffsets()[i+1] - 1], sorted by atom
+         * index. Each entry is (atom index << 2 | separation).
+         */
+        const std::vector<unsigned int>& GetExclusionOffsets() const
+        {
+          return m_exclusionOffsets;
+        }
+        const std::vector<unsigned int>& GetExclusions() const
+        {
+          return m_exclusions;
+        }
+        /**
+         * @return The number of bonds in the shortest path between atoms i
+         * and j (1, 2 or 3) or NotExcluded if they are more than 3 bonds apart.
+         */
+        unsigned int GetSeparation(unsigned int i, unsigned int j) const;
+
+      private:
+        void enumerate();
+
+        unsigned int                m_numAtoms;
+        std::vector<unsigned int>   m_offsets, m_neighbors;
+        std::vector<unsigned int>   m_bonds, m_angles, m_torsions, m_impropers;
+        std::vector<unsigned int>   m_exclusionOffsets, m_exclusions;
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBMolGraph class
+
+#endif
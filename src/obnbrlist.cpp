@@ -24,34 +24,38 @@
 
 #include <OBNbrList>
 #include <OBFunction>
+#include <OBProfiler>
 
 using namespace std;
 
 namespace OpenBabel {
   namespace OBFFs {
 
-    OBNbrList::OBNbrList(OBFunction *function, double rcut, bool periodic, int boxSize)
+    OBNbrList::OBNbrList(OBFunction *function, double rcut, bool periodic, int boxSize,
+        double skin)
     {
       m_function = function;
       for (unsigned int i = 0; i < function->NumParticles(); ++i)
         m_atoms.push_back(i);
       m_rcut = rcut;
       m_rcut2 = rcut*rcut;
+      m_skin = skin;
       m_boxSize = boxSize;
-      m_edgeLength = m_rcut / m_boxSize;
-      m_updateCounter = 0;
+      // the atoms within rcut of each other now were within rcut + skin at
+      // the last build
+      m_edgeLength = (m_rcut + m_skin) / m_boxSize;
+      m_periodic = periodic;
 
       initOffsetMap();
-      initCells();
-      initGhostMap(periodic);
+      build();
     }
 
-    std::vector<unsigned int> OBNbrList::GetNbrs(unsigned int index, bool uniqueOnly)
+    const std::vector<unsigned int>& OBNbrList::GetNbrs(unsigned int index, bool uniqueOnly)
     {
+      // both keep their capacity between the calls
       m_r2.clear();
-      m_r2.reserve(m_atoms.size());
-      std::vector<unsigned int> atoms;
-      Eigen::Vector3i idx(cellIndexes(m_function->GetPositions()[index]));
+      m_nbrs.clear();
+      const Eigen::Vector3i &idx = m_atomCells[index];
 
       std::vector<Eigen::Vector3i>::const_iterator i;
       // Use the offset map to find neighboring cells
@@ -70,34 +74,59 @@ namespace OpenBabel {
               continue;
           }
 
-          const double R2 = ( m_function->GetPositions()[*j] - m_function->GetPositions()[index] ).squaredNorm();
+          const double R2 = ( m_function->GetInternalPositions()[*j] - m_function->GetInternalPositions()[index] ).squaredNorm();
           if (R2 > m_rcut2)
             continue;
 
           m_r2.push_back(R2);
-          atoms.push_back(*j);
+          m_nbrs.push_back(*j);
         }
       }
 
-      return atoms;
+      return m_nbrs;
     }
 
     void OBNbrList::Update()
     {
       m_updateCounter++;
 
-      if (m_updateCounter > 10) {
-        initCells();
-        updateCells();
-        m_updateCounter = 0;
+      if (m_updateCounter > 10 || moved()) {
+        OBProfiler *profiler = m_function->GetProfiler();
+        if (profiler)
+          profiler->Begin();
+        build();
+        if (profiler)
+          profiler->End(profiler->Section("OBNbrList::Update"));
       }
     }
 
+    void OBNbrList::build()
+    {
+      // the grid dimensions change with the extent of the atoms, the ghost
+      // map depends on them
+      initCells();
+      initGhostMap(m_periodic);
+      m_buildPositions = m_function->GetInternalPositions();
+      m_updateCounter = 0;
+    }
+
+    bool OBNbrList::moved() const
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetInternalPositions();
+      if (positions.size() != m_buildPositions.size())
+        return true;
+      const double limit2 = 0.25 * m_skin * m_skin;
+      for (unsigned int i = 0; i < positions.size(); ++i)
+        if ((positions[i] - m_buildPositions[i]).squaredNorm() > limit2)
+          return true;
+      return false;
+    }
+
     void OBNbrList::initCells()
     {
       // find min & max
       for (atom_iter a = m_atoms.begin(); a != m_atoms.end(); ++a) {
-        Eigen::Vector3d pos = m_function->GetPositions()[*a];
+        Eigen::Vector3d pos = m_function->GetInternalPositions()[*a];
 
         if (!*a) {
           m_min = m_max = pos;
@@ -135,8 +164,10 @@ namespace OpenBabel {
       // the last cell is always empty and can be used for all ghost cells
       // in non-periodic boundary conditions.
       m_cells.resize(m_xyDim * m_dim.z() + 1);
+      m_atomCells.resize(m_atoms.size());
       for (atom_iter a = m_atoms.begin(); a != m_atoms.end(); ++a) {
-        m_cells[cellIndex(m_function->GetPositions()[*a])].push_back(*a);
+        m_atomCells[*a] = cellIndexes(m_function->GetInternalPositions()[*a]);
+        m_cells[cellIndex(m_atomCells[*a])].push_back(*a);
       }
     }
 
@@ -149,12 +180,29 @@ namespace OpenBabel {
       int k = abs(index.z());
       if (k) k--;
 
-      if (Eigen::Vector3i(i, j, k).squaredNorm() < m_rcut2)
+      // (i, j, k) is the cell offset to the nearest point in the cell, in cell
+      // units: the cell is searched if it is closer than rcut = boxSize cells
+      if (Eigen::Vector3i(i, j, k).squaredNorm() < m_boxSize * m_boxSize)
         return true;
 
       return false;
     }
 
+    unsigned int OBNbrList::NumSearchCells(int boxSize)
+    {
+      unsigned int count = 0;
+      for (int i = -boxSize; i <= boxSize; ++i)
+        for (int j = -boxSize; j <= boxSize; ++j)
+          for (int k = -boxSize; k <= boxSize; ++k) {
+            const int x = i ? abs(i) - 1 : 0;
+            const int y = j ? abs(j) - 1 : 0;
+            const int z = k ? abs(k) - 1 : 0;
+            if (x * x + y * y + z * z < boxSize * boxSize)
+              count++;
+          }
+      return count;
+    }
+
     void OBNbrList::initOffsetMap()
     {
       int dim = 2 * m_boxSize + 1;
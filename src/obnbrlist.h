@@ -59,16 +59,25 @@ namespace OpenBabel {
          * Constructor to include all atoms.
          * @param mol The molecule containing the atoms
          * @param rcut The cut-off distance.
-         * @param boxSize The number of cells per rcut distance.
+         * @param boxSize The number of cells per rcut + skin distance.
+         * @param skin The buffer added to the cut-off when searching the cells.
          */
-        OBNbrList(OBFunction *function, double rcut, bool periodic = false, int boxSize = 1);
+        OBNbrList(OBFunction *function, double rcut, bool periodic = false, int boxSize = 1,
+            double skin = 1.0);
         /**
          * Update the cells. While minimizing or running MD simulations,
-         * atoms move and can go from on cell into the next. This function
-         * should be called every 10-20 iterations to make sure the cells
-         * stay accurate.
+         * atoms move and can go from on cell into the next. Call this
+         * function once per step: the cells are rebuilt every 10 calls and
+         * earlier when an atom moved more than skin/2 since the last rebuild.
          */
         void Update();
+        /**
+         * Rebuild the cells in the next Update().
+         */
+        void Invalidate()
+        {
+          m_buildPositions.clear();
+        }
         /**
          * Get the near-neighbor atoms for @p atom. The squared distance is
          * checked and is cached for later use (see GetDist2() function).
@@ -77,9 +86,9 @@ namespace OpenBabel {
          * The @p atom itself isn't added to the list.
          *
          * @param index The atom index (0...N-1) for which to return the near-neighbors
-         * @return The near-neighbors for @p pos
+         * @return The near-neighbors for @p pos, valid until the next call
          */
-        std::vector<unsigned int> GetNbrs(unsigned int index, bool uniqueOnly = true);
+        const std::vector<unsigned int>& GetNbrs(unsigned int index, bool uniqueOnly = true);
         /**
          * Get the cached squared distance from the atom last used to call
          * nbrs to the atom with @p index in the returned vector.
@@ -90,6 +99,12 @@ namespace OpenBabel {
         {
           return m_r2.at(index);
         }
+        /**
+         * @return The number of cells searched for the neighbors of an atom with
+         * @p boxSize cells per cut-off distance. Smaller cells (larger @p boxSize)
+         * test fewer atoms outside the cut-off but visit more cells.
+         */
+        static unsigned int NumSearchCells(int boxSize);
 
       private:
         inline unsigned int ghostIndex(int i, int j, int k) const
@@ -132,6 +147,10 @@ namespace OpenBabel {
           return index;
         }
 
+        //! Rebuild the cells and the ghost map for the current positions.
+        void build();
+        //! @return True if an atom moved more than skin/2 since the last build().
+        bool moved() const;
         void initCells();
         void updateCells();
         void initOffsetMap();
@@ -140,10 +159,13 @@ namespace OpenBabel {
 
         OBFunction                         *m_function;
         std::vector<unsigned int>           m_atoms;
-        double                              m_rcut, m_rcut2;
+        double                              m_rcut, m_rcut2, m_skin;
         double                              m_edgeLength;
         int                                 m_boxSize;
         int                                 m_updateCounter;
+        bool                                m_periodic;
+        std::vector<Eigen::Vector3d>        m_buildPositions;
+        std::vector<Eigen::Vector3i>        m_atomCells; //!< cell of each atom at the last build()
 
         Eigen::Vector3d                     m_min, m_max;
         Eigen::Vector3i                     m_dim;
@@ -156,6 +178,7 @@ namespace OpenBabel {
         int                                 m_ghostXY;
 
         std::vector<double>                 m_r2;
+        std::vector<unsigned int>           m_nbrs;
     };
   
   } // end namespace OBFFs
@@ -0,0 +1,230 @@
+/*********************************************************************
+  OBProfiler - Wall time and hardware counters per term
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBProfiler>
+
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+
+#ifdef WIN32
+#include <QTime>
+#else
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#define OB_PERF_EVENTS
+#endif
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    namespace {
+      double wallSeconds()
+      {
+#ifdef WIN32
+        static QTime clock;
+        if (clock.isNull())
+          clock.start();
+        return 0.001 * clock.elapsed();
+#elif defined(CLOCK_MONOTONIC)
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + 1e-9 * t.tv_nsec;
+#else
+        timeval t;
+        gettimeofday(&t, 0);
+        return t.tv_sec + 1e-6 * t.tv_usec;
+#endif
+      }
+
+      void clear(OBProfiler::Statistics &stats, const std::string &name)
+      {
+        stats.name = name;
+        stats.calls = 0;
+        stats.seconds = 0.0;
+        stats.cycles = stats.instructions = stats.cacheReferences = 0.0;
+        stats.cacheMisses = stats.branchMisses = 0.0;
+      }
+
+#ifdef OB_PERF_EVENTS
+      int openCounter(unsigned long long config, int groupFd)
+      {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        // user space only, allowed with perf_event_paranoid <= 2
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+      }
+#endif
+    }
+
+    OBProfiler::OBProfiler(bool counters) : m_numCounters(0)
+    {
+      clear(m_total, "total");
+
+#ifdef OB_PERF_EVENTS
+      if (!counters)
+        return;
+
+      // same order as the Statistics fields
+      const unsigned long long configs[MaxCounters] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_REFERENCES,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+      };
+      for (int i = 0; i < MaxCounters; ++i) {
+        // a missing counter (e.g. cache events in a VM) only leaves its field 0
+        const int fd = openCounter(configs[i], m_numCounters ? m_fds[0] : -1);
+        if (fd < 0) {
+          // without cycles there is no group leader
+          if (i == 0)
+            return;
+          continue;
+        }
+        m_fds[m_numCounters] = fd;
+        m_events[m_numCounters] = i;
+        m_numCounters++;
+      }
+#else
+      (void) counters;
+#endif
+    }
+
+    OBProfiler::~OBProfiler()
+    {
+#ifdef OB_PERF_EVENTS
+      for (int i = 0; i < m_numCounters; ++i)
+        close(m_fds[i]);
+#endif
+    }
+
+    unsigned int OBProfiler::Section(const std::string &name)
+    {
+      for (unsigned int i = 0; i < m_sections.size(); ++i)
+        if (m_sections[i].name == name)
+          return i;
+      Statistics stats;
+      clear(stats, name);
+      m_sections.push_back(stats);
+      return m_sections.size() - 1;
+    }
+
+    void OBProfiler::read(Sample &sample) const
+    {
+      memset(sample.counts, 0, sizeof(sample.counts));
+#ifdef OB_PERF_EVENTS
+      if (m_numCounters) {
+        // PERF_FORMAT_GROUP: number of counters followed by the values
+        unsigned long long values[1 + MaxCounters];
+        if (::read(m_fds[0], values, sizeof(values)) > 0)
+          for (unsigned long long i = 0; i < values[0] && i < (unsigned long long) m_numCounters; ++i)
+            sample.counts[m_events[i]] = values[1 + i];
+      }
+#endif
+      sample.seconds = wallSeconds();
+    }
+
+    void OBProfiler::Begin()
+    {
+      m_stack.push_back(Sample());
+      read(m_stack.back());
+    }
+
+    void OBProfiler::add(Statistics &stats, const Sample &begin, const Sample &end) const
+    {
+      stats.calls++;
+      stats.seconds += end.seconds - begin.seconds;
+      stats.cycles += end.counts[0] - begin.counts[0];
+      stats.instructions += end.counts[1] - begin.counts[1];
+      stats.cacheReferences += end.counts[2] - begin.counts[2];
+      stats.cacheMisses += end.counts[3] - begin.counts[3];
+      stats.branchMisses += end.counts[4] - begin.counts[4];
+    }
+
+    void OBProfiler::End(unsigned int section)
+    {
+      if (m_stack.empty() || section >= m_sections.size())
+        return;
+
+      Sample end;
+      read(end);
+      add(m_sections[section], m_stack.back(), end);
+      if (m_stack.size() == 1)
+        add(m_total, m_stack.back(), end);
+      m_stack.pop_back();
+    }
+
+    OBProfiler::Statistics OBProfiler::GetStatistics(const std::string &name) const
+    {
+      for (unsigned int i = 0; i < m_sections.size(); ++i)
+        if (m_sections[i].name == name)
+          return m_sections[i];
+      Statistics stats;
+      clear(stats, name);
+      return stats;
+    }
+
+    void OBProfiler::ResetStatistics()
+    {
+      for (unsigned int i = 0; i < m_sections.size(); ++i)
+        clear(m_sections[i], m_sections[i].name);
+      clear(m_total, "total");
+    }
+
+    void OBProfiler::Report(std::ostream &os) const
+    {
+      char line[256];
+      snprintf(line, sizeof(line), "%-24s %8s %10s %10s", "SECTION", "CALLS", "TIME(s)", "us/CALL");
+      os << line;
+      if (HasCounters()) {
+        snprintf(line, sizeof(line), " %6s %8s %12s", "IPC", "CMISS%", "BRMISS/CALL");
+        os << line;
+      }
+      os << "\n";
+
+      for (unsigned int i = 0; i <= m_sections.size(); ++i) {
+        const Statistics &stats = (i < m_sections.size()) ? m_sections[i] : m_total;
+        snprintf(line, sizeof(line), "%-24s %8lu %10.4f %10.2f", stats.name.c_str(), stats.calls,
+            stats.seconds, 1e6 * stats.SecondsPerCall());
+        os << line;
+        if (HasCounters()) {
+          snprintf(line, sizeof(line), " %6.2f %8.2f %12.1f", stats.IPC(), 100.0 * stats.CacheMissRate(),
+              stats.calls ? stats.branchMisses / stats.calls : 0.0);
+          os << line;
+        }
+        os << "\n";
+      }
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
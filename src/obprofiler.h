@@ -0,0 +1,163 @@
+/*********************************************************************
+  OBProfiler - Wall time and hardware counters per term
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBPROFILER_H
+#define OBPROFILER_H
+
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /**
+     * @class OBProfiler obprofiler.h <OBProfiler>
+     * @brief Collects wall time and hardware performance counters per section.
+     *
+     * When set with OBFunction::SetProfiler(), the function measures every
+     * OBFunctionTerm::Compute() (section named after the term) and the
+     * neighbor list rebuilds ("OBNbrList::Update", "OBClusterPairList::Build").
+     * The statistics of a section are summed over all calls since construction
+     * or ResetStatistics(). Sections can be nested, the rebuilds are included
+     * in the term that triggers them. GetTotal() sums the outermost sections
+     * (i.e. the whole run).
+     *
+     * On Linux the cycles, instructions, cache references/misses and branch
+     * misses are read with perf_event_open(). The counters measure the thread
+     * that created the profiler (user space only), so the function should be
+     * computed by that thread and without OpenMP threads for accurate counts.
+     * When the counters are not available (other systems, containers,
+     * /proc/sys/kernel/perf_event_paranoid) only the time is measured and
+     * HasCounters() returns false.
+     *
+     * @code
+     * OBProfiler profiler;
+     * function->SetProfiler(&profiler);
+     * minimize.ConjugateGradients(1000);
+     * profiler.Report(std::cout);
+     * std::cout << profiler.GetStatistics("LJ6_12").IPC() << std::endl;
+     * @endcode
+     */
+    class OBProfiler
+    {
+      public:
+        /**
+         * Statistics for one section.
+         */
+        struct Statistics
+        {
+          std::string name;
+          unsigned long calls;
+          double seconds; //!< wall time
+          double cycles, instructions, cacheReferences, cacheMisses, branchMisses; //!< 0 without counters
+
+          //! @return The instructions per cycle.
+          double IPC() const
+          {
+            return cycles > 0.0 ? instructions / cycles : 0.0;
+          }
+          //! @return The fraction of the cache references that missed (0...1).
+          double CacheMissRate() const
+          {
+            return cacheReferences > 0.0 ? cacheMisses / cacheReferences : 0.0;
+          }
+          //! @return The average wall time per call.
+          double SecondsPerCall() const
+          {
+            return calls ? seconds / calls : 0.0;
+          }
+        };
+
+        /**
+         * Constructor, opens the counters for the calling thread unless
+         * @p counters is false.
+         */
+        explicit OBProfiler(bool counters = true);
+        ~OBProfiler();
+
+        /**
+         * @return True if the hardware counters could be opened.
+         */
+        bool HasCounters() const
+        {
+          return m_numCounters > 0;
+        }
+        /**
+         * @return The id for section @p name, added if it is new.
+         */
+        unsigned int Section(const std::string &name);
+        /**
+         * Start measuring a section, must be followed by End().
+         */
+        void Begin();
+        /**
+         * Add the time and counts since the matching Begin() to @p section.
+         */
+        void End(unsigned int section);
+
+        const std::vector<Statistics>& GetStatistics() const
+        {
+          return m_sections;
+        }
+        /**
+         * @return The statistics for section @p name (calls is 0 if there
+         * is no such section).
+         */
+        Statistics GetStatistics(const std::string &name) const;
+        /**
+         * @return The sum of the outermost sections.
+         */
+        Statistics GetTotal() const
+        {
+          return m_total;
+        }
+        void ResetStatistics();
+        /**
+         * Write a table with the statistics to @p os.
+         */
+        void Report(std::ostream &os) const;
+
+      private:
+        enum { MaxCounters = 5 };
+        struct Sample
+        {
+          double seconds;
+          double counts[MaxCounters];
+        };
+
+        OBProfiler(const OBProfiler&);
+        OBProfiler& operator=(const OBProfiler&);
+
+        void read(Sample &sample) const;
+        void add(Statistics &stats, const Sample &begin, const Sample &end) const;
+
+        int m_fds[MaxCounters]; //!< perf event file descriptors, m_fds[0] is the group leader
+        int m_events[MaxCounters]; //!< Statistics field (0 cycles ... 4 branch misses) of each counter
+        int m_numCounters;
+        std::vector<Sample> m_stack; //!< samples for the open Begin() calls
+        std::vector<Statistics> m_sections;
+        Statistics m_total;
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBProfiler class
+
+#endif
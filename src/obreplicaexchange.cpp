@@ -0,0 +1,246 @@
+/*********************************************************************
+  OBReplicaExchange - Parallel tempering over a temperature ladder
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBReplicaExchange>
+#include <OBFunction>
+#include <OBDynamics>
+#include <OBLogFile>
+#include <OBTrajectory>
+
+#include <openbabel/mol.h>
+#include <openbabel/oberror.h>
+
+#include <QThread>
+
+#include <cmath>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    OBReplicaExchange::OBReplicaExchange() : m_sampler(MonteCarlo), m_stepsPerExchange(100),
+        m_stepSize(0.0), m_seed(0), m_numThreads(1), m_numExchanges(0)
+    {
+    }
+
+    OBReplicaExchange::~OBReplicaExchange()
+    {
+      clear();
+    }
+
+    void OBReplicaExchange::clear()
+    {
+      for (unsigned int i = 0; i < m_functions.size(); ++i) {
+        delete m_functions[i];
+        delete m_random[i];
+      }
+      for (unsigned int i = 0; i < m_dynamics.size(); ++i)
+        delete m_dynamics[i];
+      m_functions.clear();
+      m_dynamics.clear();
+      m_random.clear();
+      m_replicas.clear();
+      m_indexes.clear();
+      m_energies.clear();
+      m_trajectories.clear();
+    }
+
+    std::vector<double> OBReplicaExchange::GeometricLadder(double tMin, double tMax, unsigned int numReplicas)
+    {
+      std::vector<double> temperatures;
+      for (unsigned int i = 0; i < numReplicas; ++i)
+        temperatures.push_back(numReplicas > 1 ? tMin * pow(tMax / tMin, double(i) / (numReplicas - 1)) : tMin);
+      return temperatures;
+    }
+
+    bool OBReplicaExchange::Setup(const OBFunction *function, OBMol &mol, int numThreads)
+    {
+      clear();
+      if (m_temperatures.empty()) {
+        obErrorLog.ThrowError(__FUNCTION__, "No temperatures set", obError);
+        return false;
+      }
+      if (numThreads < 1)
+        numThreads = QThread::idealThreadCount();
+      m_numThreads = (numThreads > 0) ? numThreads : 1;
+
+      if (m_seed)
+        m_exchangeRandom.Seed(m_seed);
+      else
+        m_exchangeRandom.TimeSeed();
+
+      // the set up is done sequentially, the copies after the first take the
+      // typing, charges and term choices of the first (OBFunction::SetupCopy()),
+      // the terms still look up their parameters for every copy
+      const unsigned int numReplicas = m_temperatures.size();
+      for (unsigned int i = 0; i < numReplicas; ++i) {
+        OBFunction *copy = function->NewInstance();
+        if (!copy) {
+          clear();
+          return false;
+        }
+        copy->GetLogFile()->SetLogLevel(OBLogFile::None);
+        m_functions.push_back(copy);
+        m_random.push_back(new OBRandom);
+        m_random.back()->Seed(m_exchangeRandom.NextInt());
+        if (!(i ? copy->SetupCopy(m_functions[0], mol) : copy->Setup(mol))) {
+          clear();
+          return false;
+        }
+
+        if (m_sampler == Dynamics) {
+          OBDynamics *dynamics = new OBDynamics(copy);
+          m_dynamics.push_back(dynamics);
+          dynamics->SetTimeStep(m_stepSize > 0.0 ? m_stepSize : 1.0);
+          if (!dynamics->Setup(mol)) {
+            clear();
+            return false;
+          }
+          dynamics->InitializeVelocities(m_temperatures[i], m_exchangeRandom.NextInt() | 1);
+          dynamics->SetThermostat(m_temperatures[i]);
+        }
+
+        copy->Compute(OBFunction::Value);
+        m_energies.push_back(copy->GetValue());
+        m_replicas.push_back(i);
+        m_indexes.push_back(i);
+      }
+
+      m_trajectories.assign(numReplicas, 0);
+      m_numExchanges = 0;
+      ResetStatistics();
+      return true;
+    }
+
+    void OBReplicaExchange::ResetStatistics()
+    {
+      const unsigned int numReplicas = m_functions.size();
+      m_attempts.assign(numReplicas, 0);
+      m_accepted.assign(numReplicas, 0);
+      m_moves.assign(numReplicas, 0);
+      m_acceptedMoves.assign(numReplicas, 0);
+      m_roundTrips.assign(numReplicas, 0);
+      m_direction.assign(numReplicas, 0);
+    }
+
+    void OBReplicaExchange::SetTrajectory(unsigned int index, OBTrajectoryWriter *trajectory)
+    {
+      if (index < m_trajectories.size())
+        m_trajectories[index] = trajectory;
+    }
+
+    void OBReplicaExchange::sample(unsigned int replica, double temperature)
+    {
+      OBFunction *function = m_functions[replica];
+
+      if (m_sampler == Dynamics) {
+        m_dynamics[replica]->TakeNSteps(m_stepsPerExchange);
+        m_energies[replica] = m_dynamics[replica]->GetPotentialEnergy();
+        return;
+      }
+
+      // Metropolis Monte Carlo with single atom moves
+      OBRandom &random = *m_random[replica];
+      std::vector<Eigen::Vector3d> &positions = function->GetPositions();
+      const double beta = 1.0 / (OBDynamics::Boltzmann * temperature);
+      const double stepSize = (m_stepSize > 0.0) ? m_stepSize : 0.1;
+      double energy = m_energies[replica];
+      for (int step = 0; step < m_stepsPerExchange; ++step) {
+        const unsigned int atom = static_cast<unsigned int>(random.NextInt()) % positions.size();
+        const Eigen::Vector3d old = positions[atom];
+        positions[atom] += stepSize * Eigen::Vector3d(2.0 * random.NextFloat() - 1.0,
+            2.0 * random.NextFloat() - 1.0, 2.0 * random.NextFloat() - 1.0);
+        function->Compute(OBFunction::Value);
+        const double trial = function->GetValue();
+        m_moves[replica]++;
+        if (trial <= energy || random.NextFloat() < exp(-beta * (trial - energy))) {
+          energy = trial;
+          m_acceptedMoves[replica]++;
+        } else
+          positions[atom] = old;
+      }
+      m_energies[replica] = energy;
+    }
+
+    void OBReplicaExchange::exchange(bool odd)
+    {
+      const unsigned int numReplicas = m_replicas.size();
+      for (unsigned int i = odd ? 1 : 0; i + 1 < numReplicas; i += 2) {
+        const unsigned int a = m_replicas[i], b = m_replicas[i + 1];
+        const double Ti = m_temperatures[i], Tj = m_temperatures[i + 1];
+        const double delta = (1.0 / Ti - 1.0 / Tj) / OBDynamics::Boltzmann * (m_energies[a] - m_energies[b]);
+        m_attempts[i]++;
+        if (delta < 0.0 && m_exchangeRandom.NextFloat() >= exp(delta))
+          continue;
+
+        m_accepted[i]++;
+        m_replicas[i] = b;
+        m_replicas[i + 1] = a;
+        m_indexes[a] = i + 1;
+        m_indexes[b] = i;
+        if (m_sampler == Dynamics) {
+          // keep the kinetic energy consistent with the new temperatures
+          std::vector<Eigen::Vector3d> &va = m_dynamics[a]->GetVelocities();
+          std::vector<Eigen::Vector3d> &vb = m_dynamics[b]->GetVelocities();
+          const double scale = sqrt(Tj / Ti);
+          for (unsigned int j = 0; j < va.size(); ++j) {
+            va[j] *= scale;
+            vb[j] /= scale;
+          }
+          m_dynamics[a]->SetThermostat(Tj);
+          m_dynamics[b]->SetThermostat(Ti);
+        }
+      }
+
+      // round trips: lowest -> highest -> lowest temperature
+      for (unsigned int replica = 0; replica < numReplicas; ++replica) {
+        if (m_indexes[replica] == 0) {
+          if (m_direction[replica] < 0)
+            m_roundTrips[replica]++;
+          m_direction[replica] = 1;
+        } else if (m_indexes[replica] == numReplicas - 1 && m_direction[replica] > 0)
+          m_direction[replica] = -1;
+      }
+    }
+
+    bool OBReplicaExchange::Run(int numExchanges)
+    {
+      if (m_functions.empty())
+        return false;
+
+      const int numReplicas = m_functions.size();
+      for (int n = 0; n < numExchanges; ++n) {
+        // the replicas are independent until the exchange
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(m_numThreads)
+        for (int replica = 0; replica < numReplicas; ++replica)
+          sample(replica, m_temperatures[m_indexes[replica]]);
+
+        exchange(m_numExchanges % 2 == 1);
+        m_numExchanges++;
+
+        for (unsigned int i = 0; i < m_trajectories.size(); ++i)
+          if (m_trajectories[i])
+            m_trajectories[i]->AddFrame(m_functions[m_replicas[i]]);
+      }
+
+      return true;
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
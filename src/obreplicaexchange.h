@@ -0,0 +1,216 @@
+/*********************************************************************
+  OBReplicaExchange - Parallel tempering over a temperature ladder
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBREPLICAEXCHANGE_H
+#define OBREPLICAEXCHANGE_H
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include <openbabel/rand.h>
+
+namespace OpenBabel {
+
+  class OBMol;
+
+  namespace OBFFs {
+
+    class OBFunction;
+    class OBDynamics;
+    class OBTrajectoryWriter;
+
+    /**
+     * @class OBReplicaExchange obreplicaexchange.h <OBReplicaExchange>
+     * @brief Replica exchange (parallel tempering) with Monte Carlo or dynamics.
+     *
+     * Every replica has its own copy of the function (OBFunction::NewInstance(),
+     * the typing and charges of the first copy are reused) and
+     * samples at one temperature of the ladder. The replicas are run in
+     * parallel (OpenMP), after every SetStepsPerExchange() steps neighboring
+     * temperatures are swapped with the Metropolis criterion
+     * min(1, exp((1/kT_i - 1/kT_j) (E_i - E_j))), alternating between the
+     * even and the odd pairs.
+     *
+     * @code
+     * OBReplicaExchange remd;
+     * remd.SetTemperatures(OBReplicaExchange::GeometricLadder(300.0, 600.0, 8));
+     * remd.Setup(function, mol);
+     * remd.SetTrajectory(0, &trajectory); // the 300 K ensemble
+     * remd.Run(1000);
+     * std::cout << remd.GetAcceptanceRatio(0) << std::endl;
+     * @endcode
+     */
+    class OBReplicaExchange
+    {
+      public:
+        enum Sampler
+        {
+          MonteCarlo, //!< random single atom displacements
+          Dynamics    //!< OBDynamics with the Andersen thermostat
+        };
+
+        OBReplicaExchange();
+        ~OBReplicaExchange();
+
+        /**
+         * @return @p numReplicas temperatures from @p tMin to @p tMax with a
+         * constant ratio (about equal acceptance for a constant heat capacity).
+         */
+        static std::vector<double> GeometricLadder(double tMin, double tMax, unsigned int numReplicas);
+
+        //! \name Configuration (before Setup())
+        //@{
+        /**
+         * Set the temperature ladder (K, ascending).
+         */
+        void SetTemperatures(const std::vector<double> &temperatures)
+        {
+          m_temperatures = temperatures;
+        }
+        const std::vector<double>& GetTemperatures() const
+        {
+          return m_temperatures;
+        }
+        void SetSampler(Sampler sampler)
+        {
+          m_sampler = sampler;
+        }
+        /**
+         * Set the number of Monte Carlo moves or dynamics steps between exchanges (default 100).
+         */
+        void SetStepsPerExchange(int steps)
+        {
+          m_stepsPerExchange = steps;
+        }
+        /**
+         * Set the maximum Monte Carlo displacement (Angstrom, default 0.1) or
+         * the dynamics time step (fs, default 1.0).
+         */
+        void SetStepSize(double stepSize)
+        {
+          m_stepSize = stepSize;
+        }
+        void SetSeed(int seed)
+        {
+          m_seed = seed;
+        }
+        //@}
+
+        /**
+         * Create and set up one copy of @p function for each temperature,
+         * all starting from the positions in @p mol. The copies after the
+         * first are set up with OBFunction::SetupCopy(), which for GAFF reuses
+         * the typing, charges and auto-tuned terms of the first copy. The terms
+         * of every copy still look up their parameters and exclusions.
+         * @param numThreads The maximum number of threads (0: one per core).
+         */
+        bool Setup(const OBFunction *function, OBMol &mol, int numThreads = 0);
+        /**
+         * Run @p numExchanges rounds of sampling followed by an exchange attempt.
+         */
+        bool Run(int numExchanges);
+        /**
+         * Write the positions of the replica at temperature @p index to
+         * @p trajectory after every exchange (0 to stop).
+         */
+        void SetTrajectory(unsigned int index, OBTrajectoryWriter *trajectory);
+
+        unsigned int NumReplicas() const
+        {
+          return m_functions.size();
+        }
+        /**
+         * @return The replica currently at temperature @p index.
+         */
+        unsigned int GetReplica(unsigned int index) const
+        {
+          return m_replicas[index];
+        }
+        OBFunction* GetFunction(unsigned int replica) const
+        {
+          return m_functions[replica];
+        }
+        /**
+         * @return The energy of the replica at temperature @p index.
+         */
+        double GetEnergy(unsigned int index) const
+        {
+          return m_energies[m_replicas[index]];
+        }
+
+        //! \name Statistics
+        //@{
+        //! @return The number of exchange attempts between temperature @p index and @p index + 1.
+        unsigned long GetNumAttempts(unsigned int index) const
+        {
+          return m_attempts[index];
+        }
+        //! @return The fraction of accepted exchanges between temperature @p index and @p index + 1.
+        double GetAcceptanceRatio(unsigned int index) const
+        {
+          return m_attempts[index] ? double(m_accepted[index]) / m_attempts[index] : 0.0;
+        }
+        //! @return The fraction of accepted Monte Carlo moves of @p replica.
+        double GetMoveAcceptanceRatio(unsigned int replica) const
+        {
+          return m_moves[replica] ? double(m_acceptedMoves[replica]) / m_moves[replica] : 0.0;
+        }
+        //! @return The number of times @p replica went from the lowest to the highest temperature and back.
+        unsigned int GetNumRoundTrips(unsigned int replica) const
+        {
+          return m_roundTrips[replica];
+        }
+        void ResetStatistics();
+        //@}
+
+      private:
+        OBReplicaExchange(const OBReplicaExchange&);
+        OBReplicaExchange& operator=(const OBReplicaExchange&);
+
+        void clear();
+        //! Sample @p replica at temperature @p index.
+        void sample(unsigned int replica, double temperature);
+        void exchange(bool odd);
+
+        std::vector<double> m_temperatures;
+        Sampler m_sampler;
+        int m_stepsPerExchange;
+        double m_stepSize;
+        int m_seed, m_numThreads, m_numExchanges;
+
+        std::vector<OBFunction*> m_functions; //!< one per replica
+        std::vector<OBDynamics*> m_dynamics; //!< one per replica for the Dynamics sampler
+        std::vector<OBRandom*> m_random; //!< one per replica
+        OBRandom m_exchangeRandom;
+        std::vector<unsigned int> m_replicas; //!< replica at each temperature
+        std::vector<unsigned int> m_indexes; //!< temperature index of each replica
+        std::vector<double> m_energies; //!< current energy of each replica
+        std::vector<OBTrajectoryWriter*> m_trajectories; //!< per temperature, may be 0
+        std::vector<unsigned long> m_attempts, m_accepted; //!< per neighbor pair
+        std::vector<unsigned long> m_moves, m_acceptedMoves; //!< per replica
+        std::vector<unsigned int> m_roundTrips; //!< per replica
+        std::vector<int> m_direction; //!< per replica: 1 after visiting the lowest, -1 after the highest temperature
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBReplicaExchange class
+
+#endif
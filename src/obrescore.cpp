@@ -0,0 +1,132 @@
+/*********************************************************************
+  OBRescore - Evaluate a function for the frames of a trajectory
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBRescore>
+#include <OBFunction>
+#include <OBFunctionTerm>
+#include <OBLogFile>
+#include <OBTrajectory>
+
+#include <openbabel/mol.h>
+
+#include <QThread>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    OBRescore::OBRescore() : m_numAtoms(0)
+    {
+    }
+
+    OBRescore::~OBRescore()
+    {
+      clear();
+    }
+
+    void OBRescore::clear()
+    {
+      for (unsigned int i = 0; i < m_functions.size(); ++i)
+        delete m_functions[i];
+      m_functions.clear();
+      m_termNames.clear();
+      m_numAtoms = 0;
+    }
+
+    bool OBRescore::Setup(const OBFunction *function, OBMol &topology, int numThreads)
+    {
+      clear();
+      if (numThreads < 1)
+        numThreads = QThread::idealThreadCount();
+      if (numThreads < 1)
+        numThreads = 1;
+
+      // the set up is done sequentially, the copies share the OBFFType and
+      // OBChargeMethod: the first copy computes the types and charges, the
+      // others reuse them (OBFunction::SetupCopy())
+      for (int i = 0; i < numThreads; ++i) {
+        OBFunction *copy = function->NewInstance();
+        if (!copy) {
+          clear();
+          return false;
+        }
+        copy->GetLogFile()->SetLogLevel(OBLogFile::None);
+        m_functions.push_back(copy);
+        const bool ok = i ? copy->SetupCopy(m_functions[0], topology) : copy->Setup(topology);
+        if (!ok) {
+          clear();
+          return false;
+        }
+      }
+
+      m_numAtoms = topology.NumAtoms();
+      const std::vector<OBFunctionTerm*> &terms = m_functions[0]->GetTerms();
+      for (unsigned int i = 0; i < terms.size(); ++i)
+        m_termNames.push_back(terms[i]->GetName());
+      return true;
+    }
+
+    bool OBRescore::Rescore(const OBTrajectoryReader &trajectory, std::vector<double> &values,
+        std::vector<double> *termValues, unsigned int first, unsigned int last, unsigned int stride)
+    {
+      if (m_functions.empty() || trajectory.NumAtoms() != m_numAtoms)
+        return false;
+      if (last > trajectory.NumFrames())
+        last = trajectory.NumFrames();
+      if (!stride)
+        stride = 1;
+
+      const unsigned int numFrames = (first < last) ? (last - first + stride - 1) / stride : 0;
+      const unsigned int numTerms = NumTerms();
+      values.resize(numFrames);
+      if (termValues)
+        termValues->resize(numFrames * numTerms);
+
+      // one block of consecutive frames per function copy
+      const int numBlocks = m_functions.size();
+      #pragma omp parallel for schedule(static, 1)
+      for (int block = 0; block < numBlocks; ++block) {
+        OBFunction *function = m_functions[block];
+        const std::vector<OBFunctionTerm*> &terms = function->GetTerms();
+        const unsigned int begin = (unsigned long) numFrames * block / numBlocks;
+        const unsigned int end = (unsigned long) numFrames * (block + 1) / numBlocks;
+
+        for (unsigned int i = begin; i < end; ++i) {
+          const unsigned int frame = first + i * stride;
+          const float *x = trajectory.GetX(frame);
+          const float *y = trajectory.GetY(frame);
+          const float *z = trajectory.GetZ(frame);
+          for (unsigned int j = 0; j < m_numAtoms; ++j)
+            function->GetPosition(j) = Eigen::Vector3d(x[j], y[j], z[j]);
+
+          // the frames of a block need not be consecutive in time (stride)
+          function->ResetNeighborLists();
+          function->Compute(OBFunction::Value);
+          values[i] = function->GetValue();
+          if (termValues)
+            for (unsigned int t = 0; t < numTerms; ++t)
+              (*termValues)[i * numTerms + t] = terms[t]->GetValue();
+        }
+      }
+
+      return true;
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
@@ -0,0 +1,108 @@
+/*********************************************************************
+  OBRescore - Evaluate a function for the frames of a trajectory
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBRESCORE_H
+#define OBRESCORE_H
+
+#include <vector>
+#include <string>
+
+namespace OpenBabel {
+
+  class OBMol;
+
+  namespace OBFFs {
+
+    class OBFunction;
+    class OBTrajectoryReader;
+
+    /**
+     * @class OBRescore obrescore.h <OBRescore>
+     * @brief Compute the (term) values of a function for the frames of a trajectory.
+     *
+     * Setup() creates one copy of the function per thread (see
+     * OBFunction::NewInstance()) and sets each copy up once for the topology
+     * molecule, the copies after the first reuse its types, charges and
+     * automatic choices (OBFunction::SetupCopy()). Rescore() splits the frames
+     * in contiguous blocks, one per copy, and copies the coordinates of each
+     * frame directly from the memory-mapped trajectory into the positions of
+     * the function. The neighbor lists are rebuilt for every frame.
+     *
+     * @code
+     * OBRescore rescore;
+     * rescore.Setup(function, topology);
+     * OBTrajectoryReader trajectory;
+     * trajectory.Open("md.dcd");
+     * std::vector<double> values, termValues;
+     * rescore.Rescore(trajectory, values, &termValues);
+     * @endcode
+     */
+    class OBRescore
+    {
+      public:
+        OBRescore();
+        ~OBRescore();
+        /**
+         * Set up @p numThreads (0: one per core) copies of @p function for
+         * @p topology.
+         * @return False if a copy could not be created or set up.
+         */
+        bool Setup(const OBFunction *function, OBMol &topology, int numThreads = 0);
+        unsigned int NumThreads() const
+        {
+          return m_functions.size();
+        }
+        unsigned int NumTerms() const
+        {
+          return m_termNames.size();
+        }
+        //! @return The names of the terms, in the order used by Rescore().
+        const std::vector<std::string>& GetTermNames() const
+        {
+          return m_termNames;
+        }
+        /**
+         * Compute the values for the frames first, first + stride, ... < last
+         * of @p trajectory.
+         *
+         * @param values The value for each frame.
+         * @param termValues If not 0, the term values for each frame (NumTerms()
+         * values per frame).
+         * @return False if the number of atoms in @p trajectory does not match
+         * the topology.
+         */
+        bool Rescore(const OBTrajectoryReader &trajectory, std::vector<double> &values,
+            std::vector<double> *termValues = 0, unsigned int first = 0,
+            unsigned int last = ~0u, unsigned int stride = 1);
+
+      private:
+        OBRescore(const OBRescore&);
+        OBRescore& operator=(const OBRescore&);
+        void clear();
+
+        std::vector<OBFunction*> m_functions;
+        std::vector<std::string> m_termNames;
+        unsigned int m_numAtoms;
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBRescore class
+
+#endif
@@ -0,0 +1,371 @@
+/*********************************************************************
+  OBScheduler - Work-stealing task scheduler
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBScheduler>
+#include <OBFunction>
+#include <OBFunctionTerm>
+
+#include <QThread>
+
+#include <deque>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    class OBSchedulerWorker : public QThread
+    {
+      public:
+        OBSchedulerWorker(OBScheduler *scheduler, unsigned int index)
+          : m_scheduler(scheduler), m_index(index), m_tasks(0), m_steals(0),
+          m_idleMs(0), m_idleStart(0), m_idle(false)
+        {
+          m_clock.start();
+        }
+      protected:
+        void run()
+        {
+          m_scheduler->workerLoop(this);
+        }
+      private:
+        friend class OBScheduler;
+        OBScheduler *m_scheduler;
+        unsigned int m_index;
+        QMutex m_mutex; //!< protects the members below
+        std::deque<OBScheduler::Entry> m_deque;
+        unsigned long m_tasks, m_steals;
+        QTime m_clock;
+        int m_idleMs, m_idleStart;
+        bool m_idle;
+    };
+
+    namespace {
+      class TermTask : public OBTask
+      {
+        public:
+          TermTask(OBFunctionTerm *term) : m_term(term) {}
+          void Run(OBScheduler &)
+          {
+            m_term->Compute(OBFunction::Value);
+          }
+        private:
+          OBFunctionTerm *m_term;
+      };
+    }
+
+    ////////////////////////////////////////////////////////////////////////
+    // OBTaskList
+
+    OBTaskList::~OBTaskList()
+    {
+      for (unsigned int i = 0; i < m_tasks.size(); ++i)
+        delete m_tasks[i];
+    }
+
+    void OBTaskList::Add(OBTask *task, double cost)
+    {
+      m_tasks.push_back(task);
+      m_cost += cost;
+    }
+
+    void OBTaskList::Run(OBScheduler &scheduler)
+    {
+      for (unsigned int i = 0; i < m_tasks.size(); ++i)
+        m_tasks[i]->Run(scheduler);
+    }
+
+    ////////////////////////////////////////////////////////////////////////
+    // OBTaskGroup
+
+    void OBTaskGroup::Add()
+    {
+      QMutexLocker locker(&m_mutex);
+      m_count++;
+    }
+
+    void OBTaskGroup::Done()
+    {
+      QMutexLocker locker(&m_mutex);
+      if (--m_count == 0)
+        m_condition.wakeAll();
+    }
+
+    ////////////////////////////////////////////////////////////////////////
+    // OBScheduler
+
+    OBScheduler::OBScheduler(int numThreads) : m_pending(0), m_next(0), m_quit(false)
+    {
+      if (numThreads < 1)
+        numThreads = QThread::idealThreadCount();
+      if (numThreads < 1)
+        numThreads = 1;
+
+      m_clock.start();
+      for (int i = 0; i < numThreads; ++i)
+        m_workers.push_back(new OBSchedulerWorker(this, i));
+      for (int i = 0; i < numThreads; ++i)
+        m_workers[i]->start();
+    }
+
+    OBScheduler::~OBScheduler()
+    {
+      Wait();
+
+      m_mutex.lock();
+      m_quit = true;
+      m_wake.wakeAll();
+      m_mutex.unlock();
+
+      for (unsigned int i = 0; i < m_workers.size(); ++i) {
+        m_workers[i]->wait();
+        delete m_workers[i];
+      }
+    }
+
+    OBSchedulerWorker* OBScheduler::currentWorker() const
+    {
+      QThread *thread = QThread::currentThread();
+      for (unsigned int i = 0; i < m_workers.size(); ++i)
+        if (m_workers[i] == thread)
+          return m_workers[i];
+      return 0;
+    }
+
+    void OBScheduler::Submit(OBTask *task, OBTaskGroup *group)
+    {
+      Entry entry;
+      entry.task = task;
+      entry.group = group;
+      m_all.Add();
+      if (group)
+        group->Add();
+
+      // sub-tasks go to the deque of the submitting worker
+      OBSchedulerWorker *worker = currentWorker();
+      if (!worker) {
+        QMutexLocker locker(&m_mutex);
+        worker = m_workers[m_next++ % m_workers.size()];
+      }
+
+      worker->m_mutex.lock();
+      worker->m_deque.push_back(entry);
+      worker->m_mutex.unlock();
+
+      QMutexLocker locker(&m_mutex);
+      m_pending++;
+      m_wake.wakeOne();
+    }
+
+    void OBScheduler::SubmitGrouped(const std::vector<OBTask*> &tasks, const std::vector<double> &costs,
+        double grainSize, OBTaskGroup *group)
+    {
+      OBTaskList *list = 0;
+      for (unsigned int i = 0; i < tasks.size(); ++i) {
+        const double cost = (i < costs.size()) ? costs[i] : 1.0;
+        if (cost >= grainSize) {
+          Submit(tasks[i], group);
+          continue;
+        }
+
+        if (!list)
+          list = new OBTaskList;
+        list->Add(tasks[i], cost);
+        if (list->GetCost() >= grainSize) {
+          Submit(list, group);
+          list = 0;
+        }
+      }
+
+      if (list)
+        Submit(list, group);
+    }
+
+    bool OBScheduler::pop(OBSchedulerWorker *worker, Entry &entry)
+    {
+      bool found = false;
+
+      // own deque: most recent first
+      worker->m_mutex.lock();
+      if (!worker->m_deque.empty()) {
+        entry = worker->m_deque.back();
+        worker->m_deque.pop_back();
+        found = true;
+      }
+      worker->m_mutex.unlock();
+
+      // steal the oldest task from another worker
+      for (unsigned int i = 1; !found && i < m_workers.size(); ++i) {
+        OBSchedulerWorker *victim = m_workers[(worker->m_index + i) % m_workers.size()];
+        victim->m_mutex.lock();
+        if (!victim->m_deque.empty()) {
+          entry = victim->m_deque.front();
+          victim->m_deque.pop_front();
+          found = true;
+        }
+        victim->m_mutex.unlock();
+        if (found) {
+          worker->m_mutex.lock();
+          worker->m_steals++;
+          worker->m_mutex.unlock();
+        }
+      }
+
+      if (found) {
+        QMutexLocker locker(&m_mutex);
+        m_pending--;
+      }
+      return found;
+    }
+
+    void OBScheduler::run(OBSchedulerWorker *worker, Entry &entry)
+    {
+      entry.task->Run(*this);
+      delete entry.task;
+
+      worker->m_mutex.lock();
+      worker->m_tasks++;
+      worker->m_mutex.unlock();
+
+      if (entry.group)
+        entry.group->Done();
+      m_all.Done();
+    }
+
+    void OBScheduler::workerLoop(OBSchedulerWorker *worker)
+    {
+      Entry entry;
+      while (true) {
+        if (pop(worker, entry)) {
+          run(worker, entry);
+          continue;
+        }
+
+        QMutexLocker locker(&m_mutex);
+        if (m_pending)
+          continue; // a task is being moved, try again
+        if (m_quit)
+          return;
+
+        worker->m_mutex.lock();
+        worker->m_idle = true;
+        worker->m_idleStart = worker->m_clock.elapsed();
+        worker->m_mutex.unlock();
+
+        m_wake.wait(&m_mutex);
+
+        worker->m_mutex.lock();
+        worker->m_idle = false;
+        worker->m_idleMs += worker->m_clock.elapsed() - worker->m_idleStart;
+        worker->m_mutex.unlock();
+      }
+    }
+
+    void OBScheduler::Wait(OBTaskGroup &group)
+    {
+      OBSchedulerWorker *worker = currentWorker();
+      if (!worker) {
+        QMutexLocker locker(&group.m_mutex);
+        while (group.m_count)
+          group.m_condition.wait(&group.m_mutex);
+        return;
+      }
+
+      // called from a task: help instead of blocking the worker
+      Entry entry;
+      while (true) {
+        group.m_mutex.lock();
+        const int count = group.m_count;
+        group.m_mutex.unlock();
+        if (!count)
+          return;
+
+        if (pop(worker, entry))
+          run(worker, entry);
+        else
+          QThread::yieldCurrentThread();
+      }
+    }
+
+    void OBScheduler::Wait()
+    {
+      Wait(m_all);
+    }
+
+    void OBScheduler::ComputeValue(OBFunction *function)
+    {
+      // the terms would add to the decomposition concurrently, the profiler
+      // counters measure the calling thread
+      if (function->GetDecomposition() || function->GetProfiler()) {
+        function->Compute(OBFunction::Value);
+        return;
+      }
+
+      function->GatherPositions();
+      const std::vector<OBFunctionTerm*> &terms = function->GetTerms();
+      OBTaskGroup group;
+      for (unsigned int i = 0; i < terms.size(); ++i)
+        Submit(new TermTask(terms[i]), &group);
+      Wait(group);
+    }
+
+    OBScheduler::Statistics OBScheduler::GetStatistics() const
+    {
+      Statistics stats;
+      stats.tasks = 0;
+      stats.steals = 0;
+      stats.busySeconds = 0.0;
+      stats.threads = m_workers.size();
+
+      m_mutex.lock();
+      stats.seconds = 0.001 * m_clock.elapsed();
+      m_mutex.unlock();
+
+      for (unsigned int i = 0; i < m_workers.size(); ++i) {
+        OBSchedulerWorker *worker = m_workers[i];
+        QMutexLocker locker(&worker->m_mutex);
+        const int elapsed = worker->m_clock.elapsed();
+        int idle = worker->m_idleMs;
+        if (worker->m_idle)
+          idle += elapsed - worker->m_idleStart;
+        stats.tasks += worker->m_tasks;
+        stats.steals += worker->m_steals;
+        stats.busySeconds += 0.001 * (elapsed - idle);
+      }
+
+      return stats;
+    }
+
+    void OBScheduler::ResetStatistics()
+    {
+      m_mutex.lock();
+      m_clock.restart();
+      m_mutex.unlock();
+
+      for (unsigned int i = 0; i < m_workers.size(); ++i) {
+        OBSchedulerWorker *worker = m_workers[i];
+        QMutexLocker locker(&worker->m_mutex);
+        worker->m_clock.restart();
+        worker->m_tasks = worker->m_steals = 0;
+        worker->m_idleMs = 0;
+        worker->m_idleStart = 0;
+      }
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
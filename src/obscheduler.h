@@ -0,0 +1,220 @@
+/*********************************************************************
+  OBScheduler - Work-stealing task scheduler
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBSCHEDULER_H
+#define OBSCHEDULER_H
+
+#include <vector>
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QTime>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    class OBFunction;
+    class OBScheduler;
+    class OBSchedulerWorker;
+
+    /**
+     * @class OBTask obscheduler.h <OBScheduler>
+     * @brief A unit of work for the OBScheduler.
+     *
+     * The scheduler takes ownership of submitted tasks and deletes them after
+     * Run(). Tasks can submit sub-tasks to the scheduler passed to Run().
+     */
+    class OBTask
+    {
+      public:
+        virtual ~OBTask() {}
+        virtual void Run(OBScheduler &scheduler) = 0;
+    };
+
+    /**
+     * @class OBTaskList obscheduler.h <OBScheduler>
+     * @brief A task running a list of (small) tasks sequentially.
+     *
+     * Grouping small tasks reduces the scheduling overhead per task.
+     */
+    class OBTaskList : public OBTask
+    {
+      public:
+        OBTaskList() : m_cost(0.0) {}
+        ~OBTaskList();
+        /**
+         * Add a task (ownership is taken) with an estimated @p cost.
+         */
+        void Add(OBTask *task, double cost = 1.0);
+        unsigned int Size() const
+        {
+          return m_tasks.size();
+        }
+        //! @return The sum of the task costs.
+        double GetCost() const
+        {
+          return m_cost;
+        }
+        void Run(OBScheduler &scheduler);
+      private:
+        std::vector<OBTask*> m_tasks;
+        double m_cost;
+    };
+
+    /**
+     * @class OBTaskGroup obscheduler.h <OBScheduler>
+     * @brief Counter for a set of tasks to wait for, see OBScheduler::Wait().
+     */
+    class OBTaskGroup
+    {
+      public:
+        OBTaskGroup() : m_count(0) {}
+      private:
+        friend class OBScheduler;
+        void Add();
+        void Done();
+
+        QMutex m_mutex;
+        QWaitCondition m_condition;
+        int m_count;
+    };
+
+    /**
+     * @class OBScheduler obscheduler.h <OBScheduler>
+     * @brief Work-stealing task scheduler for batches of heterogeneous jobs
+     *
+     * Every worker thread has its own task deque. A worker runs the tasks from
+     * the back of its own deque (most recently submitted first, these are
+     * usually the sub-tasks of the task it is running) and steals from the
+     * front of the other deques when its own deque is empty. Tasks submitted
+     * from outside the pool are distributed round-robin.
+     *
+     * Large jobs can be split by submitting sub-tasks from Run() and waiting
+     * for them with a OBTaskGroup, a worker waiting for a group runs other
+     * tasks in the meantime. Small jobs should be grouped with OBTaskList or
+     * SubmitGrouped() so the scheduling overhead stays small.
+     *
+     * @code
+     * OBScheduler scheduler;
+     * for (...)
+     *   scheduler.Submit(new MyTask(...));
+     * scheduler.Wait();
+     * std::cout << scheduler.GetStatistics().Utilization() << std::endl;
+     * @endcode
+     */
+    class OBScheduler
+    {
+      public:
+        /**
+         * Throughput statistics since construction or ResetStatistics().
+         */
+        struct Statistics
+        {
+          unsigned long tasks; //!< number of tasks completed
+          unsigned long steals; //!< number of tasks stolen from another worker
+          double seconds; //!< wall time
+          double busySeconds; //!< total time the workers were not idle
+          int threads;
+
+          //! @return The completed tasks per second.
+          double Throughput() const
+          {
+            return seconds > 0.0 ? tasks / seconds : 0.0;
+          }
+          //! @return The fraction of the available core time used (0...1).
+          double Utilization() const
+          {
+            return seconds > 0.0 ? busySeconds / (seconds * threads) : 0.0;
+          }
+        };
+
+        /**
+         * Constructor, starts @p numThreads worker threads (0: one per core).
+         */
+        explicit OBScheduler(int numThreads = 0);
+        /**
+         * Destructor, waits for all tasks and stops the workers.
+         */
+        ~OBScheduler();
+
+        int NumThreads() const
+        {
+          return m_workers.size();
+        }
+        /**
+         * Submit @p task, the scheduler takes ownership. When @p group is
+         * given, the task is added to it.
+         */
+        void Submit(OBTask *task, OBTaskGroup *group = 0);
+        /**
+         * Submit the tasks with their estimated costs. Tasks with a cost less
+         * than @p grainSize are grouped in OBTaskLists of about @p grainSize.
+         */
+        void SubmitGrouped(const std::vector<OBTask*> &tasks, const std::vector<double> &costs,
+            double grainSize, OBTaskGroup *group = 0);
+        /**
+         * Wait for all tasks in @p group. Called from a task, the worker runs
+         * other tasks while waiting.
+         */
+        void Wait(OBTaskGroup &group);
+        /**
+         * Wait for all submitted tasks.
+         */
+        void Wait();
+        /**
+         * Compute the value of @p function with one task per term (only for
+         * OBFunction::Value, with gradients all terms add to the same
+         * gradients). This splits the evaluation of a large molecule. With an
+         * OBDecomposition or OBProfiler set, the function is computed in the
+         * calling thread.
+         */
+        void ComputeValue(OBFunction *function);
+
+        Statistics GetStatistics() const;
+        void ResetStatistics();
+
+      private:
+        friend class OBSchedulerWorker;
+        struct Entry
+        {
+          OBTask *task;
+          OBTaskGroup *group;
+        };
+
+        //! @return The worker for the calling thread or 0.
+        OBSchedulerWorker* currentWorker() const;
+        bool pop(OBSchedulerWorker *worker, Entry &entry);
+        void run(OBSchedulerWorker *worker, Entry &entry);
+        void workerLoop(OBSchedulerWorker *worker);
+
+        std::vector<OBSchedulerWorker*> m_workers;
+        OBTaskGroup m_all; //!< contains every task
+        mutable QMutex m_mutex; //!< protects the members below
+        QWaitCondition m_wake;
+        int m_pending; //!< tasks in the deques
+        unsigned int m_next; //!< round-robin worker for external submits
+        bool m_quit;
+        QTime m_clock; //!< wall time for the statistics
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBScheduler class
+
+#endif
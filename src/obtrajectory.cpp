@@ -0,0 +1,403 @@
+/*********************************************************************
+  OBTrajectory - Binary (DCD) trajectory writer and reader
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBTrajectory>
+#include <OBFunction>
+
+#include <openbabel/oberror.h>
+
+#include <QThread>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /*
+     * DCD layout (all records are Fortran unformatted records with a 4 byte
+     * length before and after the data):
+     *
+     *   record 1 (84 bytes): "CORD", 20 ints (number of frames, first step,
+     *                        step interval, last step, ..., time step as float,
+     *                        unit cell flag, ..., CHARMM version)
+     *   record 2: number of title lines, 80 characters per line
+     *   record 3: number of atoms
+     *   per frame: [unit cell record (48 bytes)], X, Y and Z records
+     */
+    namespace {
+      //! Offsets of the frame count and last step in the header.
+      const long NumFramesOffset = 8;
+      const long LastStepOffset = 20;
+      //! Frames are written when the buffer is larger than this (floats).
+      const unsigned int BufferSize = 256 * 1024;
+
+      void writeInt(FILE *file, int value)
+      {
+        fwrite(&value, sizeof(int), 1, file);
+      }
+
+      int readInt(const char *data)
+      {
+        int value;
+        memcpy(&value, data, sizeof(int));
+        return value;
+      }
+    }
+
+    class OBTrajectoryWriterThread : public QThread
+    {
+      public:
+        OBTrajectoryWriterThread(OBTrajectoryWriter *writer) : m_writer(writer) {}
+      protected:
+        void run()
+        {
+          m_writer->writerLoop();
+        }
+      private:
+        OBTrajectoryWriter *m_writer;
+    };
+
+    ////////////////////////////////////////////////////////////////////////
+    // OBTrajectoryWriter
+
+    OBTrajectoryWriter::OBTrajectoryWriter() : m_file(0), m_numAtoms(0), m_numFrames(0),
+        m_thread(0), m_quit(false), m_error(false)
+    {
+    }
+
+    OBTrajectoryWriter::~OBTrajectoryWriter()
+    {
+      Close();
+    }
+
+    bool OBTrajectoryWriter::Open(const std::string &filename, unsigned int numAtoms,
+        double timeStep, const std::string &title)
+    {
+      Close();
+
+      m_file = fopen(filename.c_str(), "wb");
+      if (!m_file) {
+        obErrorLog.ThrowError(__FUNCTION__, "Cannot create " + filename, obError);
+        return false;
+      }
+      m_numAtoms = numAtoms;
+      m_numFrames = 0;
+      m_error = false;
+      m_quit = false;
+
+      // record 1: the frame count and last step are updated in Close()
+      int control[20];
+      memset(control, 0, sizeof(control));
+      control[2] = 1; // step interval
+      const float delta = timeStep;
+      memcpy(&control[9], &delta, sizeof(float));
+      control[19] = 24; // CHARMM version
+      writeInt(m_file, 84);
+      fwrite("CORD", 1, 4, m_file);
+      fwrite(control, sizeof(int), 20, m_file);
+      writeInt(m_file, 84);
+
+      // record 2: two title lines
+      char titles[160];
+      memset(titles, ' ', sizeof(titles));
+      const char *creator = "REMARKS Created by OpenBabel OBFFs";
+      memcpy(titles, creator, strlen(creator));
+      memcpy(titles + 80, title.c_str(), std::min(title.size(), size_t(80)));
+      writeInt(m_file, 4 + sizeof(titles));
+      writeInt(m_file, 2);
+      fwrite(titles, 1, sizeof(titles), m_file);
+      writeInt(m_file, 4 + sizeof(titles));
+
+      // record 3
+      writeInt(m_file, 4);
+      writeInt(m_file, numAtoms);
+      writeInt(m_file, 4);
+
+      if (ferror(m_file)) {
+        fclose(m_file);
+        m_file = 0;
+        return false;
+      }
+
+      m_buffer.reserve(BufferSize + 3 * (numAtoms + 2));
+      m_thread = new OBTrajectoryWriterThread(this);
+      m_thread->start();
+      return true;
+    }
+
+    float* OBTrajectoryWriter::newFrame()
+    {
+      const unsigned int recordSize = m_numAtoms + 2;
+      const unsigned int start = m_buffer.size();
+      m_buffer.resize(start + 3 * recordSize);
+      float *frame = &m_buffer[start];
+
+      // record markers around the X, Y and Z arrays
+      const int bytes = 4 * m_numAtoms;
+      for (unsigned int i = 0; i < 3; ++i) {
+        memcpy(frame + i * recordSize, &bytes, sizeof(int));
+        memcpy(frame + i * recordSize + recordSize - 1, &bytes, sizeof(int));
+      }
+
+      m_numFrames++;
+      return frame + 1;
+    }
+
+    void OBTrajectoryWriter::AddFrame(const OBFunction *function)
+    {
+      if (!m_file || function->NumParticles() != m_numAtoms)
+        return;
+
+      float *x = newFrame();
+      float *y = x + m_numAtoms + 2;
+      float *z = y + m_numAtoms + 2;
+      for (unsigned int i = 0; i < m_numAtoms; ++i) {
+        const Eigen::Vector3d &pos = function->GetPosition(i);
+        x[i] = pos.x();
+        y[i] = pos.y();
+        z[i] = pos.z();
+      }
+
+      if (m_buffer.size() >= BufferSize)
+        flush();
+    }
+
+    void OBTrajectoryWriter::AddFrame(const std::vector<Eigen::Vector3d> &positions)
+    {
+      if (!m_file || positions.size() != m_numAtoms)
+        return;
+
+      float *x = newFrame();
+      float *y = x + m_numAtoms + 2;
+      float *z = y + m_numAtoms + 2;
+      for (unsigned int i = 0; i < m_numAtoms; ++i) {
+        x[i] = positions[i].x();
+        y[i] = positions[i].y();
+        z[i] = positions[i].z();
+      }
+
+      if (m_buffer.size() >= BufferSize)
+        flush();
+    }
+
+    void OBTrajectoryWriter::flush()
+    {
+      QMutexLocker locker(&m_mutex);
+      while (!m_pending.empty())
+        m_condition.wait(&m_mutex);
+      // the buffers are swapped, their memory is reused
+      m_pending.swap(m_buffer);
+      m_condition.wakeAll();
+    }
+
+    void OBTrajectoryWriter::writerLoop()
+    {
+      QMutexLocker locker(&m_mutex);
+      while (true) {
+        while (m_pending.empty() && !m_quit)
+          m_condition.wait(&m_mutex);
+        if (m_pending.empty())
+          return;
+
+        // m_pending is not changed by AddFrame() until it is empty
+        locker.unlock();
+        const size_t written = fwrite(&m_pending[0], sizeof(float), m_pending.size(), m_file);
+        locker.relock();
+
+        if (written != m_pending.size())
+          m_error = true;
+        m_pending.clear();
+        m_condition.wakeAll();
+      }
+    }
+
+    bool OBTrajectoryWriter::Close()
+    {
+      if (!m_file)
+        return true;
+
+      flush();
+      m_mutex.lock();
+      while (!m_pending.empty())
+        m_condition.wait(&m_mutex);
+      m_quit = true;
+      m_condition.wakeAll();
+      m_mutex.unlock();
+      m_thread->wait();
+      delete m_thread;
+      m_thread = 0;
+
+      fseek(m_file, NumFramesOffset, SEEK_SET);
+      writeInt(m_file, m_numFrames);
+      fseek(m_file, LastStepOffset, SEEK_SET);
+      writeInt(m_file, m_numFrames);
+      const bool ok = !m_error && !ferror(m_file);
+      fclose(m_file);
+      m_file = 0;
+      m_buffer.clear();
+      return ok;
+    }
+
+    ////////////////////////////////////////////////////////////////////////
+    // OBTrajectoryReader
+
+    OBTrajectoryReader::OBTrajectoryReader() : m_data(0), m_size(0), m_numAtoms(0),
+        m_numFrames(0), m_firstFrame(0), m_frameSize(0), m_cellSize(0), m_timeStep(0.0)
+    {
+    }
+
+    OBTrajectoryReader::~OBTrajectoryReader()
+    {
+      Close();
+    }
+
+    void OBTrajectoryReader::Close()
+    {
+#ifndef WIN32
+      if (m_data && m_copy.empty())
+        munmap(const_cast<char*>(m_data), m_size);
+#endif
+      m_copy.clear();
+      m_data = 0;
+      m_size = 0;
+      m_numAtoms = m_numFrames = 0;
+    }
+
+    bool OBTrajectoryReader::Open(const std::string &filename)
+    {
+      Close();
+
+#ifndef WIN32
+      int fd = open(filename.c_str(), O_RDONLY);
+      if (fd < 0) {
+        obErrorLog.ThrowError(__FUNCTION__, "Cannot open " + filename, obError);
+        return false;
+      }
+      struct stat info;
+      if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *data = mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED) {
+          m_data = static_cast<const char*>(data);
+          m_size = info.st_size;
+        }
+      }
+      ::close(fd);
+#else
+      std::ifstream ifs(filename.c_str(), std::ios::binary);
+      m_copy.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      if (!m_copy.empty()) {
+        m_data = &m_copy[0];
+        m_size = m_copy.size();
+      }
+#endif
+      if (!m_data) {
+        obErrorLog.ThrowError(__FUNCTION__, "Cannot read " + filename, obError);
+        return false;
+      }
+
+      // record 1
+      if (m_size < 92 || readInt(m_data) != 84 || memcmp(m_data + 4, "CORD", 4) ||
+          readInt(m_data + 88) != 84) {
+        obErrorLog.ThrowError(__FUNCTION__, filename + " is no DCD file in the native byte order", obError);
+        Close();
+        return false;
+      }
+      const char *control = m_data + 8;
+      if (readInt(control + 4 * 8)) {
+        obErrorLog.ThrowError(__FUNCTION__, "DCD files with fixed atoms are not supported", obError);
+        Close();
+        return false;
+      }
+      float delta;
+      memcpy(&delta, control + 4 * 9, sizeof(float));
+      m_timeStep = delta;
+      m_cellSize = readInt(control + 4 * 10) ? 48 + 8 : 0;
+
+      // record 2
+      size_t offset = 92;
+      const int titleSize = (m_size >= offset + 8) ? readInt(m_data + offset) : -1;
+      if (titleSize < 4 || offset + titleSize + 8 + 12 > m_size ||
+          readInt(m_data + offset + 4 + titleSize) != titleSize) {
+        obErrorLog.ThrowError(__FUNCTION__, filename + " has an invalid title record", obError);
+        Close();
+        return false;
+      }
+      const int numTitles = readInt(m_data + offset + 4);
+      m_title.clear();
+      for (int i = 0; i < numTitles && 4 + 80 * (i + 1) <= titleSize; ++i) {
+        std::string line(m_data + offset + 8 + 80 * i, 80);
+        line.erase(line.find_last_not_of(' ') + 1);
+        if (i)
+          m_title += "\n";
+        m_title += line;
+      }
+      offset += titleSize + 8;
+
+      // record 3, the number of atoms must also fit the 4 * n byte record
+      // markers of the coordinates
+      const int numAtoms = readInt(m_data + offset + 4);
+      if (readInt(m_data + offset) != 4 || readInt(m_data + offset + 8) != 4 ||
+          numAtoms <= 0 || numAtoms > INT_MAX / 4) {
+        obErrorLog.ThrowError(__FUNCTION__, filename + " has an invalid atom count record", obError);
+        Close();
+        return false;
+      }
+      m_numAtoms = numAtoms;
+      m_firstFrame = offset + 12;
+      m_frameSize = m_cellSize + 3 * (4 * size_t(m_numAtoms) + 8);
+
+      // the X record of the first frame
+      if (m_size >= m_firstFrame + m_cellSize + 4 &&
+          readInt(m_data + m_firstFrame + m_cellSize) != 4 * numAtoms) {
+        obErrorLog.ThrowError(__FUNCTION__, filename + " has a coordinate record that does not match the atom count", obError);
+        Close();
+        return false;
+      }
+      m_numFrames = (m_size - m_firstFrame) / m_frameSize;
+      return true;
+    }
+
+    bool OBTrajectoryReader::GetFrame(unsigned int frame, std::vector<Eigen::Vector3d> &positions) const
+    {
+      if (frame >= m_numFrames)
+        return false;
+
+      const float *x = GetX(frame);
+      const float *y = GetY(frame);
+      const float *z = GetZ(frame);
+      positions.resize(m_numAtoms);
+      for (unsigned int i = 0; i < m_numAtoms; ++i)
+        positions[i] = Eigen::Vector3d(x[i], y[i], z[i]);
+      return true;
+    }
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
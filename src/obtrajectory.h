@@ -0,0 +1,194 @@
+/*********************************************************************
+  OBTrajectory - Binary (DCD) trajectory writer and reader
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBTRAJECTORY_H
+#define OBTRAJECTORY_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+
+#include <Eigen/Core>
+
+#include <QMutex>
+#include <QWaitCondition>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    class OBFunction;
+    class OBTrajectoryWriterThread;
+
+    /**
+     * @class OBTrajectoryWriter obtrajectory.h <OBTrajectory>
+     * @brief Asynchronous writer for binary (CHARMM/NAMD DCD) trajectories.
+     *
+     * The file has a fixed header followed by float32 frames (X, Y and Z
+     * arrays), it can be read by VMD, MDAnalysis and OBTrajectoryReader.
+     *
+     * AddFrame() only converts the coordinates to float into a memory buffer,
+     * full buffers are written to disk by a background thread. The coordinates
+     * are always stored in the input (OBMol) atom order.
+     *
+     * @code
+     * OBTrajectoryWriter trajectory;
+     * trajectory.Open("min.dcd", function->NumParticles());
+     * OBMinimize minimize(function);
+     * minimize.SetTrajectory(&trajectory);
+     * minimize.ConjugateGradients(1000);
+     * trajectory.Close();
+     * @endcode
+     */
+    class OBTrajectoryWriter
+    {
+      public:
+        OBTrajectoryWriter();
+        /**
+         * Destructor, calls Close().
+         */
+        ~OBTrajectoryWriter();
+        /**
+         * Create @p filename for frames with @p numAtoms atoms. The @p timeStep
+         * (in AKMA units for MD, 1.0 for minimizations) is stored in the header.
+         * @return True if the file could be created.
+         */
+        bool Open(const std::string &filename, unsigned int numAtoms, double timeStep = 1.0,
+            const std::string &title = "");
+        bool IsOpen() const
+        {
+          return m_file != 0;
+        }
+        /**
+         * Add the current positions of @p function.
+         */
+        void AddFrame(const OBFunction *function);
+        /**
+         * Add a frame, @p positions are in the input atom order.
+         */
+        void AddFrame(const std::vector<Eigen::Vector3d> &positions);
+        unsigned int NumFrames() const
+        {
+          return m_numFrames;
+        }
+        /**
+         * Write the remaining frames, update the frame count in the header and
+         * close the file.
+         * @return False if writing failed.
+         */
+        bool Close();
+
+      private:
+        friend class OBTrajectoryWriterThread;
+        OBTrajectoryWriter(const OBTrajectoryWriter&);
+        OBTrajectoryWriter& operator=(const OBTrajectoryWriter&);
+
+        //! @return Pointer to the X, Y and Z arrays of a new frame in the buffer.
+        float* newFrame();
+        //! Hand the buffer to the writer thread.
+        void flush();
+        void writerLoop();
+
+        FILE *m_file;
+        unsigned int m_numAtoms, m_numFrames;
+        std::vector<float> m_buffer; //!< frames being filled by AddFrame()
+        OBTrajectoryWriterThread *m_thread;
+        QMutex m_mutex; //!< protects the members below
+        QWaitCondition m_condition;
+        std::vector<float> m_pending; //!< frames being written by the thread
+        bool m_quit, m_error;
+    };
+
+    /**
+     * @class OBTrajectoryReader obtrajectory.h <OBTrajectory>
+     * @brief Memory-mapped reader for DCD trajectories.
+     *
+     * The file is mapped into memory, GetX(), GetY() and GetZ() return
+     * pointers into the mapping without copying. Only files in the native
+     * byte order without fixed atoms are supported. The number of frames is
+     * computed from the file size, a file from an interrupted run can be read.
+     */
+    class OBTrajectoryReader
+    {
+      public:
+        OBTrajectoryReader();
+        ~OBTrajectoryReader();
+        /**
+         * Map @p filename and read the header.
+         * @return False if the file could not be mapped or is no supported DCD file.
+         */
+        bool Open(const std::string &filename);
+        void Close();
+
+        unsigned int NumAtoms() const
+        {
+          return m_numAtoms;
+        }
+        unsigned int NumFrames() const
+        {
+          return m_numFrames;
+        }
+        double GetTimeStep() const
+        {
+          return m_timeStep;
+        }
+        const std::string& GetTitle() const
+        {
+          return m_title;
+        }
+        //! @return The X coordinates of @p frame (NumAtoms() floats).
+        const float* GetX(unsigned int frame) const
+        {
+          return frameData(frame);
+        }
+        const float* GetY(unsigned int frame) const
+        {
+          return frameData(frame) + m_numAtoms + 2;
+        }
+        const float* GetZ(unsigned int frame) const
+        {
+          return frameData(frame) + 2 * (m_numAtoms + 2);
+        }
+        /**
+         * Copy @p frame to @p positions.
+         */
+        bool GetFrame(unsigned int frame, std::vector<Eigen::Vector3d> &positions) const;
+
+      private:
+        OBTrajectoryReader(const OBTrajectoryReader&);
+        OBTrajectoryReader& operator=(const OBTrajectoryReader&);
+
+        const float* frameData(unsigned int frame) const
+        {
+          return reinterpret_cast<const float*>(m_data + m_firstFrame + frame * m_frameSize + m_cellSize + 4);
+        }
+
+        const char *m_data;
+        size_t m_size;
+        std::vector<char> m_copy; //!< file contents where mmap is not available
+        unsigned int m_numAtoms, m_numFrames;
+        size_t m_firstFrame, m_frameSize, m_cellSize;
+        double m_timeStep;
+        std::string m_title;
+    };
+
+  } // end namespace OBFFs
+} // end namespace OpenBabel
+
+//! \brief OBTrajectoryWriter and OBTrajectoryReader classes
+
+#endif
@@ -0,0 +1,90 @@
+/**********************************************************************
+  ArenaTest - unit testing for OBArena
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBArena>
+
+#include <iostream>
+
+#include "obtest.h"
+
+using namespace OpenBabel::OBFFs;
+
+struct Index
+{
+  unsigned int iA, iB;
+};
+
+struct Parameter
+{
+  double sigma, epsilon;
+};
+
+bool aligned(const void *pointer)
+{
+  return reinterpret_cast<size_t>(pointer) % OBArena::Alignment == 0;
+}
+
+int main()
+{
+  OBArena arena;
+  OB_ASSERT( arena.Allocate<Index>(0) == 0 );
+
+  // arrays are aligned and do not overlap
+  Index *i = arena.Allocate<Index>(100);
+  Parameter *p = arena.Allocate<Parameter>(100);
+  OB_ASSERT( aligned(i) );
+  OB_ASSERT( aligned(p) );
+  OB_ASSERT( reinterpret_cast<char*>(p) >= reinterpret_cast<char*>(i + 100) );
+  for (unsigned int j = 0; j < 100; ++j) {
+    i[j].iA = j;
+    i[j].iB = j + 1;
+    p[j].sigma = p[j].epsilon = 0.5 * j;
+  }
+  OB_ASSERT( i[99].iB == 100 );
+  OB_ASSERT( arena.NumBlocks() == 1 );
+
+  // the memory is reused after a reset
+  arena.Reset();
+  OB_ASSERT( arena.GetSize() == 0 );
+  OB_ASSERT( arena.Allocate<Index>(100) == i );
+
+  // a larger setup spills into extra blocks ...
+  arena.Reset();
+  const size_t capacity = arena.GetCapacity();
+  size_t total = 0;
+  for (unsigned int j = 0; j < 10; ++j) {
+    Parameter *q = arena.Allocate<Parameter>(capacity / sizeof(Parameter) / 4 + 1);
+    OB_ASSERT( aligned(q) );
+    q[0].sigma = j;
+    total += capacity / sizeof(Parameter) / 4 + 1;
+  }
+  OB_ASSERT( arena.NumBlocks() > 1 );
+  const size_t size = arena.GetSize();
+  OB_ASSERT( size >= total * sizeof(Parameter) );
+
+  // ... which are replaced by a single block for the next one
+  arena.Reset();
+  OB_ASSERT( arena.NumBlocks() == 1 );
+  OB_ASSERT( arena.GetCapacity() >= size );
+  for (unsigned int j = 0; j < 10; ++j)
+    arena.Allocate<Parameter>(capacity / sizeof(Parameter) / 4 + 1);
+  OB_ASSERT( arena.NumBlocks() == 1 );
+
+  std::cout << "arena: " << arena.GetSize() << " of " << arena.GetCapacity() << " bytes" << std::endl;
+  return 0;
+}
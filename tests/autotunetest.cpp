@@ -0,0 +1,71 @@
+/**********************************************************************
+  AutoTuneTest - unit testing for OBAutoTune
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBAutoTune>
+#include <OBNbrList>
+
+#include <iostream>
+
+#include "obtest.h"
+
+using namespace OpenBabel::OBFFs;
+
+// n x n x n atoms with spacing d
+std::vector<Eigen::Vector3d> grid(int n, double d)
+{
+  std::vector<Eigen::Vector3d> positions;
+  for (int x = 0; x < n; ++x)
+    for (int y = 0; y < n; ++y)
+      for (int z = 0; z < n; ++z)
+        positions.push_back(Eigen::Vector3d(x * d, y * d, z * d));
+  return positions;
+}
+
+int main()
+{
+  OB_ASSERT( OBNbrList::NumSearchCells(1) == 27 );
+  OB_ASSERT( OBNbrList::NumSearchCells(2) > 27 );
+
+  // two atoms
+  std::vector<Eigen::Vector3d> pair = grid(1, 1.0);
+  pair.push_back(Eigen::Vector3d(1.5, 0.0, 0.0));
+  OB_ASSERT( OBAutoTune::CountNeighbors(pair, 2.0) == 1.0 );
+  OB_ASSERT( OBAutoTune::CountNeighbors(pair, 1.0) == 0.0 );
+
+  // interior atoms of a grid have 6 neighbors at distance d
+  std::vector<Eigen::Vector3d> positions = grid(5, 1.0);
+  const double neighbors = OBAutoTune::CountNeighbors(positions, 1.1);
+  OB_ASSERT( neighbors > 3.0 && neighbors < 6.0 );
+  OB_ASSERT( OBAutoTune::CountNeighbors(positions, 10.0) == 124.0 );
+
+  // all pairs for small molecules, cluster pairs for large systems
+  OB_ASSERT( OBAutoTune::AllPairTime(30) < OBAutoTune::ClusterPairTime(30, 29.0) );
+  OB_ASSERT( OBAutoTune::AllPairTime(50000) > OBAutoTune::ClusterPairTime(50000, 400.0) );
+  OB_ASSERT( OBAutoTune::AllPairTime(1000) < OBAutoTune::AllPairTime(2000) );
+  OB_ASSERT( OBAutoTune::ClusterPairTime(1000, 100.0) < OBAutoTune::ClusterPairTime(1000, 200.0) );
+
+  // finer neighbor list cells for dense systems
+  OB_ASSERT( OBAutoTune::NbrListBoxSize(0.0) == 1 );
+  OB_ASSERT( OBAutoTune::NbrListBoxSize(1000.0) > 1 );
+
+  // no threads for small systems
+  OB_ASSERT( OBAutoTune::NumThreads(0.0) == 1 );
+  OB_ASSERT( OBAutoTune::NumThreads(1.0) >= 1 );
+
+  return 0;
+}
@@ -0,0 +1,136 @@
+/**********************************************************************
+  ClusterPairListTest - unit testing for the OBClusterPairList class
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBClusterPairList>
+#include <OBFunction>
+
+#include "obtest.h"
+#include "mockfunction.h"
+
+using namespace OpenBabel::OBFFs;
+
+// count the atom pairs within rcut using the cluster pairs and their masks
+unsigned int test(OBFunction *function, double r, double skin)
+{
+  OBClusterPairList *list = new OBClusterPairList(function, r, skin);
+  const unsigned int CS = OBClusterPairList::ClusterSize;
+
+  // every atom is in exactly one slot
+  std::vector<unsigned int> slots(function->NumParticles(), 0);
+  for (unsigned int s = 0; s < list->GetAtoms().size(); ++s)
+    if (list->GetAtoms()[s] != OBClusterPairList::NoAtom)
+      slots[list->GetAtoms()[s]]++;
+  for (unsigned int i = 0; i < slots.size(); ++i)
+    OB_ASSERT(slots[i] == 1);
+
+  const double *x = list->GetX();
+  const double *y = list->GetY();
+  const double *z = list->GetZ();
+  const std::vector<OBClusterPairList::ClusterPair> &pairs = list->GetClusterPairs();
+  unsigned int count = 0;
+  for (unsigned int p = 0; p < pairs.size(); ++p)
+    for (unsigned int a = 0; a < CS; ++a)
+      for (unsigned int b = 0; b < CS; ++b) {
+        if (!((pairs[p].mask >> (a * CS + b)) & 1u))
+          continue;
+        const unsigned int i = pairs[p].i * CS + a;
+        const unsigned int j = pairs[p].j * CS + b;
+        const double dx = x[i] - x[j], dy = y[i] - y[j], dz = z[i] - z[j];
+        if (dx * dx + dy * dy + dz * dz <= r * r)
+          count++;
+      }
+
+  delete list;
+  return count;
+}
+
+int main()
+{
+  MockFunction *function = new MockFunction(1000);
+
+  // create a 10x10x10 slightly distorted grid with atoms
+  for (int i = 0; i < 10; ++i)
+    for (int j = 0; j < 10; ++j)
+      for (int k = 0; k < 10; ++k) {
+        function->GetPositions()[i * 100 + j * 10 + k] = Eigen::Vector3d(1.1 * i + 0.01 * k, 0.9 * j, (double)k + 0.02 * i);
+      }
+
+  // compute the correct number of pairs
+  unsigned int correct5 = 0;
+  unsigned int correct10 = 0;
+  for (unsigned int i = 0; i < 1000; ++i) {
+    for (unsigned int j = i + 1; j < 1000; ++j) {
+      double r2 = ( function->GetPositions()[i] - function->GetPositions()[j] ).squaredNorm();
+
+      if (r2 <= 25.0)
+        correct5++;
+      if (r2 <= 100.0)
+        correct10++;
+    }
+  }
+
+  unsigned int count;
+
+  count = test(function, 5., 0.);
+  OB_ASSERT(correct5 == count);
+
+  count = test(function, 5., 1.);
+  OB_ASSERT(correct5 == count);
+
+  count = test(function, 10., 0.5);
+  OB_ASSERT(correct10 == count);
+
+  // interaction groups: only pairs between the two halves
+  OpenBabel::OBBitVec first, second;
+  for (unsigned int i = 0; i < 1000; ++i) {
+    if (i < 500)
+      first.SetBitOn(i);
+    else
+      second.SetBitOn(i);
+  }
+  function->AddInterGroups(first, second);
+
+  unsigned int correctGroups = 0;
+  for (unsigned int i = 0; i < 500; ++i)
+    for (unsigned int j = 500; j < 1000; ++j)
+      if (( function->GetPositions()[i] - function->GetPositions()[j] ).squaredNorm() <= 25.0)
+        correctGroups++;
+
+  count = test(function, 5., 1.);
+  OB_ASSERT(correctGroups == count);
+
+  // an atom moving more than skin/2 rebuilds the list before the interval
+  OBClusterPairList *list = new OBClusterPairList(function, 5., 1., 10);
+  OB_ASSERT( !list->Update() );
+  function->GetPositions()[0] += Eigen::Vector3d(0.4, 0.0, 0.0);
+  OB_ASSERT( !list->Update() );
+  function->GetPositions()[0] += Eigen::Vector3d(0.2, 0.0, 0.0);
+  OB_ASSERT( list->Update() );
+  // the interval is an upper bound
+  for (int i = 0; i < 10; ++i)
+    OB_ASSERT( !list->Update() );
+  OB_ASSERT( list->Update() );
+  // a new configuration, e.g. the next trajectory frame
+  OB_ASSERT( !list->Update() );
+  list->Invalidate();
+  OB_ASSERT( list->Update() );
+  OB_ASSERT( !list->Update() );
+  delete list;
+
+  delete function;
+}
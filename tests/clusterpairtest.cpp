@@ -0,0 +1,126 @@
+/**********************************************************************
+  ClusterPairTest - unit testing for the cluster pair terms
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBFunction>
+#include "../src/forceterms/LJ6_12.h"
+#include "../src/forceterms/Coulomb.h"
+#include "../src/forceterms/ClusterPair.h"
+
+#include <cmath>
+
+#include "obtest.h"
+#include "mockterms.h"
+
+using namespace OpenBabel::OBFFs;
+
+const unsigned int numAtoms = 80;
+const char *names[] = { "c", "h", "n", "o" };
+const double typeSigma[] = { 3.40, 2.65, 3.25, 2.96 };
+const double typeEpsilon[] = { 0.086, 0.016, 0.17, 0.21 };
+
+// the non-bonded pairs of the chain (see MockType) within rcut and the 1-4 pairs
+double reference(const std::vector<Eigen::Vector3d> &positions, const std::vector<double> &charges,
+    double rcut, bool coulomb)
+{
+  double energy = 0.0;
+  for (unsigned int j = 0; j < positions.size(); ++j)
+    for (unsigned int k = j + 1; k < positions.size(); ++k) {
+      const double r = (positions[j] - positions[k]).norm();
+      if (k - j < 3 || (k - j > 3 && r >= rcut))
+        continue;
+      if (coulomb) {
+        const double scale = (k - j == 3) ? 0.8333 : 1.0;
+        energy += scale * 332.0716 * charges[j] * charges[k] / r;
+      } else {
+        const double scale = (k - j == 3) ? 0.5 : 1.0;
+        const double sigma = sqrt(typeSigma[j % 4] * typeSigma[k % 4]);
+        const double epsilon = scale * sqrt(typeEpsilon[j % 4] * typeEpsilon[k % 4]);
+        const double term6 = pow(sigma / r, 6.0);
+        energy += 4.0 * epsilon * (term6 * term6 - term6);
+      }
+    }
+  return energy;
+}
+
+int main()
+{
+  std::vector<Eigen::Vector3d> positions(numAtoms);
+  std::vector<std::string> types(numAtoms);
+  std::vector<double> charges(numAtoms);
+  for (unsigned int i = 0; i < numAtoms; ++i) {
+    // a 5x4x4 lattice, the chain snakes through it: bonded atoms are neighbors
+    const unsigned int layer = i / 20;
+    unsigned int row = (i % 20) / 5, column = i % 5;
+    if (row % 2)
+      column = 4 - column;
+    if (layer % 2)
+      row = 3 - row;
+    positions[i] = Eigen::Vector3d(3.0 * column + 0.1 * sin(i), 3.0 * row + 0.1 * cos(i), 3.0 * layer);
+    types[i] = names[i % 4];
+    charges[i] = 0.4 * sin(1.7 * i);
+  }
+
+  MockLJDatabase database;
+  for (unsigned int t = 0; t < 4; ++t)
+    database.AddType(names[t], typeSigma[t], typeEpsilon[t]);
+  MockType type(types);
+  MockCharges method(charges);
+
+  // a cut-off larger than the molecule: the same energy and gradients as LJ6_12 and Coulomb
+  const double large = 50.0;
+  MockTermFunction full(positions), cluster(positions);
+  full.SetParameterDB(&database);
+  full.SetOBFFType(&type);
+  full.SetOBChargeMethod(&method);
+  full.AddTerm(new LJ6_12(&full));
+  full.AddTerm(new Coulomb(&full));
+  cluster.SetParameterDB(&database);
+  cluster.SetOBFFType(&type);
+  cluster.SetOBChargeMethod(&method);
+  cluster.AddTerm(new LJ6_12ClusterPair(&cluster, large));
+  cluster.AddTerm(new CoulombClusterPair(&cluster, large));
+  OB_REQUIRE( full.SetupTerms() );
+  OB_REQUIRE( cluster.SetupTerms() );
+
+  full.Compute(OBFunction::Gradients);
+  cluster.Compute(OBFunction::Gradients);
+  for (unsigned int t = 0; t < 2; ++t) {
+    const double value = full.GetTerms()[t]->GetValue();
+    OB_ASSERT( fabs(cluster.GetTerms()[t]->GetValue() - value) < 1.0e-8 * (1.0 + fabs(value)) );
+  }
+  for (unsigned int i = 0; i < numAtoms; ++i)
+    OB_ASSERT( (cluster.GetGradients()[i] - full.GetGradients()[i]).norm() < 1.0e-8 * (1.0 + full.GetGradients()[i].norm()) );
+
+  // a cut-off smaller than the molecule: only the pairs within the cut-off
+  const double small = 10.0;
+  MockTermFunction truncated(positions);
+  truncated.SetParameterDB(&database);
+  truncated.SetOBFFType(&type);
+  truncated.SetOBChargeMethod(&method);
+  truncated.AddTerm(new LJ6_12ClusterPair(&truncated, small));
+  truncated.AddTerm(new CoulombClusterPair(&truncated, small));
+  OB_REQUIRE( truncated.SetupTerms() );
+  truncated.Compute(OBFunction::Value);
+  const double lj = reference(positions, charges, small, false);
+  const double coulomb = reference(positions, charges, small, true);
+  OB_ASSERT( fabs(truncated.GetTerms()[0]->GetValue() - lj) < 1.0e-8 * (1.0 + fabs(lj)) );
+  OB_ASSERT( fabs(truncated.GetTerms()[1]->GetValue() - coulomb) < 1.0e-8 * (1.0 + fabs(coulomb)) );
+  OB_ASSERT( fabs(truncated.GetTerms()[1]->GetValue() - full.GetTerms()[1]->GetValue()) > 1.0e-3 );
+
+  return 0;
+}
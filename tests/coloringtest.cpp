@@ -0,0 +1,109 @@
+/**********************************************************************
+  ColoringTest - unit testing for OBFunctionTerm::ColorInteractions
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBFunction>
+#include <OBFunctionTerm>
+
+#include "obtest.h"
+#include "mockfunction.h"
+
+using namespace OpenBabel::OBFFs;
+
+class MockTerm : public OBFunctionTerm
+{
+  public:
+    MockTerm(OBFunction *function) : OBFunctionTerm(function) {}
+    std::string GetName() const { return "MockTerm"; }
+    bool Setup() { return true; }
+    void Compute(OBFunction::Computation computation = OBFunction::Value) {}
+    double GetValue() const { return 0.0; }
+
+    void Test(const std::vector<unsigned int> &atoms, unsigned int atomsPerInteraction)
+    {
+      std::vector<unsigned int> order, colorOffsets;
+      ColorInteractions(atoms, atomsPerInteraction, order, colorOffsets);
+      const unsigned int numInteractions = atoms.size() / atomsPerInteraction;
+
+      // order is a permutation
+      OB_REQUIRE(order.size() == numInteractions);
+      OB_REQUIRE(colorOffsets.back() == numInteractions);
+      std::vector<bool> seen(numInteractions, false);
+      for (unsigned int i = 0; i < order.size(); ++i) {
+        OB_ASSERT(!seen[order[i]]);
+        seen[order[i]] = true;
+      }
+
+      // no atom occurs twice in a color
+      for (unsigned int c = 0; c + 1 < colorOffsets.size(); ++c) {
+        OB_ASSERT(colorOffsets[c] < colorOffsets[c + 1]);
+        std::vector<bool> used(m_function->NumParticles(), false);
+        for (unsigned int i = colorOffsets[c]; i < colorOffsets[c + 1]; ++i)
+          for (unsigned int a = 0; a < atomsPerInteraction; ++a) {
+            const unsigned int atom = atoms[order[i] * atomsPerInteraction + a];
+            OB_ASSERT(!used[atom]);
+            used[atom] = true;
+          }
+      }
+
+      // copy the arrays in color order
+      std::vector<unsigned int> sorted(order.size());
+      for (unsigned int i = 0; i < order.size(); ++i)
+        sorted[i] = i;
+      Permute(&sorted[0], order);
+      OB_ASSERT(sorted == order);
+    }
+};
+
+int main()
+{
+  const unsigned int n = 100;
+  MockFunction *function = new MockFunction(n);
+  MockTerm term(function);
+
+  // chain: bonds, angles and torsions
+  std::vector<unsigned int> bonds, angles, torsions;
+  for (unsigned int i = 0; i + 1 < n; ++i) {
+    bonds.push_back(i);
+    bonds.push_back(i + 1);
+  }
+  for (unsigned int i = 0; i + 2 < n; ++i) {
+    angles.push_back(i);
+    angles.push_back(i + 1);
+    angles.push_back(i + 2);
+  }
+  for (unsigned int i = 0; i + 3 < n; ++i) {
+    torsions.push_back(i);
+    torsions.push_back(i + 1);
+    torsions.push_back(i + 2);
+    torsions.push_back(i + 3);
+  }
+
+  term.Test(bonds, 2);
+  term.Test(angles, 3);
+  term.Test(torsions, 4);
+
+  // star: all bonds share atom 0, every bond needs its own color
+  std::vector<unsigned int> star;
+  for (unsigned int i = 1; i < n; ++i) {
+    star.push_back(0);
+    star.push_back(i);
+  }
+  term.Test(star, 2);
+
+  delete function;
+}
@@ -0,0 +1,72 @@
+/**********************************************************************
+  ConstraintsTest - unit testing for the OBConstraints class
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBFunction>
+#include <OBLogFile>
+#include <OBConstraints>
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/obiter.h>
+#include <openbabel/obconversion.h>
+
+#include <cmath>
+
+#include "obtest.h"
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+int main()
+{
+  OBMol mol;
+  OBConversion conv;
+  conv.SetInFormat("pdb");
+  std::ifstream ifs("acetone.pdb");
+  OB_REQUIRE( conv.Read(&mol, &ifs) );
+
+  GAFFParameterDB database("../data/gaff.dat");
+  GAFFTypeRules typeRules("../data/gaff.prm");
+  GAFFType type(&typeRules);
+  OBGasteiger charges;
+
+  OBFunction *function = OBFunctionFactory::GetFactory("GAFF")->NewInstance();
+  function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  function->SetParameterDB(&database);
+  function->SetOBFFType(&type);
+  function->SetOBChargeMethod(&charges);
+  OB_REQUIRE( function->Setup(mol) );
+
+  // the bonds to hydrogen are constrained to r0 of the GAFF bond parameters
+  // (c3-hc: 1.092), not to their current length
+  OBConstraints constraints;
+  unsigned int numHydrogens = 0;
+  FOR_ATOMS_OF_MOL (atom, mol)
+    if (atom->IsHydrogen())
+      numHydrogens++;
+  OB_ASSERT( numHydrogens == 6 );
+  OB_ASSERT( constraints.AddHydrogenBonds(mol, function) == numHydrogens );
+  OB_ASSERT( constraints.GetDistances().size() == numHydrogens );
+  for (unsigned int i = 0; i < constraints.GetDistances().size(); ++i)
+    OB_ASSERT( fabs(constraints.GetDistances()[i].distance - 1.092) < 1e-6 );
+
+  delete function;
+  return 0;
+}
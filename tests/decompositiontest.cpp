@@ -0,0 +1,83 @@
+/**********************************************************************
+  DecompositionTest - unit testing for the OBDecomposition class
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBFunction>
+#include <OBLogFile>
+#include <OBDecomposition>
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <cmath>
+
+#include "obtest.h"
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+int main()
+{
+  OBMol mol;
+  OBConversion conv;
+  conv.SetInFormat("pdb");
+  std::ifstream ifs("acetone.pdb");
+  OB_REQUIRE( conv.Read(&mol, &ifs) );
+
+  GAFFParameterDB database("../data/gaff.dat");
+  GAFFTypeRules typeRules("../data/gaff.prm");
+  GAFFType type(&typeRules);
+  OBGasteiger charges;
+
+  OBFunction *function = OBFunctionFactory::GetFactory("GAFF")->NewInstance();
+  function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  function->SetParameterDB(&database);
+  function->SetOBFFType(&type);
+  function->SetOBChargeMethod(&charges);
+  OB_REQUIRE( function->Setup(mol) );
+  function->Compute(OBFunction::Gradients);
+  const double E = function->GetValue();
+
+  // the decomposition adds up to the value: first atom in group 0, the others
+  // in group 1
+  OBDecomposition decomposition;
+  decomposition.SetGroup(0, 0);
+  for (unsigned int i = 1; i < mol.NumAtoms(); ++i)
+    decomposition.SetGroup(i, 1);
+  function->SetDecomposition(&decomposition);
+  function->Compute(OBFunction::Gradients);
+  OB_ASSERT( fabs(E - function->GetValue()) < 1e-6 );
+  double atomSum = 0.0;
+  for (unsigned int i = 0; i < mol.NumAtoms(); ++i)
+    atomSum += decomposition.GetAtomValue(i);
+  OB_ASSERT( fabs(E - atomSum) < 1e-6 );
+  OB_ASSERT( fabs(E - decomposition.GetGroupValue(0) - decomposition.GetGroupValue(1)) < 1e-6 );
+  const double pairSum = decomposition.GetGroupPairValue(0, 0) + decomposition.GetGroupPairValue(0, 1) +
+      decomposition.GetGroupPairValue(1, 1);
+  OB_ASSERT( fabs(E - pairSum) < 1e-6 );
+
+  // the decomposition is reset for every computation
+  function->Compute(OBFunction::Value);
+  OB_ASSERT( fabs(E - decomposition.GetGroupValue(0) - decomposition.GetGroupValue(1)) < 1e-6 );
+  function->SetDecomposition(0);
+
+  delete function;
+  return 0;
+}
@@ -0,0 +1,153 @@
+/**********************************************************************
+  DenseTest - unit testing for the dense path of the LJ6_12 and Coulomb terms
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBFunction>
+#include "../src/forceterms/LJ6_12.h"
+#include "../src/forceterms/Coulomb.h"
+
+#include <cmath>
+
+#include "obtest.h"
+#include "mockterms.h"
+
+using OpenBabel::OBBitVec;
+
+using namespace OpenBabel::OBFFs;
+
+// fewer than LJ6_12::MaxDenseAtoms and Coulomb::MaxDenseAtoms
+const unsigned int numAtoms = 40;
+const char *names[] = { "c", "h", "n", "o" };
+const double typeSigma[] = { 3.40, 2.65, 3.25, 2.96 };
+const double typeEpsilon[] = { 0.086, 0.016, 0.17, 0.21 };
+
+// with groups, only the pairs within the first half of the atoms
+bool IsSelected(bool groups, unsigned int j, unsigned int k)
+{
+  return !groups || (j < numAtoms / 2 && k < numAtoms / 2);
+}
+
+// all selected pairs of the chain (see MockType), forces in gradients
+double reference(const std::vector<Eigen::Vector3d> &positions, const std::vector<double> &charges,
+    LJ6_12::MixingRule rule, double factorOneFour, bool groups, bool coulomb,
+    std::vector<Eigen::Vector3d> &gradients)
+{
+  double energy = 0.0;
+  gradients.assign(positions.size(), Eigen::Vector3d::Zero());
+  for (unsigned int j = 0; j < positions.size(); ++j)
+    for (unsigned int k = j + 1; k < positions.size(); ++k) {
+      if (k - j < 3 || !IsSelected(groups, j, k))
+        continue;
+      const Eigen::Vector3d d = positions[j] - positions[k];
+      const double r = d.norm();
+      const double scale = (k - j == 3) ? factorOneFour : 1.0;
+      double e, dE;
+      if (coulomb) {
+        e = scale * 332.0716 * charges[j] * charges[k] / r;
+        dE = -e / r;
+      } else {
+        double sigma, epsilon;
+        switch (rule) {
+          case LJ6_12::geometric:
+            LJ6_12::Mix<LJ6_12::geometric>(sigma, epsilon, typeSigma[j % 4], typeEpsilon[j % 4], typeSigma[k % 4], typeEpsilon[k % 4]);
+            break;
+          case LJ6_12::arithmetic:
+            LJ6_12::Mix<LJ6_12::arithmetic>(sigma, epsilon, typeSigma[j % 4], typeEpsilon[j % 4], typeSigma[k % 4], typeEpsilon[k % 4]);
+            break;
+          case LJ6_12::sixthpower:
+            LJ6_12::Mix<LJ6_12::sixthpower>(sigma, epsilon, typeSigma[j % 4], typeEpsilon[j % 4], typeSigma[k % 4], typeEpsilon[k % 4]);
+            break;
+        }
+        epsilon *= scale;
+        const double term6 = pow(sigma / r, 6.0);
+        e = 4.0 * epsilon * (term6 * term6 - term6);
+        dE = 4.0 * epsilon * (-12.0 * term6 * term6 + 6.0 * term6) / r;
+      }
+      energy += e;
+      gradients[j] -= dE * d / r;
+      gradients[k] += dE * d / r;
+    }
+  return energy;
+}
+
+void test(LJ6_12::MixingRule rule, double factorOneFour, bool groups)
+{
+  std::vector<Eigen::Vector3d> positions(numAtoms);
+  std::vector<std::string> types(numAtoms);
+  std::vector<double> charges(numAtoms);
+  for (unsigned int i = 0; i < numAtoms; ++i) {
+    positions[i] = Eigen::Vector3d(3.0 * (i % 5) + 0.1 * sin(i), 3.0 * ((i / 5) % 4) + 0.1 * cos(i), 3.0 * (i / 20));
+    types[i] = names[i % 4];
+    charges[i] = 0.4 * sin(1.7 * i);
+  }
+
+  MockLJDatabase database;
+  for (unsigned int t = 0; t < 4; ++t)
+    database.AddType(names[t], typeSigma[t], typeEpsilon[t]);
+  // with groups, the atoms outside the group have a type without parameters
+  OBBitVec group;
+  if (groups)
+    for (unsigned int i = 0; i < numAtoms; ++i) {
+      if (i < numAtoms / 2)
+        group.SetBitOn(i);
+      else
+        types[i] = "x";
+    }
+  MockType type(types);
+  MockCharges method(charges);
+
+  MockTermFunction function(positions);
+  function.SetParameterDB(&database);
+  function.SetOBFFType(&type);
+  function.SetOBChargeMethod(&method);
+  if (groups)
+    function.AddInterGroup(group);
+  OBFunctionTerm *lj = new LJ6_12(&function, factorOneFour, rule);
+  OBFunctionTerm *coulomb = new Coulomb(&function, factorOneFour);
+  function.AddTerm(lj);
+  function.AddTerm(coulomb);
+  OB_REQUIRE( function.SetupTerms() );
+
+  std::vector<Eigen::Vector3d> ljGradients, coulombGradients;
+  const double ljRef = reference(positions, charges, rule, factorOneFour, groups, false, ljGradients);
+  const double coulombRef = reference(positions, charges, rule, factorOneFour, groups, true, coulombGradients);
+
+  function.Compute(OBFunction::Value);
+  OB_ASSERT( fabs(lj->GetValue() - ljRef) < 1.0e-8 * (1.0 + fabs(ljRef)) );
+  OB_ASSERT( fabs(coulomb->GetValue() - coulombRef) < 1.0e-8 * (1.0 + fabs(coulombRef)) );
+
+  function.Compute(OBFunction::Gradients);
+  OB_ASSERT( fabs(lj->GetValue() - ljRef) < 1.0e-8 * (1.0 + fabs(ljRef)) );
+  OB_ASSERT( fabs(coulomb->GetValue() - coulombRef) < 1.0e-8 * (1.0 + fabs(coulombRef)) );
+  for (unsigned int i = 0; i < numAtoms; ++i) {
+    const Eigen::Vector3d expected = ljGradients[i] + coulombGradients[i];
+    OB_ASSERT( (function.GetGradients()[i] - expected).norm() < 1.0e-8 * (1.0 + expected.norm()) );
+  }
+}
+
+int main()
+{
+  const LJ6_12::MixingRule rules[] = { LJ6_12::geometric, LJ6_12::arithmetic, LJ6_12::sixthpower };
+  for (unsigned int r = 0; r < 3; ++r) {
+    test(rules[r], 0.5, false);
+    // a different 1-4 scaling
+    test(rules[r], 0.25, false);
+    // the atoms outside the group are not looked up
+    test(rules[r], 0.5, true);
+  }
+  return 0;
+}
@@ -0,0 +1,179 @@
+/**********************************************************************
+  DynamicsTest - unit testing for OBDynamics and OBConstraints
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBDynamics>
+#include <OBConstraints>
+#include <OBFunction>
+#include <OBLogFile>
+
+#include <cmath>
+#include <iostream>
+
+#include "obtest.h"
+
+using namespace OpenBabel::OBFFs;
+
+/**
+ * Harmonic springs between pairs of atoms.
+ */
+class SpringFunction : public OBFunction
+{
+  public:
+    struct Spring
+    {
+      unsigned int iA, iB;
+      double K, r0;
+    };
+    SpringFunction(unsigned int numParticles) : OBFunction(), m_value(0.0)
+    {
+      m_positions.resize(numParticles, Eigen::Vector3d::Zero());
+      m_gradients.resize(numParticles, Eigen::Vector3d::Zero());
+    }
+    void AddSpring(unsigned int iA, unsigned int iB, double K, double r0)
+    {
+      Spring spring = { iA, iB, K, r0 };
+      m_springs.push_back(spring);
+    }
+    std::string GetName() const
+    {
+      return "SpringFunction";
+    }
+    void Compute(Computation computation = Value)
+    {
+      m_value = 0.0;
+      for (unsigned int i = 0; i < m_gradients.size(); ++i)
+        m_gradients[i] = Eigen::Vector3d::Zero();
+      for (unsigned int i = 0; i < m_springs.size(); ++i) {
+        const Spring &s = m_springs[i];
+        const Eigen::Vector3d rab = m_positions[s.iA] - m_positions[s.iB];
+        const double r = rab.norm();
+        m_value += s.K * (r - s.r0) * (r - s.r0);
+        // forces
+        const Eigen::Vector3d F = (-2.0 * s.K * (r - s.r0) / r) * rab;
+        m_gradients[s.iA] += F;
+        m_gradients[s.iB] -= F;
+      }
+    }
+    double GetValue() const
+    {
+      return m_value;
+    }
+    std::string GetUnit() const
+    {
+      return "kcal/mol";
+    }
+    void ProcessOptions(std::vector<Option> &options)
+    {
+    }
+    std::string GetDefaultOptions() const
+    {
+      return "";
+    }
+  private:
+    std::vector<Spring> m_springs;
+    double m_value;
+};
+
+int main()
+{
+  const double distanceOH = 0.9572, distanceHH = 1.5139, distanceCH = 1.09;
+
+  // two waters (0-2, 3-5) and a C-H (6-7)
+  SpringFunction function(8);
+  function.GetLogFile()->SetLogLevel(OBLogFile::None);
+  std::vector<Eigen::Vector3d> &positions = function.GetPositions();
+  positions[0] = Eigen::Vector3d(0.0, 0.0, 0.0);
+  positions[1] = Eigen::Vector3d(0.9572, 0.0, 0.0);
+  positions[2] = Eigen::Vector3d(-0.2400, 0.9266, 0.0);
+  positions[3] = Eigen::Vector3d(3.0, 0.0, 0.0);
+  positions[4] = Eigen::Vector3d(3.0, 0.9572, 0.0);
+  positions[5] = Eigen::Vector3d(3.0, -0.2400, 0.9266);
+  positions[6] = Eigen::Vector3d(0.0, 3.0, 0.0);
+  positions[7] = Eigen::Vector3d(1.09, 3.0, 0.0);
+  function.AddSpring(0, 3, 5.0, 2.8);
+  function.AddSpring(1, 5, 2.0, 3.0);
+  function.AddSpring(0, 6, 5.0, 3.2);
+  function.AddSpring(4, 7, 1.0, 4.0);
+
+  OBConstraints constraints;
+  constraints.AddWater(0, 1, 2, distanceOH, distanceHH);
+  constraints.AddWater(3, 4, 5, distanceOH, distanceHH);
+  constraints.AddDistance(6, 7, distanceCH);
+  OB_ASSERT( constraints.NumConstraints() == 7 );
+  OB_ASSERT( constraints.IsConstrained(2, 1) );
+  OB_ASSERT( !constraints.IsConstrained(0, 3) );
+  function.SetConstraints(&constraints);
+  OB_ASSERT( function.IsConstrained(0, 1, 2) );
+  OB_ASSERT( !function.IsConstrained(0, 1, 3) );
+
+  std::vector<double> masses(8, 1.008);
+  masses[0] = masses[3] = 15.999;
+  masses[6] = 12.011;
+
+  // SETTLE gives the same positions as SHAKE for the three water distances
+  {
+    std::vector<double> inverseMasses(8);
+    for (unsigned int i = 0; i < 8; ++i)
+      inverseMasses[i] = 1.0 / masses[i];
+    std::vector<Eigen::Vector3d> reference = positions, settled = positions;
+    for (unsigned int i = 0; i < 8; ++i)
+      settled[i] += 0.03 * Eigen::Vector3d(sin(3.0 * i), cos(5.0 * i), sin(7.0 * i + 1.0));
+    std::vector<Eigen::Vector3d> shaken = settled;
+
+    OB_REQUIRE( constraints.Setup(&function, inverseMasses) );
+    OB_ASSERT( constraints.ConstrainPositions(reference, settled) );
+
+    OBConstraints distances;
+    distances.AddDistance(0, 1, distanceOH);
+    distances.AddDistance(0, 2, distanceOH);
+    distances.AddDistance(1, 2, distanceHH);
+    distances.SetTolerance(1e-12);
+    OB_REQUIRE( distances.Setup(&function, inverseMasses) );
+    OB_ASSERT( distances.ConstrainPositions(reference, shaken) );
+
+    for (unsigned int i = 0; i < 3; ++i)
+      OB_ASSERT( (settled[i] - shaken[i]).norm() < 1e-6 );
+    OB_ASSERT( fabs((settled[0] - settled[1]).norm() - distanceOH) < 1e-10 );
+    OB_ASSERT( fabs((settled[1] - settled[2]).norm() - distanceHH) < 1e-10 );
+    OB_ASSERT( fabs((settled[3] - settled[5]).norm() - distanceOH) < 1e-10 );
+    OB_ASSERT( fabs((settled[6] - settled[7]).norm() - distanceCH) < 1e-6 );
+  }
+
+  // NVE dynamics with 2 fs steps: constraints hold and the energy is conserved
+  OBDynamics dynamics(&function);
+  dynamics.SetTimeStep(2.0);
+  OB_REQUIRE( dynamics.Setup(masses) );
+  OB_ASSERT( dynamics.NumDegreesOfFreedom() == 3 * 8 - 3 - 7 );
+  dynamics.InitializeVelocities(300.0, 42);
+  OB_ASSERT( fabs(dynamics.GetTemperature() - 300.0) < 1e-6 );
+
+  const double initialEnergy = dynamics.GetPotentialEnergy() + dynamics.GetKineticEnergy();
+  OB_REQUIRE( dynamics.TakeNSteps(1000) );
+  OB_ASSERT( dynamics.GetStep() == 1000 );
+  const double finalEnergy = dynamics.GetPotentialEnergy() + dynamics.GetKineticEnergy();
+  std::cout << "energy: " << initialEnergy << " -> " << finalEnergy << std::endl;
+  OB_ASSERT( fabs(finalEnergy - initialEnergy) < 0.05 * dynamics.GetKineticEnergy() + 0.01 );
+
+  OB_ASSERT( fabs((positions[0] - positions[1]).norm() - distanceOH) < 1e-6 );
+  OB_ASSERT( fabs((positions[4] - positions[5]).norm() - distanceHH) < 1e-6 );
+  OB_ASSERT( fabs((positions[6] - positions[7]).norm() - distanceCH) < 1e-6 );
+  // no velocity along the constraints
+  const std::vector<Eigen::Vector3d> &velocities = dynamics.GetVelocities();
+  OB_ASSERT( fabs((positions[0] - positions[2]).dot(velocities[0] - velocities[2])) < 1e-6 );
+  OB_ASSERT( fabs((positions[6] - positions[7]).dot(velocities[6] - velocities[7])) < 1e-6 );
+}
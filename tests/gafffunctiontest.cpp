@@ -57,5 +57,25 @@ int main()
   ss << "vdwterm = allpair";
   gaff_function->SetOptions(ss.str());
 
+  // sorting the atoms does not change the energy or the gradients
+  gaff_function->Setup(mol);
+  gaff_function->Compute(OBFunction::Gradients);
+  double E = gaff_function->GetValue();
+  std::vector<Eigen::Vector3d> gradients(gaff_function->GetGradients());
+
+  gaff_function->SetAtomReordering(true);
+  gaff_function->Setup(mol);
+  gaff_function->Compute(OBFunction::Gradients);
+  OB_ASSERT( fabs(E - gaff_function->GetValue()) < 1e-6 );
+  for (unsigned int i = 0; i < mol.NumAtoms(); ++i) {
+    OB_ASSERT( (gradients[i] - gaff_function->GetGradient(i)).norm() < 1e-6 );
+    OB_ASSERT( (gradients[i] - gaff_function->GetGradients()[i]).norm() < 1e-6 );
+    OB_ASSERT( (Eigen::Vector3d(mol.GetAtom(i + 1)->GetVector().AsArray()) - gaff_function->GetPositions()[i]).norm() < 1e-12 );
+  }
+
+  // bounded computation: same value below the bound, rejected above
+  OB_ASSERT( gaff_function->ComputeBounded(E + 1.0) );
+  OB_ASSERT( fabs(E - gaff_function->GetValue()) < 1e-6 );
+  OB_ASSERT( !gaff_function->ComputeBounded(E - 1.0) );
 
 }
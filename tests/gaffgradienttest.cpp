@@ -1,4 +1,5 @@
 #include <OBFunction>
+#include <OBFunctionTerm>
 #include <OBLogFile>
 #include "obtest.h"
 #include <GAFF>
@@ -223,5 +224,24 @@ int main()
   gaff_function->Compute();
   cout << "energy: " << gaff_function->GetValue() << endl;
 
-
+  // generalized Born implicit solvent (chain rule through the Born radii)
+  const char *gbmodels[] = { "obc", "hct" };
+  for (unsigned int m = 0; m < 2; ++m) {
+    std::stringstream gboptions;
+    gboptions << "bonded = all" << std::endl;
+    gboptions << "vdwterm = allpair" << std::endl;
+    gboptions << "electroterm = gb" << std::endl;
+    gboptions << "gbmodel = " << gbmodels[m] << std::endl;
+    gaff_function->SetOptions(gboptions.str());
+    gaff_function->Setup(mol);
+
+    ValidateGradients(gaff_function);
+
+    gaff_function->Compute();
+    cout << "energy (gb " << gbmodels[m] << "): " << gaff_function->GetValue() << endl;
+    const std::vector<OBFunctionTerm*> &terms = gaff_function->GetTerms();
+    for (unsigned int i = 0; i < terms.size(); ++i)
+      if (terms[i]->GetName() == "Generalized Born")
+        OB_ASSERT( terms[i]->GetValue() < 0.0 );
+  }
 }
@@ -0,0 +1,83 @@
+/**********************************************************************
+  GasteigerTest - unit testing for the Gasteiger charges
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include "../src/chargemethods/obgasteiger.h"
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <cmath>
+
+#include "obtest.h"
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+int main()
+{
+  // aromatic molecules, OpenBabel assigns sp2 to all aromatic atoms
+  const char *smiles[] = { "c1ccccc1", "Cc1ccccc1", "c1ccncc1", "c1cc[nH]c1", "Clc1ccccc1" };
+
+  OBConversion conv;
+  OB_REQUIRE( conv.SetInFormat("smi") );
+
+  for (unsigned int m = 0; m < 5; ++m) {
+    OBMol mol;
+    OB_REQUIRE( conv.ReadString(&mol, smiles[m]) );
+    mol.AddHydrogens();
+
+    // the charges computed by OpenBabel
+    std::vector<double> reference;
+    for (unsigned int i = 1; i <= mol.NumAtoms(); ++i)
+      reference.push_back(mol.GetAtom(i)->GetPartialCharge());
+
+    // the kekulized bonds as read
+    std::vector<double> partialCharges, formalCharges;
+    OB_REQUIRE( OBGasteiger::ComputeCharges(mol, partialCharges, formalCharges) );
+    OB_REQUIRE( partialCharges.size() == mol.NumAtoms() );
+    for (unsigned int i = 0; i < mol.NumAtoms(); ++i)
+      OB_ASSERT( fabs(partialCharges[i] - reference[i]) < 1.0e-4 );
+
+    // aromatic bonds (order 5) are not counted as double bonds
+    OBMol aromatic(mol);
+    for (unsigned int i = 0; i < aromatic.NumBonds(); ++i)
+      if (aromatic.GetBond(i)->IsAromatic())
+        aromatic.GetBond(i)->SetBondOrder(5);
+    OB_REQUIRE( OBGasteiger::ComputeCharges(aromatic, partialCharges, formalCharges) );
+    for (unsigned int i = 0; i < mol.NumAtoms(); ++i)
+      OB_ASSERT( fabs(partialCharges[i] - reference[i]) < 1.0e-4 );
+
+    // the charges conserve the total (formal) charge
+    double totalCharge = 0.0;
+    for (unsigned int i = 0; i < mol.NumAtoms(); ++i)
+      totalCharge += partialCharges[i];
+    OB_ASSERT( fabs(totalCharge) < 1.0e-6 );
+
+    // the batch computation gives the same charges
+    std::vector<const OBMol*> mols(2, &mol);
+    std::vector<std::vector<double> > charges;
+    OB_REQUIRE( OBGasteiger::ComputeCharges(mols, charges) );
+    OB_REQUIRE( charges.size() == 2 );
+    for (unsigned int i = 0; i < mol.NumAtoms(); ++i)
+      OB_ASSERT( fabs(charges[1][i] - partialCharges[i]) < 1.0e-12 );
+  }
+
+  return 0;
+}
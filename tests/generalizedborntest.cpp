@@ -0,0 +1,82 @@
+/**********************************************************************
+  GeneralizedBornTest - unit testing for the GeneralizedBorn term
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBFunction>
+#include "../src/forceterms/GeneralizedBorn.h"
+
+#include <cmath>
+
+#include "obtest.h"
+#include "mockterms.h"
+
+using namespace OpenBabel::OBFFs;
+
+const unsigned int numAtoms = 64;
+const double rcut = 5.0;
+const char *names[] = { "c3", "hc", "o", "n" };
+
+// the term with its neighbor list set up for the current positions
+double reference(const std::vector<Eigen::Vector3d> &positions, MockType *type, MockCharges *charges,
+    std::vector<Eigen::Vector3d> &gradients)
+{
+  MockTermFunction function(positions);
+  function.SetOBFFType(type);
+  function.SetOBChargeMethod(charges);
+  function.AddTerm(new GeneralizedBorn(&function, GeneralizedBorn::OBC, rcut, 78.5, 1.0, 1));
+  OB_REQUIRE( function.SetupTerms() );
+  function.Compute(OBFunction::Gradients);
+  gradients = function.GetGradients();
+  return function.GetValue();
+}
+
+int main()
+{
+  // a 4x4x4 grid
+  std::vector<Eigen::Vector3d> start(numAtoms);
+  std::vector<std::string> types(numAtoms);
+  std::vector<double> partialCharges(numAtoms);
+  for (unsigned int i = 0; i < numAtoms; ++i) {
+    start[i] = Eigen::Vector3d(2.0 * (i % 4), 2.0 * ((i / 4) % 4), 2.0 * (i / 16));
+    types[i] = names[i % 4];
+    partialCharges[i] = 0.3 * sin(1.3 * i);
+  }
+  MockType type(types, false);
+  MockCharges charges(partialCharges);
+
+  MockTermFunction function(start);
+  function.SetOBFFType(&type);
+  function.SetOBChargeMethod(&charges);
+  function.AddTerm(new GeneralizedBorn(&function, GeneralizedBorn::OBC, rcut, 78.5, 1.0, 1));
+  OB_REQUIRE( function.SetupTerms() );
+
+  // the atoms drift out of the box of the first neighbor list build and the
+  // grid expands, the energy and forces match a newly set up term
+  std::vector<Eigen::Vector3d> gradients;
+  for (unsigned int step = 1; step <= 40; ++step) {
+    for (unsigned int i = 0; i < numAtoms; ++i)
+      function.GetPositions()[i] = (1.0 + 0.02 * step) * start[i] +
+          Eigen::Vector3d(0.2 * step, -0.1 * step, 0.05 * sin(double(i + step)));
+    function.Compute(OBFunction::Gradients);
+    const double E = reference(function.GetPositions(), &type, &charges, gradients);
+    OB_ASSERT( fabs(function.GetValue() - E) < 1.0e-9 * (1.0 + fabs(E)) );
+    for (unsigned int i = 0; i < numAtoms; ++i)
+      OB_ASSERT( (function.GetGradients()[i] - gradients[i]).norm() < 1.0e-9 * (1.0 + gradients[i].norm()) );
+  }
+
+  return 0;
+}
@@ -0,0 +1,149 @@
+/**********************************************************************
+  InteractionGroupTest - unit testing for the interaction groups
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBFunction>
+#include "../src/forceterms/LJ6_12.h"
+#include "../src/forceterms/Coulomb.h"
+
+#include <cmath>
+
+#include "obtest.h"
+#include "mockterms.h"
+
+using OpenBabel::OBBitVec;
+
+using namespace OpenBabel::OBFFs;
+
+// the non-bonded pairs selected by the groups, group A is the first half of
+// the atoms, group B the second half
+enum Selection {
+  NoGroups, //!< all pairs
+  InterA, //!< AddInterGroup(A): the pairs within A
+  InterAB, //!< AddInterGroups(A, B): the pairs between A and B
+  IntraOnly //!< AddIntraGroup(A) and AddIntraGroup(B): no pairs
+};
+
+const char *names[] = { "c", "h", "n", "o" };
+const double typeSigma[] = { 3.40, 2.65, 3.25, 2.96 };
+const double typeEpsilon[] = { 0.086, 0.016, 0.17, 0.21 };
+
+bool IsSelected(Selection selection, unsigned int j, unsigned int k, unsigned int numAtoms)
+{
+  const bool aj = (j < numAtoms / 2), ak = (k < numAtoms / 2);
+  switch (selection) {
+    case NoGroups: return true;
+    case InterA: return aj && ak;
+    case InterAB: return aj != ak;
+    case IntraOnly: return false;
+  }
+  return false;
+}
+
+// all selected pairs of the chain (see MockType), 1-4 pairs are scaled
+double reference(const std::vector<Eigen::Vector3d> &positions, const std::vector<double> &charges,
+    Selection selection, bool coulomb)
+{
+  const unsigned int numAtoms = positions.size();
+  double energy = 0.0;
+  for (unsigned int j = 0; j < numAtoms; ++j)
+    for (unsigned int k = j + 1; k < numAtoms; ++k) {
+      if (k - j < 3 || !IsSelected(selection, j, k, numAtoms))
+        continue;
+      const double r = (positions[j] - positions[k]).norm();
+      if (coulomb) {
+        const double scale = (k - j == 3) ? 0.8333 : 1.0;
+        energy += scale * 332.0716 * charges[j] * charges[k] / r;
+      } else {
+        const double scale = (k - j == 3) ? 0.5 : 1.0;
+        const double sigma = sqrt(typeSigma[j % 4] * typeSigma[k % 4]);
+        const double epsilon = scale * sqrt(typeEpsilon[j % 4] * typeEpsilon[k % 4]);
+        const double term6 = pow(sigma / r, 6.0);
+        energy += 4.0 * epsilon * (term6 * term6 - term6);
+      }
+    }
+  return energy;
+}
+
+void test(unsigned int numAtoms)
+{
+  std::vector<Eigen::Vector3d> positions(numAtoms);
+  std::vector<std::string> types(numAtoms);
+  std::vector<double> charges(numAtoms);
+  for (unsigned int i = 0; i < numAtoms; ++i) {
+    positions[i] = Eigen::Vector3d(3.0 * (i % 5) + 0.1 * sin(i), 3.0 * ((i / 5) % 5) + 0.1 * cos(i), 3.0 * (i / 25));
+    types[i] = names[i % 4];
+    charges[i] = 0.4 * sin(1.7 * i);
+  }
+
+  MockLJDatabase database;
+  for (unsigned int t = 0; t < 4; ++t)
+    database.AddType(names[t], typeSigma[t], typeEpsilon[t]);
+  MockType type(types);
+  MockCharges method(charges);
+
+  OBBitVec a, b;
+  for (unsigned int i = 0; i < numAtoms; ++i) {
+    if (i < numAtoms / 2)
+      a.SetBitOn(i);
+    else
+      b.SetBitOn(i);
+  }
+
+  const Selection selections[] = { NoGroups, InterA, InterAB, IntraOnly };
+  for (unsigned int s = 0; s < 4; ++s) {
+    MockTermFunction function(positions);
+    function.SetParameterDB(&database);
+    function.SetOBFFType(&type);
+    function.SetOBChargeMethod(&method);
+    switch (selections[s]) {
+      case NoGroups:
+        break;
+      case InterA:
+        function.AddInterGroup(a);
+        break;
+      case InterAB:
+        function.AddInterGroups(a, b);
+        break;
+      case IntraOnly:
+        function.AddIntraGroup(a);
+        function.AddIntraGroup(b);
+        break;
+    }
+    OBFunctionTerm *lj = new LJ6_12(&function);
+    OBFunctionTerm *coulomb = new Coulomb(&function);
+    function.AddTerm(lj);
+    function.AddTerm(coulomb);
+    OB_REQUIRE( function.SetupTerms() );
+    function.Compute(OBFunction::Value);
+
+    const double ljRef = reference(positions, charges, selections[s], false);
+    const double coulombRef = reference(positions, charges, selections[s], true);
+    OB_ASSERT( fabs(lj->GetValue() - ljRef) < 1.0e-8 * (1.0 + fabs(ljRef)) );
+    OB_ASSERT( fabs(coulomb->GetValue() - coulombRef) < 1.0e-8 * (1.0 + fabs(coulombRef)) );
+    if (selections[s] == IntraOnly)
+      OB_ASSERT( lj->GetValue() == 0.0 && coulomb->GetValue() == 0.0 );
+  }
+}
+
+int main()
+{
+  // dense path and pair arrays
+  test(20);
+  test(80);
+  return 0;
+}
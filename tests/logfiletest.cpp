@@ -0,0 +1,119 @@
+/**********************************************************************
+  LogFileTest - unit testing for the structured OBLogFile records
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBLogFile>
+
+#include <QThread>
+
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+#include "obtest.h"
+
+using namespace OpenBabel::OBFFs;
+
+class LogThread : public QThread
+{
+  public:
+    LogThread(OBLogFile *logfile, int count) : m_logfile(logfile), m_count(count) {}
+  protected:
+    void run()
+    {
+      for (int i = 0; i < m_count; ++i)
+        m_logfile->Log(OBLogFile::Low, "step", " %4.0f\n", "step", i);
+    }
+  private:
+    OBLogFile *m_logfile;
+    int m_count;
+};
+
+int countLines(const std::string &str)
+{
+  int lines = 0;
+  for (std::string::size_type i = 0; i < str.size(); ++i)
+    if (str[i] == '\n')
+      lines++;
+  return lines;
+}
+
+int main()
+{
+  // text records are formatted like the old snprintf() lines
+  {
+    std::stringstream ss;
+    OBLogFile logfile;
+    logfile.SetOutputStream(&ss);
+    logfile.SetLogLevel(OBLogFile::Low);
+    logfile.Log(OBLogFile::Low, "cg_step", " %4.0f    %8.3f    %8.3f\n", "step", 10, "energy", -1.5, "previous", 2.25);
+    logfile.Log(OBLogFile::Medium, "filtered", "not written\n");
+    logfile.Log(OBLogFile::Low, "plain", 0, "a", 1);
+    logfile.Write(OBLogFile::High, "not written\n");
+    logfile.Write("message\n");
+    OB_ASSERT( ss.str() == "   10      -1.500       2.250\nplain a=1\nmessage\n" );
+  }
+
+  // JSON lines
+  {
+    std::stringstream ss;
+    OBLogFile logfile;
+    logfile.SetOutputStream(&ss);
+    logfile.SetFormat(OBLogFile::JsonLines);
+    logfile.Log(OBLogFile::Low, "cg_step", " %4.0f\n", "step", 10, "energy", -1.5);
+    logfile.Write("say \"hi\"\n");
+    const std::string out = ss.str();
+    OB_ASSERT( countLines(out) == 2 );
+    OB_ASSERT( out.find("\"level\":\"low\",\"event\":\"cg_step\",\"step\":10,\"energy\":-1.5}\n") != std::string::npos );
+    OB_ASSERT( out.find("\"event\":\"message\",\"text\":\"say \\\"hi\\\"\\n\"}") != std::string::npos );
+  }
+
+  // asynchronous: several threads, all records are written or counted as dropped
+  {
+    std::stringstream ss;
+    OBLogFile logfile;
+    logfile.SetOutputStream(&ss);
+    logfile.SetAsynchronous(true);
+    OB_ASSERT( logfile.IsAsynchronous() );
+    const int numThreads = 4, count = 5000;
+    std::vector<LogThread*> threads;
+    for (int i = 0; i < numThreads; ++i) {
+      threads.push_back(new LogThread(&logfile, count));
+      threads.back()->start();
+    }
+    for (int i = 0; i < numThreads; ++i) {
+      threads[i]->wait();
+      delete threads[i];
+    }
+    logfile.SetAsynchronous(false);
+
+    // the log_dropped lines report the records dropped since the previous one
+    std::istringstream lines(ss.str());
+    std::string line;
+    int numRecords = 0, numReported = 0;
+    while (std::getline(lines, line)) {
+      int dropped;
+      if (sscanf(line.c_str(), "  (%d log records dropped)", &dropped) == 1)
+        numReported += dropped;
+      else
+        numRecords++;
+    }
+    const int numDropped = logfile.NumDropped();
+    OB_ASSERT( numRecords == numThreads * count - numDropped );
+    OB_ASSERT( numReported == numDropped );
+  }
+}
@@ -0,0 +1,145 @@
+#include <OBFunction>
+#include <OBFunctionTerm>
+#include <OBFFType>
+#include <OBChargeMethod>
+#include <OBFFParameterDB>
+
+#include <string>
+#include <vector>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /**
+     * Atom types from a list. With @p chain the atoms form a linear chain: atoms
+     * i and i+1 are bonded, i and i+2 are 1-3 and i and i+3 are 1-4.
+     */
+    class MockType : public OBFFType
+    {
+      public:
+        MockType(const std::vector<std::string> &types, bool chain = true) : m_chain(chain)
+        {
+          m_atoms = types;
+        }
+        bool SetTypes(const OBMol &mol)
+        {
+          return true;
+        }
+        const std::string& GetAtomType(const size_t &i) const
+        {
+          return m_atoms[i];
+        }
+        bool IsConnected(const size_t &iA, const size_t &iB) const
+        {
+          return m_chain && Separation(iA, iB) == 1;
+        }
+        bool IsOneThree(const size_t &iA, const size_t &iB) const
+        {
+          return m_chain && Separation(iA, iB) == 2;
+        }
+        bool IsOneFour(const size_t &iA, const size_t &iB) const
+        {
+          return m_chain && Separation(iA, iB) == 3;
+        }
+        static size_t Separation(size_t iA, size_t iB)
+        {
+          return (iA > iB) ? iA - iB : iB - iA;
+        }
+      private:
+        bool m_chain;
+    };
+
+    /**
+     * Fixed partial charges.
+     */
+    class MockCharges : public OBChargeMethod
+    {
+      public:
+        MockCharges(const std::vector<double> &charges)
+        {
+          m_partialCharges = charges;
+        }
+    };
+
+    /**
+     * Parameter database with a "LJ6_12" table (type, sigma, epsilon).
+     */
+    class MockLJDatabase : public OBFFParameterDB
+    {
+      public:
+        MockLJDatabase()
+        {
+          std::vector<std::string> header;
+          header.push_back("type");
+          header.push_back("sigma");
+          header.push_back("epsilon");
+          m_table = AddTable("LJ6_12", header);
+        }
+        void AddType(const std::string &type, double sigma, double epsilon)
+        {
+          std::vector<OBVariant> row;
+          row.push_back(OBVariant(type));
+          row.push_back(OBVariant(sigma));
+          row.push_back(OBVariant(epsilon));
+          m_table->AddRow(row);
+        }
+      private:
+        OBFFTable *m_table;
+    };
+
+    /**
+     * Computes the terms added with AddTerm() for positions set in the constructor,
+     * no OBMol is needed. Call SetupTerms() after setting the parameter database,
+     * OBFFType, OBChargeMethod and groups.
+     */
+    class MockTermFunction : public OBFunction
+    {
+      public:
+        MockTermFunction(const std::vector<Eigen::Vector3d> &positions) : OBFunction()
+        {
+          m_positions = positions;
+          m_gradients.resize(positions.size(), Eigen::Vector3d::Zero());
+        }
+        bool SetupTerms()
+        {
+          m_arena.Reset();
+          bool ok = true;
+          for (unsigned int i = 0; i < m_terms.size(); ++i)
+            if (!m_terms[i]->Setup())
+              ok = false;
+          return ok;
+        }
+        std::string GetName() const
+        {
+          return "MockTermFunction";
+        }
+        void Compute(Computation computation = Value)
+        {
+          if (computation == Gradients)
+            for (unsigned int i = 0; i < m_gradients.size(); ++i)
+              m_gradients[i] = Eigen::Vector3d::Zero();
+          for (unsigned int i = 0; i < m_terms.size(); ++i)
+            m_terms[i]->Compute(computation);
+        }
+        double GetValue() const
+        {
+          double value = 0.0;
+          for (unsigned int i = 0; i < m_terms.size(); ++i)
+            value += m_terms[i]->GetValue();
+          return value;
+        }
+        std::string GetUnit() const
+        {
+          return "kcal/mol";
+        }
+        void ProcessOptions(std::vector<Option> &options)
+        {
+        }
+        std::string GetDefaultOptions() const
+        {
+          return "";
+        }
+    };
+
+  }
+}
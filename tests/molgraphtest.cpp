@@ -0,0 +1,93 @@
+/**********************************************************************
+  MolGraphTest - unit testing for the OBMolGraph class
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBMolGraph>
+
+#include "obtest.h"
+
+using namespace OpenBabel::OBFFs;
+
+typedef std::vector<std::pair<unsigned int, unsigned int> > BondList;
+
+int main()
+{
+  OBMolGraph graph;
+  BondList bonds;
+
+  // isobutane carbons: 0 is bonded to 1, 2, 3
+  bonds.push_back(std::make_pair(0u, 1u));
+  bonds.push_back(std::make_pair(0u, 2u));
+  bonds.push_back(std::make_pair(3u, 0u));
+  graph.Build(4, bonds);
+  OB_ASSERT( graph.NumBonds() == 3 );
+  OB_ASSERT( graph.NumAngles() == 3 );
+  OB_ASSERT( graph.NumTorsions() == 0 );
+  OB_ASSERT( graph.NumImpropers() == 1 );
+  OB_ASSERT( graph.GetImpropers()[1] == 0 );
+  OB_ASSERT( graph.GetDegree(0) == 3 );
+  OB_ASSERT( graph.GetSeparation(0, 3) == 1 );
+  OB_ASSERT( graph.GetSeparation(3, 0) == 1 );
+  OB_ASSERT( graph.GetSeparation(1, 2) == 2 );
+  OB_ASSERT( graph.GetSeparation(1, 1) == OBMolGraph::NotExcluded );
+
+  // pentane carbons: 0-1-2-3-4
+  bonds.clear();
+  for (unsigned int i = 0; i < 4; ++i)
+    bonds.push_back(std::make_pair(i, i + 1));
+  graph.Build(5, bonds);
+  OB_ASSERT( graph.NumAngles() == 3 );
+  OB_ASSERT( graph.NumTorsions() == 2 );
+  OB_ASSERT( graph.NumImpropers() == 0 );
+  OB_ASSERT( graph.GetSeparation(0, 3) == 3 );
+  OB_ASSERT( graph.GetSeparation(4, 1) == 3 );
+  OB_ASSERT( graph.GetSeparation(0, 4) == OBMolGraph::NotExcluded );
+
+  // cyclopropane: no torsions, all atoms are bonded
+  bonds.clear();
+  bonds.push_back(std::make_pair(0u, 1u));
+  bonds.push_back(std::make_pair(1u, 2u));
+  bonds.push_back(std::make_pair(2u, 0u));
+  graph.Build(3, bonds);
+  OB_ASSERT( graph.NumAngles() == 3 );
+  OB_ASSERT( graph.NumTorsions() == 0 );
+  OB_ASSERT( graph.GetSeparation(0, 2) == 1 );
+
+  // cyclobutane: one torsion per bond, the shortest path is used
+  bonds.clear();
+  for (unsigned int i = 0; i < 4; ++i)
+    bonds.push_back(std::make_pair(i, (i + 1) % 4));
+  graph.Build(4, bonds);
+  OB_ASSERT( graph.NumAngles() == 4 );
+  OB_ASSERT( graph.NumTorsions() == 4 );
+  OB_ASSERT( graph.GetSeparation(0, 2) == 2 );
+  OB_ASSERT( graph.GetSeparation(0, 3) == 1 );
+
+  // every torsion is a bonded path of 4 different atoms
+  const std::vector<unsigned int> &torsions = graph.GetTorsions();
+  for (unsigned int t = 0; t < torsions.size(); t += 4) {
+    OB_ASSERT( graph.GetSeparation(torsions[t], torsions[t + 1]) == 1 );
+    OB_ASSERT( graph.GetSeparation(torsions[t + 1], torsions[t + 2]) == 1 );
+    OB_ASSERT( graph.GetSeparation(torsions[t + 2], torsions[t + 3]) == 1 );
+    OB_ASSERT( torsions[t] != torsions[t + 3] );
+  }
+
+  // an empty molecule
+  graph.Build(0, BondList());
+  OB_ASSERT( graph.NumBonds() == 0 );
+  OB_ASSERT( graph.GetSeparation(0, 1) == OBMolGraph::NotExcluded );
+}
@@ -25,6 +25,8 @@
 #include <OBNbrList>
 #include <OBFunction>
 
+#include <cmath>
+
 #include "obtest.h"
 #include "mockfunction.h"
 
@@ -36,13 +38,55 @@ unsigned int test(OBFunction *function, int n, double r)
   
   unsigned int count = 0;
   for (unsigned int i = 0; i < function->NumParticles(); ++i) {
-    std::vector<unsigned int> nbrs = nbrList->GetNbrs(i);
+    const std::vector<unsigned int> &nbrs = nbrList->GetNbrs(i);
     count += nbrs.size();
   }
 
+  delete nbrList;
   return count;
 }
 
+// sum of 1/r over the pairs within rcut
+double pairEnergy(OBFunction *function, OBNbrList *nbrList, double rcut)
+{
+  const std::vector<Eigen::Vector3d> &positions = function->GetPositions();
+  double energy = 0.0;
+  if (!nbrList) {
+    for (unsigned int i = 0; i < positions.size(); ++i)
+      for (unsigned int j = i + 1; j < positions.size(); ++j) {
+        const double r = (positions[i] - positions[j]).norm();
+        if (r <= rcut)
+          energy += 1.0 / r;
+      }
+    return energy;
+  }
+  for (unsigned int i = 0; i < positions.size(); ++i) {
+    const std::vector<unsigned int> &nbrs = nbrList->GetNbrs(i);
+    for (unsigned int k = 0; k < nbrs.size(); ++k)
+      energy += 1.0 / sqrt(nbrList->GetDist2(k));
+  }
+  return energy;
+}
+
+// the atoms leave the box of the first build: the grid and the ghost map are
+// rebuilt, small moves between the rebuilds are covered by the skin
+void testMoving(MockFunction *function, int n)
+{
+  const double rcut = 2.5;
+  std::vector<Eigen::Vector3d> start(function->GetPositions());
+  OBNbrList *nbrList = new OBNbrList(function, rcut, false, n, 1.0);
+  for (unsigned int step = 1; step <= 60; ++step) {
+    for (unsigned int i = 0; i < start.size(); ++i)
+      function->GetPositions()[i] = (1.0 + 0.003 * step) * start[i] +
+          Eigen::Vector3d(0.1 * step, -0.05 * step, 0.05 * sin(double(i + step)));
+    nbrList->Update();
+    const double reference = pairEnergy(function, 0, rcut);
+    OB_ASSERT( fabs(pairEnergy(function, nbrList, rcut) - reference) < 1.0e-9 * reference );
+  }
+  delete nbrList;
+  function->GetPositions() = start;
+}
+
 
 
 int main()
@@ -93,6 +137,9 @@ int main()
   count = test(function, 3, 10.);
   OB_ASSERT(correct10 == count);
 
+  testMoving(function, 1);
+  testMoving(function, 2);
+
   delete function;
 }
 
@@ -0,0 +1,89 @@
+/**********************************************************************
+  OBFFProtocolTest - unit testing for the obffserver payload parsing
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include "../tools/obffprotocol.h"
+
+#include "obtest.h"
+
+using OBFFProtocol::Buffer;
+
+// a payload with the bytes of buffer followed by text
+void Append(Buffer &buffer, const std::string &text)
+{
+  buffer.Data().insert(buffer.Data().end(), text.begin(), text.end());
+}
+
+int main()
+{
+  uint32_t u;
+  double d;
+  std::string str;
+
+  // a well-formed Setup request
+  Buffer setup;
+  setup.Put(uint32_t(3));
+  Append(setup, "sdfmolecule");
+  OB_ASSERT( setup.Get(u) && u == 3 );
+  OB_ASSERT( setup.GetString(str, u) && str == "sdf" );
+  setup.GetRest(str);
+  OB_ASSERT( str == "molecule" );
+  OB_ASSERT( !setup.Get(u) );
+
+  // a format length beyond the payload, m_pos + length would wrap around
+  const uint32_t lengths[] = { 12, 0xffffffffu, 0xfffffffcu, 0x80000000u };
+  for (unsigned int i = 0; i < 4; ++i) {
+    Buffer request;
+    request.Put(lengths[i]);
+    Append(request, "sdfmol");
+    OB_ASSERT( request.Get(u) && u == lengths[i] );
+    OB_ASSERT( !request.GetString(str, u) );
+    // nothing was consumed
+    OB_ASSERT( request.GetString(str, 6) && str == "sdfmol" );
+  }
+
+  // truncated values
+  Buffer empty;
+  OB_ASSERT( !empty.Get(u) );
+  OB_ASSERT( !empty.GetString(str, 1) );
+  OB_ASSERT( empty.GetString(str, 0) && str.empty() );
+
+  Buffer partial;
+  Append(partial, "abc");
+  OB_ASSERT( !partial.Get(u) );
+  OB_ASSERT( !partial.Get(d) );
+  OB_ASSERT( partial.GetString(str, 3) && str == "abc" );
+  OB_ASSERT( !partial.GetString(str, 1) );
+
+  // an Energy request announcing two atoms with the coordinates of one
+  Buffer energy;
+  energy.Put(uint32_t(1));
+  energy.Put(uint32_t(2));
+  for (int k = 0; k < 3; ++k)
+    energy.Put(double(k));
+  uint32_t session, n;
+  OB_ASSERT( energy.Get(session) && energy.Get(n) && n == 2 );
+  OB_ASSERT( energy.Remaining() == 3 * sizeof(double) );
+  OB_ASSERT( energy.Remaining() < 3 * sizeof(double) * n );
+  unsigned int read = 0;
+  while (energy.Get(d))
+    ++read;
+  OB_ASSERT( read == 3 );
+  OB_ASSERT( energy.Remaining() == 0 );
+
+  return 0;
+}
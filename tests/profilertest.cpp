@@ -0,0 +1,91 @@
+/**********************************************************************
+  ProfilerTest - unit testing for OBProfiler
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBProfiler>
+
+#include <iostream>
+#include <vector>
+
+#include "obtest.h"
+
+using namespace OpenBabel::OBFFs;
+
+double work(unsigned int n)
+{
+  std::vector<double> values(n);
+  double sum = 0.0;
+  for (unsigned int i = 0; i < n; ++i) {
+    values[i] = 0.5 * i;
+    sum += values[(i * 7919) % (i + 1)];
+  }
+  return sum;
+}
+
+int main()
+{
+  OBProfiler profiler;
+  std::cout << "hardware counters: " << (profiler.HasCounters() ? "yes" : "no") << std::endl;
+
+  const unsigned int outer = profiler.Section("outer");
+  const unsigned int inner = profiler.Section("inner");
+  OB_ASSERT( profiler.Section("outer") == outer );
+
+  double sum = 0.0;
+  for (int i = 0; i < 10; ++i) {
+    profiler.Begin();
+    sum += work(10000);
+    profiler.Begin();
+    sum += work(100000);
+    profiler.End(inner);
+    profiler.End(outer);
+  }
+  OB_ASSERT( sum > 0.0 );
+
+  const OBProfiler::Statistics outerStats = profiler.GetStatistics("outer");
+  const OBProfiler::Statistics innerStats = profiler.GetStatistics("inner");
+  OB_ASSERT( outerStats.calls == 10 );
+  OB_ASSERT( innerStats.calls == 10 );
+  OB_ASSERT( outerStats.seconds >= innerStats.seconds );
+  // the total only counts the outermost sections
+  OB_ASSERT( profiler.GetTotal().calls == 10 );
+  OB_ASSERT( profiler.GetTotal().seconds == outerStats.seconds );
+  OB_ASSERT( profiler.GetStatistics("missing").calls == 0 );
+
+  if (profiler.HasCounters()) {
+    OB_ASSERT( innerStats.instructions > 0.0 );
+    OB_ASSERT( outerStats.instructions >= innerStats.instructions );
+    OB_ASSERT( outerStats.IPC() > 0.0 );
+  } else {
+    OB_ASSERT( outerStats.cycles == 0.0 );
+  }
+
+  // without counters only the time is measured
+  OBProfiler timer(false);
+  OB_ASSERT( !timer.HasCounters() );
+  timer.Begin();
+  timer.End(timer.Section("work"));
+  OB_ASSERT( timer.GetStatistics("work").calls == 1 );
+  // End() without Begin() is ignored
+  timer.End(timer.Section("work"));
+  OB_ASSERT( timer.GetStatistics("work").calls == 1 );
+
+  profiler.Report(std::cout);
+  profiler.ResetStatistics();
+  OB_ASSERT( profiler.GetStatistics("outer").calls == 0 );
+  OB_ASSERT( profiler.GetTotal().seconds == 0.0 );
+}
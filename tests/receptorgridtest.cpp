@@ -0,0 +1,146 @@
+/**********************************************************************
+  ReceptorGridTest - unit testing for the ReceptorGrid term
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBFunction>
+#include "../src/forceterms/ReceptorGrid.h"
+
+#include <cmath>
+
+#include "obtest.h"
+#include "mockterms.h"
+
+using OpenBabel::OBBitVec;
+
+using namespace OpenBabel::OBFFs;
+
+const unsigned int numReceptor = 6;
+const double spacing = 0.2;
+const double padding = 4.0;
+const double cutoff = 12.0;
+
+// direct ligand-receptor LJ (geometric mixing) + Coulomb, forces in gradients
+double direct(const std::vector<Eigen::Vector3d> &positions, const std::vector<double> &sigma,
+    const std::vector<double> &epsilon, const std::vector<double> &charges, std::vector<Eigen::Vector3d> &gradients)
+{
+  double energy = 0.0;
+  gradients.assign(positions.size(), Eigen::Vector3d::Zero());
+  for (unsigned int l = numReceptor; l < positions.size(); ++l)
+    for (unsigned int r = 0; r < numReceptor; ++r) {
+      const Eigen::Vector3d d = positions[l] - positions[r];
+      const double rab = d.norm();
+      if (rab > cutoff)
+        continue;
+      const double s = sqrt(sigma[l] * sigma[r]);
+      const double e = sqrt(epsilon[l] * epsilon[r]);
+      const double term6 = pow(s / rab, 6.0);
+      const double qq = 332.0716 * charges[l] * charges[r];
+      energy += 4.0 * e * (term6 * term6 - term6) + qq / rab;
+      const double dE = 4.0 * e * (-12.0 * term6 * term6 + 6.0 * term6) / rab - qq / (rab * rab);
+      gradients[l] -= dE * d / rab;
+    }
+  return energy;
+}
+
+int main()
+{
+  // a rigid receptor around a small ligand at the origin
+  std::vector<Eigen::Vector3d> positions;
+  positions.push_back(Eigen::Vector3d(5.0, 0.3, 0.1));
+  positions.push_back(Eigen::Vector3d(-4.6, 0.5, -0.4));
+  positions.push_back(Eigen::Vector3d(0.2, 4.8, 0.6));
+  positions.push_back(Eigen::Vector3d(-0.3, -5.2, 0.2));
+  positions.push_back(Eigen::Vector3d(0.4, 0.1, 5.1));
+  positions.push_back(Eigen::Vector3d(0.6, -0.2, -4.9));
+  positions.push_back(Eigen::Vector3d(0.0, 0.0, 0.0));
+  positions.push_back(Eigen::Vector3d(5.0 * spacing, 0.0, 0.0));
+  positions.push_back(Eigen::Vector3d(5.0 * spacing, 5.0 * spacing, 0.0));
+
+  std::vector<std::string> types;
+  types.push_back("n"); types.push_back("o"); types.push_back("n");
+  types.push_back("o"); types.push_back("n"); types.push_back("o");
+  types.push_back("c"); types.push_back("h"); types.push_back("c");
+  std::vector<double> charges;
+  charges.push_back(-0.4); charges.push_back(-0.5); charges.push_back(0.3);
+  charges.push_back(-0.2); charges.push_back(0.4); charges.push_back(0.1);
+  charges.push_back(0.3); charges.push_back(0.1); charges.push_back(-0.25);
+
+  const char *names[] = { "n", "o", "c", "h" };
+  const double typeSigma[] = { 3.25, 2.96, 3.40, 2.65 };
+  const double typeEpsilon[] = { 0.17, 0.21, 0.086, 0.016 };
+  MockLJDatabase database;
+  for (unsigned int t = 0; t < 4; ++t)
+    database.AddType(names[t], typeSigma[t], typeEpsilon[t]);
+  std::vector<double> sigma, epsilon;
+  for (unsigned int i = 0; i < types.size(); ++i)
+    for (unsigned int t = 0; t < 4; ++t)
+      if (types[i] == names[t]) {
+        sigma.push_back(typeSigma[t]);
+        epsilon.push_back(typeEpsilon[t]);
+      }
+
+  // the receptor atoms do not interact with each other (no chain)
+  MockType type(types, false);
+  MockCharges method(charges);
+  OBBitVec receptor;
+  for (unsigned int i = 0; i < numReceptor; ++i)
+    receptor.SetBitOn(i);
+
+  MockTermFunction function(positions);
+  function.SetParameterDB(&database);
+  function.SetOBFFType(&type);
+  function.SetOBChargeMethod(&method);
+  function.AddTerm(new ReceptorGrid(&function, receptor, spacing, padding, cutoff));
+  OB_REQUIRE( function.SetupTerms() );
+
+  std::vector<Eigen::Vector3d> gradients;
+
+  // the ligand atoms are on grid points, the maps are exact there
+  function.Compute(OBFunction::Gradients);
+  double energy = direct(positions, sigma, epsilon, charges, gradients);
+  OB_ASSERT( fabs(function.GetValue() - energy) < 1.0e-6 * fabs(energy) );
+  for (unsigned int i = 0; i < numReceptor; ++i)
+    OB_ASSERT( function.GetGradients()[i].norm() == 0.0 );
+
+  // interpolated at cell centres, the derivative of the trilinear interpolation
+  // is a central difference there
+  const Eigen::Vector3d shifts[] = {
+    spacing * Eigen::Vector3d(0.5, 0.5, 0.5),
+    spacing * Eigen::Vector3d(3.5, -7.5, 4.5),
+    spacing * Eigen::Vector3d(-4.5, 2.5, -3.5),
+    spacing * Eigen::Vector3d(2.5, -1.5, 0.5)
+  };
+  for (unsigned int s = 0; s < 4; ++s) {
+    std::vector<Eigen::Vector3d> moved(positions);
+    for (unsigned int i = numReceptor; i < moved.size(); ++i)
+      moved[i] += shifts[s];
+    function.GetPositions() = moved;
+    function.Compute(OBFunction::Gradients);
+    energy = direct(moved, sigma, epsilon, charges, gradients);
+    OB_ASSERT( fabs(function.GetValue() - energy) < 0.005 * fabs(energy) );
+    for (unsigned int i = numReceptor; i < moved.size(); ++i)
+      OB_ASSERT( (function.GetGradients()[i] - gradients[i]).norm() < 0.02 * gradients[i].norm() + 1.0e-3 );
+  }
+
+  // outside the grid the ligand does not interact
+  for (unsigned int i = numReceptor; i < positions.size(); ++i)
+    function.GetPositions()[i] = positions[i] + Eigen::Vector3d(20.0, 0.0, 0.0);
+  function.Compute(OBFunction::Gradients);
+  OB_ASSERT( function.GetValue() == 0.0 );
+
+  return 0;
+}
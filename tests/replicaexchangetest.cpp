@@ -0,0 +1,128 @@
+/**********************************************************************
+  ReplicaExchangeTest - unit testing for OBReplicaExchange
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBFunction>
+#include <OBLogFile>
+#include <OBReplicaExchange>
+#include <OBTrajectory>
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+
+#include "obtest.h"
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+void checkReplicas(const OBReplicaExchange &remd, unsigned int numExchanges)
+{
+  const unsigned int numReplicas = remd.NumReplicas();
+  std::vector<unsigned int> replicas;
+  unsigned long attempts = 0;
+  for (unsigned int i = 0; i < numReplicas; ++i) {
+    replicas.push_back(remd.GetReplica(i));
+    OB_ASSERT( fabs(remd.GetEnergy(i)) < 1e10 );
+    if (i + 1 < numReplicas) {
+      attempts += remd.GetNumAttempts(i);
+      OB_ASSERT( remd.GetAcceptanceRatio(i) >= 0.0 && remd.GetAcceptanceRatio(i) <= 1.0 );
+    }
+  }
+  // alternating even and odd pairs
+  const unsigned int numEven = (numExchanges + 1) / 2, numOdd = numExchanges / 2;
+  OB_ASSERT( attempts == numEven * (numReplicas / 2) + numOdd * ((numReplicas - 1) / 2) );
+  // the temperatures are a permutation of the replicas
+  std::sort(replicas.begin(), replicas.end());
+  for (unsigned int i = 0; i < numReplicas; ++i)
+    OB_ASSERT( replicas[i] == i );
+}
+
+int main()
+{
+  OBMol mol;
+  OBConversion conv;
+  conv.SetInFormat("pdb");
+  std::ifstream ifs("acetone.pdb");
+  OB_ASSERT( conv.Read(&mol, &ifs) );
+
+  GAFFParameterDB database("../data/gaff.dat");
+  GAFFTypeRules typeRules("../data/gaff.prm");
+  GAFFType type(&typeRules);
+  OBGasteiger charges;
+
+  OBFunction *function = OBFunctionFactory::GetFactory("GAFF")->NewInstance();
+  function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  function->SetParameterDB(&database);
+  function->SetOBFFType(&type);
+  function->SetOBChargeMethod(&charges);
+  OB_ASSERT( function->Setup(mol) );
+
+  const std::vector<double> ladder = OBReplicaExchange::GeometricLadder(300.0, 600.0, 4);
+  OB_ASSERT( ladder.size() == 4 );
+  OB_ASSERT( fabs(ladder[0] - 300.0) < 1e-9 && fabs(ladder[3] - 600.0) < 1e-9 );
+  OB_ASSERT( fabs(ladder[1] / ladder[0] - ladder[2] / ladder[1]) < 1e-9 );
+
+  // Monte Carlo
+  {
+    const char *filename = "replicaexchangetest.dcd";
+    OBReplicaExchange remd;
+    remd.SetTemperatures(ladder);
+    remd.SetStepsPerExchange(20);
+    remd.SetSeed(7);
+    OB_REQUIRE( remd.Setup(function, mol, 2) );
+    OB_ASSERT( remd.NumReplicas() == 4 );
+
+    OBTrajectoryWriter trajectory;
+    OB_ASSERT( trajectory.Open(filename, mol.NumAtoms()) );
+    remd.SetTrajectory(0, &trajectory);
+    OB_ASSERT( remd.Run(11) );
+    OB_ASSERT( trajectory.NumFrames() == 11 );
+    OB_ASSERT( trajectory.Close() );
+    remove(filename);
+
+    checkReplicas(remd, 11);
+    for (unsigned int i = 0; i < remd.NumReplicas(); ++i) {
+      OB_ASSERT( remd.GetMoveAcceptanceRatio(i) > 0.0 );
+      // the energy is the one of the current positions
+      OBFunction *copy = remd.GetFunction(remd.GetReplica(i));
+      copy->Compute(OBFunction::Value);
+      OB_ASSERT( fabs(copy->GetValue() - remd.GetEnergy(i)) < 1e-6 );
+    }
+  }
+
+  // dynamics
+  {
+    OBReplicaExchange remd;
+    remd.SetTemperatures(ladder);
+    remd.SetSampler(OBReplicaExchange::Dynamics);
+    remd.SetStepsPerExchange(10);
+    remd.SetStepSize(0.5);
+    remd.SetSeed(7);
+    OB_REQUIRE( remd.Setup(function, mol) );
+    OB_ASSERT( remd.Run(6) );
+    checkReplicas(remd, 6);
+  }
+
+  delete function;
+}
@@ -0,0 +1,106 @@
+/**********************************************************************
+  RescoreTest - unit testing for the OBRescore class
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBFunction>
+#include <OBFunctionTerm>
+#include <OBLogFile>
+#include <OBRescore>
+#include <OBTrajectory>
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <cstdio>
+#include <cmath>
+
+#include "obtest.h"
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+int main()
+{
+  OBMol mol;
+  OBConversion conv;
+  conv.SetInFormat("pdb");
+  std::ifstream ifs("acetone.pdb");
+  OB_ASSERT( conv.Read(&mol, &ifs) );
+
+  GAFFParameterDB database("../data/gaff.dat");
+  GAFFTypeRules typeRules("../data/gaff.prm");
+  GAFFType type(&typeRules);
+  OBGasteiger charges;
+
+  OBFunction *function = OBFunctionFactory::GetFactory("GAFF")->NewInstance();
+  function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  function->SetParameterDB(&database);
+  function->SetOBFFType(&type);
+  function->SetOBChargeMethod(&charges);
+  OB_ASSERT( function->Setup(mol) );
+
+  // frames with displaced atoms
+  const char *filename = "rescoretest.dcd";
+  const unsigned int numFrames = 10;
+  OBTrajectoryWriter writer;
+  OB_ASSERT( writer.Open(filename, mol.NumAtoms()) );
+  std::vector<Eigen::Vector3d> positions(mol.NumAtoms());
+  for (unsigned int frame = 0; frame < numFrames; ++frame) {
+    for (unsigned int i = 0; i < mol.NumAtoms(); ++i)
+      positions[i] = function->GetPosition(i) + 0.02 * Eigen::Vector3d(sin(frame + i), cos(frame * i), 0.0);
+    writer.AddFrame(positions);
+  }
+  OB_ASSERT( writer.Close() );
+
+  OBTrajectoryReader trajectory;
+  OB_ASSERT( trajectory.Open(filename) );
+
+  OBRescore rescore;
+  OB_ASSERT( rescore.Setup(function, mol, 3) );
+  OB_ASSERT( rescore.NumThreads() == 3 );
+  OB_ASSERT( rescore.NumTerms() == function->GetTerms().size() );
+  std::vector<double> values, termValues;
+  OB_ASSERT( rescore.Rescore(trajectory, values, &termValues) );
+  OB_ASSERT( values.size() == numFrames );
+  OB_ASSERT( termValues.size() == numFrames * rescore.NumTerms() );
+
+  // same values as setting the positions by hand
+  for (unsigned int frame = 0; frame < numFrames; ++frame) {
+    OB_ASSERT( trajectory.GetFrame(frame, positions) );
+    for (unsigned int i = 0; i < mol.NumAtoms(); ++i)
+      function->GetPosition(i) = positions[i];
+    function->Compute();
+    OB_ASSERT( fabs(values[frame] - function->GetValue()) < 1e-8 );
+    double sum = 0.0;
+    for (unsigned int t = 0; t < rescore.NumTerms(); ++t)
+      sum += termValues[frame * rescore.NumTerms() + t];
+    OB_ASSERT( fabs(sum - values[frame]) < 1e-8 );
+  }
+
+  // every third frame starting at frame 1
+  std::vector<double> subset;
+  OB_ASSERT( rescore.Rescore(trajectory, subset, 0, 1, numFrames, 3) );
+  OB_ASSERT( subset.size() == 3 );
+  OB_ASSERT( subset[2] == values[7] );
+
+  trajectory.Close();
+  remove(filename);
+  delete function;
+}
@@ -0,0 +1,160 @@
+/**********************************************************************
+  SchedulerTest - unit testing for the OBScheduler class
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBScheduler>
+#include <OBMinimize>
+#include <OBLogFile>
+#include "../src/forceterms/LJ6_12.h"
+#include "../src/forceterms/Coulomb.h"
+
+#include <cmath>
+
+#include "obtest.h"
+#include "mockterms.h"
+
+using namespace OpenBabel::OBFFs;
+
+QMutex mutex;
+long sum = 0;
+
+// add n to sum after some work proportional to n
+class AddTask : public OBTask
+{
+  public:
+    AddTask(long n) : m_n(n) {}
+    void Run(OBScheduler &)
+    {
+      volatile double x = 0.0;
+      for (long i = 0; i < 1000 * m_n; ++i)
+        x += 1.0;
+      QMutexLocker locker(&mutex);
+      sum += m_n;
+    }
+  private:
+    long m_n;
+};
+
+// a large job split into sub-tasks
+class SplitTask : public OBTask
+{
+  public:
+    SplitTask(long n) : m_n(n) {}
+    void Run(OBScheduler &scheduler)
+    {
+      OBTaskGroup group;
+      for (long i = 0; i < m_n; ++i)
+        scheduler.Submit(new AddTask(1), &group);
+      scheduler.Wait(group);
+      // all sub-tasks are done here
+      QMutexLocker locker(&mutex);
+      sum += 1000000;
+    }
+  private:
+    long m_n;
+};
+
+// minimize a chain of 30 atoms, the values computed with the scheduler or not
+std::vector<Eigen::Vector3d> minimize(OBScheduler *scheduler)
+{
+  const unsigned int numAtoms = 30;
+  const char *names[] = { "c", "h", "n", "o" };
+  const double typeSigma[] = { 3.40, 2.65, 3.25, 2.96 };
+  const double typeEpsilon[] = { 0.086, 0.016, 0.17, 0.21 };
+  std::vector<Eigen::Vector3d> positions(numAtoms);
+  std::vector<std::string> types(numAtoms);
+  std::vector<double> charges(numAtoms);
+  for (unsigned int i = 0; i < numAtoms; ++i) {
+    positions[i] = Eigen::Vector3d(3.5 * (i % 5) + 0.3 * sin(i), 3.5 * (i / 5) + 0.3 * cos(i), 0.5 * sin(2.0 * i));
+    types[i] = names[i % 4];
+    charges[i] = 0.3 * sin(1.7 * i);
+  }
+
+  MockLJDatabase database;
+  for (unsigned int t = 0; t < 4; ++t)
+    database.AddType(names[t], typeSigma[t], typeEpsilon[t]);
+  MockType type(types);
+  MockCharges method(charges);
+  MockTermFunction function(positions);
+  function.GetLogFile()->SetLogLevel(OBLogFile::None);
+  function.SetParameterDB(&database);
+  function.SetOBFFType(&type);
+  function.SetOBChargeMethod(&method);
+  function.AddTerm(new LJ6_12(&function));
+  function.AddTerm(new Coulomb(&function));
+  OB_REQUIRE( function.SetupTerms() );
+
+  OBMinimize minimizer(&function);
+  minimizer.SetScheduler(scheduler);
+  minimizer.ConjugateGradients(50, 1.0e-6);
+  return function.GetPositions();
+}
+
+int main()
+{
+  OBScheduler scheduler(4);
+  OB_ASSERT( scheduler.NumThreads() == 4 );
+
+  // independent tasks of different sizes
+  long expected = 0;
+  for (long i = 1; i <= 200; ++i) {
+    scheduler.Submit(new AddTask(i % 50));
+    expected += i % 50;
+  }
+  scheduler.Wait();
+  OB_ASSERT( sum == expected );
+  OB_ASSERT( scheduler.GetStatistics().tasks == 200 );
+
+  // nested tasks
+  scheduler.ResetStatistics();
+  sum = 0;
+  for (int i = 0; i < 8; ++i)
+    scheduler.Submit(new SplitTask(100));
+  scheduler.Wait();
+  OB_ASSERT( sum == 8 * (1000000 + 100) );
+  OB_ASSERT( scheduler.GetStatistics().tasks == 8 * 101 );
+
+  // grouping small tasks
+  scheduler.ResetStatistics();
+  sum = 0;
+  std::vector<OBTask*> tasks;
+  std::vector<double> costs;
+  for (int i = 0; i < 100; ++i) {
+    tasks.push_back(new AddTask(1));
+    costs.push_back(1.0);
+  }
+  tasks.push_back(new AddTask(100));
+  costs.push_back(100.0);
+  OBTaskGroup group;
+  scheduler.SubmitGrouped(tasks, costs, 10.0, &group);
+  scheduler.Wait(group);
+  OB_ASSERT( sum == 200 );
+  // 10 lists of 10 tasks and the large task
+  OB_ASSERT( scheduler.GetStatistics().tasks == 11 );
+
+  OBScheduler::Statistics stats = scheduler.GetStatistics();
+  OB_ASSERT( stats.Utilization() >= 0.0 );
+  OB_ASSERT( stats.threads == 4 );
+
+  // the minimizer computes the values with one task per term, the terms
+  // compute the same values as in the calling thread
+  const std::vector<Eigen::Vector3d> serial = minimize(0);
+  const std::vector<Eigen::Vector3d> scheduled = minimize(&scheduler);
+  OB_ASSERT( scheduled.size() == serial.size() );
+  for (unsigned int i = 0; i < serial.size(); ++i)
+    OB_ASSERT( (scheduled[i] - serial[i]).norm() < 1.0e-12 );
+}
@@ -0,0 +1,103 @@
+/**********************************************************************
+  TrajectoryTest - unit testing for the OBTrajectory classes
+
+  Copyright (C) 2009 by Frank Peters
+
+  This file is part of the Open Babel project.
+  For more information, see <http://openbabel.sourceforge.net/>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ **********************************************************************/
+
+#include <OBTrajectory>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "obtest.h"
+
+using namespace OpenBabel::OBFFs;
+
+// open a copy of the file @p data with the int at @p offset replaced by @p value
+bool OpenCorrupted(const std::vector<char> &data, size_t offset, int value)
+{
+  const char *filename = "trajectorytest_corrupt.dcd";
+  std::vector<char> copy(data);
+  memcpy(&copy[offset], &value, sizeof(int));
+  std::ofstream ofs(filename, std::ios::binary);
+  ofs.write(&copy[0], copy.size());
+  ofs.close();
+
+  OBTrajectoryReader reader;
+  const bool ok = reader.Open(filename);
+  reader.Close();
+  remove(filename);
+  return ok;
+}
+
+int main()
+{
+  const char *filename = "trajectorytest.dcd";
+  const unsigned int numAtoms = 100;
+  // enough frames to fill the write buffer several times
+  const unsigned int numFrames = 3000;
+
+  OBTrajectoryWriter writer;
+  OB_ASSERT( writer.Open(filename, numAtoms, 0.5, "test") );
+  std::vector<Eigen::Vector3d> positions(numAtoms);
+  for (unsigned int frame = 0; frame < numFrames; ++frame) {
+    for (unsigned int i = 0; i < numAtoms; ++i)
+      positions[i] = Eigen::Vector3d(frame, i, 0.25 * i);
+    writer.AddFrame(positions);
+  }
+  // wrong number of atoms is ignored
+  writer.AddFrame(std::vector<Eigen::Vector3d>(3));
+  OB_ASSERT( writer.NumFrames() == numFrames );
+  OB_ASSERT( writer.Close() );
+
+  OBTrajectoryReader reader;
+  OB_ASSERT( reader.Open(filename) );
+  OB_ASSERT( reader.NumAtoms() == numAtoms );
+  OB_ASSERT( reader.NumFrames() == numFrames );
+  OB_ASSERT( reader.GetTimeStep() == 0.5 );
+  OB_ASSERT( reader.GetTitle().find("test") != std::string::npos );
+
+  for (unsigned int frame = 0; frame < numFrames; frame += 97) {
+    OB_ASSERT( reader.GetX(frame)[7] == frame );
+    OB_ASSERT( reader.GetY(frame)[7] == 7.0f );
+    OB_ASSERT( reader.GetZ(frame)[7] == 1.75f );
+  }
+  OB_ASSERT( reader.GetFrame(numFrames - 1, positions) );
+  OB_ASSERT( positions.size() == numAtoms );
+  OB_ASSERT( positions[99].x() == numFrames - 1 );
+  OB_ASSERT( positions[99].z() == 24.75 );
+  OB_ASSERT( !reader.GetFrame(numFrames, positions) );
+  reader.Close();
+
+  // corrupted headers: record markers of the three header records (the title
+  // record holds two lines of 80 characters) and the number of atoms
+  std::ifstream ifs(filename, std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  ifs.close();
+  const size_t atomRecord = 92 + 4 + 4 + 160 + 4;
+  OB_ASSERT( OpenCorrupted(data, atomRecord + 4, numAtoms) );
+  OB_ASSERT( !OpenCorrupted(data, 88, 80) );
+  OB_ASSERT( !OpenCorrupted(data, atomRecord - 4, 160) );
+  OB_ASSERT( !OpenCorrupted(data, atomRecord, 8) );
+  OB_ASSERT( !OpenCorrupted(data, atomRecord + 8, 0) );
+  OB_ASSERT( !OpenCorrupted(data, atomRecord + 4, 0) );
+  OB_ASSERT( !OpenCorrupted(data, atomRecord + 4, -100) );
+  OB_ASSERT( !OpenCorrupted(data, atomRecord + 4, 0x7fffffff) );
+  OB_ASSERT( !OpenCorrupted(data, atomRecord + 4, numAtoms + 1) );
+
+  remove(filename);
+}
@@ -0,0 +1,591 @@
+#include <OBFunction>
+#include <OBLogFile>
+#include <OBMinimize>
+#include <OBScheduler>
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/oberror.h>
+#include <openbabel/obiter.h>
+#include <openbabel/builder.h>
+#include <openbabel/obconversion.h>
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadStorage>
+#include <QTime>
+
+#include <cstdlib>
+#include <map>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+using OpenBabel::OBFormat;
+using OpenBabel::OBBuilder;
+
+using namespace OpenBabel::OBFFs;
+using namespace std;
+
+/*
+ * Streaming batch energy/minimization tool.
+ *
+ * The molecules flow through a pipeline:
+ *
+ *   reader thread -> OBScheduler (work-stealing) -> writer thread
+ *
+ * The reader is the only thread using the input OBConversion. It groups
+ * small molecules into one task to keep the scheduling overhead low, large
+ * molecules get their own task and compute their energies with one sub-task
+ * per force field term (the initial energy and the line search energies of
+ * the minimizer, the gradients are computed by the task itself). The GAFF
+ * functions with their GAFFType and charge method are kept per worker thread
+ * and reused for the following molecules, all of them share the (read-only)
+ * parameter database and type rules. The writer puts the results back in
+ * input order. Parsing and writing overlap with the computation.
+ *
+ * The SMARTS matching in the setup perceives the aromaticity, rings and
+ * hybridization through OpenBabel's global typers, which are not
+ * thread-safe. The reader perceives these before a molecule is submitted so
+ * the setup in the worker threads only reads them.
+ *
+ * The jobs and their molecules come from a fixed pool: the reader parses into
+ * a free molecule and the writer clears it and returns it to the pool after
+ * writing. The pool size limits the number of molecules that have been read
+ * but not yet written, this bounds the memory used for large inputs.
+ */
+
+struct Settings
+{
+  Settings() : minimizer("cg"), steps(2500), econv(1e-6), format("csv"),
+      threads(QThread::idealThreadCount()) {}
+  std::string input, output, report;
+  std::string minimizer; //!< cg | sd | none
+  int steps;
+  double econv;
+  std::string format; //!< csv | json
+  std::string options; //!< OBFunction options
+  int threads;
+};
+
+struct Job
+{
+  unsigned int index;
+  OBMol *mol;
+  bool ok;
+  double initialEnergy, energy;
+  int milliseconds;
+};
+
+/**
+ * Pool of preallocated jobs and molecules, recycled by the writer.
+ */
+class JobPool
+{
+  public:
+    JobPool(int size)
+    {
+      for (int i = 0; i < size; ++i) {
+        Job *job = new Job;
+        job->mol = new OBMol;
+        m_jobs.push_back(job);
+      }
+      m_free = m_jobs;
+    }
+    ~JobPool()
+    {
+      for (unsigned int i = 0; i < m_jobs.size(); ++i) {
+        delete m_jobs[i]->mol;
+        delete m_jobs[i];
+      }
+    }
+    //! @return A free job, waits for one when @p wait is true and returns 0 otherwise.
+    Job* Acquire(bool wait = true)
+    {
+      QMutexLocker locker(&m_mutex);
+      while (m_free.empty()) {
+        if (!wait)
+          return 0;
+        m_condition.wait(&m_mutex);
+      }
+      Job *job = m_free.back();
+      m_free.pop_back();
+      job->ok = false;
+      job->initialEnergy = job->energy = 0.0;
+      job->milliseconds = 0;
+      return job;
+    }
+    //! Clear the molecule and return @p job to the pool.
+    void Release(Job *job)
+    {
+      job->mol->Clear();
+      QMutexLocker locker(&m_mutex);
+      m_free.push_back(job);
+      m_condition.wakeOne();
+    }
+  private:
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    std::vector<Job*> m_jobs, m_free;
+};
+
+/**
+ * Reorder buffer for the finished jobs.
+ */
+class ResultBuffer
+{
+  public:
+    ResultBuffer() : m_total(-1) {}
+    void Put(Job *job)
+    {
+      QMutexLocker locker(&m_mutex);
+      m_jobs[job->index] = job;
+      m_condition.wakeAll();
+    }
+    //! @return The job with @p index or 0 after the last job.
+    Job* Take(unsigned int index)
+    {
+      QMutexLocker locker(&m_mutex);
+      while (true) {
+        std::map<unsigned int, Job*>::iterator job = m_jobs.find(index);
+        if (job != m_jobs.end()) {
+          Job *result = job->second;
+          m_jobs.erase(job);
+          return result;
+        }
+        if (m_total >= 0 && index >= (unsigned int) m_total)
+          return 0;
+        m_condition.wait(&m_mutex);
+      }
+    }
+    //! Set the number of jobs, called when the input is exhausted.
+    void SetTotal(int total)
+    {
+      QMutexLocker locker(&m_mutex);
+      m_total = total;
+      m_condition.wakeAll();
+    }
+  private:
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    std::map<unsigned int, Job*> m_jobs;
+    int m_total;
+};
+
+//! Atoms^2 below which molecules are grouped into one task.
+const double GrainSize = 64.0 * 64.0;
+
+/**
+ * A GAFF function with its own type and charge method.
+ */
+struct TaskFunction
+{
+  TaskFunction(const Settings &settings, GAFFParameterDB *database, GAFFTypeRules *typeRules)
+    : type(typeRules)
+  {
+    function = OBFunctionFactory::GetFactory("GAFF")->NewInstance();
+    function->GetLogFile()->SetLogLevel(OBLogFile::None);
+    if (!settings.options.empty())
+      function->SetOptions(settings.options);
+    function->SetParameterDB(database);
+    function->SetOBFFType(&type);
+    function->SetOBChargeMethod(&charges);
+  }
+  ~TaskFunction()
+  {
+    delete function;
+  }
+  OBFunction *function;
+  GAFFType type;
+  OBGasteiger charges;
+};
+
+/**
+ * The free functions of one worker thread. Reusing them keeps the arena of
+ * the previous molecule. A task waiting for its sub-tasks may run another
+ * molecule on the same thread, that one gets a second function.
+ */
+class FunctionCache
+{
+  public:
+    ~FunctionCache()
+    {
+      for (unsigned int i = 0; i < m_free.size(); ++i)
+        delete m_free[i];
+    }
+    TaskFunction* Acquire(const Settings &settings, GAFFParameterDB *database,
+        GAFFTypeRules *typeRules)
+    {
+      if (m_free.empty())
+        return new TaskFunction(settings, database, typeRules);
+      TaskFunction *function = m_free.back();
+      m_free.pop_back();
+      return function;
+    }
+    void Release(TaskFunction *function)
+    {
+      m_free.push_back(function);
+    }
+  private:
+    std::vector<TaskFunction*> m_free;
+};
+
+QThreadStorage<FunctionCache*> functionCaches;
+
+//! Perceive what the setup would otherwise perceive in the worker threads.
+void Perceive(OBMol &mol)
+{
+  mol.GetSSSR();
+  FOR_ATOMS_OF_MOL (atom, mol) {
+    atom->IsInRing();
+    atom->IsAromatic();
+    atom->GetHyb();
+    atom->GetImplicitValence();
+  }
+}
+
+class MoleculeTask : public OBTask
+{
+  public:
+    MoleculeTask(const Settings &settings, Job *job, ResultBuffer *results,
+        GAFFParameterDB *database, GAFFTypeRules *typeRules)
+      : m_settings(settings), m_job(job), m_results(results), m_database(database),
+      m_typeRules(typeRules) {}
+    void Run(OBScheduler &scheduler)
+    {
+      Process(scheduler);
+      m_results->Put(m_job);
+    }
+  private:
+    void Process(OBScheduler &scheduler)
+    {
+      QTime time;
+      time.start();
+
+      if (!functionCaches.hasLocalData())
+        functionCaches.setLocalData(new FunctionCache);
+      FunctionCache *cache = functionCaches.localData();
+      TaskFunction *taskFunction = cache->Acquire(m_settings, m_database, m_typeRules);
+      OBFunction *function = taskFunction->function;
+
+      Job *job = m_job;
+      job->ok = function->Setup(*job->mol);
+      if (job->ok) {
+        // split the energy evaluations of large molecules over the terms
+        const bool split = (double(job->mol->NumAtoms()) * job->mol->NumAtoms() >= GrainSize);
+        if (split)
+          scheduler.ComputeValue(function);
+        else
+          function->Compute();
+        job->initialEnergy = job->energy = function->GetValue();
+
+        if (m_settings.minimizer != "none") {
+          OBMinimize minimize(function);
+          if (split)
+            minimize.SetScheduler(&scheduler);
+          if (m_settings.minimizer == "sd")
+            minimize.SteepestDescent(m_settings.steps, m_settings.econv);
+          else
+            minimize.ConjugateGradients(m_settings.steps, m_settings.econv);
+
+          minimize.ComputeValue();
+          job->energy = function->GetValue();
+          function->CopyPositionsToMol(*job->mol);
+        }
+      }
+      cache->Release(taskFunction);
+
+      job->milliseconds = time.elapsed();
+    }
+
+    const Settings &m_settings;
+    Job *m_job;
+    ResultBuffer *m_results;
+    GAFFParameterDB *m_database;
+    GAFFTypeRules *m_typeRules;
+};
+
+//! Quote a string for CSV or JSON output.
+std::string Quote(const std::string &str, bool json)
+{
+  std::string quoted("\"");
+  for (unsigned int i = 0; i < str.size(); ++i) {
+    if (str[i] == '"')
+      quoted += json ? "\\\"" : "\"\"";
+    else if (json && str[i] == '\\')
+      quoted += "\\\\";
+    else if (str[i] == '\n' || str[i] == '\r')
+      quoted += ' ';
+    else
+      quoted += str[i];
+  }
+  return quoted + "\"";
+}
+
+class Writer : public QThread
+{
+  public:
+    Writer(const Settings &settings, ResultBuffer *results, JobPool *pool,
+        OBConversion *conv, std::ostream *molOut, std::ostream *reportOut)
+      : m_settings(settings), m_results(results), m_pool(pool), m_conv(conv),
+      m_molOut(molOut), m_reportOut(reportOut), m_failed(0) {}
+    int NumFailed() const
+    {
+      return m_failed;
+    }
+  protected:
+    void run()
+    {
+      const bool json = (m_settings.format == "json");
+      std::ostream &os = *m_reportOut;
+      if (json)
+        os << "[" << std::endl;
+      else
+        os << "index,title,atoms,status,initial_energy,energy,time_ms" << std::endl;
+
+      unsigned int index = 0;
+      while (Job *job = m_results->Take(index)) {
+        if (!job->ok)
+          m_failed++;
+        if (m_molOut && job->ok)
+          m_conv->Write(job->mol, m_molOut);
+
+        const char *status = job->ok ? "ok" : "failed";
+        if (json) {
+          if (index)
+            os << "," << std::endl;
+          os << "  {\"index\": " << job->index
+             << ", \"title\": " << Quote(job->mol->GetTitle(), true)
+             << ", \"atoms\": " << job->mol->NumAtoms()
+             << ", \"status\": \"" << status << "\"";
+          if (job->ok)
+            os << ", \"initial_energy\": " << job->initialEnergy << ", \"energy\": " << job->energy;
+          os << ", \"time_ms\": " << job->milliseconds << "}";
+        } else {
+          os << job->index << "," << Quote(job->mol->GetTitle(), false) << ","
+             << job->mol->NumAtoms() << "," << status << ",";
+          if (job->ok)
+            os << job->initialEnergy << "," << job->energy;
+          else
+            os << ",";
+          os << "," << job->milliseconds << std::endl;
+        }
+
+        m_pool->Release(job);
+        ++index;
+      }
+
+      if (json)
+        os << std::endl << "]" << std::endl;
+      os.flush();
+    }
+  private:
+    const Settings &m_settings;
+    ResultBuffer *m_results;
+    JobPool *m_pool;
+    OBConversion *m_conv;
+    std::ostream *m_molOut, *m_reportOut;
+    int m_failed;
+};
+
+class Reader : public QThread
+{
+  public:
+    Reader(const Settings &settings, OBConversion *conv, std::istream *in, JobPool *pool,
+        OBScheduler *scheduler, ResultBuffer *results, GAFFParameterDB *database,
+        GAFFTypeRules *typeRules)
+      : m_settings(settings), m_conv(conv), m_in(in), m_pool(pool), m_scheduler(scheduler),
+      m_results(results), m_database(database), m_typeRules(typeRules), m_count(0) {}
+    unsigned int NumMolecules() const
+    {
+      return m_count;
+    }
+  protected:
+    void run()
+    {
+      // blocks when all molecules in the pool are in the pipeline
+      bool more = true, first = true;
+      OBTaskList *list = 0;
+      while (more) {
+        Job *job = m_pool->Acquire(false);
+        if (!job) {
+          // the writer may be waiting for a molecule in the unsubmitted list
+          if (list) {
+            m_scheduler->Submit(list);
+            list = 0;
+          }
+          job = m_pool->Acquire();
+        }
+        OBMol *mol = job->mol;
+        more = m_conv->Read(mol, first ? m_in : 0);
+        first = false;
+        if (!more || !mol->NumAtoms()) {
+          m_pool->Release(job);
+          continue;
+        }
+        // SMILES and other 0D/2D input needs 3D coordinates, OBBuilder is not
+        // thread-safe so this is done here
+        if (!mol->Has3D()) {
+          mol->AddHydrogens();
+          OBBuilder builder;
+          builder.Build(*mol);
+        }
+        Perceive(*mol);
+        job->index = m_count++;
+
+        // the cost of the non-bonded terms grows with the number of atoms squared
+        OBTask *task = new MoleculeTask(m_settings, job, m_results, m_database, m_typeRules);
+        const double cost = double(mol->NumAtoms()) * mol->NumAtoms();
+        if (cost >= GrainSize) {
+          m_scheduler->Submit(task);
+          continue;
+        }
+        if (!list)
+          list = new OBTaskList;
+        list->Add(task, cost);
+        if (list->GetCost() >= GrainSize) {
+          m_scheduler->Submit(list);
+          list = 0;
+        }
+      }
+      if (list)
+        m_scheduler->Submit(list);
+
+      m_results->SetTotal(m_count);
+    }
+  private:
+    const Settings &m_settings;
+    OBConversion *m_conv;
+    std::istream *m_in;
+    JobPool *m_pool;
+    OBScheduler *m_scheduler;
+    ResultBuffer *m_results;
+    GAFFParameterDB *m_database;
+    GAFFTypeRules *m_typeRules;
+    unsigned int m_count;
+};
+
+void Usage(const char *name)
+{
+  cerr << "Usage: " << name << " -i <input> [options]" << endl;
+  cerr << "  -i <file>      input molecules (any multi-molecule format, e.g. sdf, mol2, smi)" << endl;
+  cerr << "  -o <file>      write the minimized molecules" << endl;
+  cerr << "  -r <file>      write the report to file instead of stdout" << endl;
+  cerr << "  -f csv|json    report format (default csv)" << endl;
+  cerr << "  -m cg|sd|none  minimizer, none only computes the energy (default cg)" << endl;
+  cerr << "  -n <steps>     maximum number of minimization steps (default 2500)" << endl;
+  cerr << "  -e <econv>     energy convergence criterion (default 1e-6)" << endl;
+  cerr << "  -t <threads>   number of worker threads (default: number of cores)" << endl;
+  cerr << "  -c <file>      GAFF function options file" << endl;
+}
+
+int main(int argc, char **argv)
+{
+  Settings settings;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    if (i + 1 >= argc) {
+      Usage(argv[0]);
+      return -1;
+    }
+    const char *value = argv[++i];
+    if (arg == "-i")
+      settings.input = value;
+    else if (arg == "-o")
+      settings.output = value;
+    else if (arg == "-r")
+      settings.report = value;
+    else if (arg == "-f")
+      settings.format = value;
+    else if (arg == "-m")
+      settings.minimizer = value;
+    else if (arg == "-n")
+      settings.steps = atoi(value);
+    else if (arg == "-e")
+      settings.econv = atof(value);
+    else if (arg == "-t")
+      settings.threads = atoi(value);
+    else if (arg == "-c") {
+      std::ifstream cifs(value);
+      std::stringstream options;
+      std::string line;
+      while (std::getline(cifs, line))
+        options << line << std::endl;
+      settings.options = options.str();
+    } else {
+      Usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if (settings.input.empty() || settings.threads < 1 ||
+      (settings.format != "csv" && settings.format != "json") ||
+      (settings.minimizer != "cg" && settings.minimizer != "sd" && settings.minimizer != "none")) {
+    Usage(argv[0]);
+    return -1;
+  }
+
+  OBConversion inConv, outConv;
+  OBFormat *format_in = inConv.FormatFromExt(settings.input.c_str());
+  if (!format_in || !inConv.SetInFormat(format_in)) {
+    cerr << "ERROR: could not find format for file " << settings.input << endl;
+    return -1;
+  }
+  std::ifstream ifs(settings.input.c_str());
+  if (!ifs) {
+    cerr << "ERROR: could not open " << settings.input << endl;
+    return -1;
+  }
+
+  std::ofstream molOfs;
+  if (!settings.output.empty()) {
+    OBFormat *format_out = outConv.FormatFromExt(settings.output.c_str());
+    if (!format_out || !outConv.SetOutFormat(format_out)) {
+      cerr << "ERROR: could not find format for file " << settings.output << endl;
+      return -1;
+    }
+    molOfs.open(settings.output.c_str());
+  }
+  std::ofstream reportOfs;
+  if (!settings.report.empty())
+    reportOfs.open(settings.report.c_str());
+
+  // The OpenBabel error log is not thread-safe and the tasks would only
+  // fill it with type substitution messages.
+  OpenBabel::obErrorLog.StopLogging();
+
+  // shared between all tasks
+  GAFFParameterDB database(std::string(DATADIR) + "gaff.dat");
+  GAFFTypeRules typeRules(std::string(DATADIR) + "gaff.prm");
+  if (!database.IsInitialized() || !typeRules.IsInitialized()) {
+    cerr << "ERROR: could not read the GAFF parameters from " << DATADIR << endl;
+    return -1;
+  }
+
+  OBScheduler scheduler(settings.threads);
+  ResultBuffer results;
+  JobPool pool(16 * settings.threads);
+
+  Writer writer(settings, &results, &pool, &outConv,
+      settings.output.empty() ? 0 : &molOfs,
+      settings.report.empty() ? &cout : &reportOfs);
+  Reader reader(settings, &inConv, &ifs, &pool, &scheduler, &results, &database, &typeRules);
+  writer.start();
+  reader.start();
+
+  reader.wait();
+  scheduler.Wait();
+  writer.wait();
+  const unsigned int count = reader.NumMolecules();
+
+  OBScheduler::Statistics stats = scheduler.GetStatistics();
+  cerr << count << " molecules, " << writer.NumFailed() << " failed" << endl;
+  cerr << stats.tasks << " tasks (" << stats.steals << " stolen), "
+       << count / (stats.seconds > 0.0 ? stats.seconds : 1.0) << " molecules/s, "
+       << 100.0 * stats.Utilization() << "% core utilization" << endl;
+  return writer.NumFailed() ? 1 : 0;
+}
@@ -0,0 +1,591 @@
+#include <OBFunction>
+#include <OBLogFile>
+#include <OBMinimize>
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/oberror.h>
+#include <openbabel/builder.h>
+#include <openbabel/obconversion.h>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+using OpenBabel::OBFormat;
+using OpenBabel::OBBuilder;
+
+using namespace OpenBabel::OBFFs;
+using namespace std;
+
+/*
+ * Multi-process batch energy/minimization tool.
+ *
+ * Unlike batchminimize, every worker is a separate process so OpenBabel
+ * global state (obErrorLog, obLocale, plugin caches) is never shared between
+ * workers.
+ *
+ * The coordinator parses the GAFF parameters and type rules once and then
+ * forks the workers, these share the parsed parameter pages copy-on-write.
+ * The molecules are handed out through a ring of slots in an anonymous
+ * shared memory mapping:
+ *
+ *   coordinator:  Empty -> Ready (input molecule as SDF text)
+ *   worker:       Ready -> Taken -> Done (output molecule text + results)
+ *   coordinator:  Done -> Empty (written in input order)
+ *
+ * A molecule that does not fit its slot goes from Empty to Done directly, the
+ * workers skip it.
+ *
+ * Molecule k always uses slot k % numSlots, so the coordinator collects the
+ * results in input order and the ring bounds the memory use. A worker that
+ * dies is detected by the coordinator, its molecule is reported as crashed
+ * and a new worker is forked.
+ */
+
+namespace {
+
+  enum SlotState
+  {
+    Empty = 0,
+    Ready,
+    Taken,
+    Done
+  };
+
+  enum Status
+  {
+    Ok = 0,
+    Failed,
+    TooLarge,
+    Crashed
+  };
+
+  struct Shared
+  {
+    pthread_mutex_t mutex;
+    pthread_cond_t jobReady; //!< signaled when a slot becomes Ready or total is set
+    pthread_cond_t jobDone; //!< signaled when a slot becomes Done
+    unsigned int numSlots;
+    unsigned int slotSize; //!< bytes of text data per slot
+    unsigned int nextClaim; //!< next molecule index to be taken by a worker
+    unsigned int total; //!< number of molecules, UINT_MAX while reading
+  };
+
+  struct Slot
+  {
+    int state;
+    unsigned int index;
+    pid_t worker;
+    int status;
+    unsigned int numAtoms;
+    int build; //!< no 3D coordinates in the input
+    double initialEnergy, energy;
+    int milliseconds;
+    unsigned int length; //!< text length: input SDF or output molecule
+    char title[128];
+  };
+
+  struct Settings
+  {
+    Settings() : minimizer("cg"), steps(2500), econv(1e-6), format("csv"), slotKB(512)
+    {
+      processes = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    std::string input, output, report;
+    std::string minimizer; //!< cg | sd | none
+    int steps;
+    double econv;
+    std::string format; //!< csv | json
+    std::string options; //!< OBFunction options
+    int processes;
+    int slotKB;
+  };
+
+  Shared *shared = 0;
+  char *slotMemory = 0;
+  size_t slotStride = 0;
+
+  Slot* GetSlot(unsigned int index)
+  {
+    return reinterpret_cast<Slot*>(slotMemory + (index % shared->numSlots) * slotStride);
+  }
+
+  char* GetSlotData(Slot *slot)
+  {
+    return reinterpret_cast<char*>(slot) + sizeof(Slot);
+  }
+
+  //! Lock the shared mutex, recovering it when its owner died.
+  void Lock()
+  {
+    if (pthread_mutex_lock(&shared->mutex) == EOWNERDEAD)
+      pthread_mutex_consistent(&shared->mutex);
+  }
+
+  void Unlock()
+  {
+    pthread_mutex_unlock(&shared->mutex);
+  }
+
+  //! Wait for @p cond for at most @p ms milliseconds.
+  void TimedWait(pthread_cond_t *cond, int ms)
+  {
+    timeval now;
+    gettimeofday(&now, 0);
+    timespec timeout;
+    long usec = now.tv_usec + ms * 1000L;
+    timeout.tv_sec = now.tv_sec + usec / 1000000;
+    timeout.tv_nsec = (usec % 1000000) * 1000;
+    if (pthread_cond_timedwait(cond, &shared->mutex, &timeout) == EOWNERDEAD)
+      pthread_mutex_consistent(&shared->mutex);
+  }
+
+  long Milliseconds()
+  {
+    timeval now;
+    gettimeofday(&now, 0);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+  }
+
+  bool CreateShared(unsigned int numSlots, unsigned int slotSize)
+  {
+    // keep the slots 8 byte aligned
+    slotStride = (sizeof(Slot) + slotSize + 7) & ~size_t(7);
+    const size_t header = (sizeof(Shared) + 63) & ~size_t(63);
+    const size_t size = header + numSlots * slotStride;
+    void *memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+      return false;
+    memset(memory, 0, header);
+
+    shared = static_cast<Shared*>(memory);
+    slotMemory = static_cast<char*>(memory) + header;
+    shared->numSlots = numSlots;
+    shared->slotSize = slotSize;
+    shared->nextClaim = 0;
+    shared->total = UINT_MAX;
+    for (unsigned int i = 0; i < numSlots; ++i)
+      GetSlot(i)->state = Empty;
+
+    pthread_mutexattr_t mutexAttr;
+    pthread_mutexattr_init(&mutexAttr);
+    pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutexAttr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shared->mutex, &mutexAttr);
+    pthread_mutexattr_destroy(&mutexAttr);
+
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setpshared(&condAttr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&shared->jobReady, &condAttr);
+    pthread_cond_init(&shared->jobDone, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+
+    return true;
+  }
+
+  /**
+   * Worker process main loop.
+   */
+  void WorkerMain(const Settings &settings, GAFFParameterDB *database, GAFFTypeRules *typeRules,
+      OBConversion *outConv)
+  {
+    OBFunction *function = OBFunctionFactory::GetFactory("GAFF")->NewInstance();
+    GAFFType type(typeRules);
+    OBGasteiger charges;
+    function->GetLogFile()->SetLogLevel(OBLogFile::None);
+    if (!settings.options.empty())
+      function->SetOptions(settings.options);
+    function->SetParameterDB(database);
+    function->SetOBFFType(&type);
+    function->SetOBChargeMethod(&charges);
+
+    OBConversion inConv;
+    inConv.SetInFormat("sdf");
+
+    while (true) {
+      // claim the next molecule
+      Lock();
+      Slot *slot = 0;
+      while (true) {
+        const unsigned int index = shared->nextClaim;
+        if (index >= shared->total)
+          break;
+        Slot *candidate = GetSlot(index);
+        if (candidate->state == Ready && candidate->index == index) {
+          slot = candidate;
+          slot->state = Taken;
+          slot->worker = getpid();
+          shared->nextClaim++;
+          break;
+        }
+        // the coordinator marks molecules that do not fit their slot Done
+        // without making them Ready
+        if (candidate->state == Done && candidate->index == index) {
+          shared->nextClaim++;
+          continue;
+        }
+        TimedWait(&shared->jobReady, 1000);
+      }
+      Unlock();
+      if (!slot)
+        break;
+
+      // the slot is owned by this process until it is Done
+      const long start = Milliseconds();
+      OBMol mol;
+      inConv.ReadString(&mol, std::string(GetSlotData(slot), slot->length));
+      if (mol.NumAtoms() && slot->build) {
+        mol.AddHydrogens();
+        OBBuilder builder;
+        builder.Build(mol);
+      }
+
+      slot->status = Failed;
+      slot->length = 0;
+      slot->numAtoms = mol.NumAtoms();
+      if (mol.NumAtoms() && function->Setup(mol)) {
+        function->Compute();
+        slot->initialEnergy = slot->energy = function->GetValue();
+        if (settings.minimizer != "none") {
+          OBMinimize minimize(function);
+          if (settings.minimizer == "sd")
+            minimize.SteepestDescent(settings.steps, settings.econv);
+          else
+            minimize.ConjugateGradients(settings.steps, settings.econv);
+          function->Compute();
+          slot->energy = function->GetValue();
+          function->CopyPositionsToMol(mol);
+        }
+        slot->status = Ok;
+
+        if (!settings.output.empty()) {
+          const std::string text = outConv->WriteString(&mol);
+          if (text.size() <= shared->slotSize) {
+            memcpy(GetSlotData(slot), text.data(), text.size());
+            slot->length = text.size();
+          } else
+            slot->status = TooLarge;
+        }
+      }
+      slot->milliseconds = Milliseconds() - start;
+
+      Lock();
+      slot->state = Done;
+      pthread_cond_broadcast(&shared->jobDone);
+      Unlock();
+    }
+
+    delete function;
+  }
+
+  pid_t StartWorker(const Settings &settings, GAFFParameterDB *database, GAFFTypeRules *typeRules,
+      OBConversion *outConv)
+  {
+    pid_t pid = fork();
+    if (pid == 0) {
+      WorkerMain(settings, database, typeRules, outConv);
+      _exit(0);
+    }
+    return pid;
+  }
+
+  //! Quote a string for CSV or JSON output.
+  std::string Quote(const std::string &str, bool json)
+  {
+    std::string quoted("\"");
+    for (unsigned int i = 0; i < str.size(); ++i) {
+      if (str[i] == '"')
+        quoted += json ? "\\\"" : "\"\"";
+      else if (json && str[i] == '\\')
+        quoted += "\\\\";
+      else if (str[i] == '\n' || str[i] == '\r')
+        quoted += ' ';
+      else
+        quoted += str[i];
+    }
+    return quoted + "\"";
+  }
+
+  const char* StatusName(int status)
+  {
+    switch (status) {
+      case Ok:
+        return "ok";
+      case TooLarge:
+        return "too_large";
+      case Crashed:
+        return "crashed";
+      default:
+        return "failed";
+    }
+  }
+
+  void WriteReport(std::ostream &os, const Settings &settings, const Slot *slot)
+  {
+    const bool ok = (slot->status == Ok);
+    if (settings.format == "json") {
+      if (slot->index)
+        os << "," << std::endl;
+      os << "  {\"index\": " << slot->index
+         << ", \"title\": " << Quote(slot->title, true)
+         << ", \"atoms\": " << slot->numAtoms
+         << ", \"status\": \"" << StatusName(slot->status) << "\"";
+      if (ok)
+        os << ", \"initial_energy\": " << slot->initialEnergy << ", \"energy\": " << slot->energy;
+      os << ", \"time_ms\": " << slot->milliseconds << "}";
+    } else {
+      os << slot->index << "," << Quote(slot->title, false) << "," << slot->numAtoms << ","
+         << StatusName(slot->status) << ",";
+      if (ok)
+        os << slot->initialEnergy << "," << slot->energy;
+      else
+        os << ",";
+      os << "," << slot->milliseconds << std::endl;
+    }
+  }
+
+}
+
+void Usage(const char *name)
+{
+  cerr << "Usage: " << name << " -i <input> [options]" << endl;
+  cerr << "  -i <file>      input molecules (any multi-molecule format, e.g. sdf, mol2, smi)" << endl;
+  cerr << "  -o <file>      write the minimized molecules" << endl;
+  cerr << "  -r <file>      write the report to file instead of stdout" << endl;
+  cerr << "  -f csv|json    report format (default csv)" << endl;
+  cerr << "  -m cg|sd|none  minimizer, none only computes the energy (default cg)" << endl;
+  cerr << "  -n <steps>     maximum number of minimization steps (default 2500)" << endl;
+  cerr << "  -e <econv>     energy convergence criterion (default 1e-6)" << endl;
+  cerr << "  -p <procs>     number of worker processes (default: number of cores)" << endl;
+  cerr << "  -b <kB>        maximum molecule text size per shared memory slot (default 512)" << endl;
+  cerr << "  -c <file>      GAFF function options file" << endl;
+}
+
+int main(int argc, char **argv)
+{
+  Settings settings;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    if (i + 1 >= argc) {
+      Usage(argv[0]);
+      return -1;
+    }
+    const char *value = argv[++i];
+    if (arg == "-i")
+      settings.input = value;
+    else if (arg == "-o")
+      settings.output = value;
+    else if (arg == "-r")
+      settings.report = value;
+    else if (arg == "-f")
+      settings.format = value;
+    else if (arg == "-m")
+      settings.minimizer = value;
+    else if (arg == "-n")
+      settings.steps = atoi(value);
+    else if (arg == "-e")
+      settings.econv = atof(value);
+    else if (arg == "-p")
+      settings.processes = atoi(value);
+    else if (arg == "-b")
+      settings.slotKB = atoi(value);
+    else if (arg == "-c") {
+      std::ifstream cifs(value);
+      std::stringstream options;
+      std::string line;
+      while (std::getline(cifs, line))
+        options << line << std::endl;
+      settings.options = options.str();
+    } else {
+      Usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if (settings.input.empty() || settings.processes < 1 || settings.slotKB < 1 ||
+      (settings.format != "csv" && settings.format != "json") ||
+      (settings.minimizer != "cg" && settings.minimizer != "sd" && settings.minimizer != "none")) {
+    Usage(argv[0]);
+    return -1;
+  }
+
+  OBConversion inConv, sdfConv, outConv;
+  OBFormat *format_in = inConv.FormatFromExt(settings.input.c_str());
+  if (!format_in || !inConv.SetInFormat(format_in)) {
+    cerr << "ERROR: could not find format for file " << settings.input << endl;
+    return -1;
+  }
+  sdfConv.SetOutFormat("sdf");
+  std::ifstream ifs(settings.input.c_str());
+  if (!ifs) {
+    cerr << "ERROR: could not open " << settings.input << endl;
+    return -1;
+  }
+
+  std::ofstream molOfs;
+  if (!settings.output.empty()) {
+    OBFormat *format_out = outConv.FormatFromExt(settings.output.c_str());
+    if (!format_out || !outConv.SetOutFormat(format_out)) {
+      cerr << "ERROR: could not find format for file " << settings.output << endl;
+      return -1;
+    }
+    molOfs.open(settings.output.c_str());
+  }
+  std::ofstream reportOfs;
+  if (!settings.report.empty())
+    reportOfs.open(settings.report.c_str());
+  std::ostream &report = settings.report.empty() ? cout : reportOfs;
+
+  // parsed once, shared copy-on-write by the workers
+  GAFFParameterDB database(std::string(DATADIR) + "gaff.dat");
+  GAFFTypeRules typeRules(std::string(DATADIR) + "gaff.prm");
+  if (!database.IsInitialized() || !typeRules.IsInitialized()) {
+    cerr << "ERROR: could not read the GAFF parameters from " << DATADIR << endl;
+    return -1;
+  }
+  OpenBabel::obErrorLog.StopLogging();
+
+  const unsigned int numSlots = 4 * settings.processes;
+  if (!CreateShared(numSlots, settings.slotKB * 1024)) {
+    cerr << "ERROR: could not map the shared memory: " << strerror(errno) << endl;
+    return -1;
+  }
+
+  // flush before forking, the workers inherit the stream buffers
+  report.flush();
+  cout.flush();
+  std::vector<pid_t> workers;
+  for (int i = 0; i < settings.processes; ++i)
+    workers.push_back(StartWorker(settings, &database, &typeRules, &outConv));
+
+  if (settings.format == "json")
+    report << "[" << std::endl;
+  else
+    report << "index,title,atoms,status,initial_energy,energy,time_ms" << std::endl;
+
+  const long start = Milliseconds();
+  unsigned int filled = 0, collected = 0, failed = 0, crashed = 0;
+  bool inputDone = false, first = true;
+  while (!inputDone || collected < filled) {
+    // fill the free slots
+    while (!inputDone && filled - collected < numSlots) {
+      OBMol mol;
+      if (!inConv.Read(&mol, first ? &ifs : 0)) {
+        inputDone = true;
+        Lock();
+        shared->total = filled;
+        pthread_cond_broadcast(&shared->jobReady);
+        Unlock();
+        break;
+      }
+      first = false;
+      if (!mol.NumAtoms())
+        continue;
+
+      const std::string text = sdfConv.WriteString(&mol);
+      Slot *slot = GetSlot(filled);
+      slot->index = filled;
+      slot->numAtoms = mol.NumAtoms();
+      // SMILES and other 0D/2D input is built in the worker
+      slot->build = !mol.Has3D();
+      strncpy(slot->title, mol.GetTitle(), sizeof(slot->title) - 1);
+      slot->title[sizeof(slot->title) - 1] = '\0';
+      Lock();
+      if (text.size() > shared->slotSize) {
+        slot->status = TooLarge;
+        slot->milliseconds = 0;
+        slot->length = 0;
+        slot->state = Done;
+      } else {
+        memcpy(GetSlotData(slot), text.data(), text.size());
+        slot->length = text.size();
+        slot->state = Ready;
+      }
+      // also wakes the workers waiting to skip a molecule that is too large
+      pthread_cond_broadcast(&shared->jobReady);
+      Unlock();
+      filled++;
+    }
+
+    if (collected == filled)
+      continue;
+
+    // collect the next molecule in input order
+    Slot *slot = GetSlot(collected);
+    Lock();
+    while (slot->state != Done) {
+      TimedWait(&shared->jobDone, 200);
+      if (slot->state == Done)
+        break;
+
+      // replace dead workers, their molecules are reported as crashed
+      int status;
+      pid_t pid;
+      while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (unsigned int i = 0; i < numSlots; ++i) {
+          Slot *s = GetSlot(i);
+          if (s->state == Taken && s->worker == pid) {
+            s->status = Crashed;
+            s->length = 0;
+            s->state = Done;
+          }
+        }
+        // a worker exits normally once all molecules are taken
+        const bool normal = WIFEXITED(status) && !WEXITSTATUS(status);
+        for (unsigned int i = 0; i < workers.size(); ++i)
+          if (workers[i] == pid) {
+            Unlock();
+            workers[i] = normal ? 0 : StartWorker(settings, &database, &typeRules, &outConv);
+            Lock();
+          }
+      }
+    }
+    Unlock();
+
+    if (slot->status != Ok)
+      failed++;
+    if (slot->status == Crashed)
+      crashed++;
+    if (slot->status == Ok && slot->length)
+      molOfs.write(GetSlotData(slot), slot->length);
+    WriteReport(report, settings, slot);
+
+    Lock();
+    // no worker skipped the molecule that is too large yet, the slot is
+    // reused below
+    if (slot->status == TooLarge && shared->nextClaim == collected)
+      shared->nextClaim++;
+    slot->state = Empty;
+    Unlock();
+    collected++;
+  }
+
+  if (settings.format == "json")
+    report << std::endl << "]" << std::endl;
+  report.flush();
+
+  for (unsigned int i = 0; i < workers.size(); ++i)
+    if (workers[i] > 0)
+      waitpid(workers[i], 0, 0);
+
+  const double seconds = 0.001 * (Milliseconds() - start);
+  cerr << collected << " molecules, " << failed << " failed (" << crashed << " crashed), "
+       << collected / (seconds > 0.0 ? seconds : 1.0) << " molecules/s" << endl;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+/**********************************************************************
+obffprotocol.h - Binary protocol for the obffserver scoring daemon.
+
+Copyright (C) 2009 by Frank Peters
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBFF_PROTOCOL_H
+#define OBFF_PROTOCOL_H
+
+#include <stdint.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * The obffserver protocol.
+ *
+ * Client and server run on the same host (UNIX domain socket), all values
+ * are in native byte order without padding. Every request and response is
+ * a Header followed by Header::length payload bytes. The response has the
+ * same type as the request, its payload starts with a uint32 Status. When
+ * the status is not Ok, the payload contains only the status.
+ *
+ * Payloads (n = number of atoms, xyz = 3n doubles in OBMol atom order):
+ *
+ * - Setup:     request  uint32 formatLength, char format[formatLength]
+ *                       (OpenBabel format id, e.g. "sdf"), molecule text
+ *                       (rest of the payload)
+ *              response uint32 status, uint32 session, uint32 n
+ * - Energy:    request  uint32 session, uint32 n, xyz (n = 0 keeps the
+ *                       current coordinates)
+ *              response uint32 status, double energy
+ * - Gradients: request  like Energy
+ *              response uint32 status, double energy, xyz forces (-dE/dx)
+ * - Minimize:  request  uint32 session, uint32 steps (at most MaxSteps),
+ *                       double econv, uint32 n, xyz
+ *              response uint32 status, double energy, xyz coordinates
+ * - Release:   request  uint32 session
+ *              response uint32 status
+ *
+ * A session keeps the set-up function for a molecule warm. Sessions can be
+ * used from any connection and are evicted least recently used first.
+ * Energies are in kcal/mol, distances in Angstrom.
+ */
+namespace OBFFProtocol {
+
+  const uint32_t Magic = 0x4f424646; // "OBFF"
+
+  enum RequestType
+  {
+    Setup = 1,
+    Energy = 2,
+    Gradients = 3,
+    Minimize = 4,
+    Release = 5
+  };
+
+  enum Status
+  {
+    Ok = 0,
+    Error = 1,          //!< the molecule could not be read or set up
+    UnknownSession = 2, //!< the session was released or evicted
+    BadRequest = 3      //!< malformed payload or atom count mismatch
+  };
+
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t length; //!< payload length in bytes
+  };
+
+  //! Maximum payload length accepted by the server.
+  const uint32_t MaxPayload = 256 * 1024 * 1024;
+  //! Maximum number of minimization steps, the server clamps larger values.
+  const uint32_t MaxSteps = 10000;
+
+  /**
+   * Sequential reader/writer for the payloads. The Get functions return
+   * false, without reading, when the payload is too short.
+   */
+  class Buffer
+  {
+    public:
+      Buffer() : m_pos(0) {}
+      std::vector<char>& Data()
+      {
+        return m_data;
+      }
+      void Clear()
+      {
+        m_data.clear();
+        m_pos = 0;
+      }
+      template <typename T>
+      bool Get(T &value)
+      {
+        // m_pos <= m_data.size(), the difference cannot wrap around
+        if (sizeof(T) > m_data.size() - m_pos)
+          return false;
+        memcpy(&value, &m_data[m_pos], sizeof(T));
+        m_pos += sizeof(T);
+        return true;
+      }
+      bool GetString(std::string &str, uint32_t length)
+      {
+        if (length > m_data.size() - m_pos)
+          return false;
+        str.assign(m_data.begin() + m_pos, m_data.begin() + m_pos + length);
+        m_pos += length;
+        return true;
+      }
+      //! @return The number of payload bytes not read yet.
+      size_t Remaining() const
+      {
+        return m_data.size() - m_pos;
+      }
+      void GetRest(std::string &str)
+      {
+        str.assign(m_data.begin() + m_pos, m_data.end());
+        m_pos = m_data.size();
+      }
+      template <typename T>
+      void Put(const T &value)
+      {
+        const char *bytes = reinterpret_cast<const char*>(&value);
+        m_data.insert(m_data.end(), bytes, bytes + sizeof(T));
+      }
+    private:
+      std::vector<char> m_data;
+      size_t m_pos;
+  };
+
+}
+
+#endif
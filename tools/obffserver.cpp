@@ -0,0 +1,589 @@
+#include <OBFunction>
+#include <OBLogFile>
+#include <OBMinimize>
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/oberror.h>
+#include <openbabel/obconversion.h>
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "obffprotocol.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <set>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+using OBFFProtocol::Buffer;
+
+using namespace OpenBabel::OBFFs;
+using namespace std;
+
+/*
+ * Persistent scoring daemon.
+ *
+ * The server keeps the GAFF parameter database, the type rules and the
+ * recently set-up functions (sessions) in memory and serves requests over a
+ * UNIX domain socket, see obffprotocol.h for the protocol. The main thread
+ * accepts the connections, a pool of worker threads serves them (one
+ * connection at a time per worker).
+ *
+ * A worker holds a connection until the client closes it, also while the
+ * connection is idle. With more persistent clients than worker threads
+ * (-t), the additional clients wait in the queue until a connection is
+ * closed. Clients should close idle connections, or the server should be
+ * started with at least as many threads as persistent clients.
+ */
+
+namespace {
+  volatile sig_atomic_t quit = 0;
+
+  //! Held while a molecule is read and set up: the SMARTS matching of the
+  //! GAFF types perceives the molecule through OpenBabel's global typers.
+  QMutex setupMutex;
+
+  void HandleSignal(int)
+  {
+    quit = 1;
+  }
+}
+
+/**
+ * A molecule with a set-up function. Sessions are reference counted, an
+ * evicted session is deleted when the last worker using it releases it.
+ */
+struct Session
+{
+  Session(GAFFTypeRules *typeRules) : function(0), type(typeRules), id(0), numAtoms(0),
+      lastUse(0), refs(0), evicted(false) {}
+  ~Session()
+  {
+    delete function;
+  }
+
+  OBFunction *function;
+  GAFFType type;
+  OBGasteiger charges;
+  OBMol mol;
+  QMutex mutex; //!< held while the function is used
+  uint32_t id;
+  uint32_t numAtoms;
+  // protected by the SessionCache mutex
+  unsigned long lastUse;
+  int refs;
+  bool evicted;
+};
+
+class SessionCache
+{
+  public:
+    SessionCache(unsigned int capacity) : m_capacity(capacity), m_nextId(1), m_clock(0) {}
+    ~SessionCache()
+    {
+      std::map<uint32_t, Session*>::iterator i;
+      for (i = m_sessions.begin(); i != m_sessions.end(); ++i)
+        delete i->second;
+    }
+    /**
+     * Add a new session, the caller holds a reference.
+     * @return The session id.
+     */
+    uint32_t Add(Session *session)
+    {
+      QMutexLocker locker(&m_mutex);
+      session->id = m_nextId++;
+      session->refs = 1;
+      session->lastUse = ++m_clock;
+      m_sessions[session->id] = session;
+
+      // evict the least recently used sessions
+      while (m_sessions.size() > m_capacity) {
+        std::map<uint32_t, Session*>::iterator i, oldest = m_sessions.begin();
+        for (i = m_sessions.begin(); i != m_sessions.end(); ++i)
+          if (i->second->lastUse < oldest->second->lastUse)
+            oldest = i;
+        evict(oldest);
+      }
+
+      return session->id;
+    }
+    //! @return The session with @p id (with a reference) or 0.
+    Session* Acquire(uint32_t id)
+    {
+      QMutexLocker locker(&m_mutex);
+      std::map<uint32_t, Session*>::iterator i = m_sessions.find(id);
+      if (i == m_sessions.end())
+        return 0;
+      i->second->refs++;
+      i->second->lastUse = ++m_clock;
+      return i->second;
+    }
+    void Release(Session *session)
+    {
+      QMutexLocker locker(&m_mutex);
+      if (--session->refs == 0 && session->evicted)
+        delete session;
+    }
+    bool Remove(uint32_t id)
+    {
+      QMutexLocker locker(&m_mutex);
+      std::map<uint32_t, Session*>::iterator i = m_sessions.find(id);
+      if (i == m_sessions.end())
+        return false;
+      evict(i);
+      return true;
+    }
+  private:
+    void evict(std::map<uint32_t, Session*>::iterator i)
+    {
+      Session *session = i->second;
+      m_sessions.erase(i);
+      session->evicted = true;
+      if (!session->refs)
+        delete session;
+    }
+
+    QMutex m_mutex;
+    std::map<uint32_t, Session*> m_sessions;
+    unsigned int m_capacity;
+    uint32_t m_nextId;
+    unsigned long m_clock;
+};
+
+/**
+ * The accepted connections waiting for a worker.
+ */
+class ConnectionQueue
+{
+  public:
+    ConnectionQueue() : m_closed(false) {}
+    void Push(int fd)
+    {
+      QMutexLocker locker(&m_mutex);
+      m_fds.push_back(fd);
+      m_condition.wakeOne();
+    }
+    //! @return The next connection or -1 when the server shuts down.
+    int Pop()
+    {
+      QMutexLocker locker(&m_mutex);
+      while (m_fds.empty() && !m_closed)
+        m_condition.wait(&m_mutex);
+      if (m_closed)
+        return -1;
+      int fd = m_fds.front();
+      m_fds.pop_front();
+      m_active.insert(fd);
+      return fd;
+    }
+    void Done(int fd)
+    {
+      QMutexLocker locker(&m_mutex);
+      m_active.erase(fd);
+      close(fd);
+    }
+    //! Stop the workers, the active connections are shut down.
+    void Close()
+    {
+      QMutexLocker locker(&m_mutex);
+      m_closed = true;
+      for (unsigned int i = 0; i < m_fds.size(); ++i)
+        close(m_fds[i]);
+      m_fds.clear();
+      std::set<int>::iterator fd;
+      for (fd = m_active.begin(); fd != m_active.end(); ++fd)
+        shutdown(*fd, SHUT_RDWR);
+      m_condition.wakeAll();
+    }
+  private:
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    std::deque<int> m_fds;
+    std::set<int> m_active;
+    bool m_closed;
+};
+
+bool ReadFully(int fd, char *data, size_t size)
+{
+  while (size) {
+    ssize_t n = read(fd, data, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool WriteFully(int fd, const char *data, size_t size)
+{
+  while (size) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+class Worker : public QThread
+{
+  public:
+    Worker(ConnectionQueue *connections, SessionCache *sessions, GAFFParameterDB *database,
+        GAFFTypeRules *typeRules, const std::string &options)
+      : m_connections(connections), m_sessions(sessions), m_database(database),
+      m_typeRules(typeRules), m_options(options) {}
+  protected:
+    void run()
+    {
+      int fd;
+      while ((fd = m_connections->Pop()) >= 0) {
+        Serve(fd);
+        m_connections->Done(fd);
+      }
+    }
+  private:
+    void Serve(int fd)
+    {
+      OBFFProtocol::Header header;
+      Buffer request, response;
+      while (ReadFully(fd, reinterpret_cast<char*>(&header), sizeof(header))) {
+        if (header.magic != OBFFProtocol::Magic || header.length > OBFFProtocol::MaxPayload)
+          return;
+        request.Clear();
+        request.Data().resize(header.length);
+        if (header.length && !ReadFully(fd, &request.Data()[0], header.length))
+          return;
+
+        response.Clear();
+        switch (header.type) {
+          case OBFFProtocol::Setup:
+            HandleSetup(request, response);
+            break;
+          case OBFFProtocol::Energy:
+          case OBFFProtocol::Gradients:
+            HandleEnergy(request, response, header.type == OBFFProtocol::Gradients);
+            break;
+          case OBFFProtocol::Minimize:
+            HandleMinimize(request, response);
+            break;
+          case OBFFProtocol::Release:
+            HandleRelease(request, response);
+            break;
+          default:
+            response.Put(uint32_t(OBFFProtocol::BadRequest));
+            break;
+        }
+
+        header.length = response.Data().size();
+        if (!WriteFully(fd, reinterpret_cast<const char*>(&header), sizeof(header)) ||
+            !WriteFully(fd, &response.Data()[0], header.length))
+          return;
+      }
+    }
+
+    void HandleSetup(Buffer &request, Buffer &response)
+    {
+      uint32_t formatLength;
+      std::string format, text;
+      if (!request.Get(formatLength) || !request.GetString(format, formatLength)) {
+        response.Put(uint32_t(OBFFProtocol::BadRequest));
+        return;
+      }
+      request.GetRest(text);
+
+      Session *session = new Session(m_typeRules);
+      QMutexLocker locker(&setupMutex);
+      OBConversion conv;
+      if (!conv.SetInFormat(format.c_str()) || !conv.ReadString(&session->mol, text) ||
+          !session->mol.NumAtoms()) {
+        delete session;
+        response.Put(uint32_t(OBFFProtocol::Error));
+        return;
+      }
+
+      session->function = OBFunctionFactory::GetFactory("GAFF")->NewInstance();
+      session->function->GetLogFile()->SetLogLevel(OBLogFile::None);
+      if (!m_options.empty())
+        session->function->SetOptions(m_options);
+      session->function->SetParameterDB(m_database);
+      session->function->SetOBFFType(&session->type);
+      session->function->SetOBChargeMethod(&session->charges);
+      if (!session->function->Setup(session->mol)) {
+        delete session;
+        response.Put(uint32_t(OBFFProtocol::Error));
+        return;
+      }
+      session->numAtoms = session->mol.NumAtoms();
+      locker.unlock();
+
+      const uint32_t id = m_sessions->Add(session);
+      response.Put(uint32_t(OBFFProtocol::Ok));
+      response.Put(id);
+      response.Put(session->numAtoms);
+      m_sessions->Release(session);
+    }
+
+    /**
+     * Read n and the coordinates into the function. A truncated request
+     * leaves the coordinates of the session unchanged.
+     */
+    bool ReadCoordinates(Buffer &request, Session *session)
+    {
+      uint32_t n;
+      if (!request.Get(n))
+        return false;
+      if (!n)
+        return true;
+      if (n != session->numAtoms || request.Remaining() < 3 * sizeof(double) * n)
+        return false;
+      for (uint32_t i = 0; i < n; ++i) {
+        double x, y, z;
+        request.Get(x);
+        request.Get(y);
+        request.Get(z);
+        session->function->GetPosition(i) = Eigen::Vector3d(x, y, z);
+      }
+      return true;
+    }
+
+    Session* AcquireSession(Buffer &request, Buffer &response)
+    {
+      uint32_t id;
+      if (!request.Get(id)) {
+        response.Put(uint32_t(OBFFProtocol::BadRequest));
+        return 0;
+      }
+      Session *session = m_sessions->Acquire(id);
+      if (!session)
+        response.Put(uint32_t(OBFFProtocol::UnknownSession));
+      return session;
+    }
+
+    void HandleEnergy(Buffer &request, Buffer &response, bool gradients)
+    {
+      Session *session = AcquireSession(request, response);
+      if (!session)
+        return;
+
+      session->mutex.lock();
+      if (!ReadCoordinates(request, session)) {
+        response.Put(uint32_t(OBFFProtocol::BadRequest));
+      } else {
+        OBFunction *function = session->function;
+        function->Compute(gradients ? OBFunction::Gradients : OBFunction::Value);
+        response.Put(uint32_t(OBFFProtocol::Ok));
+        response.Put(function->GetValue());
+        if (gradients)
+          for (uint32_t i = 0; i < session->numAtoms; ++i)
+            for (int k = 0; k < 3; ++k)
+              response.Put(function->GetGradient(i)[k]);
+      }
+      session->mutex.unlock();
+
+      m_sessions->Release(session);
+    }
+
+    void HandleMinimize(Buffer &request, Buffer &response)
+    {
+      Session *session = AcquireSession(request, response);
+      if (!session)
+        return;
+
+      uint32_t steps;
+      double econv;
+      session->mutex.lock();
+      if (!request.Get(steps) || !request.Get(econv) || !ReadCoordinates(request, session)) {
+        response.Put(uint32_t(OBFFProtocol::BadRequest));
+      } else {
+        OBFunction *function = session->function;
+        OBMinimize minimize(function);
+        minimize.ConjugateGradients(std::min(steps, OBFFProtocol::MaxSteps), econv);
+        function->Compute();
+        response.Put(uint32_t(OBFFProtocol::Ok));
+        response.Put(function->GetValue());
+        for (uint32_t i = 0; i < session->numAtoms; ++i)
+          for (int k = 0; k < 3; ++k)
+            response.Put(function->GetPosition(i)[k]);
+      }
+      session->mutex.unlock();
+
+      m_sessions->Release(session);
+    }
+
+    void HandleRelease(Buffer &request, Buffer &response)
+    {
+      uint32_t id;
+      if (!request.Get(id))
+        response.Put(uint32_t(OBFFProtocol::BadRequest));
+      else if (!m_sessions->Remove(id))
+        response.Put(uint32_t(OBFFProtocol::UnknownSession));
+      else
+        response.Put(uint32_t(OBFFProtocol::Ok));
+    }
+
+    ConnectionQueue *m_connections;
+    SessionCache *m_sessions;
+    GAFFParameterDB *m_database;
+    GAFFTypeRules *m_typeRules;
+    std::string m_options;
+};
+
+void Usage(const char *name)
+{
+  cerr << "Usage: " << name << " [options]" << endl;
+  cerr << "  -s <path>      socket path, only accessible by the user (default" << endl;
+  cerr << "                 /tmp/obffserver.sock)" << endl;
+  cerr << "  -t <threads>   number of worker threads (default: number of cores)," << endl;
+  cerr << "                 each open connection occupies one thread" << endl;
+  cerr << "  -k <sessions>  maximum number of warm sessions (default 64)" << endl;
+  cerr << "  -c <file>      GAFF function options file" << endl;
+}
+
+int main(int argc, char **argv)
+{
+  std::string path("/tmp/obffserver.sock"), options;
+  int threads = QThread::idealThreadCount();
+  int capacity = 64;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    if (i + 1 >= argc) {
+      Usage(argv[0]);
+      return -1;
+    }
+    const char *value = argv[++i];
+    if (arg == "-s")
+      path = value;
+    else if (arg == "-t")
+      threads = atoi(value);
+    else if (arg == "-k")
+      capacity = atoi(value);
+    else if (arg == "-c") {
+      std::ifstream cifs(value);
+      std::stringstream ss;
+      std::string line;
+      while (std::getline(cifs, line))
+        ss << line << std::endl;
+      options = ss.str();
+    } else {
+      Usage(argv[0]);
+      return -1;
+    }
+  }
+  if (threads < 1 || capacity < 1) {
+    Usage(argv[0]);
+    return -1;
+  }
+
+  // The OpenBabel error log is not thread-safe.
+  OpenBabel::obErrorLog.StopLogging();
+
+  GAFFParameterDB database(std::string(DATADIR) + "gaff.dat");
+  GAFFTypeRules typeRules(std::string(DATADIR) + "gaff.prm");
+  if (!database.IsInitialized() || !typeRules.IsInitialized()) {
+    cerr << "ERROR: could not read the GAFF parameters from " << DATADIR << endl;
+    return -1;
+  }
+
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    cerr << "ERROR: socket path too long: " << path << endl;
+    return -1;
+  }
+  strcpy(address.sun_path, path.c_str());
+
+  // only replace the socket of a previous server, never another file
+  struct stat status;
+  if (lstat(path.c_str(), &status) == 0) {
+    if (!S_ISSOCK(status.st_mode)) {
+      cerr << "ERROR: " << path << " exists and is not a socket" << endl;
+      return -1;
+    }
+    unlink(path.c_str());
+  }
+
+  // the socket is only accessible by the user running the server
+  int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  const mode_t mask = umask(077);
+  const bool bound = listenFd >= 0 && bind(listenFd, (sockaddr*) &address, sizeof(address)) == 0;
+  umask(mask);
+  if (!bound || listen(listenFd, 64) < 0) {
+    cerr << "ERROR: could not listen on " << path << ": " << strerror(errno) << endl;
+    return -1;
+  }
+
+  // no SA_RESTART: accept() returns with EINTR on SIGINT/SIGTERM
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = HandleSignal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, 0);
+  sigaction(SIGTERM, &action, 0);
+  signal(SIGPIPE, SIG_IGN);
+
+  // the workers inherit the blocked signals, only the main thread (in
+  // accept()) handles SIGINT/SIGTERM
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, 0);
+
+  ConnectionQueue connections;
+  SessionCache sessions(capacity);
+  std::vector<Worker*> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.push_back(new Worker(&connections, &sessions, &database, &typeRules, options));
+    workers.back()->start();
+  }
+  pthread_sigmask(SIG_UNBLOCK, &signals, 0);
+
+  cerr << "listening on " << path << " with " << threads << " threads" << endl;
+  while (!quit) {
+    int fd = accept(listenFd, 0, 0);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      cerr << "ERROR: accept: " << strerror(errno) << endl;
+      break;
+    }
+    connections.Push(fd);
+  }
+
+  close(listenFd);
+  unlink(path.c_str());
+  connections.Close();
+  for (unsigned int i = 0; i < workers.size(); ++i) {
+    workers[i]->wait();
+    delete workers[i];
+  }
+
+  return 0;
+}